@@ -0,0 +1,34 @@
+#ifndef MACHO_RE_BENCH_H
+#define MACHO_RE_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static inline double bench_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static inline void bench_report(const char *name, size_t items,
+                                const char *unit, double elapsed_ms) {
+  double per_second = elapsed_ms > 0 ? items / (elapsed_ms / 1e3) : 0;
+  printf("%-32s %10zu %-8s %10.2f ms %12.2f M%s/s\n", name, items, unit,
+         elapsed_ms, per_second / 1e6, unit);
+}
+
+void bench_byte_stats(void);
+void bench_demangle(void);
+void bench_diff(void);
+void bench_dyld_cache(void);
+void bench_export_trie(void);
+void bench_leb128(void);
+void bench_lsh(void);
+void bench_parse(void);
+void bench_pattern_scan(void);
+void bench_strings(void);
+void bench_term_index(void);
+
+#endif
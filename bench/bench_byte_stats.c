@@ -0,0 +1,57 @@
+#include "../lib/byte_stats.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Binary like content, by 4 KB pages: code like bytes, text and zero
+ * padding.
+ */
+#define DATA_SIZE (256 * 1024 * 1024)
+#define PAGE_SIZE 4096
+
+static uint8_t *build_data(void) {
+  uint8_t *data = malloc(DATA_SIZE);
+  assert(data != NULL);
+  uint32_t seed = 42;
+  for (size_t page = 0; page < DATA_SIZE; page += PAGE_SIZE) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t kind = (seed >> 16) % 10;
+    for (size_t i = page; i < page + PAGE_SIZE; i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = kind < 4   ? (seed >> 24) % 4 ? 0x48 + (seed >> 16) % 8
+                                              : (seed >> 16)
+                : kind < 7 ? 'a' + (seed >> 16) % 26
+                           : 0;
+    }
+  }
+  return data;
+}
+
+void bench_byte_stats(void) {
+  uint8_t *data = build_data();
+
+  uint64_t naive_histogram[256] = {0};
+  double start = bench_now_ms();
+  for (size_t i = 0; i < DATA_SIZE; i++) {
+    naive_histogram[data[i]]++;
+  }
+  bench_report("byte_histogram_naive", DATA_SIZE, "B", bench_now_ms() - start);
+
+  struct byte_stats_info stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.size = DATA_SIZE;
+  start = bench_now_ms();
+  byte_histogram_add(data, DATA_SIZE, stats.histogram);
+  finalize_byte_stats(&stats);
+  bench_report("byte_histogram_tables", DATA_SIZE, "B",
+               bench_now_ms() - start);
+  assert(memcmp(naive_histogram, stats.histogram, sizeof(stats.histogram)) ==
+         0);
+
+  printf("  (entropy: %.3f, printable: %.1f%%, zero: %.1f%%)\n",
+         stats.entropy, stats.printable_ratio * 100, stats.zero_ratio * 100);
+  free(data);
+}
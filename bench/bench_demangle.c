@@ -0,0 +1,115 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A 1M entries symbol table of Itanium mangled methods drawn from
+ * NUM_UNIQUE_NAMES distinct ones, plus some C symbols, demangled in
+ * batches: once cold, once with a warm cache, and once on a single thread.
+ */
+#define NUM_SYMBOLS (1024 * 1024)
+#define NUM_UNIQUE_NAMES 50000
+#define BATCH_SIZE 4096
+#define NAME_MAX_SIZE 96
+
+static uint32_t next_random(uint32_t *seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+// The platform demangler, for the baseline
+char *__cxa_demangle(const char *mangled_name, char *output_buffer,
+                     size_t *length, int *status);
+
+static const char *const parameters[] = {
+    "v", "i", "PKcm", "d",
+    "RKNSt3__112basic_stringIcNS_11char_traitsIcEENS_9allocatorIcEEEE"};
+
+static char **build_names(uint32_t *seed) {
+  char **names = malloc(NUM_UNIQUE_NAMES * sizeof(char *));
+  assert(names != NULL);
+  for (size_t index = 0; index < NUM_UNIQUE_NAMES; index++) {
+    names[index] = malloc(NAME_MAX_SIZE);
+    assert(names[index] != NULL);
+    if (index % 10 == 0) {
+      snprintf(names[index], NAME_MAX_SIZE, "_c_function_%zu", index);
+      continue;
+    }
+    char namespace_name[16];
+    char class_name[16];
+    char method_name[16];
+    snprintf(namespace_name, sizeof(namespace_name), "ns%u",
+             next_random(seed) % 50);
+    snprintf(class_name, sizeof(class_name), "Class%zu", index / 8);
+    snprintf(method_name, sizeof(method_name), "method%zu", index % 8);
+    snprintf(names[index], NAME_MAX_SIZE, "__ZN%zu%s%zu%s%zu%sE%s",
+             strlen(namespace_name), namespace_name, strlen(class_name),
+             class_name, strlen(method_name), method_name,
+             parameters[next_random(seed) % 5]);
+  }
+  return names;
+}
+
+static void demangle_table(const char *name,
+                           struct machore_demangler *demangler,
+                           const char **symbols, const char **demangled) {
+  struct demangle_stats before;
+  machore_demangler_stats(demangler, &before);
+  double start = bench_now_ms();
+  for (size_t first = 0; first < NUM_SYMBOLS; first += BATCH_SIZE) {
+    machore_demangle_batch(demangler, symbols + first, BATCH_SIZE,
+                           demangled + first);
+  }
+  bench_report(name, NUM_SYMBOLS, "name", bench_now_ms() - start);
+
+  struct demangle_stats after;
+  machore_demangler_stats(demangler, &after);
+  uint64_t num_lookups = after.num_lookups - before.num_lookups;
+  uint64_t num_hits = after.num_hits - before.num_hits;
+  printf("  (%llu lookups, %.1f%% hits, %llu cached names)\n",
+         (unsigned long long)num_lookups,
+         num_lookups ? 100.0 * num_hits / num_lookups : 0,
+         (unsigned long long)after.num_entries);
+}
+
+void bench_demangle(void) {
+  uint32_t seed = 42;
+  char **names = build_names(&seed);
+  const char **symbols = malloc(NUM_SYMBOLS * sizeof(char *));
+  const char **demangled = malloc(NUM_SYMBOLS * sizeof(char *));
+  assert(symbols != NULL && demangled != NULL);
+  for (size_t index = 0; index < NUM_SYMBOLS; index++) {
+    symbols[index] = names[next_random(&seed) % NUM_UNIQUE_NAMES];
+  }
+
+  struct machore_demangler *demangler = machore_demangler_create(0);
+  demangle_table("demangle_cold", demangler, symbols, demangled);
+  assert(demangled[0] != NULL || strncmp(symbols[0], "__Z", 3) != 0);
+  demangle_table("demangle_warm", demangler, symbols, demangled);
+  machore_demangler_destroy(demangler);
+
+  demangler = machore_demangler_create(1);
+  demangle_table("demangle_cold_1_thread", demangler, symbols, demangled);
+  machore_demangler_destroy(demangler);
+
+  // Baseline: one platform demangler call and allocation per C++ symbol
+  double start = bench_now_ms();
+  for (size_t index = 0; index < NUM_SYMBOLS; index++) {
+    if (strncmp(symbols[index], "__Z", 3) == 0) {
+      int status;
+      free(__cxa_demangle(symbols[index] + 1, NULL, NULL, &status));
+    }
+  }
+  bench_report("demangle_uncached_1_thread", NUM_SYMBOLS, "name",
+               bench_now_ms() - start);
+
+  for (size_t index = 0; index < NUM_UNIQUE_NAMES; index++) {
+    free(names[index]);
+  }
+  free(names);
+  free(symbols);
+  free(demangled);
+}
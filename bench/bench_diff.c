@@ -0,0 +1,78 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Two builds with millions of C++ like symbols and strings, 1% of them
+ * renamed between builds.
+ */
+#define NUM_SYMBOLS 2000000
+#define NUM_STRINGS 1000000
+
+static char *make_name(const char *format, size_t index) {
+  char name[128];
+  snprintf(name, sizeof(name), format, index % 977, index, index * 31);
+  char *copy = strdup(name);
+  assert(copy != NULL);
+  return copy;
+}
+
+static void build_arch(struct machore_arch_output_t *arch_output,
+                       size_t renamed_from) {
+  memset(arch_output, 0, sizeof(struct machore_arch_output_t));
+  arch_output->symbols = calloc(NUM_SYMBOLS, sizeof(struct symbol_info));
+  arch_output->strings = calloc(NUM_STRINGS, sizeof(struct string_info));
+  assert(arch_output->symbols != NULL && arch_output->strings != NULL);
+
+  for (size_t i = 0; i < NUM_SYMBOLS; i++) {
+    size_t index = i % 100 == 0 ? renamed_from + i : i;
+    arch_output->symbols[i].name =
+        make_name("__ZN7mozilla%zu6detail%zuImpl%zuEv", index);
+    strcpy(arch_output->symbols[i].type, "EXTERNAL");
+  }
+  arch_output->num_symbols = NUM_SYMBOLS;
+
+  for (size_t i = 0; i < NUM_STRINGS; i++) {
+    size_t index = i % 100 == 0 ? renamed_from + i : i;
+    arch_output->strings[i].content =
+        make_name("Couldn't load %zu from module %zu (%zu)", index);
+    arch_output->strings[i].size =
+        strlen(arch_output->strings[i].content) + 1;
+  }
+  arch_output->num_strings = NUM_STRINGS;
+}
+
+static void free_arch(struct machore_arch_output_t *arch_output) {
+  for (size_t i = 0; i < arch_output->num_symbols; i++) {
+    free(arch_output->symbols[i].name);
+  }
+  for (size_t i = 0; i < arch_output->num_strings; i++) {
+    free(arch_output->strings[i].content);
+  }
+  free(arch_output->symbols);
+  free(arch_output->strings);
+}
+
+void bench_diff(void) {
+  struct machore_arch_output_t old_arch;
+  struct machore_arch_output_t new_arch;
+  build_arch(&old_arch, 0);
+  build_arch(&new_arch, 10 * NUM_SYMBOLS);
+
+  struct machore_diff_t diff;
+  double start = bench_now_ms();
+  machore_diff_arch(&diff, &old_arch, &new_arch);
+  bench_report("diff_arch", 2 * (NUM_SYMBOLS + NUM_STRINGS), "names",
+               bench_now_ms() - start);
+  // Every renamed name is removed from the old build and added to the new
+  assert(diff.num_entries == 2 * (NUM_SYMBOLS + NUM_STRINGS) / 100);
+
+  printf("  (%zu differences)\n", diff.num_entries);
+  machore_clean_diff(&diff);
+  free_arch(&old_arch);
+  free_arch(&new_arch);
+}
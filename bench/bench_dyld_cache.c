@@ -0,0 +1,69 @@
+#include "../lib/libmachore.h"
+#include "../tools/synthetic_cache.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * A split synthetic cache: the __TEXT of NUM_IMAGES dylibs spread over the
+ * main file and 3 subcaches, and a shared __LINKEDIT in a fourth one. Every
+ * image is parsed, views included, from a freshly opened cache: on one
+ * thread, on one thread per CPU, and with strings and symbols left to the
+ * paging APIs.
+ */
+#define NUM_IMAGES 1024
+#define NUM_SUBCACHES 4
+
+static void parse_cache(const char *name, const char *path, size_t num_threads,
+                        bool is_paged) {
+  struct machore_output_t *outputs =
+      malloc(NUM_IMAGES * sizeof(struct machore_output_t));
+  assert(outputs != NULL);
+  for (size_t index = 0; index < NUM_IMAGES; index++) {
+    init_output(&outputs[index]);
+    outputs[index].is_paged = is_paged;
+  }
+
+  double start = bench_now_ms();
+  struct machore_dyld_cache *cache = machore_dyld_cache_open(path);
+  assert(cache != NULL);
+  size_t num_parsed = machore_dyld_cache_parse_images(cache, 0, NUM_IMAGES,
+                                                      outputs, num_threads);
+  bench_report(name, num_parsed, "image", bench_now_ms() - start);
+
+  for (size_t index = 0; index < NUM_IMAGES; index++) {
+    clean_output(&outputs[index]);
+  }
+  machore_dyld_cache_close(cache);
+  free(outputs);
+}
+
+void bench_dyld_cache(void) {
+  char path[] = "/tmp/macho_re_bench_cache_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  struct synthetic_cache_options options = {
+      .num_images = NUM_IMAGES,
+      .num_subcaches = NUM_SUBCACHES,
+      .num_strings = 500,
+      .num_symbols = 2000,
+  };
+  if (!write_synthetic_cache(path, &options)) {
+    printf("Error: could not write '%s'\n", path);
+    return;
+  }
+
+  parse_cache("dyld_cache_parse_1_thread", path, 1, false);
+  parse_cache("dyld_cache_parse", path, 0, false);
+  parse_cache("dyld_cache_parse_paged", path, 0, true);
+
+  unlink(path);
+  for (size_t index = 1; index <= NUM_SUBCACHES; index++) {
+    char subcache_path[sizeof(path) + 8];
+    snprintf(subcache_path, sizeof(subcache_path), "%s.%02zu", path, index);
+    unlink(subcache_path);
+  }
+}
@@ -0,0 +1,126 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Synthetic trie exporting `_sym000000` ... `_sym999999`:
+ *
+ *   root --"_sym"--> digit node --"0".."9"--> ... (6 levels) --> leaf
+ *
+ * Nodes are laid out breadth first and every child offset is written as a
+ * padded 5 bytes uleb128 so that offsets can be computed upfront.
+ */
+#define NUM_DIGITS 6
+#define NUM_EXPORTS 1000000
+#define OFFSET_SIZE 5
+#define ROOT_NODE_SIZE (1 + 1 + sizeof("_sym") + OFFSET_SIZE)
+#define DIGIT_NODE_SIZE (1 + 1 + 10 * (2 + OFFSET_SIZE))
+#define LEAF_NODE_SIZE (1 + 1 + OFFSET_SIZE + 1)
+
+static uint8_t *write_padded_uleb128(uint8_t *p, uint64_t value) {
+  for (int i = 0; i < OFFSET_SIZE - 1; i++) {
+    *p++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *p++ = value & 0x7f;
+  return p;
+}
+
+static uint8_t *build_trie(size_t *trie_size) {
+  // level_offsets[k] is the offset of the first node at depth k (digits read)
+  size_t level_offsets[NUM_DIGITS + 2];
+  size_t level_counts[NUM_DIGITS + 1];
+  level_offsets[0] = ROOT_NODE_SIZE;
+  level_counts[0] = 1;
+  for (int level = 1; level <= NUM_DIGITS; level++) {
+    level_counts[level] = level_counts[level - 1] * 10;
+    level_offsets[level] =
+        level_offsets[level - 1] + level_counts[level - 1] * DIGIT_NODE_SIZE;
+  }
+  *trie_size = level_offsets[NUM_DIGITS] + NUM_EXPORTS * LEAF_NODE_SIZE;
+
+  uint8_t *trie = malloc(*trie_size);
+  assert(trie != NULL);
+  uint8_t *p = trie;
+
+  // Root
+  *p++ = 0;
+  *p++ = 1;
+  memcpy(p, "_sym", sizeof("_sym"));
+  p += sizeof("_sym");
+  p = write_padded_uleb128(p, level_offsets[0]);
+
+  // Digit nodes
+  for (int level = 0; level < NUM_DIGITS; level++) {
+    size_t child_size = level + 1 == NUM_DIGITS ? LEAF_NODE_SIZE
+                                                : DIGIT_NODE_SIZE;
+    for (size_t node = 0; node < level_counts[level]; node++) {
+      *p++ = 0;
+      *p++ = 10;
+      for (int digit = 0; digit < 10; digit++) {
+        *p++ = '0' + digit;
+        *p++ = '\0';
+        size_t child = node * 10 + digit;
+        p = write_padded_uleb128(p, level_offsets[level + 1] +
+                                        child * child_size);
+      }
+    }
+  }
+
+  // Leaves: regular export at a fake address
+  for (size_t leaf = 0; leaf < NUM_EXPORTS; leaf++) {
+    *p++ = 1 + OFFSET_SIZE;
+    *p++ = 0;
+    p = write_padded_uleb128(p, 0x1000 + leaf * 16);
+    *p++ = 0;
+  }
+  assert((size_t)(p - trie) == *trie_size);
+  return trie;
+}
+
+static bool sum_addresses(const struct export_info *export_info,
+                          void *context) {
+  *(uint64_t *)context += export_info->address + export_info->name_size;
+  return true;
+}
+
+void bench_export_trie(void) {
+  size_t trie_size;
+  uint8_t *trie = build_trie(&trie_size);
+
+  uint64_t checksum = 0;
+  double start = bench_now_ms();
+  size_t num_exports =
+      machore_walk_exports(trie, trie_size, sum_addresses, &checksum);
+  bench_report("export_trie_walk", num_exports, "exports",
+               bench_now_ms() - start);
+  assert(num_exports == NUM_EXPORTS);
+
+  // Look up every export in a scattered order
+  char(*names)[16] = malloc(NUM_EXPORTS * sizeof(*names));
+  assert(names != NULL);
+  for (size_t i = 0; i < NUM_EXPORTS; i++) {
+    snprintf(names[i], sizeof(names[i]), "_sym%06zu",
+             (i * 7919) % NUM_EXPORTS);
+  }
+
+  size_t found = 0;
+  start = bench_now_ms();
+  for (size_t i = 0; i < NUM_EXPORTS; i++) {
+    struct export_info export_info;
+    if (machore_lookup_export(trie, trie_size, names[i], &export_info) &&
+        export_info.address == 0x1000 + ((i * 7919) % NUM_EXPORTS) * 16) {
+      found++;
+    }
+  }
+  bench_report("export_trie_lookup", found, "lookups", bench_now_ms() - start);
+  assert(found == NUM_EXPORTS);
+
+  printf("  (trie size: %zu bytes, checksum: %llu)\n", trie_size,
+         (unsigned long long)checksum);
+  free(names);
+  free(trie);
+}
@@ -0,0 +1,67 @@
+#include "../lib/leb128.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/*
+ * Function starts like stream: deltas between functions are mostly 1 or 2
+ * bytes long, with a few larger gaps.
+ */
+#define NUM_VALUES 10000000
+
+static uint8_t *build_stream(size_t *stream_size) {
+  uint8_t *stream = malloc(NUM_VALUES * 3);
+  assert(stream != NULL);
+  uint8_t *p = stream;
+  uint32_t seed = 42;
+  for (size_t i = 0; i < NUM_VALUES; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t r = (seed >> 8) % 100;
+    uint64_t value = r < 45   ? 4 + (seed >> 16) % 120
+                     : r < 95 ? 128 + (seed >> 12) % 16000
+                              : 16384 + (seed >> 4) % 2000000;
+    do {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      *p++ = byte | (value != 0 ? 0x80 : 0);
+    } while (value != 0);
+  }
+  *stream_size = p - stream;
+  return stream;
+}
+
+void bench_leb128(void) {
+  size_t stream_size;
+  uint8_t *stream = build_stream(&stream_size);
+  uint64_t *values = malloc(NUM_VALUES * sizeof(uint64_t));
+  assert(values != NULL);
+
+  const uint8_t *cursor = stream;
+  const uint8_t *end = stream + stream_size;
+  size_t count = 0;
+  double start = bench_now_ms();
+  while (count < NUM_VALUES && read_uleb128(&cursor, end, &values[count])) {
+    count++;
+  }
+  bench_report("uleb128_scalar", count, "entries", bench_now_ms() - start);
+  uint64_t scalar_checksum = 0;
+  for (size_t i = 0; i < count; i++) {
+    scalar_checksum += values[i];
+  }
+
+  cursor = stream;
+  start = bench_now_ms();
+  count = decode_uleb128_batch(&cursor, end, values, NUM_VALUES);
+  bench_report("uleb128_batch", count, "entries", bench_now_ms() - start);
+  uint64_t batch_checksum = 0;
+  for (size_t i = 0; i < count; i++) {
+    batch_checksum += values[i];
+  }
+  assert(count == NUM_VALUES && batch_checksum == scalar_checksum);
+
+  printf("  (stream size: %zu bytes, checksum: %llu)\n", stream_size,
+         (unsigned long long)batch_checksum);
+  free(values);
+  free(stream);
+}
@@ -0,0 +1,128 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * A corpus of NUM_FAMILIES families of NUM_MEMBERS binaries: members of a
+ * family share 90% of their FEATURES_PER_BINARY strings.
+ */
+#define NUM_FAMILIES 20000
+#define NUM_MEMBERS 5
+#define FEATURES_PER_BINARY 100
+#define NUM_QUERIES 10000
+#define NUM_FINGERPRINT_STRINGS 1000000
+
+static char feature_names[FEATURES_PER_BINARY][64];
+
+static void fingerprint_member(size_t family, size_t member,
+                               struct fingerprint_info *fingerprint) {
+  struct string_info strings[FEATURES_PER_BINARY];
+  for (size_t i = 0; i < FEATURES_PER_BINARY; i++) {
+    if (i % 10 == member) {
+      snprintf(feature_names[i], sizeof(feature_names[i]),
+               "member %zu of %zu (%zu)", member, family, i);
+    } else {
+      snprintf(feature_names[i], sizeof(feature_names[i]),
+               "_OBJC_CLASS_$_Family%zuFeature%zu", family, i);
+    }
+    strings[i].content = feature_names[i];
+    strings[i].size = strlen(feature_names[i]) + 1;
+  }
+  struct machore_arch_output_t arch_output;
+  memset(&arch_output, 0, sizeof(arch_output));
+  arch_output.strings = strings;
+  arch_output.num_strings = FEATURES_PER_BINARY;
+  machore_fingerprint_arch(&arch_output, fingerprint);
+}
+
+static void bench_fingerprint(void) {
+  struct machore_arch_output_t arch_output;
+  memset(&arch_output, 0, sizeof(arch_output));
+  arch_output.strings =
+      calloc(NUM_FINGERPRINT_STRINGS, sizeof(struct string_info));
+  assert(arch_output.strings != NULL);
+  for (size_t i = 0; i < NUM_FINGERPRINT_STRINGS; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "Couldn't load %zu from module %zu",
+             i % 977, i);
+    arch_output.strings[i].content = strdup(name);
+    arch_output.strings[i].size = strlen(name) + 1;
+  }
+  arch_output.num_strings = NUM_FINGERPRINT_STRINGS;
+
+  struct fingerprint_info fingerprint;
+  double start = bench_now_ms();
+  machore_fingerprint_arch(&arch_output, &fingerprint);
+  bench_report("fingerprint", NUM_FINGERPRINT_STRINGS, "features",
+               bench_now_ms() - start);
+
+  for (size_t i = 0; i < NUM_FINGERPRINT_STRINGS; i++) {
+    free(arch_output.strings[i].content);
+  }
+  free(arch_output.strings);
+}
+
+void bench_lsh(void) {
+  bench_fingerprint();
+
+  char path[] = "/tmp/bench_lsh_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  unlink(path);
+
+  size_t num_records = (size_t)NUM_FAMILIES * NUM_MEMBERS;
+  struct fingerprint_info *fingerprints =
+      malloc(num_records * sizeof(struct fingerprint_info));
+  assert(fingerprints != NULL);
+  for (size_t family = 0; family < NUM_FAMILIES; family++) {
+    for (size_t member = 0; member < NUM_MEMBERS; member++) {
+      fingerprint_member(family, member,
+                         &fingerprints[family * NUM_MEMBERS + member]);
+    }
+  }
+
+  struct machore_lsh_index *index = machore_lsh_open(path);
+  assert(index != NULL);
+  double start = bench_now_ms();
+  for (size_t i = 0; i < num_records; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "family%zu", i / NUM_MEMBERS);
+    machore_lsh_insert(index, name, &fingerprints[i]);
+  }
+  bool is_saved = machore_lsh_save(index);
+  assert(is_saved);
+  (void)is_saved;
+  bench_report("lsh_insert_save", num_records, "records",
+               bench_now_ms() - start);
+  machore_lsh_close(index);
+
+  // Query with unseen members: the best match must be in their family
+  index = machore_lsh_open(path);
+  assert(index != NULL && machore_lsh_size(index) == num_records);
+  size_t num_found = 0;
+  start = bench_now_ms();
+  for (size_t i = 0; i < NUM_QUERIES; i++) {
+    size_t family = (i * 7919) % NUM_FAMILIES;
+    struct fingerprint_info fingerprint;
+    fingerprint_member(family, NUM_MEMBERS + 1, &fingerprint);
+    struct lsh_match matches[10];
+    size_t num_matches = machore_lsh_query(index, &fingerprint, matches, 10);
+    char name[32];
+    snprintf(name, sizeof(name), "family%zu", family);
+    num_found += num_matches > 0 && strcmp(matches[0].name, name) == 0;
+  }
+  double elapsed = bench_now_ms() - start;
+  bench_report("lsh_query", NUM_QUERIES, "queries", elapsed);
+  printf("%-32s %10.1f us/query, %zu/%d found in family\n", "",
+         elapsed * 1e3 / NUM_QUERIES, num_found, NUM_QUERIES);
+
+  machore_lsh_close(index);
+  unlink(path);
+  free(fingerprints);
+}
@@ -0,0 +1,33 @@
+#include "bench.h"
+
+#include <string.h>
+
+struct bench_case {
+  const char *name;
+  void (*run)(void);
+};
+
+static const struct bench_case bench_cases[] = {
+    {"byte_stats", bench_byte_stats},
+    {"demangle", bench_demangle},
+    {"diff", bench_diff},
+    {"dyld_cache", bench_dyld_cache},
+    {"export_trie", bench_export_trie},
+    {"leb128", bench_leb128},
+    {"lsh", bench_lsh},
+    {"parse", bench_parse},
+    {"pattern_scan", bench_pattern_scan},
+    {"strings", bench_strings},
+    {"term_index", bench_term_index},
+};
+
+int main(int argc, char *argv[]) {
+  // Optional filter: only run the benchmarks whose name contains argv[1]
+  const char *filter = argc > 1 ? argv[1] : NULL;
+  for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+    if (filter == NULL || strstr(bench_cases[i].name, filter) != NULL) {
+      bench_cases[i].run();
+    }
+  }
+  return 0;
+}
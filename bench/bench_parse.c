@@ -0,0 +1,219 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Slice with one __TEXT segment holding a __cstring section, a dylib and a
+ * symbol table, in each of the four header layouts.
+ *
+ *   header | LC_SEGMENT(_64) + section | LC_LOAD_DYLIB | LC_SYMTAB
+ *   __cstring | nlist(_64)[NUM_SYMBOLS] | string table
+ */
+#define NUM_STRINGS 20000
+#define NUM_SYMBOLS 200000
+#define NAME_SIZE 16
+#define NUM_ITERATIONS 10
+#define NUM_VALIDATIONS 100000
+
+struct slice_writer {
+  uint8_t *buffer;
+  bool is_swapped;
+};
+
+static void put32(struct slice_writer *writer, size_t offset, uint32_t value) {
+  value = writer->is_swapped ? __builtin_bswap32(value) : value;
+  memcpy(writer->buffer + offset, &value, sizeof(value));
+}
+
+static void put64(struct slice_writer *writer, size_t offset, uint64_t value) {
+  value = writer->is_swapped ? __builtin_bswap64(value) : value;
+  memcpy(writer->buffer + offset, &value, sizeof(value));
+}
+
+// Fields that are 32 or 64 bits wide depending on the layout
+static void put_address(struct slice_writer *writer, bool is_64,
+                        size_t offset, uint64_t value) {
+  if (is_64) {
+    put64(writer, offset, value);
+  } else {
+    put32(writer, offset, (uint32_t)value);
+  }
+}
+
+static uint8_t *build_slice(bool is_64, bool is_swapped, size_t *size) {
+  const size_t header_size =
+      is_64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+  const size_t segment_size = is_64 ? sizeof(struct segment_command_64)
+                                    : sizeof(struct segment_command);
+  const size_t section_size =
+      is_64 ? sizeof(struct section_64) : sizeof(struct section);
+  const size_t nlist_size =
+      is_64 ? sizeof(struct nlist_64) : sizeof(struct nlist);
+
+  const size_t seg = header_size;
+  const size_t sect = seg + segment_size;
+  const size_t dylib = sect + section_size;
+  const size_t symtab = dylib + sizeof(struct dylib_command) + 32;
+  const size_t cstring = 0x1000;
+  const size_t symoff = cstring + NUM_STRINGS * NAME_SIZE;
+  const size_t stroff = symoff + NUM_SYMBOLS * nlist_size;
+  *size = stroff + 1 + NUM_SYMBOLS * NAME_SIZE;
+
+  struct slice_writer writer = {calloc(1, *size), is_swapped};
+  assert(writer.buffer != NULL);
+
+  // The header starts like a mach_header in both widths
+  put32(&writer, offsetof(struct mach_header, magic),
+        is_64 ? MH_MAGIC_64 : MH_MAGIC);
+  put32(&writer, offsetof(struct mach_header, cputype),
+        is_64 ? CPU_TYPE_ARM64 : CPU_TYPE_ARM);
+  put32(&writer, offsetof(struct mach_header, filetype), MH_EXECUTE);
+  put32(&writer, offsetof(struct mach_header, ncmds), 3);
+  put32(&writer, offsetof(struct mach_header, sizeofcmds),
+        symtab + sizeof(struct symtab_command) - seg);
+
+  // cmd, cmdsize and segname share their offsets too, the rest does not
+  put32(&writer, seg, is_64 ? LC_SEGMENT_64 : LC_SEGMENT);
+  put32(&writer, seg + 4, dylib - seg);
+  memcpy(writer.buffer + seg + 8, "__TEXT", 6);
+  const size_t seg_fields = seg + 24;
+  const size_t address_size = is_64 ? 8 : 4;
+  put_address(&writer, is_64, seg_fields + 2 * address_size, 0);
+  put_address(&writer, is_64, seg_fields + 3 * address_size, *size);
+  put32(&writer, seg_fields + 4 * address_size + 8, 1);
+
+  memcpy(writer.buffer + sect, "__cstring", 9);
+  memcpy(writer.buffer + sect + 16, "__TEXT", 6);
+  put_address(&writer, is_64, sect + 32 + address_size,
+              NUM_STRINGS * NAME_SIZE);
+  put32(&writer, sect + 32 + 2 * address_size, cstring);
+  for (size_t index = 0; index < NUM_STRINGS; index++) {
+    snprintf((char *)writer.buffer + cstring + index * NAME_SIZE, NAME_SIZE,
+             "string_%zu", index);
+  }
+
+  put32(&writer, dylib, LC_LOAD_DYLIB);
+  put32(&writer, dylib + 4, symtab - dylib);
+  put32(&writer, dylib + offsetof(struct dylib_command, dylib.name),
+        sizeof(struct dylib_command));
+  memcpy(writer.buffer + dylib + sizeof(struct dylib_command),
+         "/usr/lib/libSystem.B.dylib", 26);
+
+  put32(&writer, symtab, LC_SYMTAB);
+  put32(&writer, symtab + 4, sizeof(struct symtab_command));
+  put32(&writer, symtab + offsetof(struct symtab_command, symoff), symoff);
+  put32(&writer, symtab + offsetof(struct symtab_command, nsyms),
+        NUM_SYMBOLS);
+  put32(&writer, symtab + offsetof(struct symtab_command, stroff), stroff);
+  put32(&writer, symtab + offsetof(struct symtab_command, strsize),
+        *size - stroff);
+  for (size_t index = 0; index < NUM_SYMBOLS; index++) {
+    // n_strx, n_type and n_sect have the same offsets in nlist(_64)
+    size_t symbol = symoff + index * nlist_size;
+    size_t name = 1 + index * NAME_SIZE;
+    put32(&writer, symbol, name);
+    writer.buffer[symbol + 4] = N_SECT | N_EXT;
+    writer.buffer[symbol + 5] = 1;
+    snprintf((char *)writer.buffer + stroff + name, NAME_SIZE, "_symbol_%zu",
+             index);
+  }
+  return writer.buffer;
+}
+
+static void bench_layout(const char *name, bool is_64, bool is_swapped) {
+  size_t size;
+  uint8_t *buffer = build_slice(is_64, is_swapped, &size);
+
+  double start = bench_now_ms();
+  for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++) {
+    struct machore_output_t output;
+    init_output(&output);
+    parse_macho(&output, buffer, size);
+    assert(output.arch_outputs[0].num_symbols == NUM_SYMBOLS);
+    assert(output.arch_outputs[0].num_strings == NUM_STRINGS);
+    assert(output.arch_outputs[0].num_dylibs == 1);
+    clean_output(&output);
+  }
+  bench_report(name, NUM_ITERATIONS * (NUM_SYMBOLS + NUM_STRINGS), "entry",
+               bench_now_ms() - start);
+  free(buffer);
+}
+
+// Time to the first page of strings and symbols without materializing them
+static void bench_first_page(const char *name) {
+  size_t size;
+  uint8_t *buffer = build_slice(true, false, &size);
+
+  double start = bench_now_ms();
+  for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++) {
+    struct machore_output_t output;
+    init_output(&output);
+    output.is_paged = true;
+    parse_macho(&output, buffer, size);
+    struct string_info strings[20];
+    struct symbol_info symbols[20];
+    size_t num_strings =
+        machore_get_strings(&output.arch_outputs[0], 0, strings, 20);
+    size_t num_symbols =
+        machore_get_symbols(&output.arch_outputs[0], 0, symbols, 20);
+    assert(num_strings == 20 && num_symbols == 20);
+    clean_output(&output);
+  }
+  bench_report(name, NUM_ITERATIONS, "page", bench_now_ms() - start);
+  free(buffer);
+}
+
+// Share of the parse time spent in the validation pass parse_macho() starts
+// with, against a full and a paged parse
+static void bench_validation(const char *name, bool is_64, bool is_swapped) {
+  size_t size;
+  uint8_t *buffer = build_slice(is_64, is_swapped, &size);
+
+  double parse_ms[2];
+  for (int is_paged = 0; is_paged < 2; is_paged++) {
+    double start = bench_now_ms();
+    for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++) {
+      struct machore_output_t output;
+      init_output(&output);
+      output.is_paged = is_paged;
+      parse_macho(&output, buffer, size);
+      assert(output.num_arch_outputs == 1);
+      clean_output(&output);
+    }
+    parse_ms[is_paged] = bench_now_ms() - start;
+  }
+
+  // Too fast to be timed over NUM_ITERATIONS runs
+  double start = bench_now_ms();
+  for (int iteration = 0; iteration < NUM_VALIDATIONS; iteration++) {
+    struct validation_result result;
+    bool is_valid = machore_validate(buffer, size, &result);
+    assert(is_valid);
+    (void)is_valid;
+  }
+  double validate_ms = bench_now_ms() - start;
+  bench_report(name, NUM_VALIDATIONS, "file", validate_ms);
+  double per_file_ms = validate_ms / NUM_VALIDATIONS;
+  printf("%-32s %10.4f %% of a parse, %.2f %% of a paged parse\n", "",
+         100 * per_file_ms / (parse_ms[0] / NUM_ITERATIONS),
+         100 * per_file_ms / (parse_ms[1] / NUM_ITERATIONS));
+  free(buffer);
+}
+
+void bench_parse(void) {
+  bench_layout("parse_64", true, false);
+  bench_layout("parse_64_swapped", true, true);
+  bench_layout("parse_32", false, false);
+  bench_layout("parse_32_swapped", false, true);
+  bench_first_page("parse_64_first_page");
+  bench_validation("validate_64", true, false);
+  bench_validation("validate_32_swapped", false, true);
+}
@@ -0,0 +1,107 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * IOC like patterns (domains, paths, keys) scanned over string section like
+ * data: printable text with NUL separators and a few planted hits.
+ */
+#define NUM_PATTERNS 10000
+#define PATTERN_MAX_SIZE 32
+#define DATA_SIZE (64 * 1024 * 1024)
+#define NUM_PLANTED 1000
+
+static const char *const pattern_suffixes[] = {".com", ".net", ".plist",
+                                               "/bin/", "Key"};
+
+static uint32_t next_random(uint32_t *seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+static void build_patterns(char **patterns, size_t *pattern_sizes,
+                           uint32_t *seed) {
+  for (size_t i = 0; i < NUM_PATTERNS; i++) {
+    char *pattern = malloc(PATTERN_MAX_SIZE);
+    assert(pattern != NULL);
+    size_t size = 6 + next_random(seed) % 14;
+    for (size_t j = 0; j < size; j++) {
+      pattern[j] = 'a' + next_random(seed) % 26;
+    }
+    const char *suffix = pattern_suffixes[next_random(seed) % 5];
+    memcpy(pattern + size, suffix, strlen(suffix));
+    size += strlen(suffix);
+    patterns[i] = pattern;
+    pattern_sizes[i] = size;
+  }
+}
+
+static uint8_t *build_data(char **patterns, size_t *pattern_sizes,
+                           uint32_t *seed) {
+  uint8_t *data = malloc(DATA_SIZE);
+  assert(data != NULL);
+  for (size_t i = 0; i < DATA_SIZE; i++) {
+    uint32_t r = next_random(seed);
+    data[i] = r % 24 == 0 ? 0 : r % 24 == 1 ? ' ' : 'A' + (r >> 8) % 58;
+  }
+  for (size_t i = 0; i < NUM_PLANTED; i++) {
+    size_t index = next_random(seed) % NUM_PATTERNS;
+    // One hit per slot so that planted patterns never overlap
+    size_t slot_size = DATA_SIZE / NUM_PLANTED;
+    size_t offset =
+        i * slot_size + next_random(seed) % (slot_size - PATTERN_MAX_SIZE);
+    memcpy(data + offset, patterns[index], pattern_sizes[index]);
+  }
+  return data;
+}
+
+void bench_pattern_scan(void) {
+  uint32_t seed = 42;
+  char **patterns = malloc(NUM_PATTERNS * sizeof(char *));
+  size_t *pattern_sizes = malloc(NUM_PATTERNS * sizeof(size_t));
+  assert(patterns != NULL && pattern_sizes != NULL);
+  build_patterns(patterns, pattern_sizes, &seed);
+  uint8_t *data = build_data(patterns, pattern_sizes, &seed);
+
+  double start = bench_now_ms();
+  struct machore_pattern_set *set = machore_pattern_set_create(
+      (const char *const *)patterns, pattern_sizes, NUM_PATTERNS);
+  bench_report("pattern_set_create", machore_pattern_set_size(set), "patterns",
+               bench_now_ms() - start);
+
+  start = bench_now_ms();
+  size_t num_matches =
+      machore_pattern_set_scan(set, data, DATA_SIZE, NULL, NULL);
+  bench_report("pattern_set_scan", DATA_SIZE, "B", bench_now_ms() - start);
+  assert(num_matches >= NUM_PLANTED);
+
+  // Baseline: one memchr()/memcmp() pass per pattern over the first 256 KB
+  size_t baseline_size = 256 * 1024;
+  size_t baseline_matches = 0;
+  start = bench_now_ms();
+  for (size_t i = 0; i < NUM_PATTERNS; i++) {
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + baseline_size - pattern_sizes[i];
+    while ((cursor = memchr(cursor, patterns[i][0], end - cursor)) != NULL) {
+      if (memcmp(cursor, patterns[i], pattern_sizes[i]) == 0) {
+        baseline_matches++;
+      }
+      cursor++;
+    }
+  }
+  bench_report("memchr_per_pattern", baseline_size, "B",
+               bench_now_ms() - start);
+
+  printf("  (%zu matches, %zu in the first 256 KB with the baseline)\n",
+         num_matches, baseline_matches);
+  machore_pattern_set_destroy(set);
+  for (size_t i = 0; i < NUM_PATTERNS; i++) {
+    free(patterns[i]);
+  }
+  free(patterns);
+  free(pattern_sizes);
+  free(data);
+}
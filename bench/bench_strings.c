@@ -0,0 +1,100 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * __const like data: binary values (mostly small integers and pointers,
+ * many zero bytes) with printable words in between, scanned by the NUL
+ * separated strlen loop parse_macho uses for string sections and by the
+ * `strings -n` extractor. The UTF-16 case is __ustring like: UTF-16LE
+ * words with NUL code units in between.
+ */
+#define DATA_SIZE (64 * 1024 * 1024)
+#define MIN_LENGTH 4
+
+static uint32_t next_random(uint32_t *seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+static uint8_t *build_const_data(uint32_t *seed) {
+  uint8_t *data = malloc(DATA_SIZE);
+  assert(data != NULL);
+  size_t offset = 0;
+  while (offset < DATA_SIZE) {
+    uint32_t r = next_random(seed);
+    size_t size = 1 + r % 24;
+    if (size > DATA_SIZE - offset) {
+      size = DATA_SIZE - offset;
+    }
+    bool is_word = r % 3 == 0;
+    for (size_t i = 0; i < size; i++) {
+      uint32_t byte = next_random(seed);
+      data[offset + i] = is_word ? 'a' + byte % 26 : byte % 4 ? 0 : byte;
+    }
+    offset += size;
+  }
+  return data;
+}
+
+static uint8_t *build_ustring_data(uint32_t *seed) {
+  uint8_t *data = calloc(1, DATA_SIZE);
+  assert(data != NULL);
+  for (size_t offset = 0; offset + 1 < DATA_SIZE; offset += 2) {
+    uint32_t r = next_random(seed);
+    if (r % 16 != 0) {
+      data[offset] = 'a' + r % 26;
+    }
+  }
+  return data;
+}
+
+// The loop of parse_string_section(), without the copies
+static size_t count_nul_separated(const uint8_t *data, size_t size) {
+  const char *string = (const char *)data;
+  const char *end = string + size;
+  size_t count = 0;
+  while (string < end) {
+    size_t length = strnlen(string, end - string);
+    count += length > 0;
+    string += length + 1;
+  }
+  return count;
+}
+
+void bench_strings(void) {
+  uint32_t seed = 42;
+  uint8_t *data = build_const_data(&seed);
+
+  double start = bench_now_ms();
+  size_t num_strings = count_nul_separated(data, DATA_SIZE);
+  bench_report("strings_nul_separated", DATA_SIZE, "byte",
+               bench_now_ms() - start);
+
+  struct string_scan_options options = {.min_length = MIN_LENGTH};
+  start = bench_now_ms();
+  size_t num_runs =
+      machore_extract_strings(data, DATA_SIZE, &options, NULL, NULL);
+  bench_report("strings_min_length", DATA_SIZE, "byte",
+               bench_now_ms() - start);
+  assert(num_runs > 0 && num_runs < num_strings);
+
+  options.allow_unicode = true;
+  start = bench_now_ms();
+  machore_extract_strings(data, DATA_SIZE, &options, NULL, NULL);
+  bench_report("strings_min_length_unicode", DATA_SIZE, "byte",
+               bench_now_ms() - start);
+  free(data);
+
+  data = build_ustring_data(&seed);
+  options.allow_unicode = false;
+  options.is_utf16 = true;
+  start = bench_now_ms();
+  num_runs = machore_extract_strings(data, DATA_SIZE, &options, NULL, NULL);
+  bench_report("strings_utf16", DATA_SIZE, "byte", bench_now_ms() - start);
+  assert(num_runs > 0);
+  free(data);
+}
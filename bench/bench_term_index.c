@@ -0,0 +1,173 @@
+#include "../lib/libmachore.h"
+#include "bench.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * A corpus of NUM_BINARIES binaries, each linking DYLIBS_PER_BINARY of
+ * NUM_DYLIBS dylibs and importing IMPORTS_PER_BINARY of NUM_IMPORTS
+ * symbols, one in 16 without library validation. Binaries are added in
+ * batches of BATCH_SIZE, each batch saved to a segment (merges included),
+ * then a tenth of them are rebuilt and the index is merged to one segment.
+ */
+#define NUM_BINARIES 50000
+#define BATCH_SIZE 5000
+#define NUM_DYLIBS 500
+#define DYLIBS_PER_BINARY 8
+#define NUM_IMPORTS 20000
+#define IMPORTS_PER_BINARY 100
+#define NUM_QUERIES 10000
+
+static char dylib_paths[NUM_DYLIBS][64];
+static char import_names[NUM_IMPORTS][48];
+
+static void build_binary(size_t binary, struct machore_output_t *output,
+                         struct machore_arch_output_t *arch_output,
+                         struct dylib_info *dylibs,
+                         struct import_info *imports,
+                         struct security_flags *flags) {
+  memset(arch_output, 0, sizeof(*arch_output));
+  for (size_t i = 0; i < DYLIBS_PER_BINARY; i++) {
+    // A few popular dylibs, and a long tail
+    size_t dylib = i < 2 ? i : (binary * 31 + i * 7919) % NUM_DYLIBS;
+    memset(&dylibs[i], 0, sizeof(dylibs[i]));
+    strcpy(dylibs[i].path, dylib_paths[dylib]);
+    snprintf(dylibs[i].version, sizeof(dylibs[i].version), "%zu.0.0",
+             dylib % 3 + 1);
+    dylibs[i].ordinal = i + 1;
+  }
+  for (size_t i = 0; i < IMPORTS_PER_BINARY; i++) {
+    imports[i].name = import_names[(binary * 131 + i * i * 17) % NUM_IMPORTS];
+  }
+  memset(flags, 0, sizeof(*flags));
+  flags->is_signed = true;
+  flags->is_library_validation_disabled = binary % 16 == 0;
+
+  arch_output->dylibs = dylibs;
+  arch_output->num_dylibs = DYLIBS_PER_BINARY;
+  arch_output->imports = imports;
+  arch_output->num_imports = IMPORTS_PER_BINARY;
+  arch_output->security_flags = flags;
+  memset(output, 0, sizeof(*output));
+  output->arch_outputs = arch_output;
+  output->num_arch_outputs = 1;
+}
+
+static void add_binaries(struct machore_term_index *index, size_t first,
+                         size_t num_binaries, size_t step) {
+  struct machore_output_t output;
+  struct machore_arch_output_t arch_output;
+  struct dylib_info dylibs[DYLIBS_PER_BINARY];
+  struct import_info imports[IMPORTS_PER_BINARY];
+  struct security_flags flags;
+  for (size_t i = 0; i < num_binaries; i++) {
+    size_t binary = first + i * step;
+    char name[32];
+    snprintf(name, sizeof(name), "/Applications/App%zu", binary);
+    build_binary(binary, &output, &arch_output, dylibs, imports, &flags);
+    machore_term_index_add(index, name, &output);
+  }
+}
+
+static void remove_index(const char *path) {
+  DIR *directory = opendir(path);
+  if (directory != NULL) {
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+      if (entry->d_name[0] != '.') {
+        char file_path[512];
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+        unlink(file_path);
+      }
+    }
+    closedir(directory);
+  }
+  rmdir(path);
+}
+
+void bench_term_index(void) {
+  for (size_t i = 0; i < NUM_DYLIBS; i++) {
+    snprintf(dylib_paths[i], sizeof(dylib_paths[i]),
+             "/usr/lib/lib%zu.dylib", i);
+  }
+  for (size_t i = 0; i < NUM_IMPORTS; i++) {
+    snprintf(import_names[i], sizeof(import_names[i]), "_SecFunction%zu", i);
+  }
+  char path[] = "/tmp/bench_terms_XXXXXX";
+  if (mkdtemp(path) == NULL) {
+    printf("Error: could not create '%s'\n", path);
+    return;
+  }
+
+  struct machore_term_index *index = machore_term_index_open(path);
+  assert(index != NULL);
+  double start = bench_now_ms();
+  for (size_t first = 0; first < NUM_BINARIES; first += BATCH_SIZE) {
+    add_binaries(index, first, BATCH_SIZE, 1);
+    bool is_saved = machore_term_index_save(index);
+    assert(is_saved);
+    (void)is_saved;
+  }
+  bench_report("term_index_add_save", NUM_BINARIES, "binaries",
+               bench_now_ms() - start);
+  printf("%-32s %10zu segments\n", "",
+         machore_term_index_num_segments(index));
+
+  start = bench_now_ms();
+  add_binaries(index, 0, NUM_BINARIES / 10, 10);
+  bool is_saved = machore_term_index_save(index) &&
+                  machore_term_index_merge(index, 1);
+  assert(is_saved && machore_term_index_size(index) == NUM_BINARIES);
+  (void)is_saved;
+  bench_report("term_index_rebuild_merge", NUM_BINARIES / 10, "binaries",
+               bench_now_ms() - start);
+  machore_term_index_close(index);
+
+  start = bench_now_ms();
+  index = machore_term_index_open(path);
+  assert(index != NULL);
+  bench_report("term_index_open", NUM_BINARIES, "binaries",
+               bench_now_ms() - start);
+
+  // Rare imports, popular dylibs and flags
+  size_t num_results = 0;
+  char term[96];
+  start = bench_now_ms();
+  for (size_t i = 0; i < NUM_QUERIES; i++) {
+    switch (i % 4) {
+    case 0:
+      num_results += machore_term_index_query(
+          index, LIBMACHORE_TERM_IMPORT,
+          import_names[(i * 7919) % NUM_IMPORTS], NULL, NULL);
+      break;
+    case 1:
+      num_results += machore_term_index_query(
+          index, LIBMACHORE_TERM_DYLIB, dylib_paths[i % NUM_DYLIBS], NULL,
+          NULL);
+      break;
+    case 2:
+      snprintf(term, sizeof(term), "%s@%zu.0.0", dylib_paths[i % NUM_DYLIBS],
+               i % NUM_DYLIBS % 3 + 1);
+      num_results += machore_term_index_query(
+          index, LIBMACHORE_TERM_DYLIB_VERSION, term, NULL, NULL);
+      break;
+    default:
+      num_results += machore_term_index_query(
+          index, LIBMACHORE_TERM_FLAG, "disable-library-validation", NULL,
+          NULL);
+      break;
+    }
+  }
+  double elapsed = bench_now_ms() - start;
+  bench_report("term_index_query", NUM_QUERIES, "queries", elapsed);
+  printf("%-32s %10.1f us/query, %.0f binaries/query\n", "",
+         elapsed * 1e3 / NUM_QUERIES, (double)num_results / NUM_QUERIES);
+
+  machore_term_index_close(index);
+  remove_index(path);
+}
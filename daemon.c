@@ -0,0 +1,918 @@
+#include "daemon.h"
+#include "json.h"
+#include "lib/hash.h"
+#include "lib/libmachore.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Analysis daemon: answers queries on a Unix domain socket from a bounded
+ * LRU cache of parsed binaries, keyed by path and modification time.
+ *
+ * Every request and response is a frame: a 32-bit little-endian payload size
+ * followed by the payload. Request payloads are NUL-separated fields:
+ *
+ *   dylibs\0<path>            linked dylibs of every slice
+ *   export\0<path>\0<symbol>  whether each slice exports <symbol>
+ *   entitlements\0<path>      entitlements of every slice
+ *   stats                     cache statistics
+ *
+ * Responses are JSON objects, {"error":"..."} when the query failed.
+ *
+ * The main thread polls the idle connections and queues every connection
+ * with a pending request to a pool of workers. A worker answers one request
+ * and hands the connection back, so idle clients never hold a worker.
+ * Binaries are parsed outside of the cache lock, so a slow parse never blocks
+ * cache hits.
+ */
+
+#define DEFAULT_NUM_WORKERS 4
+#define DEFAULT_CACHE_CAPACITY 64
+#define CONNECTION_QUEUE_SIZE 256
+#define MAX_FRAME_SIZE (1 << 20)
+#define CACHE_NUM_BUCKETS 1024
+
+// Longest wait for the rest of a request or for the client to read a response
+#define REQUEST_TIMEOUT_S 1
+
+struct cache_entry {
+  char *path;
+  struct timespec mtime;
+  off_t size;
+  uint8_t *buffer;
+  struct machore_output_t output;
+
+  // Held by the cache while it is indexed, and by every worker using it
+  size_t references;
+  struct cache_entry *bucket_next;
+  struct cache_entry *lru_previous;
+  struct cache_entry *lru_next;
+};
+
+struct cache {
+  pthread_mutex_t mutex;
+  struct cache_entry *buckets[CACHE_NUM_BUCKETS];
+  // Most recently used first
+  struct cache_entry *lru_head;
+  struct cache_entry *lru_tail;
+  size_t num_entries;
+  size_t capacity;
+
+  uint64_t num_hits;
+  uint64_t num_misses;
+};
+
+struct connection_queue {
+  pthread_mutex_t mutex;
+  pthread_cond_t is_not_empty;
+  pthread_cond_t is_not_full;
+  int fds[CONNECTION_QUEUE_SIZE];
+  size_t head;
+  size_t count;
+  // Set on shutdown, workers exit once the queue is empty
+  bool is_closed;
+};
+
+struct server {
+  struct cache cache;
+  // Connections with a pending request
+  struct connection_queue queue;
+
+  // Connections served by workers, to watch again
+  pthread_mutex_t returned_mutex;
+  int *returned_fds;
+  size_t num_returned;
+  size_t returned_capacity;
+  // Written by workers to wake up the dispatcher
+  int wake_fds[2];
+};
+
+struct worker_buffers {
+  char *request;
+  size_t request_capacity;
+  FILE *stream;
+  char *response;
+  size_t response_size;
+};
+
+// Only read by the dispatcher, workers wait for the queue to close
+static volatile sig_atomic_t is_stopping = 0;
+
+static void handle_stop_signal(int signal_number) {
+  (void)signal_number;
+  is_stopping = 1;
+}
+
+static size_t path_bucket(const char *path) {
+  return hash_bytes(path, strlen(path)) & (CACHE_NUM_BUCKETS - 1);
+}
+
+static void release_entry(struct cache_entry *entry) {
+  // Called with the cache lock held
+  if (--entry->references > 0) {
+    return;
+  }
+  clean_output(&entry->output);
+  free(entry->buffer);
+  free(entry->path);
+  free(entry);
+}
+
+static void unlink_entry(struct cache *cache, struct cache_entry *entry) {
+  struct cache_entry **link = &cache->buckets[path_bucket(entry->path)];
+  while (*link != entry) {
+    link = &(*link)->bucket_next;
+  }
+  *link = entry->bucket_next;
+
+  if (entry->lru_previous) {
+    entry->lru_previous->lru_next = entry->lru_next;
+  } else {
+    cache->lru_head = entry->lru_next;
+  }
+  if (entry->lru_next) {
+    entry->lru_next->lru_previous = entry->lru_previous;
+  } else {
+    cache->lru_tail = entry->lru_previous;
+  }
+  cache->num_entries--;
+  release_entry(entry);
+}
+
+static void push_entry(struct cache *cache, struct cache_entry *entry) {
+  entry->lru_previous = NULL;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head) {
+    cache->lru_head->lru_previous = entry;
+  } else {
+    cache->lru_tail = entry;
+  }
+  cache->lru_head = entry;
+}
+
+static struct cache_entry *find_entry(struct cache *cache, const char *path) {
+  struct cache_entry *entry = cache->buckets[path_bucket(path)];
+  while (entry && strcmp(entry->path, path) != 0) {
+    entry = entry->bucket_next;
+  }
+  return entry;
+}
+
+static bool is_same_version(const struct cache_entry *entry,
+                            const struct stat *st) {
+  return entry->mtime.tv_sec == st->st_mtime &&
+#ifdef __APPLE__
+         entry->mtime.tv_nsec == st->st_mtimespec.tv_nsec &&
+#else
+         entry->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+#endif
+         entry->size == st->st_size;
+}
+
+// Reads and parses a binary, the modification time comes from the same open
+// file so a concurrent rewrite cannot pair old contents with a new mtime.
+// Files rejected by the validation are not cached: `*validation_error` tells
+// why, and errno is set on the other failures.
+static struct cache_entry *load_entry(const char *path,
+                                      validation_error_t *validation_error) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  struct cache_entry *entry = calloc(1, sizeof(struct cache_entry));
+  entry->path = strdup(path);
+  entry->mtime.tv_sec = st.st_mtime;
+#ifdef __APPLE__
+  entry->mtime.tv_nsec = st.st_mtimespec.tv_nsec;
+#else
+  entry->mtime.tv_nsec = st.st_mtim.tv_nsec;
+#endif
+  entry->size = st.st_size;
+  entry->buffer = malloc(st.st_size);
+  size_t read_size = 0;
+  while (entry->buffer && read_size < (size_t)st.st_size) {
+    ssize_t result =
+        read(fd, entry->buffer + read_size, st.st_size - read_size);
+    if (result <= 0) {
+      break;
+    }
+    read_size += result;
+  }
+  close(fd);
+  if (!entry->buffer || read_size != (size_t)st.st_size) {
+    free(entry->buffer);
+    free(entry->path);
+    free(entry);
+    return NULL;
+  }
+
+  init_output(&entry->output);
+  parse_macho(&entry->output, entry->buffer, entry->size);
+  *validation_error = entry->output.validation.error;
+  if (*validation_error != LIBMACHORE_VALIDATION_OK) {
+    clean_output(&entry->output);
+    free(entry->buffer);
+    free(entry->path);
+    free(entry);
+    return NULL;
+  }
+  entry->references = 1;
+  return entry;
+}
+
+// Returns the parsed binary at `path`, loading it on a miss or when the file
+// changed. Release it with cache_release().
+static struct cache_entry *cache_acquire(struct cache *cache, const char *path,
+                                         validation_error_t *validation_error) {
+  *validation_error = LIBMACHORE_VALIDATION_OK;
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cache->mutex);
+  struct cache_entry *entry = find_entry(cache, path);
+  if (entry && is_same_version(entry, &st)) {
+    // Move to the front of the LRU list
+    if (entry != cache->lru_head) {
+      entry->lru_previous->lru_next = entry->lru_next;
+      if (entry->lru_next) {
+        entry->lru_next->lru_previous = entry->lru_previous;
+      } else {
+        cache->lru_tail = entry->lru_previous;
+      }
+      push_entry(cache, entry);
+    }
+    entry->references++;
+    cache->num_hits++;
+    pthread_mutex_unlock(&cache->mutex);
+    return entry;
+  }
+  cache->num_misses++;
+  pthread_mutex_unlock(&cache->mutex);
+
+  struct cache_entry *loaded = load_entry(path, validation_error);
+  if (!loaded) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cache->mutex);
+  // Replace the stale entry, or the one another worker loaded meanwhile
+  entry = find_entry(cache, path);
+  if (entry) {
+    unlink_entry(cache, entry);
+  }
+  size_t bucket = path_bucket(path);
+  loaded->bucket_next = cache->buckets[bucket];
+  cache->buckets[bucket] = loaded;
+  push_entry(cache, loaded);
+  cache->num_entries++;
+  while (cache->num_entries > cache->capacity) {
+    unlink_entry(cache, cache->lru_tail);
+  }
+  loaded->references++;
+  pthread_mutex_unlock(&cache->mutex);
+  return loaded;
+}
+
+static void cache_release(struct cache *cache, struct cache_entry *entry) {
+  pthread_mutex_lock(&cache->mutex);
+  release_entry(entry);
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+static void clean_cache(struct cache *cache) {
+  while (cache->lru_tail) {
+    unlink_entry(cache, cache->lru_tail);
+  }
+  pthread_mutex_destroy(&cache->mutex);
+}
+
+static void write_error(FILE *stream, const char *message) {
+  fprintf(stream, "{\"error\":");
+  write_json_string(stream, message);
+  fprintf(stream, "}");
+}
+
+static void write_dylibs(FILE *stream, const struct machore_output_t *output) {
+  fprintf(stream, "{\"slices\":[");
+  for (size_t i = 0; i < output->num_arch_outputs; i++) {
+    const struct machore_arch_output_t *arch_output = &output->arch_outputs[i];
+    fprintf(stream, "%s{\"architecture\":", i ? "," : "");
+    write_json_string(stream, arch_output->architecture);
+    fprintf(stream, ",\"dylibs\":");
+    write_json_dylibs(stream, arch_output);
+    fprintf(stream, "}");
+  }
+  fprintf(stream, "]}");
+}
+
+static void write_export(FILE *stream, const struct machore_output_t *output,
+                         const char *symbol) {
+  fprintf(stream, "{\"symbol\":");
+  write_json_string(stream, symbol);
+  fprintf(stream, ",\"slices\":[");
+  for (size_t i = 0; i < output->num_arch_outputs; i++) {
+    const struct machore_arch_output_t *arch_output = &output->arch_outputs[i];
+    struct export_info export_info;
+    bool is_exported =
+        machore_lookup_export(arch_output->export_trie,
+                              arch_output->export_trie_size, symbol,
+                              &export_info);
+    fprintf(stream, "%s{\"architecture\":", i ? "," : "");
+    write_json_string(stream, arch_output->architecture);
+    fprintf(stream, ",\"exported\":%s", is_exported ? "true" : "false");
+    if (is_exported) {
+      fprintf(stream, ",\"address\":%llu",
+              (unsigned long long)export_info.address);
+    }
+    fprintf(stream, "}");
+  }
+  fprintf(stream, "]}");
+}
+
+static void write_entitlements(FILE *stream,
+                               const struct machore_output_t *output) {
+  fprintf(stream, "{\"slices\":[");
+  for (size_t i = 0; i < output->num_arch_outputs; i++) {
+    const struct machore_arch_output_t *arch_output = &output->arch_outputs[i];
+    fprintf(stream, "%s{\"architecture\":", i ? "," : "");
+    write_json_string(stream, arch_output->architecture);
+    fprintf(stream, ",\"entitlements\":");
+    if (arch_output->entitlements) {
+      write_json_string(stream, arch_output->entitlements);
+    } else {
+      fprintf(stream, "null");
+    }
+    fprintf(stream, "}");
+  }
+  fprintf(stream, "]}");
+}
+
+static void answer_request(struct server *server, FILE *stream, char *request,
+                           size_t request_size) {
+  // Split the NUL-separated fields, the frame is NUL terminated by the reader
+  const char *fields[3] = {request, NULL, NULL};
+  size_t num_fields = 1;
+  for (size_t i = 0; i < request_size && num_fields < 3; i++) {
+    if (request[i] == '\0') {
+      fields[num_fields++] = &request[i + 1];
+    }
+  }
+
+  const char *command = fields[0];
+  if (strcmp(command, "stats") == 0) {
+    pthread_mutex_lock(&server->cache.mutex);
+    fprintf(stream,
+            "{\"entries\":%zu,\"capacity\":%zu,\"hits\":%llu,\"misses\":%llu}",
+            server->cache.num_entries, server->cache.capacity,
+            (unsigned long long)server->cache.num_hits,
+            (unsigned long long)server->cache.num_misses);
+    pthread_mutex_unlock(&server->cache.mutex);
+    return;
+  }
+
+  bool is_known = strcmp(command, "dylibs") == 0 ||
+                  strcmp(command, "export") == 0 ||
+                  strcmp(command, "entitlements") == 0;
+  if (!is_known) {
+    write_error(stream, "unknown command");
+    return;
+  }
+  if (!fields[1] || (strcmp(command, "export") == 0 && !fields[2])) {
+    write_error(stream, "missing argument");
+    return;
+  }
+
+  validation_error_t validation_error;
+  struct cache_entry *entry =
+      cache_acquire(&server->cache, fields[1], &validation_error);
+  if (!entry && validation_error != LIBMACHORE_VALIDATION_OK) {
+    char message[128];
+    snprintf(message, sizeof(message), "not a valid Mach-O file: %s",
+             machore_validation_error_string(validation_error));
+    write_error(stream, message);
+    return;
+  }
+  if (!entry) {
+    write_error(stream, strerror(errno ? errno : ENOENT));
+    return;
+  }
+  if (strcmp(command, "dylibs") == 0) {
+    write_dylibs(stream, &entry->output);
+  } else if (strcmp(command, "export") == 0) {
+    write_export(stream, &entry->output, fields[2]);
+  } else {
+    write_entitlements(stream, &entry->output);
+  }
+  cache_release(&server->cache, entry);
+}
+
+static bool read_all(int fd, void *data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t result = read(fd, (uint8_t *)data + done, size - done);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    done += result;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const void *data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t result = write(fd, (const uint8_t *)data + done, size - done);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    done += result;
+  }
+  return true;
+}
+
+static void encode_frame_size(uint8_t header[4], uint32_t size) {
+  header[0] = size;
+  header[1] = size >> 8;
+  header[2] = size >> 16;
+  header[3] = size >> 24;
+}
+
+static uint32_t decode_frame_size(const uint8_t header[4]) {
+  return header[0] | header[1] << 8 | header[2] << 16 |
+         (uint32_t)header[3] << 24;
+}
+
+static bool write_frame(int fd, const char *payload, size_t size) {
+  uint8_t header[4];
+  encode_frame_size(header, size);
+  return write_all(fd, header, sizeof(header)) &&
+         write_all(fd, payload, size);
+}
+
+// Reads a frame into `*payload`, NUL terminated, growing it as needed
+static bool read_frame(int fd, char **payload, size_t *capacity,
+                       size_t *size) {
+  uint8_t header[4];
+  if (!read_all(fd, header, sizeof(header))) {
+    return false;
+  }
+  *size = decode_frame_size(header);
+  if (*size > MAX_FRAME_SIZE) {
+    return false;
+  }
+  if (*size + 1 > *capacity) {
+    *capacity = *size + 1;
+    *payload = realloc(*payload, *capacity);
+  }
+  (*payload)[*size] = '\0';
+  return read_all(fd, *payload, *size);
+}
+
+// Answers one request of a readable connection, false when it is closed
+static bool serve_request(struct server *server, struct worker_buffers *buffers,
+                          int fd) {
+  size_t request_size;
+  if (!read_frame(fd, &buffers->request, &buffers->request_capacity,
+                  &request_size)) {
+    return false;
+  }
+  errno = 0;
+  rewind(buffers->stream);
+  answer_request(server, buffers->stream, buffers->request, request_size);
+  long length = ftell(buffers->stream);
+  fflush(buffers->stream);
+  return write_frame(fd, buffers->response, length);
+}
+
+static void return_connection(struct server *server, int fd) {
+  pthread_mutex_lock(&server->returned_mutex);
+  if (server->num_returned == server->returned_capacity) {
+    server->returned_capacity =
+        server->returned_capacity ? server->returned_capacity * 2 : 64;
+    server->returned_fds = realloc(server->returned_fds,
+                                   server->returned_capacity * sizeof(int));
+  }
+  server->returned_fds[server->num_returned++] = fd;
+  pthread_mutex_unlock(&server->returned_mutex);
+
+  // Wake up the dispatcher to watch the connection again
+  char byte = 0;
+  while (write(server->wake_fds[1], &byte, 1) < 0 && errno == EINTR) {
+  }
+}
+
+static void *run_worker(void *argument) {
+  struct server *server = argument;
+  struct connection_queue *queue = &server->queue;
+  struct worker_buffers buffers;
+  memset(&buffers, 0, sizeof(buffers));
+  buffers.stream = open_memstream(&buffers.response, &buffers.response_size);
+
+  while (true) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0 && !queue->is_closed) {
+      pthread_cond_wait(&queue->is_not_empty, &queue->mutex);
+    }
+    if (queue->count == 0) {
+      pthread_mutex_unlock(&queue->mutex);
+      break;
+    }
+    int fd = queue->fds[queue->head];
+    queue->head = (queue->head + 1) % CONNECTION_QUEUE_SIZE;
+    queue->count--;
+    pthread_cond_signal(&queue->is_not_full);
+    pthread_mutex_unlock(&queue->mutex);
+
+    if (serve_request(server, &buffers, fd)) {
+      return_connection(server, fd);
+    } else {
+      close(fd);
+    }
+  }
+
+  fclose(buffers.stream);
+  free(buffers.response);
+  free(buffers.request);
+  return NULL;
+}
+
+static void push_connection(struct connection_queue *queue, int fd) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == CONNECTION_QUEUE_SIZE && !queue->is_closed) {
+    pthread_cond_wait(&queue->is_not_full, &queue->mutex);
+  }
+  if (queue->count == CONNECTION_QUEUE_SIZE) {
+    pthread_mutex_unlock(&queue->mutex);
+    close(fd);
+    return;
+  }
+  queue->fds[(queue->head + queue->count) % CONNECTION_QUEUE_SIZE] = fd;
+  queue->count++;
+  pthread_cond_signal(&queue->is_not_empty);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+static int connect_socket(const char *socket_path, bool is_listening) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    printf("Error: socket path '%s' is too long\n", socket_path);
+    return -1;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  int result;
+  if (is_listening) {
+    unlink(socket_path);
+    result = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    if (result == 0) {
+      result = listen(fd, SOMAXCONN);
+    }
+  } else {
+    result = connect(fd, (struct sockaddr *)&address, sizeof(address));
+  }
+  if (result != 0) {
+    perror(socket_path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void add_pollfd(struct pollfd **pollfds, size_t *num_pollfds,
+                       size_t *capacity, int fd) {
+  if (*num_pollfds == *capacity) {
+    *capacity *= 2;
+    *pollfds = realloc(*pollfds, *capacity * sizeof(struct pollfd));
+  }
+  (*pollfds)[*num_pollfds].fd = fd;
+  (*pollfds)[*num_pollfds].events = POLLIN;
+  (*pollfds)[*num_pollfds].revents = 0;
+  (*num_pollfds)++;
+}
+
+// Watches the listening socket and the idle connections, and hands every
+// connection with a pending request to the workers
+static void dispatch_connections(struct server *server, int listen_fd) {
+  size_t capacity = 64;
+  struct pollfd *pollfds = malloc(capacity * sizeof(struct pollfd));
+  size_t num_pollfds = 0;
+  add_pollfd(&pollfds, &num_pollfds, &capacity, listen_fd);
+  add_pollfd(&pollfds, &num_pollfds, &capacity, server->wake_fds[0]);
+
+  while (!is_stopping) {
+    if (poll(pollfds, num_pollfds, -1) < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+        break;
+      }
+      continue;
+    }
+
+    // Connections being served are not watched until a worker returns them
+    for (size_t i = num_pollfds; i-- > 2;) {
+      if (pollfds[i].revents) {
+        push_connection(&server->queue, pollfds[i].fd);
+        pollfds[i] = pollfds[--num_pollfds];
+      }
+    }
+
+    if (pollfds[1].revents) {
+      char bytes[64];
+      while (read(server->wake_fds[0], bytes, sizeof(bytes)) > 0) {
+      }
+      pthread_mutex_lock(&server->returned_mutex);
+      for (size_t i = 0; i < server->num_returned; i++) {
+        add_pollfd(&pollfds, &num_pollfds, &capacity,
+                   server->returned_fds[i]);
+      }
+      server->num_returned = 0;
+      pthread_mutex_unlock(&server->returned_mutex);
+    }
+
+    if (pollfds[0].revents) {
+      int fd = accept(listen_fd, NULL, NULL);
+      if (fd >= 0) {
+        // BSDs inherit O_NONBLOCK from the listening socket, workers block
+        fcntl(fd, F_SETFL, 0);
+        // A stalled client must not hold a worker forever
+        struct timeval timeout = {.tv_sec = REQUEST_TIMEOUT_S};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        add_pollfd(&pollfds, &num_pollfds, &capacity, fd);
+      }
+    }
+  }
+
+  for (size_t i = 2; i < num_pollfds; i++) {
+    close(pollfds[i].fd);
+  }
+  free(pollfds);
+}
+
+int serve_main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printf("Usage: %s serve <socket> [--workers <count>] [--cache <count>]\n",
+           argv[0]);
+    return 1;
+  }
+  const char *socket_path = argv[2];
+  size_t num_workers = DEFAULT_NUM_WORKERS;
+  size_t cache_capacity = DEFAULT_CACHE_CAPACITY;
+  for (int arg_index = 3; arg_index < argc; arg_index++) {
+    const char *option = argv[arg_index];
+    if (strcmp(option, "--workers") == 0 && arg_index + 1 < argc) {
+      num_workers = strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(option, "--cache") == 0 && arg_index + 1 < argc) {
+      cache_capacity = strtoul(argv[++arg_index], NULL, 10);
+    } else {
+      printf("Error: unknown option '%s'\n", option);
+      return 1;
+    }
+  }
+  if (num_workers == 0 || cache_capacity == 0) {
+    printf("Error: --workers and --cache must be positive\n");
+    return 1;
+  }
+
+  int listen_fd = connect_socket(socket_path, true);
+  if (listen_fd < 0) {
+    return 1;
+  }
+
+  struct server *server = calloc(1, sizeof(struct server));
+  if (pipe(server->wake_fds) != 0) {
+    perror("pipe");
+    close(listen_fd);
+    free(server);
+    return 1;
+  }
+  fcntl(server->wake_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+
+  // No SA_RESTART: a signal must interrupt poll()
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  pthread_mutex_init(&server->cache.mutex, NULL);
+  server->cache.capacity = cache_capacity;
+  pthread_mutex_init(&server->queue.mutex, NULL);
+  pthread_cond_init(&server->queue.is_not_empty, NULL);
+  pthread_cond_init(&server->queue.is_not_full, NULL);
+  pthread_mutex_init(&server->returned_mutex, NULL);
+  pthread_t *workers = malloc(num_workers * sizeof(pthread_t));
+  for (size_t i = 0; i < num_workers; i++) {
+    pthread_create(&workers[i], NULL, run_worker, server);
+  }
+  printf("Listening on %s with %zu workers\n", socket_path, num_workers);
+  fflush(stdout);
+
+  dispatch_connections(server, listen_fd);
+
+  // Workers finish the request they are serving
+  pthread_mutex_lock(&server->queue.mutex);
+  server->queue.is_closed = true;
+  pthread_cond_broadcast(&server->queue.is_not_empty);
+  pthread_cond_broadcast(&server->queue.is_not_full);
+  pthread_mutex_unlock(&server->queue.mutex);
+  for (size_t i = 0; i < num_workers; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  for (size_t i = 0; i < server->queue.count; i++) {
+    size_t index = (server->queue.head + i) % CONNECTION_QUEUE_SIZE;
+    close(server->queue.fds[index]);
+  }
+  for (size_t i = 0; i < server->num_returned; i++) {
+    close(server->returned_fds[i]);
+  }
+
+  close(listen_fd);
+  unlink(socket_path);
+  close(server->wake_fds[0]);
+  close(server->wake_fds[1]);
+  free(workers);
+  free(server->returned_fds);
+  clean_cache(&server->cache);
+  pthread_mutex_destroy(&server->queue.mutex);
+  pthread_cond_destroy(&server->queue.is_not_empty);
+  pthread_cond_destroy(&server->queue.is_not_full);
+  pthread_mutex_destroy(&server->returned_mutex);
+  free(server);
+  return 0;
+}
+
+struct load_test_client {
+  const char *socket_path;
+  const char *request;
+  size_t request_size;
+  size_t num_requests;
+  // Nanoseconds per request
+  uint64_t *latencies;
+  bool is_failed;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *run_load_test_client(void *argument) {
+  struct load_test_client *client = argument;
+  int fd = connect_socket(client->socket_path, false);
+  if (fd < 0) {
+    client->is_failed = true;
+    return NULL;
+  }
+
+  char *response = NULL;
+  size_t response_capacity = 0;
+  for (size_t i = 0; i < client->num_requests; i++) {
+    uint64_t start = now_ns();
+    size_t response_size;
+    if (!write_frame(fd, client->request, client->request_size) ||
+        !read_frame(fd, &response, &response_capacity, &response_size)) {
+      client->is_failed = true;
+      break;
+    }
+    client->latencies[i] = now_ns() - start;
+    if (i == 0 && strncmp(response, "{\"error\"", 8) == 0) {
+      printf("Error: %s\n", response);
+      client->is_failed = true;
+      break;
+    }
+  }
+  free(response);
+  close(fd);
+  return NULL;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+  uint64_t latency_a = *(const uint64_t *)a;
+  uint64_t latency_b = *(const uint64_t *)b;
+  return latency_a < latency_b ? -1 : latency_a > latency_b;
+}
+
+int load_test_main(int argc, char *argv[]) {
+  if (argc < 4) {
+    printf("Usage: %s load-test <socket> <binary> [--connections <count>] "
+           "[--requests <count>]\n",
+           argv[0]);
+    return 1;
+  }
+  size_t num_connections = 4;
+  size_t num_requests = 10000;
+  for (int arg_index = 4; arg_index < argc; arg_index++) {
+    const char *option = argv[arg_index];
+    if (strcmp(option, "--connections") == 0 && arg_index + 1 < argc) {
+      num_connections = strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(option, "--requests") == 0 && arg_index + 1 < argc) {
+      num_requests = strtoul(argv[++arg_index], NULL, 10);
+    } else {
+      printf("Error: unknown option '%s'\n", option);
+      return 1;
+    }
+  }
+  if (num_connections == 0 || num_requests == 0) {
+    printf("Error: --connections and --requests must be positive\n");
+    return 1;
+  }
+
+  // `dylibs <binary>`: the daemon resolves paths from its own directory
+  char *binary_path = realpath(argv[3], NULL);
+  if (!binary_path) {
+    perror(argv[3]);
+    return 1;
+  }
+  size_t request_size = sizeof("dylibs") + strlen(binary_path);
+  char *request = malloc(request_size);
+  memcpy(request, "dylibs", sizeof("dylibs"));
+  memcpy(request + sizeof("dylibs"), binary_path, strlen(binary_path));
+
+  // Requests are split evenly between the connections
+  size_t requests_per_client = (num_requests + num_connections - 1) /
+                               num_connections;
+  struct load_test_client *clients =
+      calloc(num_connections, sizeof(struct load_test_client));
+  uint64_t *latencies =
+      calloc(num_connections * requests_per_client, sizeof(uint64_t));
+  pthread_t *threads = malloc(num_connections * sizeof(pthread_t));
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < num_connections; i++) {
+    clients[i].socket_path = argv[2];
+    clients[i].request = request;
+    clients[i].request_size = request_size;
+    clients[i].num_requests = requests_per_client;
+    clients[i].latencies = latencies + i * requests_per_client;
+    pthread_create(&threads[i], NULL, run_load_test_client, &clients[i]);
+  }
+  bool is_failed = false;
+  for (size_t i = 0; i < num_connections; i++) {
+    pthread_join(threads[i], NULL);
+    is_failed |= clients[i].is_failed;
+  }
+  double elapsed_s = (now_ns() - start) / 1e9;
+
+  int status = 0;
+  if (is_failed) {
+    printf("Error: some requests failed\n");
+    status = 1;
+  } else {
+    size_t total = num_connections * requests_per_client;
+    qsort(latencies, total, sizeof(uint64_t), compare_latencies);
+    printf("%zu requests over %zu connections in %.2f s\n", total,
+           num_connections, elapsed_s);
+    printf("QPS: %.0f\n", total / elapsed_s);
+    printf("Latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           latencies[total / 2] / 1e3, latencies[total * 99 / 100] / 1e3,
+           latencies[total - 1] / 1e3);
+  }
+
+  free(threads);
+  free(latencies);
+  free(clients);
+  free(request);
+  free(binary_path);
+  return status;
+}
@@ -0,0 +1,11 @@
+#ifndef MACHO_RE_DAEMON_H
+#define MACHO_RE_DAEMON_H
+
+// `macho_re serve <socket> [--workers <count>] [--cache <count>]`
+int serve_main(int argc, char *argv[]);
+
+// `macho_re load-test <socket> <binary> [--connections <count>]
+// [--requests <count>]`
+int load_test_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,72 @@
+#include "../lib/libmachore.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * libFuzzer target: parse_macho(), then the lazy decoders of every slice it
+ * accepted (paging, byte stats, export trie, metadata, fingerprint). Build
+ * with -DMACHO_RE_FUZZ=ON (clang), then run it over a corpus of Mach-O
+ * files and the seeds of fuzz/corpus (regressions):
+ *   fuzz/fuzz_parse corpus/ fuzz/corpus/
+ */
+
+static bool count_export(const struct export_info *export_info,
+                         void *context) {
+  (void)export_info;
+  (*(size_t *)context)++;
+  return true;
+}
+
+static void decode_arch(struct machore_arch_output_t *arch_output) {
+  struct string_info strings[16];
+  struct symbol_info symbols[16];
+  size_t num_strings = machore_count_strings(arch_output);
+  size_t num_symbols = machore_count_symbols(arch_output);
+  // First and last pages
+  machore_get_strings(arch_output, 0, strings, 16);
+  machore_get_strings(arch_output, num_strings > 16 ? num_strings - 16 : 0,
+                      strings, 16);
+  machore_get_symbols(arch_output, 0, symbols, 16);
+  machore_get_symbols(arch_output, num_symbols > 16 ? num_symbols - 16 : 0,
+                      symbols, 16);
+  for (size_t index = 0; index < 16 && index < num_symbols; index++) {
+    // Names are read with strlen()
+    volatile size_t length = strlen(symbols[index].name);
+    (void)length;
+  }
+
+  size_t num_sections;
+  machore_section_stats(arch_output, &num_sections);
+  size_t num_exports = 0;
+  machore_walk_exports(arch_output->export_trie, arch_output->export_trie_size,
+                       count_export, &num_exports);
+
+  for (int kind = 0; kind < LIBMACHORE_METADATA_COUNT; kind++) {
+    size_t num_names;
+    machore_metadata_names(arch_output, (metadata_kind_t)kind, &num_names);
+  }
+
+  struct fingerprint_info fingerprint;
+  machore_fingerprint_arch(arch_output, &fingerprint);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  // parse_macho() takes a mutable buffer
+  uint8_t *buffer = malloc(size > 0 ? size : 1);
+  if (buffer == NULL) {
+    return 0;
+  }
+  memcpy(buffer, data, size);
+
+  struct machore_output_t output;
+  init_output(&output);
+  output.is_paged = size > 0 && (data[size - 1] & 1);
+  parse_macho(&output, buffer, size);
+  for (size_t index = 0; index < output.num_arch_outputs; index++) {
+    decode_arch(&output.arch_outputs[index]);
+  }
+  clean_output(&output);
+  free(buffer);
+  return 0;
+}
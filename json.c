@@ -0,0 +1,28 @@
+#include "json.h"
+
+void write_json_string(FILE *stream, const char *content) {
+  fputc('"', stream);
+  for (const unsigned char *c = (const unsigned char *)content; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(stream, "\\%c", *c);
+    } else if (*c < 0x20 || *c == 0x7F) {
+      fprintf(stream, "\\u%04x", *c);
+    } else {
+      fputc(*c, stream);
+    }
+  }
+  fputc('"', stream);
+}
+
+void write_json_dylibs(FILE *stream,
+                       const struct machore_arch_output_t *arch_output) {
+  fprintf(stream, "[");
+  for (size_t i = 0; i < arch_output->num_dylibs; i++) {
+    fprintf(stream, "%s{\"path\":", i ? "," : "");
+    write_json_string(stream, arch_output->dylibs[i].path);
+    fprintf(stream, ",\"version\":");
+    write_json_string(stream, arch_output->dylibs[i].version);
+    fprintf(stream, "}");
+  }
+  fprintf(stream, "]");
+}
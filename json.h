@@ -0,0 +1,15 @@
+#ifndef MACHO_RE_JSON_H
+#define MACHO_RE_JSON_H
+
+#include "lib/libmachore.h"
+
+#include <stdio.h>
+
+// Writes a NUL-terminated string as a quoted JSON string
+void write_json_string(FILE *stream, const char *content);
+
+// Writes the dylibs of a slice as an array of {"path","version"} objects
+void write_json_dylibs(FILE *stream,
+                       const struct machore_arch_output_t *arch_output);
+
+#endif
@@ -0,0 +1,145 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "byte_stats.h"
+
+/*
+ * Byte histogram kernel.
+ *
+ * Incrementing a single table stalls on store-to-load forwarding whenever
+ * neighbouring bytes are equal, which is most of the time in code and
+ * padding. Consecutive bytes are instead counted in 4 interleaved uint32_t
+ * tables, merged at the end.
+ *
+ * Blocks of 64 identical bytes (zero fill, alignment padding) are detected
+ * with SIMD compares and counted at once.
+ */
+
+#define HISTOGRAM_TABLES 4
+#define HISTOGRAM_BLOCK_SIZE 64
+
+// A table gets at most one count per byte: flush before uint32_t overflows
+#define HISTOGRAM_CHUNK_SIZE ((size_t)1 << 30)
+
+// Under this size, setting up the tables costs more than it saves
+#define HISTOGRAM_MIN_SIZE 1024
+
+static bool is_uniform_block(const uint8_t *block) {
+#if defined(__SSE2__)
+  const __m128i first = _mm_set1_epi8((char)block[0]);
+  __m128i equal = _mm_and_si128(
+      _mm_and_si128(
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)block), first),
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(block + 16)),
+                         first)),
+      _mm_and_si128(
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(block + 32)),
+                         first),
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(block + 48)),
+                         first)));
+  return _mm_movemask_epi8(equal) == 0xFFFF;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t first = vdupq_n_u8(block[0]);
+  uint8x16_t equal =
+      vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(block), first),
+                        vceqq_u8(vld1q_u8(block + 16), first)),
+               vandq_u8(vceqq_u8(vld1q_u8(block + 32), first),
+                        vceqq_u8(vld1q_u8(block + 48), first)));
+  return vminvq_u8(equal) == 0xFF;
+#else
+  const uint64_t first = block[0] * 0x0101010101010101ULL;
+  uint64_t differences = 0;
+  for (size_t i = 0; i < HISTOGRAM_BLOCK_SIZE; i += 8) {
+    uint64_t word;
+    memcpy(&word, block + i, sizeof(word));
+    differences |= word ^ first;
+  }
+  return differences == 0;
+#endif
+}
+
+static void histogram_chunk(const uint8_t *data, size_t size,
+                            uint32_t tables[HISTOGRAM_TABLES][256]) {
+  size_t position = 0;
+  for (; position + HISTOGRAM_BLOCK_SIZE <= size;
+       position += HISTOGRAM_BLOCK_SIZE) {
+    const uint8_t *block = data + position;
+    if (is_uniform_block(block)) {
+      tables[0][block[0]] += HISTOGRAM_BLOCK_SIZE;
+      continue;
+    }
+    for (size_t i = 0; i < HISTOGRAM_BLOCK_SIZE; i += 8) {
+      uint64_t word;
+      memcpy(&word, block + i, sizeof(word));
+      tables[0][word & 0xFF]++;
+      tables[1][(word >> 8) & 0xFF]++;
+      tables[2][(word >> 16) & 0xFF]++;
+      tables[3][(word >> 24) & 0xFF]++;
+      tables[0][(word >> 32) & 0xFF]++;
+      tables[1][(word >> 40) & 0xFF]++;
+      tables[2][(word >> 48) & 0xFF]++;
+      tables[3][word >> 56]++;
+    }
+  }
+  for (; position < size; position++) {
+    tables[0][data[position]]++;
+  }
+}
+
+void byte_histogram_add(const uint8_t *data, size_t size,
+                        uint64_t histogram[256]) {
+  if (size < HISTOGRAM_MIN_SIZE) {
+    for (size_t i = 0; i < size; i++) {
+      histogram[data[i]]++;
+    }
+    return;
+  }
+
+  uint32_t tables[HISTOGRAM_TABLES][256];
+  for (size_t offset = 0; offset < size; offset += HISTOGRAM_CHUNK_SIZE) {
+    size_t chunk_size = size - offset < HISTOGRAM_CHUNK_SIZE
+                            ? size - offset
+                            : HISTOGRAM_CHUNK_SIZE;
+    memset(tables, 0, sizeof(tables));
+    histogram_chunk(data + offset, chunk_size, tables);
+    for (int byte = 0; byte < 256; byte++) {
+      histogram[byte] += (uint64_t)tables[0][byte] + tables[1][byte] +
+                         tables[2][byte] + tables[3][byte];
+    }
+  }
+}
+
+static bool is_printable_byte(int byte) {
+  return (byte >= 0x20 && byte < 0x7F) || byte == '\t' || byte == '\n' ||
+         byte == '\r';
+}
+
+void finalize_byte_stats(struct byte_stats_info *stats) {
+  stats->entropy = 0;
+  stats->printable_ratio = 0;
+  stats->zero_ratio = 0;
+  if (stats->size == 0) {
+    return;
+  }
+
+  uint64_t num_printable = 0;
+  for (int byte = 0; byte < 256; byte++) {
+    uint64_t count = stats->histogram[byte];
+    if (count == 0) {
+      continue;
+    }
+    double probability = (double)count / stats->size;
+    stats->entropy -= probability * log2(probability);
+    if (is_printable_byte(byte)) {
+      num_printable += count;
+    }
+  }
+  stats->printable_ratio = (double)num_printable / stats->size;
+  stats->zero_ratio = (double)stats->histogram[0] / stats->size;
+}
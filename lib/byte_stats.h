@@ -0,0 +1,17 @@
+#ifndef LIBMACHORE_BYTE_STATS_H
+#define LIBMACHORE_BYTE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libmachore.h"
+
+// Adds the number of occurrences of every byte value in `data` to
+// `histogram`.
+void byte_histogram_add(const uint8_t *data, size_t size,
+                        uint64_t histogram[256]);
+
+// Computes entropy and ratios from `stats->histogram` and `stats->size`.
+void finalize_byte_stats(struct byte_stats_info *stats);
+
+#endif
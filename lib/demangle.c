@@ -0,0 +1,425 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "libmachore.h"
+
+/*
+ * Batched demangling with a memo cache.
+ *
+ * Symbol names repeat heavily across slices and binaries, so every mangled
+ * name is demangled once: the cache maps the mangled bytes to the result
+ * (or to NULL on failure) and is split in DEMANGLE_NUM_SHARDS independently
+ * locked hash tables, picked from the top bits of the hash. Misses are
+ * demangled outside the shard lock, each thread reusing its own output
+ * buffer, and only the final result is copied into the cache entry.
+ *
+ * Batches are cut in chunks of DEMANGLE_CHUNK_SIZE names that the worker
+ * threads and the caller claim with an atomic counter.
+ */
+
+#define DEMANGLE_NUM_SHARDS 64
+#define DEMANGLE_SHARD_BITS 6
+#define DEMANGLE_INITIAL_BUCKETS 256
+#define DEMANGLE_CHUNK_SIZE 512
+
+// The platform demangler, from the C++ ABI library
+char *__cxa_demangle(const char *mangled_name, char *output_buffer,
+                     size_t *length, int *status);
+
+struct memo_entry {
+  struct memo_entry *next;
+  uint64_t hash;
+  // NULL when the name failed to demangle, or into `mangled` otherwise
+  const char *demangled;
+  size_t mangled_size;
+  char mangled[];
+};
+
+struct memo_shard {
+  pthread_mutex_t mutex;
+  struct memo_entry **buckets;
+  size_t num_buckets;
+  size_t num_entries;
+  uint64_t num_lookups;
+  uint64_t num_hits;
+  uint64_t num_failures;
+} __attribute__((aligned(64)));
+
+// Output buffer of a thread, grown by the demanglers and reused
+struct demangle_buffer {
+  char *data;
+  size_t capacity;
+};
+
+struct machore_demangler {
+  struct memo_shard shards[DEMANGLE_NUM_SHARDS];
+
+  machore_demangle_hook_t swift_hook;
+  void *swift_context;
+
+  pthread_t *threads;
+  size_t num_threads;
+  struct demangle_buffer caller_buffer;
+
+  // Current batch. Workers wait for a new generation, claim chunks through
+  // `next_name` and the last one to finish wakes the caller up.
+  pthread_mutex_t mutex;
+  pthread_cond_t has_batch;
+  pthread_cond_t is_batch_done;
+  uint64_t generation;
+  size_t num_working;
+  bool is_stopping;
+  const char *const *names;
+  const char **demangled;
+  size_t num_names;
+  size_t next_name;
+};
+
+typedef enum {
+  MANGLING_NONE,
+  MANGLING_ITANIUM,
+  // __Z<encoding>_block_invoke[_<n>], a block in a C++ function
+  MANGLING_ITANIUM_BLOCK,
+  MANGLING_SWIFT,
+} mangling_t;
+
+#define BLOCK_INVOKE_SUFFIX "_block_invoke"
+#define BLOCK_INVOKE_PREFIX "invocation function for block in "
+
+// Names are given without the leading underscore Mach-O adds to C symbols
+static mangling_t get_mangling(const char *name) {
+  if (strncmp(name, "_Z", 2) == 0) {
+    return MANGLING_ITANIUM;
+  }
+  if (strncmp(name, "__Z", 3) == 0 || strncmp(name, "___Z", 4) == 0) {
+    return MANGLING_ITANIUM_BLOCK;
+  }
+  if (strncmp(name, "$s", 2) == 0 || strncmp(name, "$S", 2) == 0 ||
+      strncmp(name, "_T0", 3) == 0) {
+    return MANGLING_SWIFT;
+  }
+  return MANGLING_NONE;
+}
+
+static struct memo_entry *find_entry(const struct memo_shard *shard,
+                                     uint64_t hash, const char *name,
+                                     size_t size) {
+  struct memo_entry *entry = shard->buckets[hash & (shard->num_buckets - 1)];
+  for (; entry != NULL; entry = entry->next) {
+    if (entry->hash == hash && entry->mangled_size == size &&
+        memcmp(entry->mangled, name, size) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void grow_shard(struct memo_shard *shard) {
+  size_t num_buckets = 2 * shard->num_buckets;
+  struct memo_entry **buckets = calloc(num_buckets, sizeof(*buckets));
+  assert(buckets != NULL);
+  for (size_t index = 0; index < shard->num_buckets; index++) {
+    struct memo_entry *entry = shard->buckets[index];
+    while (entry != NULL) {
+      struct memo_entry *next = entry->next;
+      struct memo_entry **bucket = &buckets[entry->hash & (num_buckets - 1)];
+      entry->next = *bucket;
+      *bucket = entry;
+      entry = next;
+    }
+  }
+  free(shard->buckets);
+  shard->buckets = buckets;
+  shard->num_buckets = num_buckets;
+}
+
+// libstdc++ does not know block names: the encoding is demangled alone and
+// printed as libc++abi does. NULL on failure.
+static const char *demangle_block(const char *name,
+                                  struct demangle_buffer *buffer) {
+  const char *encoding = strstr(name, "_Z");
+  // The last suffix, followed by nothing or by _<n>
+  const char *suffix = NULL;
+  for (const char *match = encoding;
+       (match = strstr(match + 1, BLOCK_INVOKE_SUFFIX)) != NULL;) {
+    suffix = match;
+  }
+  if (suffix == NULL) {
+    return NULL;
+  }
+  const char *tail = suffix + strlen(BLOCK_INVOKE_SUFFIX);
+  if (*tail == '_') {
+    tail++;
+    while (*tail >= '0' && *tail <= '9') {
+      tail++;
+    }
+  }
+  if (*tail != '\0') {
+    return NULL;
+  }
+
+  char *mangled = strndup(encoding, suffix - encoding);
+  assert(mangled != NULL);
+  int status;
+  char *function = __cxa_demangle(mangled, NULL, NULL, &status);
+  free(mangled);
+  if (function == NULL) {
+    return NULL;
+  }
+  size_t length = strlen(BLOCK_INVOKE_PREFIX) + strlen(function) + 1;
+  if (length > buffer->capacity) {
+    buffer->data = realloc(buffer->data, length);
+    assert(buffer->data != NULL);
+    buffer->capacity = length;
+  }
+  strcpy(buffer->data, BLOCK_INVOKE_PREFIX);
+  strcat(buffer->data, function);
+  free(function);
+  return buffer->data;
+}
+
+// Demangles into the thread buffer, NULL on failure
+static const char *demangle_name(const struct machore_demangler *demangler,
+                                 const char *name, mangling_t mangling,
+                                 struct demangle_buffer *buffer) {
+  // Demanglers may set `length` to the size of the result rather than to the
+  // size of the buffer, which is always at least as large
+  size_t length = buffer->capacity;
+  char *result = NULL;
+  if (mangling == MANGLING_ITANIUM) {
+    int status;
+    result = __cxa_demangle(name, buffer->data, &length, &status);
+  } else if (mangling == MANGLING_ITANIUM_BLOCK) {
+    return demangle_block(name, buffer);
+  } else if (demangler->swift_hook != NULL) {
+    result = demangler->swift_hook(name, buffer->data, &length,
+                                   demangler->swift_context);
+  }
+  if (result == NULL) {
+    return NULL;
+  }
+  if (result != buffer->data || length > buffer->capacity) {
+    buffer->data = result;
+    buffer->capacity = length;
+  }
+  return result;
+}
+
+static const char *lookup_name(struct machore_demangler *demangler,
+                               const char *symbol_name,
+                               struct demangle_buffer *buffer) {
+  const char *name = symbol_name[0] == '_' ? symbol_name + 1 : symbol_name;
+  mangling_t mangling = get_mangling(name);
+  if (mangling == MANGLING_NONE ||
+      (mangling == MANGLING_SWIFT && demangler->swift_hook == NULL)) {
+    return NULL;
+  }
+
+  size_t size = strlen(name);
+  uint64_t hash = hash_bytes(name, size);
+  struct memo_shard *shard =
+      &demangler->shards[hash >> (64 - DEMANGLE_SHARD_BITS)];
+  pthread_mutex_lock(&shard->mutex);
+  shard->num_lookups++;
+  struct memo_entry *entry = find_entry(shard, hash, name, size);
+  if (entry != NULL) {
+    shard->num_hits++;
+    pthread_mutex_unlock(&shard->mutex);
+    return entry->demangled;
+  }
+  pthread_mutex_unlock(&shard->mutex);
+
+  const char *result = demangle_name(demangler, name, mangling, buffer);
+  size_t result_size = result != NULL ? strlen(result) + 1 : 0;
+  entry = malloc(sizeof(*entry) + size + 1 + result_size);
+  assert(entry != NULL);
+  entry->hash = hash;
+  entry->mangled_size = size;
+  memcpy(entry->mangled, name, size + 1);
+  entry->demangled = NULL;
+  if (result != NULL) {
+    memcpy(entry->mangled + size + 1, result, result_size);
+    entry->demangled = entry->mangled + size + 1;
+  }
+
+  // Another thread may have demangled the same name in the meantime
+  pthread_mutex_lock(&shard->mutex);
+  struct memo_entry *existing = find_entry(shard, hash, name, size);
+  if (existing != NULL) {
+    pthread_mutex_unlock(&shard->mutex);
+    free(entry);
+    return existing->demangled;
+  }
+  if (shard->num_entries >= shard->num_buckets) {
+    grow_shard(shard);
+  }
+  struct memo_entry **bucket =
+      &shard->buckets[hash & (shard->num_buckets - 1)];
+  entry->next = *bucket;
+  *bucket = entry;
+  shard->num_entries++;
+  shard->num_failures += result == NULL;
+  pthread_mutex_unlock(&shard->mutex);
+  return entry->demangled;
+}
+
+static void demangle_chunks(struct machore_demangler *demangler,
+                            struct demangle_buffer *buffer) {
+  for (;;) {
+    size_t first = __atomic_fetch_add(&demangler->next_name,
+                                      DEMANGLE_CHUNK_SIZE, __ATOMIC_RELAXED);
+    if (first >= demangler->num_names) {
+      return;
+    }
+    size_t end = first + DEMANGLE_CHUNK_SIZE < demangler->num_names
+                     ? first + DEMANGLE_CHUNK_SIZE
+                     : demangler->num_names;
+    for (size_t index = first; index < end; index++) {
+      demangler->demangled[index] =
+          lookup_name(demangler, demangler->names[index], buffer);
+    }
+  }
+}
+
+static void *run_worker(void *argument) {
+  struct machore_demangler *demangler = argument;
+  struct demangle_buffer buffer = {NULL, 0};
+  uint64_t generation = 0;
+  pthread_mutex_lock(&demangler->mutex);
+  for (;;) {
+    while (!demangler->is_stopping && demangler->generation == generation) {
+      pthread_cond_wait(&demangler->has_batch, &demangler->mutex);
+    }
+    if (demangler->is_stopping) {
+      break;
+    }
+    generation = demangler->generation;
+    pthread_mutex_unlock(&demangler->mutex);
+
+    demangle_chunks(demangler, &buffer);
+
+    pthread_mutex_lock(&demangler->mutex);
+    if (--demangler->num_working == 0) {
+      pthread_cond_signal(&demangler->is_batch_done);
+    }
+  }
+  pthread_mutex_unlock(&demangler->mutex);
+  free(buffer.data);
+  return NULL;
+}
+
+struct machore_demangler *machore_demangler_create(size_t num_threads) {
+  if (num_threads == 0) {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = num_cpus > 0 ? (size_t)num_cpus : 1;
+  }
+  // Shards are cache line aligned so that they never share a line
+  struct machore_demangler *demangler =
+      aligned_alloc(_Alignof(struct machore_demangler), sizeof(*demangler));
+  assert(demangler != NULL);
+  memset(demangler, 0, sizeof(*demangler));
+  for (size_t index = 0; index < DEMANGLE_NUM_SHARDS; index++) {
+    struct memo_shard *shard = &demangler->shards[index];
+    pthread_mutex_init(&shard->mutex, NULL);
+    shard->num_buckets = DEMANGLE_INITIAL_BUCKETS;
+    shard->buckets = calloc(shard->num_buckets, sizeof(*shard->buckets));
+    assert(shard->buckets != NULL);
+  }
+  pthread_mutex_init(&demangler->mutex, NULL);
+  pthread_cond_init(&demangler->has_batch, NULL);
+  pthread_cond_init(&demangler->is_batch_done, NULL);
+
+  // The caller works on its batches too
+  demangler->threads = calloc(num_threads, sizeof(pthread_t));
+  assert(demangler->threads != NULL);
+  for (size_t index = 0; index + 1 < num_threads; index++) {
+    if (pthread_create(&demangler->threads[demangler->num_threads], NULL,
+                       run_worker, demangler) == 0) {
+      demangler->num_threads++;
+    }
+  }
+  return demangler;
+}
+
+void machore_demangler_destroy(struct machore_demangler *demangler) {
+  pthread_mutex_lock(&demangler->mutex);
+  demangler->is_stopping = true;
+  pthread_cond_broadcast(&demangler->has_batch);
+  pthread_mutex_unlock(&demangler->mutex);
+  for (size_t index = 0; index < demangler->num_threads; index++) {
+    pthread_join(demangler->threads[index], NULL);
+  }
+  free(demangler->threads);
+  free(demangler->caller_buffer.data);
+
+  for (size_t index = 0; index < DEMANGLE_NUM_SHARDS; index++) {
+    struct memo_shard *shard = &demangler->shards[index];
+    for (size_t bucket = 0; bucket < shard->num_buckets; bucket++) {
+      struct memo_entry *entry = shard->buckets[bucket];
+      while (entry != NULL) {
+        struct memo_entry *next = entry->next;
+        free(entry);
+        entry = next;
+      }
+    }
+    free(shard->buckets);
+    pthread_mutex_destroy(&shard->mutex);
+  }
+  pthread_mutex_destroy(&demangler->mutex);
+  pthread_cond_destroy(&demangler->has_batch);
+  pthread_cond_destroy(&demangler->is_batch_done);
+  free(demangler);
+}
+
+void machore_demangler_set_swift(struct machore_demangler *demangler,
+                                 machore_demangle_hook_t hook, void *context) {
+  demangler->swift_hook = hook;
+  demangler->swift_context = context;
+}
+
+void machore_demangle_batch(struct machore_demangler *demangler,
+                            const char *const *names, size_t num_names,
+                            const char **demangled) {
+  demangler->names = names;
+  demangler->demangled = demangled;
+  demangler->num_names = num_names;
+  demangler->next_name = 0;
+
+  // Small batches are not worth waking the workers up
+  if (demangler->num_threads == 0 || num_names <= DEMANGLE_CHUNK_SIZE) {
+    demangle_chunks(demangler, &demangler->caller_buffer);
+    return;
+  }
+
+  pthread_mutex_lock(&demangler->mutex);
+  demangler->num_working = demangler->num_threads;
+  demangler->generation++;
+  pthread_cond_broadcast(&demangler->has_batch);
+  pthread_mutex_unlock(&demangler->mutex);
+
+  demangle_chunks(demangler, &demangler->caller_buffer);
+
+  pthread_mutex_lock(&demangler->mutex);
+  while (demangler->num_working > 0) {
+    pthread_cond_wait(&demangler->is_batch_done, &demangler->mutex);
+  }
+  pthread_mutex_unlock(&demangler->mutex);
+}
+
+void machore_demangler_stats(struct machore_demangler *demangler,
+                             struct demangle_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (size_t index = 0; index < DEMANGLE_NUM_SHARDS; index++) {
+    struct memo_shard *shard = &demangler->shards[index];
+    pthread_mutex_lock(&shard->mutex);
+    stats->num_lookups += shard->num_lookups;
+    stats->num_hits += shard->num_hits;
+    stats->num_entries += shard->num_entries;
+    stats->num_failures += shard->num_failures;
+    pthread_mutex_unlock(&shard->mutex);
+  }
+}
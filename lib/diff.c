@@ -0,0 +1,471 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "libmachore.h"
+
+/*
+ * Slice diff.
+ *
+ * Every set (dylibs, exports, symbols, strings) is turned into an array of
+ * 16 bytes keys holding the hash of each name, sorted once with a radix sort,
+ * then both sides are merged linearly. Names are only read back on equal
+ * hashes and for the differences, so memory stays proportional to the sets
+ * and the sort and merge stream through memory.
+ *
+ * Hashes only order the sets: names with the same hash are compared byte for
+ * byte, so a collision, accidental or crafted in an untrusted binary, costs a
+ * memcmp() and never hides a difference.
+ */
+
+// Under that many keys, qsort() beats the radix passes
+#define RADIX_SORT_MIN_KEYS 4096
+
+// Only the top bits of the hashes are radix sorted, in passes small enough
+// for the bucket heads to stay in cache. Runs of equal top bits are rare and
+// finished with qsort().
+#define RADIX_DIGIT_BITS 11
+#define RADIX_NUM_PASSES 3
+#define RADIX_SORTED_BITS (RADIX_DIGIT_BITS * RADIX_NUM_PASSES)
+
+// Strings of paged outputs read per machore_get_strings() call
+#define DIFF_STRING_BATCH_SIZE 256
+
+struct diff_name {
+  const char *name;
+  size_t name_size;
+  // Compared when names match (dylib version, symbol type), may be NULL
+  const char *value;
+};
+
+struct diff_key {
+  uint64_t hash;
+  // Into the names of the set, in insertion order
+  const struct diff_name *name;
+};
+
+struct diff_set {
+  struct diff_key *keys;
+  struct diff_name *names;
+  size_t num_keys;
+};
+
+static void diff_set_init(struct diff_set *set, size_t capacity) {
+  capacity = capacity ? capacity : 1;
+  set->keys = malloc(capacity * sizeof(struct diff_key));
+  set->names = malloc(capacity * sizeof(struct diff_name));
+  assert(set->keys != NULL && set->names != NULL);
+  set->num_keys = 0;
+}
+
+static void diff_set_add(struct diff_set *set, const char *name,
+                         size_t name_size, const char *value) {
+  size_t index = set->num_keys++;
+  struct diff_name *diff_name = &set->names[index];
+  diff_name->name = name;
+  diff_name->name_size = name_size;
+  diff_name->value = value;
+  set->keys[index].hash = hash_bytes(name, name_size);
+  set->keys[index].name = diff_name;
+}
+
+// Orders keys by hash, then by name on hash collisions
+static int compare_key_names(const struct diff_key *key_a,
+                             const struct diff_key *key_b) {
+  if (key_a->hash != key_b->hash) {
+    return key_a->hash < key_b->hash ? -1 : 1;
+  }
+  const struct diff_name *name_a = key_a->name;
+  const struct diff_name *name_b = key_b->name;
+  size_t size = name_a->name_size < name_b->name_size ? name_a->name_size
+                                                      : name_b->name_size;
+  int result = memcmp(name_a->name, name_b->name, size);
+  if (result != 0) {
+    return result;
+  }
+  return name_a->name_size < name_b->name_size
+             ? -1
+             : name_a->name_size > name_b->name_size;
+}
+
+static int compare_keys(const void *a, const void *b) {
+  const struct diff_key *key_a = a;
+  const struct diff_key *key_b = b;
+  int result = compare_key_names(key_a, key_b);
+  if (result != 0) {
+    return result;
+  }
+  // Keep the first of duplicated names
+  return key_a->name < key_b->name ? -1 : key_a->name > key_b->name;
+}
+
+// Sorts by the top RADIX_SORTED_BITS of the hashes, returns the sorted keys
+// and frees the other array.
+static struct diff_key *radix_sort_keys(struct diff_key *keys,
+                                        size_t num_keys) {
+  const uint64_t digit_mask = (1ULL << RADIX_DIGIT_BITS) - 1;
+  struct diff_key *buffer = malloc(num_keys * sizeof(struct diff_key));
+  size_t(*counts)[1 << RADIX_DIGIT_BITS] =
+      calloc(RADIX_NUM_PASSES, sizeof(*counts));
+  assert(buffer != NULL && counts != NULL);
+
+  // Counts every digit in a single pass, then turns counts into offsets
+  for (size_t i = 0; i < num_keys; i++) {
+    uint64_t top_bits = keys[i].hash >> (64 - RADIX_SORTED_BITS);
+    for (int pass = 0; pass < RADIX_NUM_PASSES; pass++) {
+      counts[pass][(top_bits >> (pass * RADIX_DIGIT_BITS)) & digit_mask]++;
+    }
+  }
+  for (int pass = 0; pass < RADIX_NUM_PASSES; pass++) {
+    size_t total = 0;
+    for (size_t digit = 0; digit <= digit_mask; digit++) {
+      size_t count = counts[pass][digit];
+      counts[pass][digit] = total;
+      total += count;
+    }
+  }
+
+  struct diff_key *source = keys;
+  struct diff_key *destination = buffer;
+  for (int pass = 0; pass < RADIX_NUM_PASSES; pass++) {
+    unsigned shift = 64 - RADIX_SORTED_BITS + pass * RADIX_DIGIT_BITS;
+    for (size_t i = 0; i < num_keys; i++) {
+      destination[counts[pass][(source[i].hash >> shift) & digit_mask]++] =
+          source[i];
+    }
+    struct diff_key *swap = source;
+    source = destination;
+    destination = swap;
+  }
+
+  free(counts);
+  free(destination);
+  return source;
+}
+
+// Sorts by hash and name, and drops duplicated names
+static void diff_set_sort(struct diff_set *set) {
+  if (set->num_keys < RADIX_SORT_MIN_KEYS) {
+    qsort(set->keys, set->num_keys, sizeof(struct diff_key), compare_keys);
+  } else {
+    set->keys = radix_sort_keys(set->keys, set->num_keys);
+    const unsigned unsorted_bits = 64 - RADIX_SORTED_BITS;
+    for (size_t start = 0; start < set->num_keys;) {
+      size_t end = start + 1;
+      while (end < set->num_keys &&
+             set->keys[end].hash >> unsorted_bits ==
+                 set->keys[start].hash >> unsorted_bits) {
+        end++;
+      }
+      if (end - start > 1) {
+        qsort(set->keys + start, end - start, sizeof(struct diff_key),
+              compare_keys);
+      }
+      start = end;
+    }
+  }
+
+  size_t num_unique = 0;
+  for (size_t i = 0; i < set->num_keys; i++) {
+    if (num_unique == 0 ||
+        compare_key_names(&set->keys[num_unique - 1], &set->keys[i]) != 0) {
+      set->keys[num_unique++] = set->keys[i];
+    }
+  }
+  set->num_keys = num_unique;
+}
+
+static void diff_set_free(struct diff_set *set) {
+  free(set->keys);
+  free(set->names);
+  set->keys = NULL;
+  set->names = NULL;
+  set->num_keys = 0;
+}
+
+static void append_diff_entry(struct machore_diff_t *diff, size_t *capacity,
+                              diff_kind_t kind, diff_change_t change,
+                              const char *name, size_t name_size,
+                              const char *old_value, const char *new_value) {
+  if (diff->num_entries == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    diff->entries =
+        realloc(diff->entries, *capacity * sizeof(struct diff_entry));
+    assert(diff->entries != NULL);
+  }
+  struct diff_entry *entry = &diff->entries[diff->num_entries++];
+  entry->kind = kind;
+  entry->change = change;
+  entry->name = name;
+  entry->name_size = name_size;
+  entry->old_value = old_value;
+  entry->new_value = new_value;
+}
+
+static void append_diff_name(struct machore_diff_t *diff, size_t *capacity,
+                             diff_kind_t kind, diff_change_t change,
+                             const struct diff_key *key) {
+  append_diff_entry(diff, capacity, kind, change, key->name->name,
+                    key->name->name_size, NULL, NULL);
+}
+
+static void merge_diff_sets(struct machore_diff_t *diff, size_t *capacity,
+                            diff_kind_t kind, struct diff_set *old_set,
+                            struct diff_set *new_set) {
+  diff_set_sort(old_set);
+  diff_set_sort(new_set);
+
+  size_t i = 0;
+  size_t j = 0;
+  while (i < old_set->num_keys && j < new_set->num_keys) {
+    const struct diff_key *old_key = &old_set->keys[i];
+    const struct diff_key *new_key = &new_set->keys[j];
+    int order = compare_key_names(old_key, new_key);
+    if (order < 0) {
+      append_diff_name(diff, capacity, kind, LIBMACHORE_DIFF_REMOVED, old_key);
+      i++;
+    } else if (order > 0) {
+      append_diff_name(diff, capacity, kind, LIBMACHORE_DIFF_ADDED, new_key);
+      j++;
+    } else {
+      const struct diff_name *old_name = old_key->name;
+      const struct diff_name *new_name = new_key->name;
+      if (old_name->value != NULL && new_name->value != NULL &&
+          strcmp(old_name->value, new_name->value) != 0) {
+        append_diff_entry(diff, capacity, kind, LIBMACHORE_DIFF_CHANGED,
+                          old_name->name, old_name->name_size,
+                          old_name->value, new_name->value);
+      }
+      i++;
+      j++;
+    }
+  }
+  for (; i < old_set->num_keys; i++) {
+    append_diff_name(diff, capacity, kind, LIBMACHORE_DIFF_REMOVED,
+                     &old_set->keys[i]);
+  }
+  for (; j < new_set->num_keys; j++) {
+    append_diff_name(diff, capacity, kind, LIBMACHORE_DIFF_ADDED,
+                     &new_set->keys[j]);
+  }
+
+  diff_set_free(old_set);
+  diff_set_free(new_set);
+}
+
+static void collect_dylibs(struct diff_set *set,
+                           const struct machore_arch_output_t *arch_output) {
+  diff_set_init(set, arch_output->num_dylibs);
+  for (size_t index = 0; index < arch_output->num_dylibs; index++) {
+    const struct dylib_info *dylib_info = &arch_output->dylibs[index];
+    diff_set_add(set, dylib_info->path, strlen(dylib_info->path),
+                 dylib_info->version);
+  }
+}
+
+// Paged outputs have no `symbols`: they are decoded into `*symbols`, which
+// hold the types the changes point to.
+static void collect_symbols(struct diff_set *set, struct symbol_info **symbols,
+                            struct machore_arch_output_t *arch_output) {
+  const struct symbol_info *symbol_infos = arch_output->symbols;
+  size_t num_symbols = arch_output->num_symbols;
+  if (machore_is_paged(arch_output)) {
+    num_symbols = machore_count_symbols(arch_output);
+    *symbols = malloc((num_symbols ? num_symbols : 1) *
+                      sizeof(struct symbol_info));
+    assert(*symbols != NULL);
+    machore_get_symbols(arch_output, 0, *symbols, num_symbols);
+    symbol_infos = *symbols;
+  }
+
+  diff_set_init(set, num_symbols);
+  for (size_t index = 0; index < num_symbols; index++) {
+    const struct symbol_info *symbol_info = &symbol_infos[index];
+    diff_set_add(set, symbol_info->name, strlen(symbol_info->name),
+                 symbol_info->type);
+  }
+}
+
+static void add_string(struct diff_set *set,
+                       const struct string_info *string_info) {
+  size_t size = string_info->size;
+  if (size > 0 && string_info->content[size - 1] == '\0') {
+    size--;
+  }
+  diff_set_add(set, string_info->content, size, NULL);
+}
+
+// Strings of paged outputs are views into the parsed buffer: only the
+// batches are temporary
+static void collect_strings(struct diff_set *set,
+                            struct machore_arch_output_t *arch_output) {
+  if (!machore_is_paged(arch_output)) {
+    diff_set_init(set, arch_output->num_strings);
+    for (size_t index = 0; index < arch_output->num_strings; index++) {
+      add_string(set, &arch_output->strings[index]);
+    }
+    return;
+  }
+
+  diff_set_init(set, machore_count_strings(arch_output));
+  struct string_info strings[DIFF_STRING_BATCH_SIZE];
+  size_t first = 0;
+  size_t num_strings;
+  while ((num_strings = machore_get_strings(arch_output, first, strings,
+                                            DIFF_STRING_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < num_strings; i++) {
+      add_string(set, &strings[i]);
+    }
+    first += num_strings;
+  }
+}
+
+static bool count_export_names(const struct export_info *export_info,
+                               void *context) {
+  size_t *names_size = context;
+  *names_size += export_info->name_size + 1;
+  return true;
+}
+
+struct export_collector {
+  struct diff_set *set;
+  char *names;
+  size_t names_size;
+};
+
+static bool collect_export(const struct export_info *export_info,
+                           void *context) {
+  struct export_collector *collector = context;
+  char *name = collector->names + collector->names_size;
+  memcpy(name, export_info->name, export_info->name_size + 1);
+  collector->names_size += export_info->name_size + 1;
+  diff_set_add(collector->set, name, export_info->name_size, NULL);
+  return true;
+}
+
+// Export names live in a buffer reused during the walk: they are copied
+// into `*names`, sized by a first walk.
+static void collect_exports(struct diff_set *set, char **names,
+                            const struct machore_arch_output_t *arch_output) {
+  size_t names_size = 0;
+  size_t num_exports =
+      machore_walk_exports(arch_output->export_trie,
+                           arch_output->export_trie_size, count_export_names,
+                           &names_size);
+  diff_set_init(set, num_exports);
+  *names = malloc(names_size ? names_size : 1);
+  assert(*names != NULL);
+
+  struct export_collector collector = {set, *names, 0};
+  machore_walk_exports(arch_output->export_trie,
+                       arch_output->export_trie_size, collect_export,
+                       &collector);
+}
+
+static void diff_flag(struct machore_diff_t *diff, size_t *capacity,
+                      const char *name, bool old_value, bool new_value) {
+  if (old_value != new_value) {
+    append_diff_entry(diff, capacity, LIBMACHORE_DIFF_FLAG,
+                      LIBMACHORE_DIFF_CHANGED, name, strlen(name),
+                      old_value ? "true" : "false",
+                      new_value ? "true" : "false");
+  }
+}
+
+static void diff_flags(struct machore_diff_t *diff, size_t *capacity,
+                       const struct machore_arch_output_t *old_arch,
+                       const struct machore_arch_output_t *new_arch) {
+  diff_flag(diff, capacity, "no_undefined_refs", old_arch->no_undefined_refs,
+            new_arch->no_undefined_refs);
+  diff_flag(diff, capacity, "dyld_compatible", old_arch->dyld_compatible,
+            new_arch->dyld_compatible);
+  diff_flag(diff, capacity, "defines_weak_symbols",
+            old_arch->defines_weak_symbols, new_arch->defines_weak_symbols);
+  diff_flag(diff, capacity, "uses_weak_symbols", old_arch->uses_weak_symbols,
+            new_arch->uses_weak_symbols);
+  diff_flag(diff, capacity, "allows_stack_execution",
+            old_arch->allows_stack_execution,
+            new_arch->allows_stack_execution);
+  diff_flag(diff, capacity, "enforce_no_heap_exec",
+            old_arch->enforce_no_heap_exec, new_arch->enforce_no_heap_exec);
+
+  // Unsigned slices have no security flags: compare them as all false
+  const struct security_flags no_security_flags = {0};
+  const struct security_flags *old_flags = old_arch->security_flags != NULL
+                                               ? old_arch->security_flags
+                                               : &no_security_flags;
+  const struct security_flags *new_flags = new_arch->security_flags != NULL
+                                               ? new_arch->security_flags
+                                               : &no_security_flags;
+  diff_flag(diff, capacity, "is_signed", old_flags->is_signed,
+            new_flags->is_signed);
+  diff_flag(diff, capacity, "is_library_validation_disabled",
+            old_flags->is_library_validation_disabled,
+            new_flags->is_library_validation_disabled);
+  diff_flag(diff, capacity, "is_dylib_env_var_allowed",
+            old_flags->is_dylib_env_var_allowed,
+            new_flags->is_dylib_env_var_allowed);
+  diff_flag(diff, capacity, "has_hardened_runtime",
+            old_flags->has_hardened_runtime, new_flags->has_hardened_runtime);
+}
+
+static int compare_diff_entries(const void *a, const void *b) {
+  const struct diff_entry *entry_a = a;
+  const struct diff_entry *entry_b = b;
+  if (entry_a->kind != entry_b->kind) {
+    return entry_a->kind < entry_b->kind ? -1 : 1;
+  }
+  size_t size = entry_a->name_size < entry_b->name_size ? entry_a->name_size
+                                                        : entry_b->name_size;
+  int result = memcmp(entry_a->name, entry_b->name, size);
+  if (result != 0) {
+    return result;
+  }
+  return entry_a->name_size < entry_b->name_size
+             ? -1
+             : entry_a->name_size > entry_b->name_size;
+}
+
+void machore_diff_arch(struct machore_diff_t *diff,
+                       struct machore_arch_output_t *old_arch,
+                       struct machore_arch_output_t *new_arch) {
+  memset(diff, 0, sizeof(struct machore_diff_t));
+  size_t capacity = 0;
+  struct diff_set old_set;
+  struct diff_set new_set;
+
+  diff_flags(diff, &capacity, old_arch, new_arch);
+
+  collect_dylibs(&old_set, old_arch);
+  collect_dylibs(&new_set, new_arch);
+  merge_diff_sets(diff, &capacity, LIBMACHORE_DIFF_DYLIB, &old_set, &new_set);
+
+  collect_exports(&old_set, &diff->export_names[0], old_arch);
+  collect_exports(&new_set, &diff->export_names[1], new_arch);
+  merge_diff_sets(diff, &capacity, LIBMACHORE_DIFF_EXPORT, &old_set,
+                  &new_set);
+
+  collect_symbols(&old_set, &diff->symbols[0], old_arch);
+  collect_symbols(&new_set, &diff->symbols[1], new_arch);
+  merge_diff_sets(diff, &capacity, LIBMACHORE_DIFF_SYMBOL, &old_set,
+                  &new_set);
+
+  collect_strings(&old_set, old_arch);
+  collect_strings(&new_set, new_arch);
+  merge_diff_sets(diff, &capacity, LIBMACHORE_DIFF_STRING, &old_set,
+                  &new_set);
+
+  // Merges produce hash order: only the differences are sorted by name
+  qsort(diff->entries, diff->num_entries, sizeof(struct diff_entry),
+        compare_diff_entries);
+}
+
+void machore_clean_diff(struct machore_diff_t *diff) {
+  free(diff->entries);
+  free(diff->export_names[0]);
+  free(diff->export_names[1]);
+  free(diff->symbols[0]);
+  free(diff->symbols[1]);
+  memset(diff, 0, sizeof(struct machore_diff_t));
+}
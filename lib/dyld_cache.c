@@ -0,0 +1,747 @@
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dyld_cache_shim.h"
+#include "libmachore.h"
+
+/*
+ * dyld shared caches.
+ *
+ * The cache file and its subcaches are mapped whole. Each file starts with
+ * a dyld_cache_header whose mappings tell which addresses of the shared
+ * region its bytes are loaded at; the image table of the main file gives
+ * the address of every mach header.
+ *
+ * The load commands of an image hold file offsets relative to the cache
+ * file each of its segments is in, and __LINKEDIT is shared by all the
+ * images of a cache, possibly in another subcache. An image is parsed from
+ * a view laid out like a standalone binary:
+ *
+ *   __TEXT (mach header) | other segments | used part of __LINKEDIT
+ *
+ * where every segment is an mmap of its cache file pages, and where the
+ * offsets of a private copy of the load commands are translated into
+ * offsets in the view. parse_macho() then reads the image as it reads any
+ * slice, without copying its contents.
+ */
+
+#define MAX_IMAGE_SEGMENTS 16
+#define NO_SEGMENT SIZE_MAX
+
+_Static_assert(offsetof(dyld_cache_header_shim, subCacheArrayOffset) == 392,
+               "dyld_cache_header_shim layout");
+_Static_assert(offsetof(dyld_cache_header_shim, imagesOffset) == 448,
+               "dyld_cache_header_shim layout");
+
+struct cache_file {
+  int fd;
+  uint8_t *data;
+  size_t size;
+};
+
+// Addresses [address, address + size) are the bytes at `file_offset`
+struct cache_mapping {
+  uint64_t address;
+  uint64_t size;
+  uint64_t file_offset;
+  size_t file_index;
+};
+
+// Memory an image is parsed from, `buffer` being its mach header
+struct image_view {
+  uint8_t *mapping;
+  size_t mapping_size;
+  uint8_t *buffer;
+  size_t size;
+};
+
+struct machore_dyld_cache {
+  struct cache_file *files;
+  size_t num_files;
+  struct cache_mapping *mappings;
+  size_t num_mappings;
+  const dyld_cache_image_info_shim *images;
+  size_t num_images;
+  // Built on first parse, kept until the cache is closed
+  struct image_view *views;
+  size_t page_size;
+};
+
+static bool read_mappings(struct machore_dyld_cache *cache,
+                          size_t file_index) {
+  const struct cache_file *file = &cache->files[file_index];
+  const dyld_cache_header_shim *header =
+      (const dyld_cache_header_shim *)file->data;
+  if (memcmp(header->magic, DYLD_CACHE_MAGIC_PREFIX,
+             strlen(DYLD_CACHE_MAGIC_PREFIX)) != 0 ||
+      header->mappingOffset < offsetof(dyld_cache_header_shim, unused1) ||
+      header->mappingOffset > file->size ||
+      header->mappingCount > (file->size - header->mappingOffset) /
+                                 sizeof(dyld_cache_mapping_info_shim)) {
+    return false;
+  }
+
+  const dyld_cache_mapping_info_shim *infos =
+      (const dyld_cache_mapping_info_shim *)(file->data +
+                                             header->mappingOffset);
+  cache->mappings =
+      realloc(cache->mappings, (cache->num_mappings + header->mappingCount) *
+                                   sizeof(struct cache_mapping));
+  assert(cache->mappings != NULL || header->mappingCount == 0);
+  for (uint32_t index = 0; index < header->mappingCount; index++) {
+    if (infos[index].fileOffset > file->size ||
+        infos[index].size > file->size - infos[index].fileOffset) {
+      return false;
+    }
+    struct cache_mapping *mapping = &cache->mappings[cache->num_mappings++];
+    mapping->address = infos[index].address;
+    mapping->size = infos[index].size;
+    mapping->file_offset = infos[index].fileOffset;
+    mapping->file_index = file_index;
+  }
+  return true;
+}
+
+static bool add_file(struct machore_dyld_cache *cache, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < offsetof(dyld_cache_header_shim, unused1)) {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  // The descriptor stays open for the image views
+  cache->files = realloc(cache->files,
+                         (cache->num_files + 1) * sizeof(struct cache_file));
+  assert(cache->files != NULL);
+  struct cache_file *file = &cache->files[cache->num_files++];
+  file->fd = fd;
+  file->data = data;
+  file->size = st.st_size;
+  return read_mappings(cache, cache->num_files - 1);
+}
+
+// Header fields are only there when the header is long enough
+#define HAS_HEADER_FIELD(header, field)                                        \
+  ((header)->mappingOffset >= offsetof(dyld_cache_header_shim, field) +        \
+                                  sizeof((header)->field))
+
+static bool add_subcaches(struct machore_dyld_cache *cache, const char *path) {
+  const struct cache_file *main_file = &cache->files[0];
+  const dyld_cache_header_shim *header =
+      (const dyld_cache_header_shim *)main_file->data;
+  if (!HAS_HEADER_FIELD(header, subCacheArrayCount) ||
+      header->subCacheArrayCount == 0) {
+    return true;
+  }
+
+  // Entries gained their file suffix along with cacheSubType
+  const bool has_suffix = HAS_HEADER_FIELD(header, cacheSubType);
+  const size_t entry_size = has_suffix ? sizeof(dyld_subcache_entry_shim)
+                                       : sizeof(dyld_subcache_entry_v1_shim);
+  const uint32_t num_subcaches = header->subCacheArrayCount;
+  const uint32_t entries_offset = header->subCacheArrayOffset;
+  if (entries_offset > main_file->size ||
+      num_subcaches > (main_file->size - entries_offset) / entry_size) {
+    return false;
+  }
+
+  size_t path_size = strlen(path) + 40;
+  char *subcache_path = malloc(path_size);
+  assert(subcache_path != NULL);
+  bool is_valid = true;
+  for (uint32_t index = 0; index < num_subcaches && is_valid; index++) {
+    // cache->files moves as subcaches are added
+    const uint8_t *entry =
+        cache->files[0].data + entries_offset + index * entry_size;
+    if (has_suffix) {
+      const dyld_subcache_entry_shim *subcache =
+          (const dyld_subcache_entry_shim *)entry;
+      snprintf(subcache_path, path_size, "%s%.*s", path,
+               (int)sizeof(subcache->fileSuffix), subcache->fileSuffix);
+    } else {
+      snprintf(subcache_path, path_size, "%s.%u", path, index + 1);
+    }
+    is_valid = add_file(cache, subcache_path);
+  }
+  free(subcache_path);
+  return is_valid;
+}
+
+static bool read_images(struct machore_dyld_cache *cache) {
+  const struct cache_file *main_file = &cache->files[0];
+  const dyld_cache_header_shim *header =
+      (const dyld_cache_header_shim *)main_file->data;
+  uint32_t images_offset = header->imagesOffsetOld;
+  uint32_t num_images = header->imagesCountOld;
+  if (HAS_HEADER_FIELD(header, imagesCount) && header->imagesOffset != 0) {
+    images_offset = header->imagesOffset;
+    num_images = header->imagesCount;
+  }
+  if (images_offset > main_file->size ||
+      num_images > (main_file->size - images_offset) /
+                       sizeof(dyld_cache_image_info_shim)) {
+    return false;
+  }
+  cache->images =
+      (const dyld_cache_image_info_shim *)(main_file->data + images_offset);
+  cache->num_images = num_images;
+  return true;
+}
+
+// The mapping holding all of [address, address + size), NULL if none does
+static const struct cache_mapping *
+find_mapping(const struct machore_dyld_cache *cache, uint64_t address,
+             uint64_t size) {
+  for (size_t index = 0; index < cache->num_mappings; index++) {
+    const struct cache_mapping *mapping = &cache->mappings[index];
+    if (address >= mapping->address &&
+        address - mapping->address <= mapping->size &&
+        size <= mapping->size - (address - mapping->address)) {
+      return mapping;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Image views. Segments are recorded from a private copy of the load
+ * commands, placed in the view, then the copy is rewritten with the view
+ * offsets and written over the mapped load commands (a private mapping: the
+ * page is copied on write).
+ */
+
+struct view_segment {
+  // Range mapped into the view, in the image address and offset spaces
+  uint64_t vmaddr;
+  uint64_t fileoff;
+  uint64_t size;
+  const struct cache_mapping *mapping;
+  uint64_t view_offset;
+};
+
+struct view_layout {
+  struct view_segment segments[MAX_IMAGE_SEGMENTS];
+  size_t num_segments;
+  size_t text;
+  size_t linkedit;
+  // Part of __LINKEDIT the load commands point to
+  uint64_t linkedit_start;
+  uint64_t linkedit_end;
+};
+
+static bool is_linkedit_range(const struct view_layout *layout,
+                              uint64_t offset, uint64_t size) {
+  if (layout->linkedit == NO_SEGMENT) {
+    return false;
+  }
+  const struct view_segment *linkedit = &layout->segments[layout->linkedit];
+  return offset >= linkedit->fileoff &&
+         offset - linkedit->fileoff <= linkedit->size &&
+         size <= linkedit->size - (offset - linkedit->fileoff);
+}
+
+// Called on every (offset, count) pair of the load commands pointing into
+// __LINKEDIT, `count` being a number of `element_size` entries
+typedef void (*linkedit_field_visitor_t)(struct view_layout *layout,
+                                         uint32_t *offset, uint32_t *count,
+                                         uint32_t element_size);
+
+static void measure_linkedit_field(struct view_layout *layout,
+                                   uint32_t *offset, uint32_t *count,
+                                   uint32_t element_size) {
+  uint64_t size = (uint64_t)*count * element_size;
+  if (size == 0 || !is_linkedit_range(layout, *offset, size)) {
+    return;
+  }
+  if (layout->linkedit_start > *offset) {
+    layout->linkedit_start = *offset;
+  }
+  if (layout->linkedit_end < *offset + size) {
+    layout->linkedit_end = *offset + size;
+  }
+}
+
+// Fields outside of the mapped part of __LINKEDIT are cleared
+static void translate_linkedit_field(struct view_layout *layout,
+                                     uint32_t *offset, uint32_t *count,
+                                     uint32_t element_size) {
+  uint64_t size = (uint64_t)*count * element_size;
+  if (size == 0 || !is_linkedit_range(layout, *offset, size)) {
+    *offset = 0;
+    *count = 0;
+    return;
+  }
+  const struct view_segment *linkedit = &layout->segments[layout->linkedit];
+  *offset = (uint32_t)(linkedit->view_offset + (*offset - linkedit->fileoff));
+}
+
+static void visit_linkedit_fields(struct view_layout *layout, uint8_t *cmds,
+                                  uint32_t ncmds,
+                                  linkedit_field_visitor_t visitor) {
+  uint8_t *cmd = cmds;
+  for (uint32_t index = 0; index < ncmds; index++) {
+    struct load_command *lc = (struct load_command *)cmd;
+    switch (lc->cmd) {
+    case LC_SYMTAB: {
+      struct symtab_command *symtab = (struct symtab_command *)lc;
+      visitor(layout, &symtab->symoff, &symtab->nsyms,
+              sizeof(struct nlist_64));
+      visitor(layout, &symtab->stroff, &symtab->strsize, 1);
+      break;
+    }
+    case LC_DYSYMTAB: {
+      struct dysymtab_command *dysymtab = (struct dysymtab_command *)lc;
+      // dylib_table_of_contents and dylib_module_64 entries
+      visitor(layout, &dysymtab->tocoff, &dysymtab->ntoc, 8);
+      visitor(layout, &dysymtab->modtaboff, &dysymtab->nmodtab, 56);
+      visitor(layout, &dysymtab->extrefsymoff, &dysymtab->nextrefsyms,
+              sizeof(uint32_t));
+      visitor(layout, &dysymtab->indirectsymoff, &dysymtab->nindirectsyms,
+              sizeof(uint32_t));
+      // relocation_info entries
+      visitor(layout, &dysymtab->extreloff, &dysymtab->nextrel, 8);
+      visitor(layout, &dysymtab->locreloff, &dysymtab->nlocrel, 8);
+      break;
+    }
+    case LC_DYLD_INFO:
+    case LC_DYLD_INFO_ONLY: {
+      struct dyld_info_command *info = (struct dyld_info_command *)lc;
+      visitor(layout, &info->rebase_off, &info->rebase_size, 1);
+      visitor(layout, &info->bind_off, &info->bind_size, 1);
+      visitor(layout, &info->weak_bind_off, &info->weak_bind_size, 1);
+      visitor(layout, &info->lazy_bind_off, &info->lazy_bind_size, 1);
+      visitor(layout, &info->export_off, &info->export_size, 1);
+      break;
+    }
+    case LC_CODE_SIGNATURE:
+    case LC_SEGMENT_SPLIT_INFO:
+    case LC_FUNCTION_STARTS:
+    case LC_DATA_IN_CODE:
+    case LC_DYLD_EXPORTS_TRIE:
+    case LC_DYLD_CHAINED_FIXUPS: {
+      struct linkedit_data_command *data = (struct linkedit_data_command *)lc;
+      visitor(layout, &data->dataoff, &data->datasize, 1);
+      break;
+    }
+    default:
+      break;
+    }
+    cmd += lc->cmdsize;
+  }
+}
+
+// Load commands are walked several times: check their sizes once
+static bool are_load_commands_valid(const uint8_t *cmds, uint32_t ncmds,
+                                    uint32_t sizeofcmds) {
+  uint32_t offset = 0;
+  for (uint32_t index = 0; index < ncmds; index++) {
+    if (sizeofcmds - offset < sizeof(struct load_command)) {
+      return false;
+    }
+    const struct load_command *lc =
+        (const struct load_command *)(cmds + offset);
+    if (lc->cmdsize < sizeof(struct load_command) ||
+        lc->cmdsize > sizeofcmds - offset) {
+      return false;
+    }
+    if (lc->cmd == LC_SEGMENT_64) {
+      const struct segment_command_64 *seg =
+          (const struct segment_command_64 *)lc;
+      if (lc->cmdsize < sizeof(*seg) ||
+          seg->nsects > (lc->cmdsize - sizeof(*seg)) /
+                            sizeof(struct section_64)) {
+        return false;
+      }
+    }
+    offset += lc->cmdsize;
+  }
+  return true;
+}
+
+static bool record_segments(struct view_layout *layout, uint8_t *cmds,
+                            uint32_t ncmds, uint64_t header_address) {
+  layout->num_segments = 0;
+  layout->text = NO_SEGMENT;
+  layout->linkedit = NO_SEGMENT;
+  uint8_t *cmd = cmds;
+  for (uint32_t index = 0; index < ncmds; index++) {
+    struct load_command *lc = (struct load_command *)cmd;
+    cmd += lc->cmdsize;
+    if (lc->cmd != LC_SEGMENT_64) {
+      continue;
+    }
+    const struct segment_command_64 *seg = (struct segment_command_64 *)lc;
+    if (seg->filesize == 0) {
+      continue;
+    }
+    if (layout->num_segments == MAX_IMAGE_SEGMENTS) {
+      return false;
+    }
+    if (seg->vmaddr == header_address) {
+      layout->text = layout->num_segments;
+    } else if (strncmp(seg->segname, "__LINKEDIT", 16) == 0) {
+      layout->linkedit = layout->num_segments;
+    }
+    struct view_segment *segment = &layout->segments[layout->num_segments++];
+    segment->vmaddr = seg->vmaddr;
+    segment->fileoff = seg->fileoff;
+    segment->size = seg->filesize;
+  }
+  // The view starts with the mach header
+  return layout->text != NO_SEGMENT;
+}
+
+// Keeps the part of __LINKEDIT the load commands use
+static void narrow_linkedit(struct view_layout *layout, uint8_t *cmds,
+                            uint32_t ncmds) {
+  if (layout->linkedit == NO_SEGMENT) {
+    return;
+  }
+  layout->linkedit_start = UINT64_MAX;
+  layout->linkedit_end = 0;
+  visit_linkedit_fields(layout, cmds, ncmds, measure_linkedit_field);
+
+  struct view_segment *linkedit = &layout->segments[layout->linkedit];
+  if (layout->linkedit_start > layout->linkedit_end) {
+    layout->linkedit_start = linkedit->fileoff;
+    layout->linkedit_end = linkedit->fileoff;
+  }
+  linkedit->vmaddr += layout->linkedit_start - linkedit->fileoff;
+  linkedit->fileoff = layout->linkedit_start;
+  linkedit->size = layout->linkedit_end - layout->linkedit_start;
+}
+
+// Places the segments one page after the other, __TEXT first. Returns the
+// size of the view mapping, 0 when a segment is not in the cache.
+static size_t place_segments(const struct machore_dyld_cache *cache,
+                             struct view_layout *layout) {
+  const size_t page_size = cache->page_size;
+  size_t text_page_offset = 0;
+  size_t mapping_size = 0;
+  for (size_t order = 0; order < layout->num_segments; order++) {
+    // __TEXT, then the others in load command order
+    size_t index = order == 0                ? layout->text
+                   : order <= layout->text ? order - 1
+                                             : order;
+    struct view_segment *segment = &layout->segments[index];
+    if (segment->size == 0) {
+      segment->mapping = NULL;
+      segment->view_offset = 0;
+      continue;
+    }
+    segment->mapping = find_mapping(cache, segment->vmaddr, segment->size);
+    if (segment->mapping == NULL) {
+      return 0;
+    }
+    uint64_t source_offset = segment->mapping->file_offset +
+                             (segment->vmaddr - segment->mapping->address);
+    size_t page_offset = source_offset % page_size;
+    if (order == 0) {
+      text_page_offset = page_offset;
+    }
+    segment->view_offset = mapping_size + page_offset - text_page_offset;
+    mapping_size += (page_offset + segment->size + page_size - 1) /
+                    page_size * page_size;
+  }
+  return mapping_size;
+}
+
+static bool map_segments(const struct machore_dyld_cache *cache,
+                         const struct view_layout *layout,
+                         struct image_view *view) {
+  const size_t page_size = cache->page_size;
+  const struct view_segment *text = &layout->segments[layout->text];
+  const size_t text_page_offset =
+      (text->mapping->file_offset + (text->vmaddr - text->mapping->address)) %
+      page_size;
+  for (size_t index = 0; index < layout->num_segments; index++) {
+    const struct view_segment *segment = &layout->segments[index];
+    if (segment->mapping == NULL) {
+      continue;
+    }
+    uint64_t source_offset = segment->mapping->file_offset +
+                             (segment->vmaddr - segment->mapping->address);
+    size_t page_offset = source_offset % page_size;
+    size_t size = (page_offset + segment->size + page_size - 1) / page_size *
+                  page_size;
+    // The load commands of __TEXT are rewritten in place
+    int protection = PROT_READ | (index == layout->text ? PROT_WRITE : 0);
+    void *pages = mmap(view->mapping + text_page_offset +
+                           segment->view_offset - page_offset,
+                       size, protection, MAP_PRIVATE | MAP_FIXED,
+                       cache->files[segment->mapping->file_index].fd,
+                       source_offset - page_offset);
+    if (pages == MAP_FAILED) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void translate_segments(const struct view_layout *layout,
+                               uint8_t *cmds, uint32_t ncmds) {
+  size_t segment_index = 0;
+  uint8_t *cmd = cmds;
+  for (uint32_t index = 0; index < ncmds; index++) {
+    struct load_command *lc = (struct load_command *)cmd;
+    cmd += lc->cmdsize;
+    if (lc->cmd != LC_SEGMENT_64) {
+      continue;
+    }
+    struct segment_command_64 *seg = (struct segment_command_64 *)lc;
+    if (seg->filesize == 0) {
+      seg->fileoff = 0;
+      continue;
+    }
+    const struct view_segment *segment = &layout->segments[segment_index];
+    const uint64_t old_fileoff = seg->fileoff;
+    if (segment_index == layout->linkedit) {
+      seg->vmaddr = segment->vmaddr;
+      seg->vmsize = segment->size;
+    }
+    seg->fileoff = segment->view_offset;
+    seg->filesize = segment->size;
+    segment_index++;
+
+    struct section_64 *sect = (struct section_64 *)(seg + 1);
+    for (uint32_t i = 0; i < seg->nsects; i++) {
+      if (sect[i].offset == 0) {
+        continue;
+      }
+      uint64_t offset = sect[i].offset - old_fileoff;
+      if (sect[i].offset < old_fileoff || offset > segment->size ||
+          sect[i].size > segment->size - offset) {
+        sect[i].offset = 0;
+        sect[i].size = 0;
+        continue;
+      }
+      sect[i].offset = (uint32_t)(segment->view_offset + offset);
+    }
+  }
+}
+
+static bool build_image_view(const struct machore_dyld_cache *cache,
+                             size_t image_index, struct image_view *view) {
+  const uint64_t address = cache->images[image_index].address;
+  const struct cache_mapping *mapping =
+      find_mapping(cache, address, sizeof(struct mach_header_64));
+  if (mapping == NULL) {
+    return false;
+  }
+  const uint8_t *header_bytes = cache->files[mapping->file_index].data +
+                                mapping->file_offset +
+                                (address - mapping->address);
+  const struct mach_header_64 *header =
+      (const struct mach_header_64 *)header_bytes;
+  if (header->magic != MH_MAGIC_64 ||
+      find_mapping(cache, address,
+                   sizeof(*header) + (uint64_t)header->sizeofcmds) == NULL ||
+      !are_load_commands_valid(header_bytes + sizeof(*header), header->ncmds,
+                               header->sizeofcmds)) {
+    return false;
+  }
+
+  const uint32_t ncmds = header->ncmds;
+  const uint32_t sizeofcmds = header->sizeofcmds;
+  uint8_t *cmds = malloc(sizeofcmds);
+  assert(cmds != NULL || sizeofcmds == 0);
+  memcpy(cmds, header_bytes + sizeof(*header), sizeofcmds);
+
+  struct view_layout layout;
+  size_t mapping_size = 0;
+  if (record_segments(&layout, cmds, ncmds, address) &&
+      layout.segments[layout.text].size >= sizeof(*header) + sizeofcmds) {
+    narrow_linkedit(&layout, cmds, ncmds);
+    mapping_size = place_segments(cache, &layout);
+  }
+  if (mapping_size == 0) {
+    free(cmds);
+    return false;
+  }
+
+  // Reserve the view, then map the segments over it
+  view->mapping = mmap(NULL, mapping_size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (view->mapping == MAP_FAILED) {
+    free(cmds);
+    return false;
+  }
+  view->mapping_size = mapping_size;
+  if (!map_segments(cache, &layout, view)) {
+    munmap(view->mapping, mapping_size);
+    free(cmds);
+    return false;
+  }
+  const struct view_segment *text = &layout.segments[layout.text];
+  view->buffer = view->mapping + (text->mapping->file_offset +
+                                  (text->vmaddr - text->mapping->address)) %
+                                     cache->page_size;
+  view->size = view->mapping + mapping_size - view->buffer;
+
+  translate_segments(&layout, cmds, ncmds);
+  visit_linkedit_fields(&layout, cmds, ncmds, translate_linkedit_field);
+  memcpy(view->buffer + sizeof(*header), cmds, sizeofcmds);
+  free(cmds);
+  mprotect(view->mapping, view->buffer - view->mapping + text->size,
+           PROT_READ);
+  return true;
+}
+
+struct parse_batch {
+  struct machore_dyld_cache *cache;
+  size_t first_image;
+  size_t num_images;
+  struct machore_output_t *outputs;
+  size_t next_image;
+  size_t num_parsed;
+};
+
+static bool parse_image(struct machore_dyld_cache *cache, size_t image_index,
+                        struct machore_output_t *output) {
+  struct image_view *view = &cache->views[image_index];
+  if (view->buffer == NULL && !build_image_view(cache, image_index, view)) {
+    view->buffer = NULL;
+    return false;
+  }
+  parse_macho(output, view->buffer, view->size);
+  return true;
+}
+
+static void parse_images(struct parse_batch *batch) {
+  for (;;) {
+    size_t index =
+        __atomic_fetch_add(&batch->next_image, 1, __ATOMIC_RELAXED);
+    if (index >= batch->num_images) {
+      return;
+    }
+    if (parse_image(batch->cache, batch->first_image + index,
+                    &batch->outputs[index])) {
+      __atomic_fetch_add(&batch->num_parsed, 1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void *run_worker(void *argument) {
+  parse_images(argument);
+  return NULL;
+}
+
+struct machore_dyld_cache *machore_dyld_cache_open(const char *path) {
+  struct machore_dyld_cache *cache = calloc(1, sizeof(*cache));
+  assert(cache != NULL);
+  long page_size = sysconf(_SC_PAGESIZE);
+  cache->page_size = page_size > 0 ? (size_t)page_size : 4096;
+  if (!add_file(cache, path) || !add_subcaches(cache, path) ||
+      !read_images(cache)) {
+    machore_dyld_cache_close(cache);
+    return NULL;
+  }
+  cache->views = calloc(cache->num_images, sizeof(struct image_view));
+  assert(cache->views != NULL || cache->num_images == 0);
+  return cache;
+}
+
+void machore_dyld_cache_close(struct machore_dyld_cache *cache) {
+  if (cache->views != NULL) {
+    for (size_t index = 0; index < cache->num_images; index++) {
+      if (cache->views[index].buffer != NULL) {
+        munmap(cache->views[index].mapping, cache->views[index].mapping_size);
+      }
+    }
+  }
+  for (size_t index = 0; index < cache->num_files; index++) {
+    munmap(cache->files[index].data, cache->files[index].size);
+    close(cache->files[index].fd);
+  }
+  free(cache->views);
+  free(cache->files);
+  free(cache->mappings);
+  free(cache);
+}
+
+size_t machore_dyld_cache_count_images(const struct machore_dyld_cache *cache) {
+  return cache->num_images;
+}
+
+bool machore_dyld_cache_get_image(const struct machore_dyld_cache *cache,
+                                  size_t index,
+                                  struct cache_image_info *image_info) {
+  if (index >= cache->num_images) {
+    return false;
+  }
+  const struct cache_file *main_file = &cache->files[0];
+  uint32_t path_offset = cache->images[index].pathFileOffset;
+  const char *path = (const char *)main_file->data + path_offset;
+  // Paths are NUL terminated in the main cache file
+  if (path_offset >= main_file->size ||
+      memchr(path, '\0', main_file->size - path_offset) == NULL) {
+    path = "";
+  }
+  image_info->path = path;
+  image_info->address = cache->images[index].address;
+  return true;
+}
+
+size_t machore_dyld_cache_parse_images(struct machore_dyld_cache *cache,
+                                       size_t first, size_t num_images,
+                                       struct machore_output_t *outputs,
+                                       size_t num_threads) {
+  if (first > cache->num_images) {
+    return 0;
+  }
+  if (num_images > cache->num_images - first) {
+    num_images = cache->num_images - first;
+  }
+  if (num_threads == 0) {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = num_cpus > 0 ? (size_t)num_cpus : 1;
+  }
+  if (num_threads > num_images) {
+    num_threads = num_images;
+  }
+
+  struct parse_batch batch = {
+      .cache = cache,
+      .first_image = first,
+      .num_images = num_images,
+      .outputs = outputs,
+      .next_image = 0,
+      .num_parsed = 0,
+  };
+  // The caller parses images too
+  pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+  assert(threads != NULL || num_threads == 0);
+  size_t num_workers = 0;
+  for (size_t index = 0; index + 1 < num_threads; index++) {
+    if (pthread_create(&threads[num_workers], NULL, run_worker, &batch) ==
+        0) {
+      num_workers++;
+    }
+  }
+  parse_images(&batch);
+  for (size_t index = 0; index < num_workers; index++) {
+    pthread_join(threads[index], NULL);
+  }
+  free(threads);
+  return batch.num_parsed;
+}
@@ -0,0 +1,67 @@
+#ifndef LIBMACHORE_DYLD_CACHE_SHIM_H
+#define LIBMACHORE_DYLD_CACHE_SHIM_H
+
+#include <stdint.h>
+
+/*
+ * This whole file is a shim for the structures in dyld_cache_format.h, which
+ * is not part of the SDK
+ * Ref:
+ * https://github.com/apple-oss-distributions/dyld/blob/main/cache-builder/dyld_cache_format.h
+ *
+ * Only the fields read by dyld_cache.c are named, up to cacheSubType: older
+ * headers are shorter, and mappingOffset (the size of the header) tells
+ * which fields are there.
+ */
+
+#define DYLD_CACHE_MAGIC_PREFIX "dyld_v1"
+
+typedef struct {
+  char magic[16];               /* e.g. "dyld_v1  arm64e" */
+  uint32_t mappingOffset;       /* file offset to first mapping info */
+  uint32_t mappingCount;        /* number of mapping infos */
+  uint32_t imagesOffsetOld;     /* image infos, before imagesOffset */
+  uint32_t imagesCountOld;      /* number of image infos, before imagesCount */
+  uint8_t unused1[184];         /* dyldBaseAddress to progClosuresTrieSize */
+  uint32_t platform;            /* platform number (macOS=1, etc) */
+  uint32_t formatVersion;       /* format version and flags */
+  uint64_t sharedRegionStart;   /* base load address of the cache */
+  uint8_t unused2[160];         /* sharedRegionSize to swiftOptsSize */
+  uint32_t subCacheArrayOffset; /* file offset to subcache entries */
+  uint32_t subCacheArrayCount;  /* number of subcache entries */
+  uint8_t unused3[48];          /* symbolFileUUID to rosettaReadWriteSize */
+  uint32_t imagesOffset;        /* file offset to first image info */
+  uint32_t imagesCount;         /* number of image infos */
+  uint32_t cacheSubType;        /* main or development cache */
+} dyld_cache_header_shim;
+
+typedef struct {
+  uint64_t address;
+  uint64_t size;
+  uint64_t fileOffset;
+  uint32_t maxProt;
+  uint32_t initProt;
+} dyld_cache_mapping_info_shim;
+
+typedef struct {
+  uint64_t address; /* address of the mach header */
+  uint64_t modTime;
+  uint64_t inode;
+  uint32_t pathFileOffset; /* file offset of the install name */
+  uint32_t pad;
+} dyld_cache_image_info_shim;
+
+/* Subcaches named with their index: ".1", ".2"... */
+typedef struct {
+  uint8_t uuid[16];
+  uint64_t cacheVMOffset;
+} dyld_subcache_entry_v1_shim;
+
+/* Subcaches named with fileSuffix: ".01", ".02"... */
+typedef struct {
+  uint8_t uuid[16];
+  uint64_t cacheVMOffset;
+  char fileSuffix[32];
+} dyld_subcache_entry_shim;
+
+#endif
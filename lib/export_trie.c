@@ -0,0 +1,225 @@
+#include <mach-o/loader.h>
+
+#include <string.h>
+
+#include "leb128.h"
+#include "libmachore.h"
+
+/*
+ * Export trie, as emitted by ld64 in LC_DYLD_EXPORTS_TRIE or in the
+ * export_off range of LC_DYLD_INFO(_ONLY). Each node is:
+ *
+ *   uleb128 terminal_size
+ *   [terminal_size bytes] flags, then either
+ *     - address                     (regular, thread local, absolute)
+ *     - address, resolver           (EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER)
+ *     - dylib ordinal, import name  (EXPORT_SYMBOL_FLAGS_REEXPORT)
+ *   uint8_t children_count
+ *   children_count x { edge label (C string), uleb128 child offset }
+ *
+ * ld64 lays nodes out parents first, so we only follow children living after
+ * their parent: this bounds every walk even on malformed tries.
+ */
+
+bool parse_export_terminal(const uint8_t *terminal, const uint8_t *end,
+                           struct export_info *export_info) {
+  const uint8_t *cursor = terminal;
+  export_info->other = 0;
+  export_info->import_name = NULL;
+  if (!read_uleb128(&cursor, end, &export_info->flags)) {
+    return false;
+  }
+
+  if (export_info->flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+    export_info->address = 0;
+    if (!read_uleb128(&cursor, end, &export_info->other)) {
+      return false;
+    }
+    // An empty import name means the symbol keeps the same name
+    const char *import_name = (const char *)cursor;
+    size_t import_name_size = strnlen(import_name, end - cursor);
+    if (import_name_size == (size_t)(end - cursor)) {
+      return false;
+    }
+    export_info->import_name = import_name_size > 0 ? import_name : NULL;
+    return true;
+  }
+
+  if (!read_uleb128(&cursor, end, &export_info->address)) {
+    return false;
+  }
+  if (export_info->flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER) {
+    return read_uleb128(&cursor, end, &export_info->other);
+  }
+  return true;
+}
+
+// Reads the terminal information of the node at `*cursor` and leaves the
+// cursor on its children count.
+bool parse_export_node(const uint8_t **cursor, const uint8_t *end,
+                       bool *is_terminal, struct export_info *export_info) {
+  uint64_t terminal_size;
+  if (!read_uleb128(cursor, end, &terminal_size) ||
+      terminal_size >= (uint64_t)(end - *cursor)) {
+    return false;
+  }
+
+  *is_terminal = terminal_size != 0;
+  if (*is_terminal && !parse_export_terminal(*cursor, *cursor + terminal_size,
+                                             export_info)) {
+    return false;
+  }
+  *cursor += terminal_size;
+  return true;
+}
+
+struct export_trie_frame {
+  const uint8_t *next_child;
+  uint32_t node_offset;
+  uint32_t name_size;
+  uint8_t remaining_children;
+};
+
+size_t machore_walk_exports(const uint8_t *trie, size_t trie_size,
+                            machore_export_visitor_t visitor, void *context) {
+  if (trie == NULL || trie_size == 0) {
+    return 0;
+  }
+
+  // Fixed storage: the walk never allocates
+  struct export_trie_frame stack[LIBMACHORE_EXPORT_TRIE_MAX_DEPTH];
+  char name[LIBMACHORE_EXPORT_NAME_MAX_SIZE];
+  size_t depth = 0;
+  size_t num_exports = 0;
+
+  const uint8_t *end = trie + trie_size;
+  uint32_t node_offset = 0;
+  uint32_t name_size = 0;
+
+  for (;;) {
+    // 1. Visit the current node
+    const uint8_t *cursor = trie + node_offset;
+    bool is_terminal = false;
+    struct export_info export_info;
+    if (parse_export_node(&cursor, end, &is_terminal, &export_info)) {
+      if (is_terminal) {
+        name[name_size] = '\0';
+        export_info.name = name;
+        export_info.name_size = name_size;
+        num_exports++;
+        if (visitor != NULL && !visitor(&export_info, context)) {
+          return num_exports;
+        }
+      }
+
+      // 2. Descend into its children, if any
+      if (cursor < end && *cursor > 0 &&
+          depth < LIBMACHORE_EXPORT_TRIE_MAX_DEPTH) {
+        struct export_trie_frame *frame = &stack[depth++];
+        frame->remaining_children = *cursor;
+        frame->next_child = cursor + 1;
+        frame->node_offset = node_offset;
+        frame->name_size = name_size;
+      }
+    }
+
+    // 3. Move to the next unvisited child, unwinding finished nodes
+    bool has_next = false;
+    while (depth > 0 && !has_next) {
+      struct export_trie_frame *frame = &stack[depth - 1];
+      if (frame->remaining_children == 0) {
+        depth--;
+        continue;
+      }
+      frame->remaining_children--;
+      if (frame->next_child >= end) {
+        depth--;
+        continue;
+      }
+
+      const char *edge = (const char *)frame->next_child;
+      size_t edge_size = strnlen(edge, end - frame->next_child);
+      const uint8_t *child_cursor = frame->next_child + edge_size + 1;
+      uint64_t child_offset;
+      if (child_cursor > end ||
+          !read_uleb128(&child_cursor, end, &child_offset)) {
+        // Truncated node, drop the remaining siblings
+        depth--;
+        continue;
+      }
+      frame->next_child = child_cursor;
+
+      if (child_offset <= frame->node_offset || child_offset >= trie_size ||
+          frame->name_size + edge_size >= LIBMACHORE_EXPORT_NAME_MAX_SIZE) {
+        continue;
+      }
+      memcpy(name + frame->name_size, edge, edge_size);
+      name_size = frame->name_size + edge_size;
+      node_offset = child_offset;
+      has_next = true;
+    }
+
+    if (!has_next) {
+      return num_exports;
+    }
+  }
+}
+
+bool machore_lookup_export(const uint8_t *trie, size_t trie_size,
+                           const char *name, struct export_info *export_info) {
+  if (trie == NULL || trie_size == 0) {
+    return false;
+  }
+
+  const uint8_t *end = trie + trie_size;
+  const char *remaining = name;
+  uint64_t node_offset = 0;
+
+  for (;;) {
+    const uint8_t *cursor = trie + node_offset;
+    bool is_terminal = false;
+    if (!parse_export_node(&cursor, end, &is_terminal, export_info)) {
+      return false;
+    }
+
+    if (*remaining == '\0') {
+      if (is_terminal) {
+        export_info->name = name;
+        export_info->name_size = remaining - name;
+      }
+      return is_terminal;
+    }
+
+    if (cursor >= end) {
+      return false;
+    }
+
+    // Edges of a node never share their first byte, so at most one child
+    // can match the remaining name
+    uint8_t children_count = *cursor++;
+    bool found = false;
+    for (uint8_t index = 0; index < children_count && !found; index++) {
+      const char *edge = (const char *)cursor;
+      size_t edge_size = strnlen(edge, end - cursor);
+      cursor += edge_size + 1;
+      uint64_t child_offset;
+      if (cursor > end || !read_uleb128(&cursor, end, &child_offset)) {
+        return false;
+      }
+
+      if (edge_size > 0 && edge[0] == remaining[0] &&
+          strncmp(edge, remaining, edge_size) == 0) {
+        if (child_offset <= node_offset || child_offset >= trie_size) {
+          return false;
+        }
+        remaining += edge_size;
+        node_offset = child_offset;
+        found = true;
+      }
+    }
+
+    if (!found) {
+      return false;
+    }
+  }
+}
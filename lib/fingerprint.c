@@ -0,0 +1,146 @@
+#include <string.h>
+
+#include "hash.h"
+#include "libmachore.h"
+
+/*
+ * Similarity fingerprints of a slice, over its dylib paths, symbol names and
+ * string contents. Every feature is hashed once with its kind, so a symbol
+ * never matches a string with the same content.
+ *
+ * MinHash keeps, for each of LIBMACHORE_MINHASH_SIZE hash functions, the
+ * minimum over all features: the fraction of equal minimums of two slices
+ * estimates the Jaccard similarity of their feature sets. The hash functions
+ * are multiply-shift hashes of the 64-bit feature hash.
+ *
+ * SimHash adds +1 or -1 per bit of every feature hash and keeps the sign:
+ * slices with similar features get fingerprints at a small Hamming distance.
+ */
+
+// Symbols and strings of paged outputs read per call to the paging APIs
+#define FINGERPRINT_BATCH_SIZE 256
+
+enum {
+  FEATURE_DYLIB = 1,
+  FEATURE_SYMBOL = 2,
+  FEATURE_STRING = 3,
+};
+
+struct fingerprint_builder {
+  uint64_t multipliers[LIBMACHORE_MINHASH_SIZE];
+  uint64_t increments[LIBMACHORE_MINHASH_SIZE];
+  uint32_t minhash[LIBMACHORE_MINHASH_SIZE];
+  int64_t simhash_counts[64];
+  uint64_t num_features;
+};
+
+static void init_fingerprint_builder(struct fingerprint_builder *builder) {
+  for (int i = 0; i < LIBMACHORE_MINHASH_SIZE; i++) {
+    // Fixed parameters: fingerprints must compare across runs
+    builder->multipliers[i] = hash_mix(2 * i + 1) | 1;
+    builder->increments[i] = hash_mix(2 * i + 2);
+    builder->minhash[i] = UINT32_MAX;
+  }
+  memset(builder->simhash_counts, 0, sizeof(builder->simhash_counts));
+  builder->num_features = 0;
+}
+
+static void add_feature(struct fingerprint_builder *builder, int kind,
+                        const char *name, size_t name_size) {
+  uint64_t hash = hash_mix(hash_bytes(name, name_size) + kind);
+  for (int i = 0; i < LIBMACHORE_MINHASH_SIZE; i++) {
+    uint32_t value =
+        (uint32_t)((builder->multipliers[i] * hash + builder->increments[i]) >>
+                   32);
+    if (value < builder->minhash[i]) {
+      builder->minhash[i] = value;
+    }
+  }
+  for (int bit = 0; bit < 64; bit++) {
+    builder->simhash_counts[bit] += (int64_t)((hash >> bit) & 1) * 2 - 1;
+  }
+  builder->num_features++;
+}
+
+static void add_string_feature(struct fingerprint_builder *builder,
+                               const struct string_info *string_info) {
+  size_t size = string_info->size;
+  if (size > 0 && string_info->content[size - 1] == '\0') {
+    size--;
+  }
+  add_feature(builder, FEATURE_STRING, string_info->content, size);
+}
+
+// Paged outputs have no `symbols` nor `strings` arrays
+static void add_paged_features(struct fingerprint_builder *builder,
+                               struct machore_arch_output_t *arch_output) {
+  struct symbol_info symbols[FINGERPRINT_BATCH_SIZE];
+  size_t first = 0;
+  size_t count;
+  while ((count = machore_get_symbols(arch_output, first, symbols,
+                                      FINGERPRINT_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      add_feature(builder, FEATURE_SYMBOL, symbols[i].name,
+                  strlen(symbols[i].name));
+    }
+    first += count;
+  }
+
+  struct string_info strings[FINGERPRINT_BATCH_SIZE];
+  first = 0;
+  while ((count = machore_get_strings(arch_output, first, strings,
+                                      FINGERPRINT_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      add_string_feature(builder, &strings[i]);
+    }
+    first += count;
+  }
+}
+
+void machore_fingerprint_arch(struct machore_arch_output_t *arch_output,
+                              struct fingerprint_info *fingerprint) {
+  struct fingerprint_builder builder;
+  init_fingerprint_builder(&builder);
+
+  for (size_t index = 0; index < arch_output->num_dylibs; index++) {
+    const char *path = arch_output->dylibs[index].path;
+    add_feature(&builder, FEATURE_DYLIB, path, strlen(path));
+  }
+  if (machore_is_paged(arch_output)) {
+    add_paged_features(&builder, arch_output);
+  } else {
+    for (size_t index = 0; index < arch_output->num_symbols; index++) {
+      const char *name = arch_output->symbols[index].name;
+      add_feature(&builder, FEATURE_SYMBOL, name, strlen(name));
+    }
+    for (size_t index = 0; index < arch_output->num_strings; index++) {
+      add_string_feature(&builder, &arch_output->strings[index]);
+    }
+  }
+
+  memcpy(fingerprint->minhash, builder.minhash, sizeof(builder.minhash));
+  fingerprint->simhash = 0;
+  for (int bit = 0; bit < 64; bit++) {
+    if (builder.simhash_counts[bit] > 0) {
+      fingerprint->simhash |= 1ULL << bit;
+    }
+  }
+  fingerprint->num_features = builder.num_features;
+}
+
+double machore_fingerprint_similarity(const struct fingerprint_info *a,
+                                      const struct fingerprint_info *b) {
+  if (a->num_features == 0 || b->num_features == 0) {
+    return a->num_features == b->num_features ? 1.0 : 0.0;
+  }
+  int num_equal = 0;
+  for (int i = 0; i < LIBMACHORE_MINHASH_SIZE; i++) {
+    num_equal += a->minhash[i] == b->minhash[i];
+  }
+  return (double)num_equal / LIBMACHORE_MINHASH_SIZE;
+}
+
+unsigned machore_fingerprint_distance(const struct fingerprint_info *a,
+                                      const struct fingerprint_info *b) {
+  return __builtin_popcountll(a->simhash ^ b->simhash);
+}
@@ -0,0 +1,37 @@
+#ifndef LIBMACHORE_HASH_H
+#define LIBMACHORE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Non cryptographic 64-bit hash of a byte string, consuming 8 bytes per
+ * step. Good enough to key sets of names: never use it on untrusted input
+ * where collisions would matter.
+ */
+
+static inline uint64_t hash_mix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static inline uint64_t hash_bytes(const void *data, size_t size) {
+  const uint8_t *p = data;
+  uint64_t hash = 0x9E3779B97F4A7C15ULL ^ (size * 0xFF51AFD7ED558CCDULL);
+  for (; size >= 8; p += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    hash = (hash ^ word) * 0x9FB21C651E98DF25ULL;
+    hash ^= hash >> 29;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, p, size);
+  return hash_mix(hash ^ tail);
+}
+
+#endif
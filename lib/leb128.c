@@ -0,0 +1,98 @@
+#include "leb128.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Bit i of the result is the continuation bit of p[i], for 16 bytes.
+static inline uint32_t continuation_mask16(const uint8_t *p) {
+#if defined(__SSE2__)
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  static const int8_t shifts[16] = {0, 1, 2, 3, 4, 5, 6, 7,
+                                    0, 1, 2, 3, 4, 5, 6, 7};
+  uint8x16_t bits = vshlq_u8(vshrq_n_u8(vld1q_u8(p), 7), vld1q_s8(shifts));
+  return vaddv_u8(vget_low_u8(bits)) |
+         ((uint32_t)vaddv_u8(vget_high_u8(bits)) << 8);
+#else
+  // Gather the top bit of each byte with a multiply
+  uint64_t low;
+  uint64_t high;
+  memcpy(&low, p, sizeof(low));
+  memcpy(&high, p + 8, sizeof(high));
+  const uint64_t top_bits = 0x8080808080808080ULL;
+  const uint64_t gather = 0x0102040810204080ULL;
+  uint32_t low_mask = (((low & top_bits) >> 7) * gather) >> 56;
+  uint32_t high_mask = (((high & top_bits) >> 7) * gather) >> 56;
+  return low_mask | (high_mask << 8);
+#endif
+}
+
+static inline uint64_t combine_uleb128(const uint8_t *p, size_t size) {
+  // Function starts and most other __LINKEDIT streams are 1-2 bytes values
+  if (size == 1) {
+    return p[0];
+  }
+  if (size == 2) {
+    return (p[0] & 0x7f) | ((uint64_t)p[1] << 7);
+  }
+  uint64_t value = 0;
+  for (size_t i = 0; i < size && i < 10; i++) {
+    value |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+  }
+  return value;
+}
+
+size_t decode_uleb128_batch(const uint8_t **cursor, const uint8_t *end,
+                            uint64_t *values, size_t max_values) {
+  const uint8_t *p = *cursor;
+  size_t count = 0;
+
+  // 16 bytes at a time: the continuation mask tells where every value ends,
+  // and a chunk without continuation bits is 16 single byte values
+  while (end - p >= 16 && max_values - count >= 16) {
+    uint32_t mask = continuation_mask16(p);
+    if (mask == 0) {
+      for (size_t i = 0; i < 16; i++) {
+        values[count + i] = p[i];
+      }
+      count += 16;
+      p += 16;
+      continue;
+    }
+
+    uint32_t terminators = ~mask & 0xFFFF;
+    if (terminators == 0) {
+      // A single (overlong) value spans the whole chunk
+      if (!read_uleb128_slow(&p, end, &values[count])) {
+        break;
+      }
+      count++;
+      continue;
+    }
+
+    size_t start = 0;
+    while (terminators != 0) {
+      size_t terminator = __builtin_ctz(terminators);
+      values[count++] = combine_uleb128(p + start, terminator - start + 1);
+      start = terminator + 1;
+      terminators &= terminators - 1;
+    }
+    p += start;
+  }
+
+  // Scalar tail
+  while (p < end && count < max_values) {
+    if (!read_uleb128(&p, end, &values[count])) {
+      break;
+    }
+    count++;
+  }
+
+  *cursor = p;
+  return count;
+}
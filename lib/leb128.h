@@ -0,0 +1,75 @@
+#ifndef LIBMACHORE_LEB128_H
+#define LIBMACHORE_LEB128_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LEB128 decoding shared by the __LINKEDIT parsers (export trie, binding
+ * opcodes, function starts...).
+ *
+ * Every decoder advances `*cursor` and refuses to read past `end`. Most
+ * values in __LINKEDIT fit in a single byte, so that case is kept inline.
+ */
+
+static inline bool read_uleb128_slow(const uint8_t **cursor,
+                                     const uint8_t *end, uint64_t *value) {
+  const uint8_t *p = *cursor;
+  uint64_t result = 0;
+  unsigned shift = 0;
+  while (p < end) {
+    uint8_t byte = *p++;
+    if (shift < 64) {
+      result |= (uint64_t)(byte & 0x7f) << shift;
+    }
+    shift += 7;
+    if ((byte & 0x80) == 0) {
+      *cursor = p;
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline bool read_uleb128(const uint8_t **cursor, const uint8_t *end,
+                                uint64_t *value) {
+  if (*cursor < end && (**cursor & 0x80) == 0) {
+    *value = *(*cursor)++;
+    return true;
+  }
+  return read_uleb128_slow(cursor, end, value);
+}
+
+static inline bool read_sleb128(const uint8_t **cursor, const uint8_t *end,
+                                int64_t *value) {
+  const uint8_t *p = *cursor;
+  int64_t result = 0;
+  unsigned shift = 0;
+  while (p < end) {
+    uint8_t byte = *p++;
+    if (shift < 64) {
+      result |= (int64_t)((uint64_t)(byte & 0x7f) << shift);
+    }
+    shift += 7;
+    if ((byte & 0x80) == 0) {
+      // Sign extend from the last byte read
+      if (shift < 64 && (byte & 0x40)) {
+        result |= (int64_t)(~0ULL << shift);
+      }
+      *cursor = p;
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Decodes up to `max_values` consecutive uleb128 values, 16 bytes at a time
+// with SIMD when available. Returns the number of values decoded; the
+// cursor is left after the last complete value.
+size_t decode_uleb128_batch(const uint8_t **cursor, const uint8_t *end,
+                            uint64_t *values, size_t max_values);
+
+#endif
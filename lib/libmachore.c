@@ -1,6 +1,7 @@
 #include <libkern/OSByteOrder.h>
 #include <mach-o/dyld.h>
 #include <mach-o/fat.h>
+#include <mach-o/fixup-chains.h>
 #include <mach-o/loader.h>
 #include <mach-o/nlist.h>
 
@@ -9,7 +10,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "byte_stats.h"
 #include "cs_blobs_shim.h"
+#include "leb128.h"
 #include "libmachore.h"
 
 /*
@@ -20,49 +23,52 @@
  *
  */
 
-bool is_fat_header(uint8_t *buffer) {
-  uint32_t magic = *(uint32_t *)buffer;
+bool is_fat_header(const uint8_t *buffer) {
+  uint32_t magic = *(const uint32_t *)buffer;
   return magic == FAT_MAGIC || magic == FAT_CIGAM || magic == FAT_MAGIC_64 ||
          magic == FAT_CIGAM_64;
 }
 
-void clean_arch_output(struct machore_arch_output_t *arch_output) {
-  // Binary flags
-  arch_output->no_undefined_refs = false;
-  arch_output->dyld_compatible = false;
-  arch_output->defines_weak_symbols = false;
-  arch_output->uses_weak_symbols = false;
-  arch_output->allows_stack_execution = false;
-  arch_output->enforce_no_heap_exec = false;
-
-  // Security flags
-  if (arch_output->security_flags != NULL) {
-    free(arch_output->security_flags);
-  }
-
-  // TODO: we should free the memory of the dylibs, strings
-  // and symbols by iterating over the arrays and freeing
-  // each element.
-  free(arch_output->dylibs);
-  arch_output->num_dylibs = 0;
-
-  free(arch_output->strings);
-  arch_output->num_strings = 0;
+// Fat headers are big-endian. FAT_MAGIC_64 files describe their slices with
+// fat_arch_64 entries, whose offsets and sizes can go past 4 GB.
+uint32_t get_num_fat_archs(const uint8_t *buffer) {
+  return OSSwapBigToHostInt32(((const struct fat_header *)buffer)->nfat_arch);
+}
 
-  free(arch_output->symbols);
-  arch_output->num_symbols = 0;
+size_t get_fat_arch_size(const uint8_t *buffer) {
+  uint32_t magic =
+      OSSwapBigToHostInt32(((const struct fat_header *)buffer)->magic);
+  return magic == FAT_MAGIC_64 ? sizeof(struct fat_arch_64)
+                               : sizeof(struct fat_arch);
+}
 
-  if (arch_output->entitlements != NULL) {
-    free(arch_output->entitlements);
+void read_fat_arch(const uint8_t *buffer, uint32_t arch_index,
+                   struct slice_info *slice) {
+  const size_t arch_size = get_fat_arch_size(buffer);
+  const uint8_t *entry =
+      buffer + sizeof(struct fat_header) + arch_index * arch_size;
+  if (arch_size == sizeof(struct fat_arch_64)) {
+    const struct fat_arch_64 *arch = (const struct fat_arch_64 *)entry;
+    slice->cputype = OSSwapBigToHostInt32(arch->cputype);
+    slice->cpusubtype = OSSwapBigToHostInt32(arch->cpusubtype);
+    slice->offset = OSSwapBigToHostInt64(arch->offset);
+    slice->size = OSSwapBigToHostInt64(arch->size);
+    slice->align = OSSwapBigToHostInt32(arch->align);
+  } else {
+    const struct fat_arch *arch = (const struct fat_arch *)entry;
+    slice->cputype = OSSwapBigToHostInt32(arch->cputype);
+    slice->cpusubtype = OSSwapBigToHostInt32(arch->cpusubtype);
+    slice->offset = OSSwapBigToHostInt32(arch->offset);
+    slice->size = OSSwapBigToHostInt32(arch->size);
+    slice->align = OSSwapBigToHostInt32(arch->align);
   }
 }
 
 // The version is a 32-bit integer in the format 0xMMmmPPPP, where MM is the
 // major version, mm is the minor version, and PPPP is the patch version.
 // We need to extract these values and print them in the format MM.mm.PPPP.
-bool parse_dylib_version(struct dylib_command *cmd, char *output_version_str,
+bool parse_dylib_version(uint32_t version, char *output_version_str,
                          size_t output_version_str_size) {
-  uint32_t version = cmd->dylib.current_version;
   uint32_t major = (version >> 24) & 0xFF;
   uint32_t minor = (version >> 16) & 0xFF;
   uint32_t patch = version & 0xFF;
@@ -72,14 +78,14 @@ bool parse_dylib_version(struct dylib_command *cmd, char *output_version_str,
   return written >= output_version_str_size;
 }
 
-bool parse_dylib_name(struct dylib_command *cmd, char *output_name_str,
+bool parse_dylib_name(const char *name, char *output_name_str,
                       size_t output_name_str_size) {
-  const char *name = (char *)cmd + cmd->dylib.name.offset;
   size_t written = snprintf(output_name_str, output_name_str_size, "%s", name);
   return written >= output_name_str_size;
 }
 
-void parse_dylib_command(struct dylib_command *dylib_cmd,
+void parse_dylib_command(const char *name, uint32_t current_version,
+                         uint32_t ordinal,
                          struct machore_arch_output_t *arch_output) {
   arch_output->num_dylibs++;
   arch_output->dylibs = realloc(
@@ -90,125 +96,680 @@ void parse_dylib_command(struct dylib_command *dylib_cmd,
 
   char name_str[LIBMACHORE_DYLIB_PATH_SIZE];
   bool is_name_truncated =
-      parse_dylib_name(dylib_cmd, name_str, LIBMACHORE_DYLIB_PATH_SIZE);
+      parse_dylib_name(name, name_str, LIBMACHORE_DYLIB_PATH_SIZE);
   dylib_info->is_path_truncated = is_name_truncated;
   strncpy(dylib_info->path, name_str, LIBMACHORE_DYLIB_PATH_SIZE);
 
   char version_str[LIBMACHORE_DYLIB_VERSION_SIZE];
-  parse_dylib_version(dylib_cmd, version_str, LIBMACHORE_DYLIB_VERSION_SIZE);
+  parse_dylib_version(current_version, version_str,
+                      LIBMACHORE_DYLIB_VERSION_SIZE);
   strncpy(dylib_info->version, version_str, LIBMACHORE_DYLIB_VERSION_SIZE);
+
+  dylib_info->ordinal = ordinal;
+}
+
+// [offset, offset + size) lies in a slice of `slice_size` bytes
+bool is_range_in_slice(uint64_t offset, uint64_t size, uint64_t slice_size) {
+  return offset <= slice_size && size <= slice_size - offset;
 }
 
-#define PARSE_SECTION(arch_output, buffer, sect, segment_name)                 \
-  char *string_start = (char *)buffer + sect->offset;                          \
-  char *string_end = string_start + sect->size;                                \
-  char *string = string_start;                                                 \
-  while (string < string_end) {                                                \
-    const size_t string_length = strlen(string);                               \
-    if (string_length > 0) {                                                   \
-      arch_output->num_strings++;                                              \
-      arch_output->strings =                                                   \
-          realloc(arch_output->strings,                                        \
-                  arch_output->num_strings * sizeof(struct string_info));      \
-      struct string_info *string_info =                                        \
-          &arch_output->strings[arch_output->num_strings - 1];                 \
-      assert(string_info != NULL);                                             \
-      string_info->size = string_length + 1;                                   \
-      string_info->content = malloc(string_info->size);                        \
-      assert(string_info->content != NULL);                                    \
-      strcpy(string_info->content, string);                                    \
-      strncpy(string_info->original_segment, segment_name, 24);                \
-      strncpy(string_info->original_section, sect->sectname, 24);              \
-      ptrdiff_t relative_offset = string - string_start;                       \
-      string_info->original_offset = sect->offset + relative_offset;           \
-    }                                                                          \
-    string += string_length + 1;                                               \
+// Segments of the current slice, collected once before walking the load
+// commands so that virtual addresses can be translated to file offsets.
+#define MAX_SEGMENTS 64
+
+// pointer_format of segments without chained fixups: pointers are vmaddrs
+#define CHAINED_PTR_NONE 0
+// pointer_format of segments whose chain starts can't be read
+#define CHAINED_PTR_UNKNOWN UINT16_MAX
+
+struct segment_range {
+  uint64_t vmaddr;
+  uint64_t vmsize;
+  uint64_t fileoff;
+  uint64_t filesize;
+  // DYLD_CHAINED_PTR_* of the pointers it holds, or CHAINED_PTR_NONE
+  uint16_t pointer_format;
+};
+
+struct segment_map {
+  struct segment_range segments[MAX_SEGMENTS];
+  uint32_t num_segments;
+  uint64_t base_address;
+  bool is_64;
+  bool is_swapped;
+};
+
+void add_segment_range(struct segment_map *map, uint64_t vmaddr,
+                       uint64_t vmsize, uint64_t fileoff, uint64_t filesize) {
+  if (map->num_segments == MAX_SEGMENTS) {
+    return;
   }
+  // The image base is the segment mapping the start of the file (__TEXT)
+  if (fileoff == 0 && filesize != 0) {
+    map->base_address = vmaddr;
+  }
+  struct segment_range *range = &map->segments[map->num_segments++];
+  range->vmaddr = vmaddr;
+  range->vmsize = vmsize;
+  range->fileoff = fileoff;
+  range->filesize = filesize;
+  range->pointer_format = CHAINED_PTR_NONE;
+}
 
-void parse_text_segment64(struct machore_arch_output_t *arch_output,
-                          uint8_t *buffer, struct segment_command_64 *seg) {
-  struct section_64 *sect = (void *)seg + sizeof(struct segment_command_64);
-  for (uint32_t index = 0; index < seg->nsects; index++) {
-    if (strcmp(sect->sectname, "__cstring") == 0 ||
-        strcmp(sect->sectname, "__const") == 0 ||
-        strcmp(sect->sectname, "__oslogstring") == 0) {
-      PARSE_SECTION(arch_output, buffer, sect, "__TEXT");
+// Records the pointer format of every segment with chained fixups, as
+// listed by the starts of LC_DYLD_CHAINED_FIXUPS (checked by
+// validate_chained_fixups()). Segments are in load command order.
+void collect_pointer_formats(struct segment_map *map, const uint8_t *buffer,
+                             const struct linkedit_data_command
+                                 *linkedit_data_cmd) {
+  const uint8_t *fixups = buffer + linkedit_data_cmd->dataoff;
+  const struct dyld_chained_fixups_header *header =
+      (const struct dyld_chained_fixups_header *)fixups;
+  if (header->fixups_version != 0) {
+    for (uint32_t index = 0; index < map->num_segments; index++) {
+      map->segments[index].pointer_format = CHAINED_PTR_UNKNOWN;
+    }
+    return;
+  }
+  const struct dyld_chained_starts_in_image *starts_in_image =
+      (const struct dyld_chained_starts_in_image *)(fixups +
+                                                    header->starts_offset);
+  for (uint32_t index = 0;
+       index < starts_in_image->seg_count && index < map->num_segments;
+       index++) {
+    uint32_t seg_info_offset = starts_in_image->seg_info_offset[index];
+    if (seg_info_offset != 0) {
+      map->segments[index].pointer_format =
+          ((const struct dyld_chained_starts_in_segment
+                *)((const uint8_t *)starts_in_image + seg_info_offset))
+              ->pointer_format;
     }
-    sect++;
   }
 }
 
-void parse_text_segment(struct machore_arch_output_t *arch_output,
-                        uint8_t *buffer, struct segment_command *seg) {
-  struct section *sect = (void *)seg + sizeof(struct segment_command);
-  for (uint32_t index = 0; index < seg->nsects; index++) {
-    if (strcmp(sect->sectname, "__cstring") == 0 ||
-        strcmp(sect->sectname, "__const") == 0 ||
-        strcmp(sect->sectname, "__oslogstring") == 0) {
-      PARSE_SECTION(arch_output, buffer, sect, "__TEXT");
+bool vmaddr_to_offset(const struct segment_map *map, uint64_t vmaddr,
+                      uint64_t *offset) {
+  for (uint32_t index = 0; index < map->num_segments; index++) {
+    const struct segment_range *range = &map->segments[index];
+    if (vmaddr >= range->vmaddr && vmaddr - range->vmaddr < range->filesize) {
+      *offset = range->fileoff + (vmaddr - range->vmaddr);
+      return true;
+    }
+  }
+  return false;
+}
+
+struct slice_decoder;
+
+// A section parse_string_section() extracts strings from
+struct string_section {
+  uint64_t offset;
+  uint64_t size;
+  char segname[17];
+  char sectname[17];
+  // __ustring, only seen by machore_extract_slice_strings()
+  bool is_utf16;
+  // Index of its first string in the string index
+  size_t first_string;
+};
+
+struct symtab_location {
+  uint32_t symoff;
+  uint32_t nsyms;
+  uint32_t stroff;
+  uint32_t strsize;
+};
+
+// State kept alive with the arch output for the lazy decoders
+struct machore_slice_context {
+  uint8_t *buffer;
+  struct segment_map segments;
+  const struct slice_decoder *decoder;
+  // Strings and symbols are left to the paging APIs
+  bool is_paged;
+
+  // String index: offset in the slice of every string, built on first
+  // access by machore_count_strings() or machore_get_string()
+  struct string_section *string_sections;
+  size_t num_string_sections;
+  uint32_t *string_offsets;
+  size_t num_strings;
+  bool is_string_index_built;
+
+  // Symbol index: symbol table entries with a name
+  struct symtab_location symtab;
+  uint32_t *symbol_entries;
+  size_t num_symbols;
+  bool is_symbol_index_built;
+};
+
+void clean_arch_output(struct machore_arch_output_t *arch_output) {
+  // Binary flags
+  arch_output->no_undefined_refs = false;
+  arch_output->dyld_compatible = false;
+  arch_output->defines_weak_symbols = false;
+  arch_output->uses_weak_symbols = false;
+  arch_output->allows_stack_execution = false;
+  arch_output->enforce_no_heap_exec = false;
+
+  // Security flags
+  if (arch_output->security_flags != NULL) {
+    free(arch_output->security_flags);
+  }
+
+  free(arch_output->dylibs);
+  arch_output->num_dylibs = 0;
+
+  // String contents are copies, symbol names point into the buffer
+  for (size_t i = 0; i < arch_output->num_strings; i++) {
+    free(arch_output->strings[i].content);
+  }
+  free(arch_output->strings);
+  arch_output->num_strings = 0;
+
+  free(arch_output->cfstrings);
+  arch_output->num_cfstrings = 0;
+
+  free(arch_output->symbols);
+  arch_output->num_symbols = 0;
+
+  free(arch_output->imports);
+  arch_output->num_imports = 0;
+  arch_output->imports_status = LIBMACHORE_IMPORTS_OK;
+
+  free(arch_output->function_starts);
+  arch_output->num_function_starts = 0;
+
+  if (arch_output->entitlements != NULL) {
+    free(arch_output->entitlements);
+  }
+
+  for (int kind = 0; kind < LIBMACHORE_METADATA_COUNT; kind++) {
+    free(arch_output->metadata[kind].names);
+    arch_output->metadata[kind].names = NULL;
+    arch_output->metadata[kind].num_names = 0;
+    arch_output->metadata[kind].is_decoded = false;
+  }
+
+  free(arch_output->section_stats);
+  arch_output->section_stats = NULL;
+  arch_output->num_section_stats = 0;
+  free(arch_output->segment_stats);
+  arch_output->segment_stats = NULL;
+  arch_output->num_segment_stats = 0;
+  arch_output->is_byte_stats_computed = false;
+
+  if (arch_output->slice_context != NULL) {
+    free(arch_output->slice_context->string_sections);
+    free(arch_output->slice_context->string_offsets);
+    free(arch_output->slice_context->symbol_entries);
+  }
+  free(arch_output->slice_context);
+  arch_output->slice_context = NULL;
+}
+
+// __kCFIsUnicode, set on CFStrings whose literal is in __ustring
+#define CFSTRING_FLAG_IS_UNICODE 0x10
+
+/*
+ * Objective-C and Swift metadata. Parsing only records where the sections
+ * live; the tables are decoded on first access through
+ * machore_metadata_names().
+ */
+struct metadata_section {
+  const char *sectname;
+  metadata_kind_t kind;
+};
+
+static const struct metadata_section metadata_sections[] = {
+    {"__objc_classlist", LIBMACHORE_METADATA_OBJC_CLASSES},
+    {"__objc_methname", LIBMACHORE_METADATA_OBJC_METHNAMES},
+    {"__objc_selrefs", LIBMACHORE_METADATA_OBJC_SELECTORS},
+    {"__swift5_types", LIBMACHORE_METADATA_SWIFT_TYPES},
+    {"__swift5_typeref", LIBMACHORE_METADATA_SWIFT_TYPEREFS},
+    {"__swift5_reflstr", LIBMACHORE_METADATA_SWIFT_REFLSTRS},
+};
+
+void record_metadata_section(struct machore_arch_output_t *arch_output,
+                             const char *sectname, uint64_t addr,
+                             uint64_t size, uint64_t offset) {
+  for (size_t index = 0;
+       index < sizeof(metadata_sections) / sizeof(metadata_sections[0]);
+       index++) {
+    // Section names are not NUL terminated when they take all 16 bytes
+    if (strncmp(sectname, metadata_sections[index].sectname, 16) == 0) {
+      struct metadata_table *table =
+          &arch_output->metadata[metadata_sections[index].kind];
+      table->section_offset = offset;
+      table->section_addr = addr;
+      table->section_size = size;
+      return;
     }
-    sect++;
   }
 }
 
-void parse_data_segment64(struct machore_arch_output_t *arch_output,
-                          uint8_t *buffer, struct segment_command_64 *seg) {
-  struct section_64 *sect = (void *)seg + sizeof(struct segment_command_64);
-  for (uint32_t index = 0; index < seg->nsects; index++) {
-    if (strcmp(sect->sectname, "__const") == 0 ||
-        strcmp(sect->sectname, "__cfstring") == 0) {
-      PARSE_SECTION(arch_output, buffer, sect, "__DATA");
+uint64_t read_data_pointer(const struct segment_map *segments,
+                           const uint8_t *location) {
+  if (segments->is_64) {
+    uint64_t pointer = *(const uint64_t *)location;
+    return segments->is_swapped ? OSSwapInt64(pointer) : pointer;
+  }
+  uint32_t pointer = *(const uint32_t *)location;
+  return segments->is_swapped ? OSSwapInt32(pointer) : pointer;
+}
+
+// Resolves the pointer stored at slice offset `location` to the slice offset
+// it points to. Pointers stored in data sections are rebased by dyld: with
+// chained fixups the on-disk value is a rebase or bind entry in the pointer
+// format of the segment holding it. Rebase targets are
+// - DYLD_CHAINED_PTR_64: a 36-bit vmaddr, high8 (top byte tag) dropped
+// - DYLD_CHAINED_PTR_64_OFFSET: a 36-bit offset from the image base
+// - DYLD_CHAINED_PTR_ARM64E*: a 32-bit offset from the image base when
+//   authenticated, else a 43-bit vmaddr (ARM64E) or offset (USERLAND)
+// - DYLD_CHAINED_PTR_32: a 26-bit vmaddr
+// Binds point to another image and resolve to nothing, as do the formats
+// of kernel and shared caches.
+bool resolve_data_pointer(const struct segment_map *map,
+                          const uint8_t *buffer, uint64_t location,
+                          uint64_t *offset) {
+  const uint64_t raw = read_data_pointer(map, buffer + location);
+  uint16_t pointer_format = CHAINED_PTR_NONE;
+  for (uint32_t index = 0; index < map->num_segments; index++) {
+    const struct segment_range *range = &map->segments[index];
+    if (location >= range->fileoff &&
+        location - range->fileoff < range->filesize) {
+      pointer_format = range->pointer_format;
+      break;
     }
-    sect++;
   }
+
+  uint64_t vmaddr;
+  switch (pointer_format) {
+  case CHAINED_PTR_NONE:
+    vmaddr = raw;
+    break;
+  case DYLD_CHAINED_PTR_64:
+  case DYLD_CHAINED_PTR_64_OFFSET:
+    if (raw >> 63) {
+      return false;
+    }
+    vmaddr = raw & 0xFFFFFFFFFULL;
+    if (pointer_format == DYLD_CHAINED_PTR_64_OFFSET) {
+      vmaddr += map->base_address;
+    }
+    break;
+  case DYLD_CHAINED_PTR_ARM64E:
+  case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+  case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+    if ((raw >> 62) & 1) {
+      return false;
+    }
+    if (raw >> 63) {
+      vmaddr = map->base_address + (raw & 0xFFFFFFFF);
+    } else {
+      vmaddr = raw & 0x7FFFFFFFFFFULL;
+      if (pointer_format != DYLD_CHAINED_PTR_ARM64E) {
+        vmaddr += map->base_address;
+      }
+    }
+    break;
+  case DYLD_CHAINED_PTR_32:
+    if (raw >> 31) {
+      return false;
+    }
+    vmaddr = raw & 0x03FFFFFF;
+    break;
+  default:
+    return false;
+  }
+  return vmaddr_to_offset(map, vmaddr, offset);
 }
 
-void parse_data_segment(struct machore_arch_output_t *arch_output,
-                        uint8_t *buffer, struct segment_command *seg) {
-  struct section *sect = (void *)seg + sizeof(struct segment_command);
-  for (uint32_t index = 0; index < seg->nsects; index++) {
-    if (strcmp(sect->sectname, "__const") == 0 ||
-        strcmp(sect->sectname, "__cfstring") == 0) {
-      PARSE_SECTION(arch_output, buffer, sect, "__DATA");
+bool offset_to_vmaddr(const struct segment_map *map, uint64_t offset,
+                      uint64_t *vmaddr) {
+  for (uint32_t index = 0; index < map->num_segments; index++) {
+    const struct segment_range *range = &map->segments[index];
+    if (offset >= range->fileoff && offset - range->fileoff < range->filesize) {
+      *vmaddr = range->vmaddr + (offset - range->fileoff);
+      return true;
     }
-    sect++;
   }
+  return false;
 }
 
-void parse_data_const_segment64(struct machore_arch_output_t *arch_output,
-                                uint8_t *buffer,
-                                struct segment_command_64 *seg) {
-  struct section_64 *sect = (void *)seg + sizeof(struct segment_command_64);
-  for (uint32_t index = 0; index < seg->nsects; index++) {
-    if (strcmp(sect->sectname, "__const") == 0) {
-      PARSE_SECTION(arch_output, buffer, sect, "__DATA_CONST");
+// File bytes of the segment holding `offset` from `offset` on, 0 when no
+// segment maps it. Pointers read from the data are not validated upfront:
+// what they point to is bounded by the segment.
+uint64_t segment_bytes_left(const struct segment_map *map, uint64_t offset) {
+  for (uint32_t index = 0; index < map->num_segments; index++) {
+    const struct segment_range *range = &map->segments[index];
+    if (offset >= range->fileoff && offset - range->fileoff < range->filesize) {
+      return range->filesize - (offset - range->fileoff);
     }
-    sect++;
   }
+  return 0;
+}
+
+// Allocates the names of a table once its number of entries is known
+struct metadata_name *allocate_metadata_names(struct metadata_table *table,
+                                              size_t count) {
+  table->names = count > 0 ? malloc(count * sizeof(struct metadata_name))
+                           : NULL;
+  assert(count == 0 || table->names != NULL);
+  table->num_names = 0;
+  return table->names;
 }
 
-void parse_data_const_segment(struct machore_arch_output_t *arch_output,
-                              uint8_t *buffer, struct segment_command *seg) {
-  struct section *sect = (void *)seg + sizeof(struct segment_command);
-  for (uint32_t index = 0; index < seg->nsects; index++) {
-    if (strcmp(sect->sectname, "__const") == 0) {
-      PARSE_SECTION(arch_output, buffer, sect, "__DATA_CONST");
+void add_metadata_name(struct metadata_table *table, uint8_t *buffer,
+                       uint64_t offset, size_t size) {
+  struct metadata_name *name = &table->names[table->num_names++];
+  name->name = (const char *)buffer + offset;
+  name->size = size;
+  name->original_offset = offset;
+}
+
+// __objc_methname, __swift5_reflstr: NUL separated strings
+void decode_cstring_table(struct metadata_table *table, uint8_t *buffer) {
+  const char *start = (const char *)buffer + table->section_offset;
+  const char *end = start + table->section_size;
+
+  size_t count = 0;
+  for (const char *p = start; p < end; p++) {
+    count += *p == '\0';
+  }
+  allocate_metadata_names(table, count + 1);
+
+  const char *string = start;
+  while (string < end) {
+    size_t size = strnlen(string, end - string);
+    if (size > 0) {
+      add_metadata_name(table, buffer, string - (const char *)buffer, size);
     }
-    sect++;
+    string += size + 1;
+  }
+}
+
+// __swift5_typeref: mangled names may embed symbolic references, a control
+// byte followed by a 32-bit relative (0x01-0x17) or an absolute pointer
+// (0x18-0x1f) that can contain NUL bytes.
+const uint8_t *next_mangled_name_end(const uint8_t *p, const uint8_t *end,
+                                     size_t pointer_size) {
+  while (p < end && *p != 0) {
+    if (*p <= 0x17) {
+      p += 1 + sizeof(int32_t);
+    } else if (*p <= 0x1f) {
+      p += 1 + pointer_size;
+    } else {
+      p++;
+    }
+  }
+  return p < end ? p : end;
+}
+
+void decode_mangled_name_table(struct metadata_table *table, uint8_t *buffer,
+                               size_t pointer_size) {
+  const uint8_t *start = buffer + table->section_offset;
+  const uint8_t *end = start + table->section_size;
+
+  size_t count = 0;
+  for (const uint8_t *p = start; p < end;) {
+    const uint8_t *name_end = next_mangled_name_end(p, end, pointer_size);
+    count += name_end > p;
+    p = name_end + 1;
+  }
+  allocate_metadata_names(table, count);
+
+  for (const uint8_t *p = start; p < end;) {
+    const uint8_t *name_end = next_mangled_name_end(p, end, pointer_size);
+    if (name_end > p) {
+      add_metadata_name(table, buffer, p - buffer, name_end - p);
+    }
+    p = name_end + 1;
+  }
+}
+
+// __objc_classlist: pointers to class_t, whose `data` field points to the
+// class_ro_t holding the name. Swift classes flag the low bits of `data`.
+//   class_t:    { isa, superclass, cache, vtable, data }
+//   class_ro_t: { flags, instanceStart, instanceSize, [reserved,]
+//                 ivarLayout, name, ... }
+bool resolve_objc_class_name(const struct segment_map *segments,
+                             const uint8_t *buffer, uint64_t class_offset,
+                             uint64_t *name_offset) {
+  const size_t pointer_size = segments->is_64 ? 8 : 4;
+  const size_t class_data_offset = 4 * pointer_size;
+  const size_t class_ro_name_offset = segments->is_64 ? 24 : 16;
+
+  uint64_t class_ro_offset;
+  if (segment_bytes_left(segments, class_offset) <
+          class_data_offset + pointer_size ||
+      !resolve_data_pointer(segments, buffer, class_offset + class_data_offset,
+                            &class_ro_offset)) {
+    return false;
+  }
+  class_ro_offset &= ~(uint64_t)(pointer_size - 1);
+  return segment_bytes_left(segments, class_ro_offset) >=
+             class_ro_name_offset + pointer_size &&
+         resolve_data_pointer(segments, buffer,
+                              class_ro_offset + class_ro_name_offset,
+                              name_offset);
+}
+
+void add_metadata_cstring(struct metadata_table *table, uint8_t *buffer,
+                          const struct segment_map *segments,
+                          uint64_t name_offset) {
+  add_metadata_name(table, buffer, name_offset,
+                    strnlen((const char *)buffer + name_offset,
+                            segment_bytes_left(segments, name_offset)));
+}
+
+void decode_objc_class_table(struct metadata_table *table, uint8_t *buffer,
+                             const struct segment_map *segments) {
+  const size_t pointer_size = segments->is_64 ? 8 : 4;
+  const size_t count = table->section_size / pointer_size;
+  allocate_metadata_names(table, count);
+
+  uint64_t entry = table->section_offset;
+  for (size_t index = 0; index < count; index++, entry += pointer_size) {
+    uint64_t class_offset;
+    uint64_t name_offset;
+    if (resolve_data_pointer(segments, buffer, entry, &class_offset) &&
+        resolve_objc_class_name(segments, buffer, class_offset,
+                                &name_offset)) {
+      add_metadata_cstring(table, buffer, segments, name_offset);
+    }
+  }
+}
+
+// __objc_selrefs: pointers into __objc_methname
+void decode_objc_selector_table(struct metadata_table *table, uint8_t *buffer,
+                                const struct segment_map *segments) {
+  const size_t pointer_size = segments->is_64 ? 8 : 4;
+  const size_t count = table->section_size / pointer_size;
+  allocate_metadata_names(table, count);
+
+  uint64_t entry = table->section_offset;
+  for (size_t index = 0; index < count; index++, entry += pointer_size) {
+    uint64_t name_offset;
+    if (resolve_data_pointer(segments, buffer, entry, &name_offset)) {
+      add_metadata_cstring(table, buffer, segments, name_offset);
+    }
+  }
+}
+
+// __swift5_types: 32-bit relative pointers whose low bits give the kind of
+// the target (TypeReferenceKind):
+//   0: type context descriptor
+//   1: pointer to a type context descriptor
+//   2: Objective-C class name
+//   3: pointer to an Objective-C class
+//   descriptor: { uint32 flags, int32 parent, int32 name (relative), ... }
+#define SWIFT_TYPE_REF_DIRECT_DESCRIPTOR 0
+#define SWIFT_TYPE_REF_INDIRECT_DESCRIPTOR 1
+#define SWIFT_TYPE_REF_DIRECT_OBJC_NAME 2
+#define SWIFT_TYPE_REF_INDIRECT_OBJC_CLASS 3
+
+bool resolve_swift_descriptor_name(const struct segment_map *segments,
+                                   const uint8_t *buffer,
+                                   uint64_t descriptor_offset,
+                                   uint64_t *name_offset) {
+  uint64_t descriptor_addr;
+  if (segment_bytes_left(segments, descriptor_offset) < 3 * sizeof(int32_t) ||
+      !offset_to_vmaddr(segments, descriptor_offset, &descriptor_addr)) {
+    return false;
+  }
+  const uint64_t name_field = descriptor_addr + 2 * sizeof(int32_t);
+  int32_t name_relative =
+      *(const int32_t *)(buffer + descriptor_offset + 2 * sizeof(int32_t));
+  return vmaddr_to_offset(segments, name_field + (int64_t)name_relative,
+                          name_offset);
+}
+
+void decode_swift_type_table(struct metadata_table *table, uint8_t *buffer,
+                             const struct segment_map *segments) {
+  const size_t pointer_size = segments->is_64 ? 8 : 4;
+  const size_t count = table->section_size / sizeof(int32_t);
+  allocate_metadata_names(table, count);
+
+  for (size_t index = 0; index < count; index++) {
+    int32_t relative = *(const int32_t *)(buffer + table->section_offset +
+                                          index * sizeof(int32_t));
+    uint64_t target = table->section_addr + index * sizeof(int32_t) +
+                      (int64_t)(relative & ~3);
+
+    uint64_t target_offset;
+    if (!vmaddr_to_offset(segments, target, &target_offset)) {
+      continue;
+    }
+    // Indirect kinds: the target holds a pointer to the actual record
+    const int kind = relative & 3;
+    if (kind == SWIFT_TYPE_REF_INDIRECT_DESCRIPTOR ||
+        kind == SWIFT_TYPE_REF_INDIRECT_OBJC_CLASS) {
+      if (segment_bytes_left(segments, target_offset) < pointer_size ||
+          !resolve_data_pointer(segments, buffer, target_offset,
+                                &target_offset)) {
+        continue;
+      }
+    }
+
+    uint64_t name_offset;
+    bool is_resolved;
+    switch (kind) {
+    case SWIFT_TYPE_REF_DIRECT_OBJC_NAME:
+      name_offset = target_offset;
+      is_resolved = true;
+      break;
+    case SWIFT_TYPE_REF_INDIRECT_OBJC_CLASS:
+      is_resolved = resolve_objc_class_name(segments, buffer, target_offset,
+                                            &name_offset);
+      break;
+    default:
+      is_resolved = resolve_swift_descriptor_name(segments, buffer,
+                                                  target_offset, &name_offset);
+      break;
+    }
+    if (is_resolved) {
+      add_metadata_cstring(table, buffer, segments, name_offset);
+    }
+  }
+}
+
+void decode_metadata_table(struct machore_arch_output_t *arch_output,
+                           metadata_kind_t kind) {
+  struct metadata_table *table = &arch_output->metadata[kind];
+  table->is_decoded = true;
+  if (table->section_size == 0 || arch_output->slice_context == NULL) {
+    return;
+  }
+
+  uint8_t *buffer = arch_output->slice_context->buffer;
+  const struct segment_map *segments = &arch_output->slice_context->segments;
+  switch (kind) {
+  case LIBMACHORE_METADATA_OBJC_CLASSES:
+    decode_objc_class_table(table, buffer, segments);
+    break;
+  case LIBMACHORE_METADATA_OBJC_SELECTORS:
+    decode_objc_selector_table(table, buffer, segments);
+    break;
+  case LIBMACHORE_METADATA_SWIFT_TYPES:
+    decode_swift_type_table(table, buffer, segments);
+    break;
+  case LIBMACHORE_METADATA_SWIFT_TYPEREFS:
+    decode_mangled_name_table(table, buffer, segments->is_64 ? 8 : 4);
+    break;
+  case LIBMACHORE_METADATA_OBJC_METHNAMES:
+  case LIBMACHORE_METADATA_SWIFT_REFLSTRS:
+    decode_cstring_table(table, buffer);
+    break;
+  default:
+    break;
+  }
+}
+
+void record_string_section(struct machore_slice_context *slice_context,
+                           const char *segname, const char *sectname,
+                           uint64_t offset, uint64_t size, bool is_utf16) {
+  slice_context->string_sections =
+      realloc(slice_context->string_sections,
+              (slice_context->num_string_sections + 1) *
+                  sizeof(struct string_section));
+  assert(slice_context->string_sections != NULL);
+  struct string_section *section =
+      &slice_context->string_sections[slice_context->num_string_sections++];
+  section->offset = offset;
+  section->size = size;
+  // Names are not NUL terminated when they take all 16 bytes
+  memcpy(section->segname, segname, 16);
+  section->segname[16] = '\0';
+  memcpy(section->sectname, sectname, 16);
+  section->sectname[16] = '\0';
+  section->is_utf16 = is_utf16;
+  section->first_string = 0;
+}
+
+// Copies the NUL separated strings of a section
+void parse_string_section(struct machore_arch_output_t *arch_output,
+                          uint8_t *buffer, const char *segname,
+                          const char *sectname, uint64_t offset,
+                          uint64_t size) {
+  char *string_start = (char *)buffer + offset;
+  char *string_end = string_start + size;
+  char *string = string_start;
+  while (string < string_end) {
+    // The last string of a section may not be NUL terminated
+    const size_t string_length = strnlen(string, string_end - string);
+    if (string_length > 0) {
+      arch_output->num_strings++;
+      arch_output->strings =
+          realloc(arch_output->strings,
+                  arch_output->num_strings * sizeof(struct string_info));
+      struct string_info *string_info =
+          &arch_output->strings[arch_output->num_strings - 1];
+      assert(string_info != NULL);
+      string_info->size = string_length + 1;
+      string_info->content = malloc(string_info->size);
+      assert(string_info->content != NULL);
+      memcpy(string_info->content, string, string_length);
+      string_info->content[string_length] = '\0';
+      // Names are not NUL terminated when they take all 16 bytes
+      strncpy(string_info->original_segment, segname, 16);
+      string_info->original_segment[16] = '\0';
+      strncpy(string_info->original_section, sectname, 16);
+      string_info->original_section[16] = '\0';
+      string_info->original_offset = offset + (string - string_start);
+    }
+    string += string_length + 1;
   }
 }
 
 void parse_entitlements(CS_GenericBlob_shim *entitlements_blob,
-                        struct machore_arch_output_t *arch_output,
-                        bool should_swap) {
+                        struct machore_arch_output_t *arch_output) {
   // Extract the entitlements XML
-  uint32_t length = should_swap ? OSSwapInt32(entitlements_blob->length)
-                                : entitlements_blob->length;
+  uint32_t length = OSSwapBigToHostInt32(entitlements_blob->length);
   uint32_t xml_length = length - sizeof(CS_GenericBlob_shim);
   char *entitlements = strndup((char *)entitlements_blob->data, xml_length);
-
-  arch_output->entitlements = malloc(xml_length + 1);
-  strcpy(arch_output->entitlements, entitlements);
+  free(arch_output->entitlements);
+  arch_output->entitlements = entitlements;
 
   // Detect sensitive entitlements
   if (strstr(entitlements,
@@ -220,9 +781,8 @@ void parse_entitlements(CS_GenericBlob_shim *entitlements_blob,
 }
 
 void parse_codesign_flags(uint32_t raw_flags,
-                          struct security_flags *security_flags,
-                          bool should_swap) {
-  uint32_t flags = should_swap ? OSSwapInt32(raw_flags) : raw_flags;
+                          struct security_flags *security_flags) {
+  uint32_t flags = OSSwapBigToHostInt32(raw_flags);
   if (flags & CS_RUNTIME) {
     security_flags->has_hardened_runtime = true;
   }
@@ -231,9 +791,12 @@ void parse_codesign_flags(uint32_t raw_flags,
 void parse_security_flags(struct machore_arch_output_t *arch_output,
                           uint8_t *buffer,
                           struct linkedit_data_command *linkedit_data_cmd) {
-  // Allocate memory for the security_flags
-  // and get the pointer to the security_flags
-  arch_output->security_flags = malloc(sizeof(struct security_flags));
+  // Allocate memory for the security_flags (once, a slice may list several
+  // signatures) and get the pointer to the security_flags
+  if (arch_output->security_flags == NULL) {
+    arch_output->security_flags = calloc(1, sizeof(struct security_flags));
+    assert(arch_output->security_flags != NULL);
+  }
   struct security_flags *security_flags = arch_output->security_flags;
 
   security_flags->is_signed = true;
@@ -242,21 +805,18 @@ void parse_security_flags(struct machore_arch_output_t *arch_output,
   uint8_t *code_slot = buffer + linkedit_data_cmd->dataoff;
   CS_SuperBlob_shim *super_blob = (CS_SuperBlob_shim *)code_slot;
 
-  bool should_swap = super_blob->magic != CSMAGIC_EMBEDDED_SIGNATURE;
-  uint32_t count =
-      should_swap ? OSSwapInt32(super_blob->count) : super_blob->count;
+  // Code signature blobs are big-endian, whatever the slice byte order
+  uint32_t count = OSSwapBigToHostInt32(super_blob->count);
 
-  for (uint16_t index = 0; index < count; index++) {
+  for (uint32_t index = 0; index < count; index++) {
     CS_BlobIndex_shim *blob_index = &super_blob->index[index];
-    uint32_t type =
-        should_swap ? OSSwapInt32(blob_index->type) : blob_index->type;
-    uint32_t offset =
-        should_swap ? OSSwapInt32(blob_index->offset) : blob_index->offset;
+    uint32_t type = OSSwapBigToHostInt32(blob_index->type);
+    uint32_t offset = OSSwapBigToHostInt32(blob_index->offset);
     switch (type) {
     case CSSLOT_CODEDIRECTORY: {
       CS_CodeDirectory_shim *code_directory =
           (CS_CodeDirectory_shim *)(code_slot + offset);
-      parse_codesign_flags(code_directory->flags, security_flags, should_swap);
+      parse_codesign_flags(code_directory->flags, security_flags);
       break;
     }
     case CSSLOT_REQUIREMENTS:
@@ -266,128 +826,532 @@ void parse_security_flags(struct machore_arch_output_t *arch_output,
       CS_GenericBlob_shim *entitlements_blob =
           (CS_GenericBlob_shim *)(code_slot + offset);
 
-      uint32_t magic = should_swap ? OSSwapInt32(entitlements_blob->magic)
-                                   : entitlements_blob->magic;
+      uint32_t magic = OSSwapBigToHostInt32(entitlements_blob->magic);
       if (magic != CSMAGIC_EMBEDDED_ENTITLEMENTS) {
         printf("Invalid magic number for entitlements\n");
         break;
       }
       // read only the size of the blob
-      parse_entitlements(entitlements_blob, arch_output, should_swap);
+      parse_entitlements(entitlements_blob, arch_output);
       break;
     }
     }
   }
 }
 
-void parse_symtab(struct machore_arch_output_t *arch_output, uint8_t *buffer,
-                  struct symtab_command *symtab_cmd) {
-  char *str_symbol_table = (char *)buffer + symtab_cmd->stroff;
-  struct nlist_64 *symbol_table_start =
-      (struct nlist_64 *)(buffer + symtab_cmd->symoff);
+// The SuperBlob index and the blobs parse_security_flags() reads lie in the
+// signature
+validation_error_t
+validate_code_signature(const uint8_t *buffer,
+                        const struct linkedit_data_command *linkedit_data_cmd) {
+  const uint8_t *code_slot = buffer + linkedit_data_cmd->dataoff;
+  const uint32_t size = linkedit_data_cmd->datasize;
+  if (size < sizeof(CS_SuperBlob_shim)) {
+    return LIBMACHORE_VALIDATION_BAD_CODE_SIGNATURE;
+  }
+  const CS_SuperBlob_shim *super_blob = (const CS_SuperBlob_shim *)code_slot;
+  const uint32_t count = OSSwapBigToHostInt32(super_blob->count);
+  if (count > (size - sizeof(CS_SuperBlob_shim)) / sizeof(CS_BlobIndex_shim)) {
+    return LIBMACHORE_VALIDATION_BAD_CODE_SIGNATURE;
+  }
 
-  for (uint32_t index = 0; index < symtab_cmd->nsyms; index++) {
-    struct nlist_64 *symbol = &symbol_table_start[index];
-    if (symbol->n_un.n_strx == 0) {
+  for (uint32_t index = 0; index < count; index++) {
+    const uint32_t type = OSSwapBigToHostInt32(super_blob->index[index].type);
+    const uint32_t offset =
+        OSSwapBigToHostInt32(super_blob->index[index].offset);
+    size_t blob_size;
+    switch (type) {
+    case CSSLOT_CODEDIRECTORY:
+      blob_size = sizeof(CS_CodeDirectory_shim);
+      break;
+    case CSSLOT_ENTITLEMENTS:
+      blob_size = sizeof(CS_GenericBlob_shim);
+      break;
+    default:
       continue;
     }
+    if (!is_range_in_slice(offset, blob_size, size)) {
+      return LIBMACHORE_VALIDATION_BAD_CODE_SIGNATURE;
+    }
+    // The entitlements are copied up to the length of their blob
+    const CS_GenericBlob_shim *blob =
+        (const CS_GenericBlob_shim *)(code_slot + offset);
+    const uint32_t length = OSSwapBigToHostInt32(blob->length);
+    if (type == CSSLOT_ENTITLEMENTS &&
+        OSSwapBigToHostInt32(blob->magic) == CSMAGIC_EMBEDDED_ENTITLEMENTS &&
+        (length < sizeof(CS_GenericBlob_shim) ||
+         !is_range_in_slice(offset, length, size))) {
+      return LIBMACHORE_VALIDATION_BAD_CODE_SIGNATURE;
+    }
+  }
+  return LIBMACHORE_VALIDATION_OK;
+}
 
-    arch_output->num_symbols++;
-    arch_output->symbols =
-        realloc(arch_output->symbols,
-                arch_output->num_symbols * sizeof(struct symbol_info));
-    struct symbol_info *symbol_info =
-        &arch_output->symbols[arch_output->num_symbols - 1];
+// Appends an import, growing the array geometrically: opcode streams do not
+// tell upfront how many symbols they bind.
+struct import_info *append_import(struct machore_arch_output_t *arch_output,
+                                  size_t *capacity) {
+  if (arch_output->num_imports == *capacity) {
+    *capacity = *capacity == 0 ? 64 : *capacity * 2;
+    arch_output->imports = realloc(arch_output->imports,
+                                   *capacity * sizeof(struct import_info));
+    assert(arch_output->imports != NULL);
+  }
+  struct import_info *import_info =
+      &arch_output->imports[arch_output->num_imports++];
+  import_info->name = NULL;
+  import_info->library_ordinal = 0;
+  import_info->is_weak = false;
+  import_info->num_references = 0;
+  return import_info;
+}
 
-    char *symbol_name = str_symbol_table + symbol->n_un.n_strx;
-    symbol_info->name = symbol_name;
+// Interprets a bind opcode stream (see BIND_OPCODE_* in loader.h). Lazy
+// binding streams are made of DONE terminated entries, so DONE only ends
+// the regular stream.
+void parse_bind_stream(struct machore_arch_output_t *arch_output,
+                       size_t *capacity, const uint8_t *cursor,
+                       const uint8_t *end, bool is_lazy) {
+  const char *symbol_name = NULL;
+  int32_t ordinal = 0;
+  bool is_weak = false;
+  struct import_info *current = NULL;
 
-    if (symbol->n_sect == NO_SECT) {
-      symbol_info->has_no_section = true;
-    } else {
-      symbol_info->has_no_section = false;
+  while (cursor < end) {
+    uint8_t immediate = *cursor & BIND_IMMEDIATE_MASK;
+    uint8_t opcode = *cursor & BIND_OPCODE_MASK;
+    cursor++;
+
+    uint64_t value;
+    uint64_t skip;
+    int64_t addend;
+    uint32_t num_binds = 0;
+    switch (opcode) {
+    case BIND_OPCODE_DONE:
+      if (!is_lazy) {
+        return;
+      }
+      break;
+    case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+      ordinal = immediate;
+      current = NULL;
+      break;
+    case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB:
+      if (!read_uleb128(&cursor, end, &value)) {
+        return;
+      }
+      ordinal = (int32_t)value;
+      current = NULL;
+      break;
+    case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+      // Special ordinals are negative numbers stored in the immediate
+      ordinal = immediate == 0 ? 0 : (int8_t)(BIND_OPCODE_MASK | immediate);
+      current = NULL;
+      break;
+    case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM: {
+      symbol_name = (const char *)cursor;
+      size_t name_size = strnlen(symbol_name, end - cursor);
+      if (name_size == (size_t)(end - cursor)) {
+        return;
+      }
+      cursor += name_size + 1;
+      is_weak = immediate & BIND_SYMBOL_FLAGS_WEAK_IMPORT;
+      current = NULL;
+      break;
+    }
+    case BIND_OPCODE_SET_TYPE_IMM:
+      break;
+    case BIND_OPCODE_SET_ADDEND_SLEB:
+      if (!read_sleb128(&cursor, end, &addend)) {
+        return;
+      }
+      break;
+    case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+    case BIND_OPCODE_ADD_ADDR_ULEB:
+      if (!read_uleb128(&cursor, end, &value)) {
+        return;
+      }
+      break;
+    case BIND_OPCODE_DO_BIND:
+    case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+      num_binds = 1;
+      break;
+    case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
+      if (!read_uleb128(&cursor, end, &value)) {
+        return;
+      }
+      num_binds = 1;
+      break;
+    case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB:
+      if (!read_uleb128(&cursor, end, &value) ||
+          !read_uleb128(&cursor, end, &skip)) {
+        return;
+      }
+      num_binds = (uint32_t)value;
+      break;
+    case BIND_OPCODE_THREADED:
+      if (immediate ==
+              BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB &&
+          !read_uleb128(&cursor, end, &value)) {
+        return;
+      }
+      break;
+    default:
+      // Unknown opcode, the rest of the stream can't be trusted
+      return;
     }
 
-    // TODO: handle symbol type N_TYPE
-    // (with #include <mach-o/stab.h> for stabs)
-    uint8_t type = symbol->n_type;
-    if (type & N_STAB) {
-      strcpy(symbol_info->type, "STAB");
-    } else if (type & N_EXT) {
-      strcpy(symbol_info->type, "EXTERNAL");
-    } else {
-      strcpy(symbol_info->type, "PRIVATE EXTERNAL");
+    if (num_binds > 0 && symbol_name != NULL) {
+      // Consecutive binds of the same symbol share one import
+      if (current == NULL) {
+        current = append_import(arch_output, capacity);
+        current->name = symbol_name;
+        current->library_ordinal = ordinal;
+        current->is_weak = is_weak;
+      }
+      current->num_references += num_binds;
     }
   }
 }
 
-void parse_load_commands(struct machore_arch_output_t *arch_output,
-                         uint8_t *buffer, uint32_t ncmds) {
-  struct mach_header *header = (struct mach_header *)buffer;
-  uint32_t magic_header = header->magic;
+void parse_bind_opcodes(struct machore_arch_output_t *arch_output,
+                        uint8_t *buffer,
+                        struct dyld_info_command *dyld_info_cmd) {
+  size_t capacity = arch_output->num_imports;
+  const uint8_t *bind = buffer + dyld_info_cmd->bind_off;
+  parse_bind_stream(arch_output, &capacity, bind,
+                    bind + dyld_info_cmd->bind_size, false);
+  const uint8_t *lazy_bind = buffer + dyld_info_cmd->lazy_bind_off;
+  parse_bind_stream(arch_output, &capacity, lazy_bind,
+                    lazy_bind + dyld_info_cmd->lazy_bind_size, true);
+}
 
-  // Go to the first load command
-  // account for the size of the mach header
-  uint8_t *cmd;
-  if (magic_header == MH_MAGIC_64) {
-    cmd = buffer + sizeof(struct mach_header_64);
-  } else {
-    cmd = buffer + sizeof(struct mach_header);
+// Counts the binds of every chain starting in the pages of one segment.
+// Rebases are skipped, binds carry the index of their import.
+void walk_chained_fixups_segment(struct machore_arch_output_t *arch_output,
+                                 uint8_t *buffer,
+                                 const struct dyld_chained_starts_in_segment
+                                     *starts,
+                                 const struct segment_range *segment) {
+  uint32_t stride;
+  bool is_32 = false;
+  switch (starts->pointer_format) {
+  case DYLD_CHAINED_PTR_ARM64E:
+  case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+  case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+    stride = 8;
+    break;
+  case DYLD_CHAINED_PTR_64:
+  case DYLD_CHAINED_PTR_64_OFFSET:
+    stride = 4;
+    break;
+  case DYLD_CHAINED_PTR_32:
+    stride = 4;
+    is_32 = true;
+    break;
+  default:
+    // Cache and firmware formats never bind to dylibs
+    return;
   }
 
-  for (uint32_t index = 0; index < ncmds; index++) {
-    struct load_command *lc = (struct load_command *)cmd;
-
-    switch (lc->cmd) {
-    case LC_LOAD_DYLIB:
-    case LC_LOAD_WEAK_DYLIB:
-    case LC_ID_DYLIB:
-    case LC_REEXPORT_DYLIB:
-    case LC_LOAD_UPWARD_DYLIB:
-    case LC_LAZY_LOAD_DYLIB: {
-      // TODO: we should add context, like the original_load_command
-      parse_dylib_command((struct dylib_command *)lc, arch_output);
-      break;
+  for (uint16_t page = 0; page < starts->page_count; page++) {
+    uint16_t start = starts->page_start[page];
+    if (start == DYLD_CHAINED_PTR_START_NONE) {
+      continue;
     }
-    // TODO: handle other __LINKEDIT segments
-    case LC_SEGMENT_64: {
-      struct segment_command_64 *seg = (struct segment_command_64 *)lc;
-      if (strcmp(seg->segname, "__TEXT") == 0) {
-        parse_text_segment64(arch_output, buffer, seg);
-      } else if (strcmp(seg->segname, "__DATA") == 0) {
-        parse_data_segment64(arch_output, buffer, seg);
-      } else if (strcmp(seg->segname, "__DATA_CONST") == 0) {
-        parse_data_const_segment64(arch_output, buffer, seg);
+    // Only 32-bit chains may have several starts in a page, listed after
+    // the page_start array
+    uint16_t overflow_index = start & ~DYLD_CHAINED_PTR_START_MULTI;
+    bool has_multiple_starts = is_32 && (start & DYLD_CHAINED_PTR_START_MULTI);
+    bool is_last_start = !has_multiple_starts;
+
+    do {
+      if (has_multiple_starts) {
+        start = starts->page_start[overflow_index++];
+        is_last_start = start & DYLD_CHAINED_PTR_START_LAST;
+        start &= ~DYLD_CHAINED_PTR_START_LAST;
       }
-      break;
-    }
-    case LC_SEGMENT: {
-      struct segment_command *seg = (struct segment_command *)lc;
-      if (strcmp(seg->segname, "__TEXT") == 0) {
-        parse_text_segment(arch_output, buffer, seg);
-      } else if (strcmp(seg->segname, "__DATA") == 0) {
-        parse_data_segment(arch_output, buffer, seg);
-      } else if (strcmp(seg->segname, "__DATA_CONST") == 0) {
-        parse_data_const_segment(arch_output, buffer, seg);
+
+      uint64_t offset = (uint64_t)page * starts->page_size + start;
+      for (;;) {
+        if (offset + (is_32 ? 4 : 8) > segment->filesize) {
+          break;
+        }
+        uint8_t *location = buffer + segment->fileoff + offset;
+        uint64_t raw;
+        uint64_t next;
+        bool is_bind;
+        uint32_t import_index;
+        if (is_32) {
+          uint32_t raw32 = *(uint32_t *)location;
+          raw = raw32;
+          is_bind = raw32 >> 31;
+          next = (raw32 >> 26) & 0x1F;
+          import_index = raw32 & 0xFFFFF;
+        } else {
+          raw = *(uint64_t *)location;
+          if (stride == 8) {
+            is_bind = (raw >> 62) & 1;
+            next = (raw >> 51) & 0x7FF;
+            import_index = starts->pointer_format ==
+                                   DYLD_CHAINED_PTR_ARM64E_USERLAND24
+                               ? raw & 0xFFFFFF
+                               : raw & 0xFFFF;
+          } else {
+            is_bind = raw >> 63;
+            next = (raw >> 51) & 0xFFF;
+            import_index = raw & 0xFFFFFF;
+          }
+        }
+
+        if (is_bind && import_index < arch_output->num_imports) {
+          arch_output->imports[import_index].num_references++;
+        }
+        if (next == 0) {
+          break;
+        }
+        offset += next * stride;
       }
-      break;
+    } while (!is_last_start);
+  }
+}
+
+void parse_chained_fixups(struct machore_arch_output_t *arch_output,
+                          uint8_t *buffer,
+                          struct linkedit_data_command *linkedit_data_cmd,
+                          const struct segment_map *segments) {
+  uint8_t *fixups = buffer + linkedit_data_cmd->dataoff;
+  struct dyld_chained_fixups_header *header =
+      (struct dyld_chained_fixups_header *)fixups;
+  // Compressed symbol pools would need zlib: say the imports are unknown
+  // rather than leave an empty table that reads as "no imports"
+  if (header->fixups_version != 0 || header->symbols_format != 0) {
+    arch_output->imports_status = LIBMACHORE_IMPORTS_UNSUPPORTED;
+    return;
+  }
+
+  // 1. Decode the import table, chains refer to imports by index
+  size_t import_size;
+  switch (header->imports_format) {
+  case DYLD_CHAINED_IMPORT:
+    import_size = sizeof(uint32_t);
+    break;
+  case DYLD_CHAINED_IMPORT_ADDEND:
+    import_size = 2 * sizeof(uint32_t);
+    break;
+  case DYLD_CHAINED_IMPORT_ADDEND64:
+    import_size = 2 * sizeof(uint64_t);
+    break;
+  default:
+    arch_output->imports_status = LIBMACHORE_IMPORTS_UNSUPPORTED;
+    return;
+  }
+
+  // The import table is sized upfront: a single allocation
+  arch_output->imports =
+      realloc(arch_output->imports, header->imports_count *
+                                         sizeof(struct import_info));
+  assert(header->imports_count == 0 || arch_output->imports != NULL);
+  arch_output->num_imports = header->imports_count;
+
+  const uint8_t *import = fixups + header->imports_offset;
+  const char *symbols = (const char *)fixups + header->symbols_offset;
+  for (uint32_t index = 0; index < header->imports_count; index++) {
+    struct import_info *import_info = &arch_output->imports[index];
+    uint64_t name_offset;
+    if (header->imports_format == DYLD_CHAINED_IMPORT_ADDEND64) {
+      uint64_t raw = *(const uint64_t *)import;
+      // 16 bits ordinal, special ordinals are sign extended
+      import_info->library_ordinal = (int16_t)(raw & 0xFFFF);
+      import_info->is_weak = (raw >> 16) & 1;
+      name_offset = raw >> 32;
+    } else {
+      uint32_t raw = *(const uint32_t *)import;
+      // 8 bits ordinal, special ordinals are sign extended
+      import_info->library_ordinal = (int8_t)(raw & 0xFF);
+      import_info->is_weak = (raw >> 8) & 1;
+      name_offset = raw >> 9;
     }
-    case LC_CODE_SIGNATURE: {
-      struct linkedit_data_command *linkedit_data_cmd =
-          (struct linkedit_data_command *)lc;
-      parse_security_flags(arch_output, buffer, linkedit_data_cmd);
-      break;
+    // Regular ordinals above 127 don't fit an int8_t, only the 3 special
+    // ordinals are negative
+    if (import_info->library_ordinal < LIBMACHORE_ORDINAL_WEAK_LOOKUP) {
+      import_info->library_ordinal &=
+          header->imports_format == DYLD_CHAINED_IMPORT_ADDEND64 ? 0xFFFF
+                                                                 : 0xFF;
     }
-    case LC_SYMTAB: {
-      struct symtab_command *symtab_cmd = (struct symtab_command *)lc;
-      parse_symtab(arch_output, buffer, symtab_cmd);
+    import_info->name = symbols + name_offset;
+    import_info->num_references = 0;
+    import += import_size;
+  }
+
+  // 2. Walk the chains of every segment to count the bound locations
+  const struct dyld_chained_starts_in_image *starts_in_image =
+      (const struct dyld_chained_starts_in_image *)(fixups +
+                                                    header->starts_offset);
+  for (uint32_t segment_index = 0;
+       segment_index < starts_in_image->seg_count &&
+       segment_index < segments->num_segments;
+       segment_index++) {
+    uint32_t seg_info_offset = starts_in_image->seg_info_offset[segment_index];
+    if (seg_info_offset == 0) {
+      continue;
     }
-    default:
-      break;
+    const struct dyld_chained_starts_in_segment *starts =
+        (const struct dyld_chained_starts_in_segment *)((const uint8_t *)
+                                                            starts_in_image +
+                                                        seg_info_offset);
+    walk_chained_fixups_segment(arch_output, buffer, starts,
+                                &segments->segments[segment_index]);
+  }
+}
+
+// The import table, the names it points to and the chain starts that
+// parse_chained_fixups() decodes lie in the fixups data, whose symbol pool
+// ends with a NUL
+validation_error_t
+validate_chained_fixups(const uint8_t *buffer,
+                        const struct linkedit_data_command *linkedit_data_cmd) {
+  const uint8_t *fixups = buffer + linkedit_data_cmd->dataoff;
+  const uint32_t size = linkedit_data_cmd->datasize;
+  if (size < sizeof(struct dyld_chained_fixups_header)) {
+    return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
+  }
+  const struct dyld_chained_fixups_header *header =
+      (const struct dyld_chained_fixups_header *)fixups;
+  size_t import_size;
+  switch (header->imports_format) {
+  case DYLD_CHAINED_IMPORT:
+    import_size = sizeof(uint32_t);
+    break;
+  case DYLD_CHAINED_IMPORT_ADDEND:
+    import_size = 2 * sizeof(uint32_t);
+    break;
+  case DYLD_CHAINED_IMPORT_ADDEND64:
+    import_size = 2 * sizeof(uint64_t);
+    break;
+  default:
+    import_size = 0;
+    break;
+  }
+  // Formats the parser skips: an unknown version, or imports it leaves out
+  // (the chain starts are still read for the pointer formats)
+  if (header->fixups_version != 0) {
+    return LIBMACHORE_VALIDATION_OK;
+  }
+  const uint32_t imports_count =
+      header->symbols_format == 0 && import_size != 0 ? header->imports_count
+                                                      : 0;
+
+  // 1. Imports and their names
+  if (imports_count > 0 &&
+      (header->imports_offset > size ||
+       imports_count > (size - header->imports_offset) / import_size ||
+       header->symbols_offset >= size || fixups[size - 1] != '\0')) {
+    return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
+  }
+  const uint32_t symbols_size = size - header->symbols_offset;
+  const uint8_t *import = fixups + header->imports_offset;
+  for (uint32_t index = 0; index < imports_count;
+       index++, import += import_size) {
+    uint64_t name_offset =
+        import_size == 2 * sizeof(uint64_t)
+            ? *(const uint64_t *)import >> 32
+            : *(const uint32_t *)import >> 9;
+    if (name_offset >= symbols_size) {
+      return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
     }
+  }
 
-    cmd += lc->cmdsize;
+  // 2. Starts of every segment, and the extra starts of 32-bit pages
+  const uint32_t starts_offset = header->starts_offset;
+  if (starts_offset > size - sizeof(uint32_t)) {
+    return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
+  }
+  const struct dyld_chained_starts_in_image *starts_in_image =
+      (const struct dyld_chained_starts_in_image *)(fixups + starts_offset);
+  const uint32_t seg_count = starts_in_image->seg_count;
+  if (seg_count >
+      (size - starts_offset - sizeof(uint32_t)) / sizeof(uint32_t)) {
+    return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
   }
+  const size_t page_start_offset =
+      offsetof(struct dyld_chained_starts_in_segment, page_start);
+  for (uint32_t index = 0; index < seg_count; index++) {
+    const uint64_t seg_info_offset = starts_in_image->seg_info_offset[index];
+    if (seg_info_offset == 0) {
+      continue;
+    }
+    const uint64_t offset = starts_offset + seg_info_offset;
+    if (!is_range_in_slice(offset, page_start_offset, size)) {
+      return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
+    }
+    const struct dyld_chained_starts_in_segment *starts =
+        (const struct dyld_chained_starts_in_segment *)(fixups + offset);
+    // Entries of page_start, page starts then the lists of extra starts
+    const uint64_t num_starts =
+        (size - offset - page_start_offset) / sizeof(uint16_t);
+    if (starts->page_count > num_starts) {
+      return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
+    }
+    if (starts->pointer_format != DYLD_CHAINED_PTR_32) {
+      continue;
+    }
+    for (uint16_t page = 0; page < starts->page_count; page++) {
+      uint16_t start = starts->page_start[page];
+      if (start == DYLD_CHAINED_PTR_START_NONE ||
+          !(start & DYLD_CHAINED_PTR_START_MULTI)) {
+        continue;
+      }
+      uint64_t overflow_index = start & ~DYLD_CHAINED_PTR_START_MULTI;
+      do {
+        if (overflow_index >= num_starts) {
+          return LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS;
+        }
+      } while (!(starts->page_start[overflow_index++] &
+                 DYLD_CHAINED_PTR_START_LAST));
+    }
+  }
+  return LIBMACHORE_VALIDATION_OK;
+}
+
+_Static_assert(sizeof(struct data_in_code_info) ==
+                   sizeof(struct data_in_code_entry),
+               "data_in_code_info must mirror data_in_code_entry");
+
+// LC_FUNCTION_STARTS is a uleb128 stream: the offset of the first function
+// from the start of __TEXT, then the delta to each following function, up to
+// a 0 terminator.
+void parse_function_starts(struct machore_arch_output_t *arch_output,
+                           uint8_t *buffer,
+                           struct linkedit_data_command *linkedit_data_cmd,
+                           const struct segment_map *segments) {
+  if (linkedit_data_cmd->datasize == 0) {
+    return;
+  }
+
+  // Every value takes at least one byte: decode into an upper bound sized
+  // array, then give the unused tail back
+  const uint8_t *cursor = buffer + linkedit_data_cmd->dataoff;
+  const uint8_t *end = cursor + linkedit_data_cmd->datasize;
+  uint64_t *addresses = malloc(linkedit_data_cmd->datasize * sizeof(uint64_t));
+  assert(addresses != NULL);
+  size_t count = decode_uleb128_batch(&cursor, end, addresses,
+                                      linkedit_data_cmd->datasize);
+
+  uint64_t address = segments->base_address;
+  size_t num_function_starts = 0;
+  while (num_function_starts < count && addresses[num_function_starts] != 0) {
+    address += addresses[num_function_starts];
+    addresses[num_function_starts++] = address;
+  }
+
+  if (num_function_starts == 0) {
+    free(addresses);
+    return;
+  }
+  arch_output->function_starts =
+      realloc(addresses, num_function_starts * sizeof(uint64_t));
+  arch_output->num_function_starts = num_function_starts;
 }
 
 void copy_cpu_arch(uint32_t cpu_type, char *output_str,
@@ -448,6 +1412,221 @@ void parse_flags(uint32_t flags, struct machore_arch_output_t *arch_output) {
   arch_output->enforce_no_heap_exec = flags & MH_NO_HEAP_EXECUTION;
 }
 
+/*
+ * Byte statistics, computed on first access by machore_section_stats() or
+ * machore_segment_stats().
+ *
+ * Every byte is read once: sections are counted into their own histogram,
+ * which is then added to their segment, and only the bytes between sections
+ * are counted into the segment directly.
+ */
+
+struct stats_range {
+  uint64_t offset;
+  uint64_t size;
+  struct byte_stats_info *stats;
+};
+
+bool is_zerofill_section(uint32_t flags) {
+  uint32_t type = flags & SECTION_TYPE;
+  return type == S_ZEROFILL || type == S_GB_ZEROFILL ||
+         type == S_THREAD_LOCAL_ZEROFILL;
+}
+
+// dSYM files keep the section headers of the binary, with a 0 offset
+bool has_section_contents(uint32_t flags, uint64_t offset) {
+  return !is_zerofill_section(flags) && offset != 0;
+}
+
+void init_byte_stats(struct byte_stats_info *stats, const char *segname,
+                     const char *sectname, uint64_t offset, uint64_t size) {
+  memset(stats, 0, sizeof(struct byte_stats_info));
+  // Names are not NUL terminated when they take all 16 bytes
+  memcpy(stats->original_segment, segname, 16);
+  if (sectname != NULL) {
+    memcpy(stats->original_section, sectname, 16);
+  }
+  stats->original_offset = offset;
+  stats->size = size;
+}
+
+void add_section_range(struct stats_range *ranges, size_t *num_ranges,
+                       struct byte_stats_info *stats, uint32_t flags) {
+  if (!has_section_contents(flags, stats->original_offset)) {
+    stats->size = 0;
+    return;
+  }
+  // Sorted by offset, sections are usually in order already
+  size_t position = (*num_ranges)++;
+  while (position > 0 &&
+         ranges[position - 1].offset > stats->original_offset) {
+    ranges[position] = ranges[position - 1];
+    position--;
+  }
+  ranges[position].offset = stats->original_offset;
+  ranges[position].size = stats->size;
+  ranges[position].stats = stats;
+}
+
+void compute_segment_stats(uint8_t *buffer, struct byte_stats_info *segment,
+                           struct stats_range *ranges, size_t num_ranges) {
+  uint64_t cursor = segment->original_offset;
+  uint64_t end = segment->original_offset + segment->size;
+  for (size_t index = 0; index < num_ranges; index++) {
+    struct stats_range *range = &ranges[index];
+    byte_histogram_add(buffer + range->offset, range->size,
+                       range->stats->histogram);
+    finalize_byte_stats(range->stats);
+
+    uint64_t start = range->offset > cursor ? range->offset : cursor;
+    uint64_t range_end = range->offset + range->size;
+    if (range_end > end) {
+      range_end = end;
+    }
+    if (start >= range_end) {
+      continue;
+    }
+    if (start > cursor) {
+      byte_histogram_add(buffer + cursor, start - cursor, segment->histogram);
+    }
+    if (start == range->offset && range_end == range->offset + range->size) {
+      for (int byte = 0; byte < 256; byte++) {
+        segment->histogram[byte] += range->stats->histogram[byte];
+      }
+    } else {
+      // Overlapping or out of segment section: only count its bytes once
+      byte_histogram_add(buffer + start, range_end - start,
+                         segment->histogram);
+    }
+    cursor = range_end;
+  }
+  if (end > cursor) {
+    byte_histogram_add(buffer + cursor, end - cursor, segment->histogram);
+  }
+  finalize_byte_stats(segment);
+}
+
+// Segments a __cfstring section is decoded in: recent linkers put it in
+// __DATA_CONST, read only once fixed up, and in __AUTH_CONST on arm64e
+bool is_cfstring_segment(const char *segname) {
+  return strncmp(segname, "__DATA", 16) == 0 ||
+         strncmp(segname, "__DATA_CONST", 16) == 0 ||
+         strncmp(segname, "__DATA_DIRTY", 16) == 0 ||
+         strncmp(segname, "__AUTH_CONST", 16) == 0;
+}
+
+// Sections parse_string_section() extracts strings from
+bool is_string_section(const char *segname, const char *sectname) {
+  if (strcmp(segname, "__TEXT") == 0) {
+    return strcmp(sectname, "__cstring") == 0 ||
+           strcmp(sectname, "__const") == 0 ||
+           strcmp(sectname, "__oslogstring") == 0;
+  }
+  if (strcmp(segname, "__DATA") == 0 || strcmp(segname, "__DATA_CONST") == 0) {
+    return strcmp(sectname, "__const") == 0;
+  }
+  return false;
+}
+
+struct section_scan {
+  machore_pattern_visitor_t visitor;
+  void *context;
+  size_t arch_index;
+  uint64_t section_offset;
+  const char *segname;
+  const char *sectname;
+  bool is_stopped;
+};
+
+// Rebases the matches of a section scan on the slice
+bool forward_section_match(const struct pattern_match *match, void *context) {
+  struct section_scan *scan = context;
+  struct pattern_match slice_match = *match;
+  slice_match.arch_index = scan->arch_index;
+  slice_match.original_offset += scan->section_offset;
+  strncpy(slice_match.original_segment, scan->segname,
+          LIBMACHORE_ORIGINAL_SEGMENT_SIZE - 1);
+  strncpy(slice_match.original_section, scan->sectname,
+          LIBMACHORE_ORIGINAL_SECTION_SIZE - 1);
+  if (scan->visitor != NULL && !scan->visitor(&slice_match, scan->context)) {
+    scan->is_stopped = true;
+    return false;
+  }
+  return true;
+}
+
+size_t scan_section(const struct machore_pattern_set *set, uint8_t *buffer,
+                    struct section_scan *scan, const char *segname,
+                    const char *sectname, uint64_t offset, uint64_t size) {
+  if (!is_string_section(segname, sectname)) {
+    return 0;
+  }
+  // Section names may use all 16 bytes without a NUL terminator
+  char section_name[17] = {0};
+  memcpy(section_name, sectname, 16);
+  scan->segname = segname;
+  scan->sectname = section_name;
+  scan->section_offset = offset;
+  return machore_pattern_set_scan(set, buffer + offset, size,
+                                  forward_section_match, scan);
+}
+
+/*
+ * Decoders of the slice layouts, see slice_decoder.h. Everything that walks
+ * the header, load commands or sections of a slice goes through the decoder
+ * picked from its magic.
+ */
+struct slice_decoder {
+  void (*parse)(struct machore_arch_output_t *arch_output, uint8_t *buffer,
+                bool is_paged);
+  void (*compute_byte_stats)(struct machore_arch_output_t *arch_output,
+                             uint8_t *buffer);
+  size_t (*scan_patterns)(const struct machore_pattern_set *set,
+                          uint8_t *buffer, struct section_scan *scan);
+  size_t (*index_symbols)(uint8_t *buffer, const struct symtab_location *symtab,
+                          uint32_t *entries);
+  void (*decode_symbol)(uint8_t *buffer, const struct symtab_location *symtab,
+                        uint32_t entry, struct symbol_info *symbol_info);
+  bool (*validate)(const uint8_t *buffer, uint64_t size,
+                   struct validation_result *result);
+};
+
+#define SLICE_IS_64 1
+#define SLICE_IS_SWAPPED 0
+#define SLICE_SUFFIX 64
+#include "slice_decoder.h"
+
+#define SLICE_IS_64 1
+#define SLICE_IS_SWAPPED 1
+#define SLICE_SUFFIX 64_swapped
+#include "slice_decoder.h"
+
+#define SLICE_IS_64 0
+#define SLICE_IS_SWAPPED 0
+#define SLICE_SUFFIX 32
+#include "slice_decoder.h"
+
+#define SLICE_IS_64 0
+#define SLICE_IS_SWAPPED 1
+#define SLICE_SUFFIX 32_swapped
+#include "slice_decoder.h"
+
+// NULL when the slice is not a Mach-O
+const struct slice_decoder *get_slice_decoder(const uint8_t *buffer) {
+  switch (*(const uint32_t *)buffer) {
+  case MH_MAGIC_64:
+    return &slice_decoder_64;
+  case MH_CIGAM_64:
+    return &slice_decoder_64_swapped;
+  case MH_MAGIC:
+    return &slice_decoder_32;
+  case MH_CIGAM:
+    return &slice_decoder_32_swapped;
+  default:
+    return NULL;
+  }
+}
+
 void parse_macho_arch(struct machore_output_t *output, int arch_index,
                       uint8_t *buffer) {
   // 1. Allocate memory for the new arch_output struct
@@ -461,25 +1640,129 @@ void parse_macho_arch(struct machore_output_t *output, int arch_index,
 
   // 2. Pick the the arch_output struct that we just allocated
   struct machore_arch_output_t *arch_output = &output->arch_outputs[arch_index];
+  memset(arch_output, 0, sizeof(struct machore_arch_output_t));
 
-  // 3. Pick the macho header of this architecture
-  struct mach_header *header = (struct mach_header *)buffer;
+  // 3. Pick the decoder of this architecture
+  const struct slice_decoder *decoder = get_slice_decoder(buffer);
+  if (decoder == NULL) {
+    strncpy(arch_output->architecture, "Unknown",
+            LIBMACHORE_ARCHITECTURE_SIZE);
+    arch_output->filetype = LIBMACHORE_FILETYPE_NOT_SUPPORTED;
+    return;
+  }
 
-  // 4. Copy the architecture name
-  uint32_t cpu_type = header->cputype;
-  copy_cpu_arch(cpu_type, arch_output->architecture,
-                LIBMACHORE_ARCHITECTURE_SIZE);
+  // 4. Parse the header and the load commands
+  decoder->parse(arch_output, buffer, output->is_paged);
+  arch_output->slice_context->decoder = decoder;
+}
 
-  // 5. Assin the filetype enum
-  uint32_t filetype = header->filetype;
-  arch_output->filetype = get_file_type(filetype);
+void compute_byte_stats(struct machore_arch_output_t *arch_output) {
+  arch_output->is_byte_stats_computed = true;
+  if (arch_output->slice_context == NULL) {
+    return;
+  }
+  struct machore_slice_context *slice_context = arch_output->slice_context;
+  slice_context->decoder->compute_byte_stats(arch_output,
+                                             slice_context->buffer);
+}
 
-  // 6. Parse the load commands
-  uint32_t ncmds = header->ncmds;
-  parse_load_commands(arch_output, buffer, ncmds);
+size_t scan_patterns_arch(const struct machore_pattern_set *set,
+                          uint8_t *buffer, struct section_scan *scan) {
+  const struct slice_decoder *decoder = get_slice_decoder(buffer);
+  return decoder != NULL ? decoder->scan_patterns(set, buffer, scan) : 0;
+}
 
-  // 7. Parse flags
-  parse_flags(header->flags, arch_output);
+/*
+ * Paging indexes. One scan of the string sections (memchr for the NUL
+ * separators) or of the symbol table records a 32-bit offset per entry;
+ * entries are then decoded one at a time, when asked for.
+ */
+
+void build_string_index(struct machore_slice_context *slice_context) {
+  slice_context->is_string_index_built = true;
+  const char *buffer = (const char *)slice_context->buffer;
+  size_t capacity = 0;
+  for (size_t index = 0; index < slice_context->num_string_sections;
+       index++) {
+    struct string_section *section = &slice_context->string_sections[index];
+    section->first_string = slice_context->num_strings;
+    if (section->is_utf16) {
+      continue;
+    }
+    const char *string = buffer + section->offset;
+    const char *end = string + section->size;
+    while (string < end) {
+      const char *string_end = memchr(string, '\0', end - string);
+      if (string_end == NULL) {
+        string_end = end;
+      }
+      if (string_end > string) {
+        if (slice_context->num_strings == capacity) {
+          capacity = capacity ? 2 * capacity : 1024;
+          slice_context->string_offsets = realloc(
+              slice_context->string_offsets, capacity * sizeof(uint32_t));
+          assert(slice_context->string_offsets != NULL);
+        }
+        slice_context->string_offsets[slice_context->num_strings++] =
+            (uint32_t)(string - buffer);
+      }
+      string = string_end + 1;
+    }
+  }
+}
+
+// Section holding the string at `index`. Sections without strings share
+// their first_string with the next one, which holds the string.
+const struct string_section *
+find_string_section(const struct machore_slice_context *slice_context,
+                    size_t index) {
+  size_t low = 0;
+  size_t high = slice_context->num_string_sections;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (slice_context->string_sections[middle].first_string <= index) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return &slice_context->string_sections[low - 1];
+}
+
+void read_indexed_string(const struct machore_slice_context *slice_context,
+                         const struct string_section *section, size_t index,
+                         struct string_info *string_info) {
+  uint32_t offset = slice_context->string_offsets[index];
+  char *content = (char *)slice_context->buffer + offset;
+  size_t available = section->offset + section->size - (uint64_t)offset;
+  size_t length = strnlen(content, available);
+  string_info->content = content;
+  // The last string of a section may not be NUL terminated: the view stops
+  // at the section end, without counting a NUL it doesn't have
+  string_info->size = length < available ? length + 1 : length;
+  string_info->original_offset = offset;
+  strcpy(string_info->original_segment, section->segname);
+  strcpy(string_info->original_section, section->sectname);
+}
+
+void build_symbol_index(struct machore_slice_context *slice_context) {
+  slice_context->is_symbol_index_built = true;
+  const struct symtab_location *symtab = &slice_context->symtab;
+  if (symtab->nsyms == 0) {
+    return;
+  }
+  // Sized for every entry, the unnamed ones are given back
+  uint32_t *entries = malloc(symtab->nsyms * sizeof(uint32_t));
+  assert(entries != NULL);
+  size_t num_symbols = slice_context->decoder->index_symbols(
+      slice_context->buffer, symtab, entries);
+  if (num_symbols == 0) {
+    free(entries);
+    return;
+  }
+  slice_context->symbol_entries =
+      realloc(entries, num_symbols * sizeof(uint32_t));
+  slice_context->num_symbols = num_symbols;
 }
 
 /*
@@ -494,6 +1777,11 @@ void init_output(struct machore_output_t *analysis) {
   analysis->arch_outputs = NULL;
   analysis->num_arch_outputs = 0;
   analysis->is_fat = false;
+  analysis->is_paged = false;
+  analysis->validation.error = LIBMACHORE_VALIDATION_OK;
+  analysis->validation.arch_index = 0;
+  analysis->validation.load_command_index = LIBMACHORE_NO_LOAD_COMMAND;
+  analysis->validation.offset = 0;
 }
 
 void clean_output(struct machore_output_t *output) {
@@ -506,22 +1794,394 @@ void clean_output(struct machore_output_t *output) {
   output->is_fat = false;
 }
 
+size_t machore_count_strings(struct machore_arch_output_t *arch_output) {
+  struct machore_slice_context *slice_context = arch_output->slice_context;
+  if (slice_context == NULL) {
+    return 0;
+  }
+  if (!slice_context->is_string_index_built) {
+    build_string_index(slice_context);
+  }
+  return slice_context->num_strings;
+}
+
+bool machore_get_string(struct machore_arch_output_t *arch_output,
+                        size_t index, struct string_info *string_info) {
+  return machore_get_strings(arch_output, index, string_info, 1) == 1;
+}
+
+size_t machore_get_strings(struct machore_arch_output_t *arch_output,
+                           size_t first, struct string_info *strings,
+                           size_t max_strings) {
+  size_t num_strings = machore_count_strings(arch_output);
+  if (first >= num_strings) {
+    return 0;
+  }
+  size_t count = num_strings - first < max_strings ? num_strings - first
+                                                   : max_strings;
+
+  const struct machore_slice_context *slice_context =
+      arch_output->slice_context;
+  const struct string_section *section =
+      find_string_section(slice_context, first);
+  const struct string_section *sections_end =
+      slice_context->string_sections + slice_context->num_string_sections;
+  for (size_t index = 0; index < count; index++) {
+    while (section + 1 < sections_end &&
+           section[1].first_string <= first + index) {
+      section++;
+    }
+    read_indexed_string(slice_context, section, first + index,
+                        &strings[index]);
+  }
+  return count;
+}
+
+struct slice_string_scan {
+  machore_string_visitor_t visitor;
+  void *context;
+  const struct string_section *section;
+  bool is_stopped;
+};
+
+// Rebases the runs of a section on the slice
+bool forward_section_run(const struct string_run *run, void *context) {
+  struct slice_string_scan *scan = context;
+  struct string_run slice_run = *run;
+  slice_run.original_offset += scan->section->offset;
+  strcpy(slice_run.original_segment, scan->section->segname);
+  strcpy(slice_run.original_section, scan->section->sectname);
+  if (scan->visitor != NULL && !scan->visitor(&slice_run, scan->context)) {
+    scan->is_stopped = true;
+    return false;
+  }
+  return true;
+}
+
+size_t machore_extract_slice_strings(
+    const struct machore_arch_output_t *arch_output,
+    const struct string_scan_options *options,
+    machore_string_visitor_t visitor, void *context) {
+  const struct machore_slice_context *slice_context =
+      arch_output->slice_context;
+  if (slice_context == NULL) {
+    return 0;
+  }
+  struct slice_string_scan scan = {
+      .visitor = visitor, .context = context, .is_stopped = false};
+  struct string_scan_options section_options = *options;
+  size_t num_runs = 0;
+  for (size_t index = 0;
+       index < slice_context->num_string_sections && !scan.is_stopped;
+       index++) {
+    scan.section = &slice_context->string_sections[index];
+    section_options.is_utf16 = scan.section->is_utf16;
+    num_runs += machore_extract_strings(
+        slice_context->buffer + scan.section->offset, scan.section->size,
+        &section_options, forward_section_run, &scan);
+  }
+  return num_runs;
+}
+
+size_t machore_count_symbols(struct machore_arch_output_t *arch_output) {
+  struct machore_slice_context *slice_context = arch_output->slice_context;
+  if (slice_context == NULL) {
+    return 0;
+  }
+  if (!slice_context->is_symbol_index_built) {
+    build_symbol_index(slice_context);
+  }
+  return slice_context->num_symbols;
+}
+
+bool machore_get_symbol(struct machore_arch_output_t *arch_output,
+                        size_t index, struct symbol_info *symbol_info) {
+  return machore_get_symbols(arch_output, index, symbol_info, 1) == 1;
+}
+
+size_t machore_get_symbols(struct machore_arch_output_t *arch_output,
+                           size_t first, struct symbol_info *symbols,
+                           size_t max_symbols) {
+  size_t num_symbols = machore_count_symbols(arch_output);
+  if (first >= num_symbols) {
+    return 0;
+  }
+  size_t count = num_symbols - first < max_symbols ? num_symbols - first
+                                                   : max_symbols;
+
+  const struct machore_slice_context *slice_context =
+      arch_output->slice_context;
+  for (size_t index = 0; index < count; index++) {
+    slice_context->decoder->decode_symbol(
+        slice_context->buffer, &slice_context->symtab,
+        slice_context->symbol_entries[first + index], &symbols[index]);
+  }
+  return count;
+}
+
+bool machore_is_paged(const struct machore_arch_output_t *arch_output) {
+  return arch_output->slice_context != NULL &&
+         arch_output->slice_context->is_paged;
+}
+
 void parse_macho(struct machore_output_t *output, uint8_t *buffer,
                  size_t size) {
+  // Nothing below checks an offset or a count against `size`
+  if (!machore_validate(buffer, size, &output->validation)) {
+    return;
+  }
+
   bool is_fat = is_fat_header(buffer);
   if (is_fat) {
     output->is_fat = true;
-    struct fat_header *header = (struct fat_header *)buffer;
-    uint32_t nfat_arch = ntohl(header->nfat_arch);
+    uint32_t nfat_arch = get_num_fat_archs(buffer);
 
     for (uint32_t arch_index = 0; arch_index < nfat_arch; arch_index++) {
-      struct fat_arch *arch =
-          (struct fat_arch *)(buffer + sizeof(struct fat_header) +
-                              arch_index * sizeof(struct fat_arch));
-      uint32_t offset = ntohl(arch->offset);
-      parse_macho_arch(output, arch_index, buffer + offset);
+      struct slice_info slice;
+      read_fat_arch(buffer, arch_index, &slice);
+      parse_macho_arch(output, arch_index, buffer + slice.offset);
     }
   } else {
     parse_macho_arch(output, 0, buffer);
   }
 }
+
+size_t machore_scan_patterns(const struct machore_pattern_set *set,
+                             uint8_t *buffer, size_t size,
+                             machore_pattern_visitor_t visitor, void *context) {
+  struct validation_result validation;
+  if (!machore_validate(buffer, size, &validation)) {
+    return 0;
+  }
+
+  struct section_scan scan = {
+      .visitor = visitor, .context = context, .is_stopped = false};
+
+  if (!is_fat_header(buffer)) {
+    scan.arch_index = 0;
+    return scan_patterns_arch(set, buffer, &scan);
+  }
+
+  uint32_t nfat_arch = get_num_fat_archs(buffer);
+  size_t num_matches = 0;
+  for (uint32_t arch_index = 0; arch_index < nfat_arch && !scan.is_stopped;
+       arch_index++) {
+    struct slice_info slice;
+    read_fat_arch(buffer, arch_index, &slice);
+    scan.arch_index = arch_index;
+    num_matches += scan_patterns_arch(set, buffer + slice.offset, &scan);
+  }
+  return num_matches;
+}
+
+bool machore_validate(const uint8_t *buffer, size_t size,
+                      struct validation_result *result) {
+  result->arch_index = 0;
+  result->load_command_index = LIBMACHORE_NO_LOAD_COMMAND;
+  result->offset = 0;
+  if (size < sizeof(uint32_t)) {
+    result->error = LIBMACHORE_VALIDATION_TRUNCATED;
+    return false;
+  }
+
+  if (!is_fat_header(buffer)) {
+    const struct slice_decoder *decoder = get_slice_decoder(buffer);
+    if (decoder == NULL) {
+      result->error = LIBMACHORE_VALIDATION_BAD_MAGIC;
+      return false;
+    }
+    return decoder->validate(buffer, size, result);
+  }
+
+  const size_t arch_size = get_fat_arch_size(buffer);
+  if (size < sizeof(struct fat_header) ||
+      get_num_fat_archs(buffer) >
+          (size - sizeof(struct fat_header)) / arch_size) {
+    result->error = LIBMACHORE_VALIDATION_TRUNCATED;
+    return false;
+  }
+  uint32_t nfat_arch = get_num_fat_archs(buffer);
+  for (uint32_t arch_index = 0; arch_index < nfat_arch; arch_index++) {
+    struct slice_info slice;
+    read_fat_arch(buffer, arch_index, &slice);
+    result->arch_index = arch_index;
+    if (slice.size < sizeof(uint32_t) ||
+        !is_range_in_slice(slice.offset, slice.size, size)) {
+      result->error = LIBMACHORE_VALIDATION_BAD_SLICE;
+      result->offset = sizeof(struct fat_header) + arch_index * arch_size;
+      return false;
+    }
+    // Other formats are parsed as "Unknown" slices
+    const struct slice_decoder *decoder =
+        get_slice_decoder(buffer + slice.offset);
+    if (decoder != NULL &&
+        !decoder->validate(buffer + slice.offset, slice.size, result)) {
+      result->offset += slice.offset;
+      return false;
+    }
+  }
+  result->arch_index = 0;
+  result->error = LIBMACHORE_VALIDATION_OK;
+  return true;
+}
+
+const char *machore_validation_error_string(validation_error_t error) {
+  switch (error) {
+  case LIBMACHORE_VALIDATION_OK:
+    return "valid";
+  case LIBMACHORE_VALIDATION_TRUNCATED:
+    return "truncated header";
+  case LIBMACHORE_VALIDATION_BAD_MAGIC:
+    return "not a Mach-O file";
+  case LIBMACHORE_VALIDATION_BAD_SLICE:
+    return "slice outside of file";
+  case LIBMACHORE_VALIDATION_BAD_LOAD_COMMANDS:
+    return "load commands outside of slice";
+  case LIBMACHORE_VALIDATION_BAD_CMDSIZE:
+    return "invalid cmdsize";
+  case LIBMACHORE_VALIDATION_BAD_SEGMENT:
+    return "segment outside of slice";
+  case LIBMACHORE_VALIDATION_BAD_SECTION:
+    return "section outside of slice";
+  case LIBMACHORE_VALIDATION_BAD_DYLIB:
+    return "invalid dylib name";
+  case LIBMACHORE_VALIDATION_BAD_SYMTAB:
+    return "invalid symbol table";
+  case LIBMACHORE_VALIDATION_BAD_DYLD_INFO:
+    return "dyld info outside of slice";
+  case LIBMACHORE_VALIDATION_BAD_LINKEDIT_DATA:
+    return "linkedit data outside of slice";
+  case LIBMACHORE_VALIDATION_BAD_CODE_SIGNATURE:
+    return "invalid code signature";
+  case LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS:
+    return "invalid chained fixups";
+  default:
+    return "unknown error";
+  }
+}
+
+size_t machore_list_slices(const uint8_t *buffer, size_t size,
+                           struct slice_info *slices, size_t max_slices) {
+  if (size < sizeof(struct mach_header)) {
+    return 0;
+  }
+
+  if (!is_fat_header(buffer)) {
+    const struct mach_header *header = (const struct mach_header *)buffer;
+    bool is_swapped;
+    switch (header->magic) {
+    case MH_MAGIC:
+    case MH_MAGIC_64:
+      is_swapped = false;
+      break;
+    case MH_CIGAM:
+    case MH_CIGAM_64:
+      is_swapped = true;
+      break;
+    default:
+      return 0;
+    }
+    if (max_slices > 0) {
+      // cputype and cpusubtype are at the same offsets in mach_header_64
+      uint32_t cputype = (uint32_t)header->cputype;
+      uint32_t cpusubtype = (uint32_t)header->cpusubtype;
+      if (is_swapped) {
+        cputype = OSSwapInt32(cputype);
+        cpusubtype = OSSwapInt32(cpusubtype);
+      }
+      slices[0].cputype = cputype;
+      slices[0].cpusubtype = cpusubtype;
+      slices[0].offset = 0;
+      slices[0].size = size;
+      slices[0].align = 0;
+    }
+    return 1;
+  }
+
+  uint32_t nfat_arch = get_num_fat_archs(buffer);
+  if (nfat_arch > (size - sizeof(struct fat_header)) /
+                      get_fat_arch_size(buffer)) {
+    return 0;
+  }
+  for (uint32_t arch_index = 0;
+       arch_index < nfat_arch && arch_index < max_slices; arch_index++) {
+    read_fat_arch(buffer, arch_index, &slices[arch_index]);
+  }
+  return nfat_arch;
+}
+
+const struct dylib_info *
+machore_import_dylib(const struct machore_arch_output_t *arch_output,
+                     const struct import_info *import_info) {
+  if (import_info->library_ordinal <= 0) {
+    return NULL;
+  }
+  for (size_t index = 0; index < arch_output->num_dylibs; index++) {
+    if (arch_output->dylibs[index].ordinal ==
+        (uint32_t)import_info->library_ordinal) {
+      return &arch_output->dylibs[index];
+    }
+  }
+  return NULL;
+}
+
+size_t machore_metadata_count(struct machore_arch_output_t *arch_output,
+                              metadata_kind_t kind) {
+  if (kind >= LIBMACHORE_METADATA_COUNT) {
+    return 0;
+  }
+
+  struct metadata_table *table = &arch_output->metadata[kind];
+  if (!table->is_decoded && arch_output->slice_context != NULL) {
+    size_t pointer_size = arch_output->slice_context->segments.is_64 ? 8 : 4;
+    switch (kind) {
+    case LIBMACHORE_METADATA_OBJC_CLASSES:
+    case LIBMACHORE_METADATA_OBJC_SELECTORS:
+      return table->section_size / pointer_size;
+    case LIBMACHORE_METADATA_SWIFT_TYPES:
+      return table->section_size / sizeof(int32_t);
+    default:
+      break;
+    }
+  }
+
+  size_t num_names;
+  machore_metadata_names(arch_output, kind, &num_names);
+  return num_names;
+}
+
+const struct byte_stats_info *
+machore_section_stats(struct machore_arch_output_t *arch_output,
+                      size_t *num_sections) {
+  if (!arch_output->is_byte_stats_computed) {
+    compute_byte_stats(arch_output);
+  }
+  *num_sections = arch_output->num_section_stats;
+  return arch_output->section_stats;
+}
+
+const struct byte_stats_info *
+machore_segment_stats(struct machore_arch_output_t *arch_output,
+                      size_t *num_segments) {
+  if (!arch_output->is_byte_stats_computed) {
+    compute_byte_stats(arch_output);
+  }
+  *num_segments = arch_output->num_segment_stats;
+  return arch_output->segment_stats;
+}
+
+const struct metadata_name *
+machore_metadata_names(struct machore_arch_output_t *arch_output,
+                       metadata_kind_t kind, size_t *num_names) {
+  if (kind >= LIBMACHORE_METADATA_COUNT) {
+    *num_names = 0;
+    return NULL;
+  }
+
+  struct metadata_table *table = &arch_output->metadata[kind];
+  if (!table->is_decoded) {
+    decode_metadata_table(arch_output, kind);
+  }
+  *num_names = table->num_names;
+  return table->names;
+}
@@ -11,11 +11,16 @@
 #define LIBMACHORE_ORIGINAL_SECTION_SIZE 24
 #define LIBMACHORE_ORIGINAL_SEGMENT_SIZE 24
 #define LIBMACHORE_SYMBOL_TYPE_SIZE 24
+#define LIBMACHORE_EXPORT_NAME_MAX_SIZE 4096
+#define LIBMACHORE_EXPORT_TRIE_MAX_DEPTH 256
+#define LIBMACHORE_MINHASH_SIZE 64
 
 struct dylib_info {
   char path[LIBMACHORE_DYLIB_PATH_SIZE];
   bool is_path_truncated;
   char version[LIBMACHORE_DYLIB_VERSION_SIZE];
+  // 1-based library ordinal used by imports, 0 for LC_ID_DYLIB
+  uint32_t ordinal;
 };
 
 typedef enum {
@@ -35,18 +40,179 @@ typedef enum {
 
 struct string_info {
   char *content;
+  // Counts the terminating NUL, except for the views of the paging APIs
+  // when the last string of a section is not NUL terminated: read `size`
+  // bytes, not up to a NUL
   size_t size;
   uint64_t original_offset;
   char original_section[LIBMACHORE_ORIGINAL_SECTION_SIZE];
   char original_segment[LIBMACHORE_ORIGINAL_SEGMENT_SIZE];
 };
 
+// A CFString literal referenced from a __cfstring section. The content is a
+// view into the parsed buffer: UTF-8 literals are NUL terminated, UTF-16
+// literals are not and hold `size / 2` code units in the slice endianness.
+struct cfstring_info {
+  const char *content;
+  size_t size;
+  bool is_utf16;
+  uint64_t original_offset;
+  // Segment of the __cfstring section (__DATA, __DATA_CONST, ...)
+  char original_segment[LIBMACHORE_ORIGINAL_SEGMENT_SIZE];
+};
+
 struct symbol_info {
   char *name;
   char type[LIBMACHORE_SYMBOL_TYPE_SIZE];
   bool has_no_section;
 };
 
+// Same layout as struct data_in_code_entry: entries are a view into the
+// parsed buffer.
+struct data_in_code_info {
+  uint32_t offset; // from the mach header
+  uint16_t length;
+  uint16_t kind; // DICE_KIND_*
+};
+
+// Objective-C and Swift metadata tables, decoded lazily on first access
+typedef enum {
+  LIBMACHORE_METADATA_OBJC_CLASSES,     // class names from __objc_classlist
+  LIBMACHORE_METADATA_OBJC_METHNAMES,   // method names from __objc_methname
+  LIBMACHORE_METADATA_OBJC_SELECTORS,   // selectors from __objc_selrefs
+  LIBMACHORE_METADATA_SWIFT_TYPES,      // type names from __swift5_types
+  LIBMACHORE_METADATA_SWIFT_TYPEREFS,   // mangled names from __swift5_typeref
+  LIBMACHORE_METADATA_SWIFT_REFLSTRS,   // field names from __swift5_reflstr
+  LIBMACHORE_METADATA_COUNT,
+} metadata_kind_t;
+
+// A name referenced by the metadata, as a view into the parsed buffer. Swift
+// mangled names may embed symbolic references (and NUL bytes): use `size`.
+struct metadata_name {
+  const char *name;
+  size_t size;
+  uint64_t original_offset;
+};
+
+struct metadata_table {
+  // Section holding the table, size is 0 when the slice has none
+  uint64_t section_offset;
+  uint64_t section_addr;
+  uint64_t section_size;
+
+  // Filled on first access
+  bool is_decoded;
+  struct metadata_name *names;
+  size_t num_names;
+};
+
+// Special library ordinals of an import (see BIND_SPECIAL_DYLIB_*)
+#define LIBMACHORE_ORDINAL_SELF 0
+#define LIBMACHORE_ORDINAL_MAIN_EXECUTABLE -1
+#define LIBMACHORE_ORDINAL_FLAT_LOOKUP -2
+#define LIBMACHORE_ORDINAL_WEAK_LOOKUP -3
+
+// A symbol imported from a dylib, decoded from the chained fixups import
+// table or from the bind opcodes. `name` is a view into the parsed buffer.
+struct import_info {
+  const char *name;
+  // Matches dylib_info.ordinal when positive, LIBMACHORE_ORDINAL_* otherwise
+  int32_t library_ordinal;
+  bool is_weak;
+  // Number of fixup locations bound to this import
+  uint32_t num_references;
+};
+
+// Whether the import table of a slice could be decoded
+typedef enum {
+  LIBMACHORE_IMPORTS_OK,
+  // Chained fixups with a version, an imports format or a symbol pool
+  // encoding (zlib, symbols_format 1) the parser does not decode: `imports`
+  // is left empty, which does not mean the slice imports nothing
+  LIBMACHORE_IMPORTS_UNSUPPORTED,
+} imports_status_t;
+
+// An exported symbol, as found in the export trie. During a walk `name` points
+// to a buffer reused for every export: copy it to keep it around.
+struct export_info {
+  const char *name;
+  size_t name_size;
+  uint64_t flags; // EXPORT_SYMBOL_FLAGS_*
+  // Offset from the image base, 0 for re-exports
+  uint64_t address;
+  // Resolver offset (stub and resolver) or dylib ordinal (re-export)
+  uint64_t other;
+  // Name in the re-exported dylib, NULL when it is unchanged
+  const char *import_name;
+};
+
+// Return false to stop the walk
+typedef bool (*machore_export_visitor_t)(const struct export_info *export_info,
+                                         void *context);
+
+// A pattern set compiled by machore_pattern_set_create()
+struct machore_pattern_set;
+
+// A pattern found while scanning. Offsets are relative to the scanned data,
+// or to the slice (like string_info) when scanning a Mach-O.
+struct pattern_match {
+  size_t pattern_index;
+  size_t arch_index;
+  uint64_t original_offset;
+  char original_section[LIBMACHORE_ORIGINAL_SECTION_SIZE];
+  char original_segment[LIBMACHORE_ORIGINAL_SEGMENT_SIZE];
+};
+
+// Return false to stop the scan
+typedef bool (*machore_pattern_visitor_t)(const struct pattern_match *match,
+                                          void *context);
+
+// Options of machore_extract_strings(), like `strings -n`
+struct string_scan_options {
+  // Shortest run reported, in characters
+  size_t min_length;
+  // Also accept well-formed non-ASCII characters: UTF-8 sequences in 8-bit
+  // runs, code units above the C1 controls and surrogate pairs in UTF-16
+  bool allow_unicode;
+  // Scan for UTF-16LE runs instead of 8-bit ones
+  bool is_utf16;
+};
+
+// A run of printable characters, `content` is a view into the scanned data.
+// Offsets are relative to the scanned data, or to the slice (like
+// string_info) when scanning a Mach-O.
+struct string_run {
+  const char *content;
+  uint64_t original_offset;
+  // In bytes, and in characters
+  size_t size;
+  size_t length;
+  bool is_utf16;
+  char original_section[LIBMACHORE_ORIGINAL_SECTION_SIZE];
+  char original_segment[LIBMACHORE_ORIGINAL_SEGMENT_SIZE];
+};
+
+// Return false to stop the extraction
+typedef bool (*machore_string_visitor_t)(const struct string_run *run,
+                                         void *context);
+
+// Byte statistics of the file content of a section or a segment
+struct byte_stats_info {
+  char original_segment[LIBMACHORE_ORIGINAL_SEGMENT_SIZE];
+  // Empty for segments
+  char original_section[LIBMACHORE_ORIGINAL_SECTION_SIZE];
+  uint64_t original_offset;
+  // Bytes analyzed, 0 for zero fill sections
+  uint64_t size;
+  uint64_t histogram[256];
+  // Shannon entropy in bits per byte (0 to 8), near 8 for packed or
+  // encrypted content
+  double entropy;
+  // Printable ASCII, tabs and new lines
+  double printable_ratio;
+  double zero_ratio;
+};
+
 struct security_flags {
   bool is_signed;
   bool is_library_validation_disabled;
@@ -54,6 +220,9 @@ struct security_flags {
   bool has_hardened_runtime;
 };
 
+// Internal state kept with an arch output for the lazy decoders
+struct machore_slice_context;
+
 struct machore_arch_output_t {
   char architecture[LIBMACHORE_ARCHITECTURE_SIZE];
   filetype_t filetype;
@@ -74,19 +243,206 @@ struct machore_arch_output_t {
   struct string_info *strings;
   size_t num_strings;
 
+  // CFStrings
+  struct cfstring_info *cfstrings;
+  size_t num_cfstrings;
+
   // Symnols
   struct symbol_info *symbols;
   size_t num_symbols;
 
+  // Imports
+  struct import_info *imports;
+  size_t num_imports;
+  imports_status_t imports_status;
+
+  // Function starts (absolute addresses, ascending)
+  uint64_t *function_starts;
+  size_t num_function_starts;
+
+  // Data in code
+  const struct data_in_code_info *data_in_code;
+  size_t num_data_in_code;
+
+  // Exports trie (view into the parsed buffer)
+  const uint8_t *export_trie;
+  size_t export_trie_size;
+
+  // Objective-C and Swift metadata, see machore_metadata_names()
+  struct metadata_table metadata[LIBMACHORE_METADATA_COUNT];
+
+  // Byte statistics, see machore_section_stats()
+  bool is_byte_stats_computed;
+  struct byte_stats_info *section_stats;
+  size_t num_section_stats;
+  struct byte_stats_info *segment_stats;
+  size_t num_segment_stats;
+
   // Codesign info
   struct security_flags *security_flags;
   char *entitlements;
+
+  // The parsed buffer must outlive the output: lazy decoders read from it
+  struct machore_slice_context *slice_context;
+};
+
+// Why machore_validate() rejected a file
+typedef enum {
+  LIBMACHORE_VALIDATION_OK,
+  LIBMACHORE_VALIDATION_TRUNCATED,          // header past the end of the file
+  LIBMACHORE_VALIDATION_BAD_MAGIC,          // neither fat nor Mach-O
+  LIBMACHORE_VALIDATION_BAD_SLICE,          // fat_arch outside of the file
+  LIBMACHORE_VALIDATION_BAD_LOAD_COMMANDS,  // sizeofcmds or ncmds too large
+  LIBMACHORE_VALIDATION_BAD_CMDSIZE,        // cmdsize too small or too large
+  LIBMACHORE_VALIDATION_BAD_SEGMENT,        // segment outside of the slice
+  LIBMACHORE_VALIDATION_BAD_SECTION,        // section outside of the slice
+  LIBMACHORE_VALIDATION_BAD_DYLIB,          // dylib name outside of cmdsize
+  LIBMACHORE_VALIDATION_BAD_SYMTAB,         // symbol or string table
+  LIBMACHORE_VALIDATION_BAD_DYLD_INFO,      // opcode stream or export trie
+  LIBMACHORE_VALIDATION_BAD_LINKEDIT_DATA,  // dataoff + datasize
+  LIBMACHORE_VALIDATION_BAD_CODE_SIGNATURE, // SuperBlob index or blob
+  LIBMACHORE_VALIDATION_BAD_CHAINED_FIXUPS, // imports or chain starts
+} validation_error_t;
+
+// Load command index of the errors found in the fat or mach header
+#define LIBMACHORE_NO_LOAD_COMMAND UINT32_MAX
+
+struct validation_result {
+  validation_error_t error;
+  // Slice of the error, 0 for thin files
+  uint32_t arch_index;
+  uint32_t load_command_index;
+  // File offset of the header, fat_arch or load command at fault
+  uint64_t offset;
 };
 
 struct machore_output_t {
   struct machore_arch_output_t *arch_outputs;
   size_t num_arch_outputs;
   bool is_fat;
+  // Set before parse_macho() to leave strings and symbols to the paging
+  // APIs (machore_get_string(), machore_get_symbol()): `strings` and
+  // `symbols` then stay empty.
+  bool is_paged;
+  // Set by parse_macho(), which parses nothing from a rejected file
+  struct validation_result validation;
+};
+
+// A slice of a fat binary, or the whole file of a thin one, as described by
+// the headers
+struct slice_info {
+  uint32_t cputype;
+  uint32_t cpusubtype;
+  uint64_t offset;
+  uint64_t size;
+  // Power of 2, 0 for thin files
+  uint32_t align;
+};
+
+// Similarity fingerprint of a slice, over its dylibs, symbols and strings
+struct fingerprint_info {
+  // Estimates the Jaccard similarity, see machore_fingerprint_similarity()
+  uint32_t minhash[LIBMACHORE_MINHASH_SIZE];
+  // Close slices are at a small Hamming distance
+  uint64_t simhash;
+  uint64_t num_features;
+};
+
+// An LSH index of fingerprints, see machore_lsh_open()
+struct machore_lsh_index;
+
+struct lsh_match {
+  // Valid until the index is saved or closed
+  const char *name;
+  // Estimated Jaccard similarity, from 0 to 1
+  double similarity;
+  // SimHash Hamming distance, from 0 to 64
+  unsigned distance;
+};
+
+// Terms of the inverted index, see machore_term_index_add()
+typedef enum {
+  LIBMACHORE_TERM_DYLIB,         // linked dylib path
+  LIBMACHORE_TERM_DYLIB_VERSION, // "<path>@<current version>"
+  LIBMACHORE_TERM_SYMBOL,        // symbol table name
+  LIBMACHORE_TERM_IMPORT,        // imported symbol name
+  LIBMACHORE_TERM_FLAG,          // "signed", "hardened-runtime", ...
+  LIBMACHORE_TERM_ENTITLEMENT,   // entitlement key not set to false
+  LIBMACHORE_TERM_COUNT,
+} term_kind_t;
+
+// An inverted index of binaries by term, see machore_term_index_open()
+struct machore_term_index;
+
+// Return false to stop the query. `name` is valid until the index is saved,
+// merged or closed.
+typedef bool (*machore_term_visitor_t)(const char *name, void *context);
+
+// A demangler with its memo cache and threads, see machore_demangler_create()
+struct machore_demangler;
+
+// Demangles `name` (without the Mach-O leading underscore) into `buffer`, a
+// malloc'ed buffer of `*length` bytes or NULL, reallocating it when it is
+// too small, like __cxa_demangle(). Returns the NUL terminated result and
+// sets `*length` to its size, or returns NULL when `name` is not valid.
+typedef char *(*machore_demangle_hook_t)(const char *name, char *buffer,
+                                         size_t *length, void *context);
+
+struct demangle_stats {
+  // Mangled names looked up in the cache, and the ones found there
+  uint64_t num_lookups;
+  uint64_t num_hits;
+  // Names in the cache, demangled or not
+  uint64_t num_entries;
+  uint64_t num_failures;
+};
+
+// A dyld shared cache and its subcaches, see machore_dyld_cache_open()
+struct machore_dyld_cache;
+
+// An image of a dyld shared cache
+struct cache_image_info {
+  // Install name, a view into the cache
+  const char *path;
+  // Address of its mach header in the shared region
+  uint64_t address;
+};
+
+typedef enum {
+  LIBMACHORE_DIFF_FLAG,
+  LIBMACHORE_DIFF_DYLIB,
+  LIBMACHORE_DIFF_EXPORT,
+  LIBMACHORE_DIFF_SYMBOL,
+  LIBMACHORE_DIFF_STRING,
+} diff_kind_t;
+
+typedef enum {
+  LIBMACHORE_DIFF_ADDED,
+  LIBMACHORE_DIFF_REMOVED,
+  LIBMACHORE_DIFF_CHANGED,
+} diff_change_t;
+
+// A difference between two slices. `name` is not NUL terminated: it is a
+// view into the compared outputs or into the diff.
+struct diff_entry {
+  diff_kind_t kind;
+  diff_change_t change;
+  const char *name;
+  size_t name_size;
+  // Dylib versions, symbol types or flag values of a change, NULL otherwise
+  const char *old_value;
+  const char *new_value;
+};
+
+struct machore_diff_t {
+  // Sorted by kind, then by name
+  struct diff_entry *entries;
+  size_t num_entries;
+
+  // Export names copied out of the export tries
+  char *export_names[2];
+  // Symbols decoded from paged outputs, holding the types of the changes
+  struct symbol_info *symbols[2];
 };
 
 void init_output(struct machore_output_t *output);
@@ -95,4 +451,267 @@ void clean_output(struct machore_output_t *output);
 
 void parse_macho(struct machore_output_t *output, uint8_t *buffer, size_t size);
 
+// Checks, in one pass over the headers and load commands, that every range
+// the parser reads lies in `buffer`: load commands, section contents, symbol
+// and string tables, __LINKEDIT data, the code signature SuperBlob and its
+// index, chained fixups imports and starts. Dylib names and the string and
+// chained fixups symbol tables must end with a NUL. parse_macho() and
+// machore_scan_patterns() validate first, then read without bounds checks.
+// Pointers stored in the data (metadata, cfstrings) are still resolved
+// against the segments when decoded, and symbol names past the string table
+// read as empty.
+bool machore_validate(const uint8_t *buffer, size_t size,
+                      struct validation_result *result);
+
+// Short description of a validation error, e.g. "section outside of slice"
+const char *machore_validation_error_string(validation_error_t error);
+
+// Lists the slices of a binary from its fat header (fat_arch or
+// fat_arch_64 entries), without parsing them. Fills at most `max_slices`
+// entries and returns the number of slices, 0 when `buffer` is not a Mach-O
+// file. Slice bounds are not checked against `size`.
+size_t machore_list_slices(const uint8_t *buffer, size_t size,
+                           struct slice_info *slices, size_t max_slices);
+
+// Returns the number of strings of the slice, the ones parse_macho extracts
+// into `strings`, indexing them on first access: one scan of the string
+// sections keeping a 32-bit offset per string. Indexing is not thread safe.
+size_t machore_count_strings(struct machore_arch_output_t *arch_output);
+
+// Fills `string_info` with the string at `index`, in `strings` order.
+// `content` is a view into the parsed buffer, not a copy.
+bool machore_get_string(struct machore_arch_output_t *arch_output,
+                        size_t index, struct string_info *string_info);
+
+// Fills `strings` with at most `max_strings` strings from index `first`,
+// and returns the number of strings filled.
+size_t machore_get_strings(struct machore_arch_output_t *arch_output,
+                           size_t first, struct string_info *strings,
+                           size_t max_strings);
+
+// Reports the runs of printable characters of `data` that are at least
+// `options->min_length` characters long, whatever separates them, and
+// returns the number of runs reported. UTF-16 runs start at even offsets.
+size_t machore_extract_strings(const uint8_t *data, size_t size,
+                               const struct string_scan_options *options,
+                               machore_string_visitor_t visitor,
+                               void *context);
+
+// Same over the string sections of a slice, the ones parse_macho extracts
+// `strings` from as 8-bit runs and __ustring (UTF-16 CFString payloads) as
+// UTF-16LE runs. `options->is_utf16` is ignored.
+size_t machore_extract_slice_strings(
+    const struct machore_arch_output_t *arch_output,
+    const struct string_scan_options *options,
+    machore_string_visitor_t visitor, void *context);
+
+// Same as the string APIs for symbols, in `symbols` order: the index keeps
+// the symbol table entries with a name.
+size_t machore_count_symbols(struct machore_arch_output_t *arch_output);
+
+bool machore_get_symbol(struct machore_arch_output_t *arch_output,
+                        size_t index, struct symbol_info *symbol_info);
+
+size_t machore_get_symbols(struct machore_arch_output_t *arch_output,
+                           size_t first, struct symbol_info *symbols,
+                           size_t max_symbols);
+
+// Whether parse_macho left `strings` and `symbols` to the paging APIs
+bool machore_is_paged(const struct machore_arch_output_t *arch_output);
+
+// Returns the dylib an import is bound to, or NULL for special ordinals.
+const struct dylib_info *
+machore_import_dylib(const struct machore_arch_output_t *arch_output,
+                     const struct import_info *import_info);
+
+// Returns the number of entries of a metadata table. Until the table is
+// decoded, pointer tables (classes, selectors, Swift types) are counted by
+// slot without being decoded, an upper bound of what machore_metadata_names
+// returns since unresolvable slots are skipped. Exact once decoded.
+size_t machore_metadata_count(struct machore_arch_output_t *arch_output,
+                              metadata_kind_t kind);
+
+// Returns the names of a metadata table, decoding it on first access.
+// Decoding is not thread safe.
+const struct metadata_name *
+machore_metadata_names(struct machore_arch_output_t *arch_output,
+                       metadata_kind_t kind, size_t *num_names);
+
+// Returns the byte statistics of every section, in load command order,
+// computing the statistics of every section and segment on first access.
+// Computing is not thread safe.
+const struct byte_stats_info *
+machore_section_stats(struct machore_arch_output_t *arch_output,
+                      size_t *num_sections);
+
+// Returns the byte statistics of every segment, padding between sections
+// included.
+const struct byte_stats_info *
+machore_segment_stats(struct machore_arch_output_t *arch_output,
+                      size_t *num_segments);
+
+// Compares two slices: flags, dylibs (added, removed, version changes),
+// exports, symbols and strings. Both outputs must outlive the diff. Paged
+// outputs are read through the paging APIs, indexing them if needed.
+void machore_diff_arch(struct machore_diff_t *diff,
+                       struct machore_arch_output_t *old_arch,
+                       struct machore_arch_output_t *new_arch);
+
+void machore_clean_diff(struct machore_diff_t *diff);
+
+// Computes the similarity fingerprint of a slice: MinHash and SimHash over
+// its dylib paths, symbol names and string contents. Paged outputs are read
+// through the paging APIs, indexing them if needed.
+void machore_fingerprint_arch(struct machore_arch_output_t *arch_output,
+                              struct fingerprint_info *fingerprint);
+
+// Estimated Jaccard similarity of the features of two slices, from 0 to 1.
+double machore_fingerprint_similarity(const struct fingerprint_info *a,
+                                      const struct fingerprint_info *b);
+
+// Hamming distance between the SimHash of two slices, from 0 to 64.
+unsigned machore_fingerprint_distance(const struct fingerprint_info *a,
+                                      const struct fingerprint_info *b);
+
+// Opens the LSH index stored at `path`, or an empty one when the file does
+// not exist yet. Returns NULL when the file is not a valid index.
+struct machore_lsh_index *machore_lsh_open(const char *path);
+
+void machore_lsh_close(struct machore_lsh_index *index);
+
+size_t machore_lsh_size(const struct machore_lsh_index *index);
+
+// Inserts a fingerprint, queryable at once but only stored on disk by
+// machore_lsh_save().
+void machore_lsh_insert(struct machore_lsh_index *index, const char *name,
+                        const struct fingerprint_info *fingerprint);
+
+// Writes the index and its inserts to disk. Returns false on I/O errors, in
+// which case the inserts are kept and can be saved again.
+bool machore_lsh_save(struct machore_lsh_index *index);
+
+// Fills `matches` with the at most `max_matches` indexed fingerprints most
+// similar to `fingerprint`, by decreasing similarity. Only fingerprints
+// sharing an LSH bucket are ranked. Returns the number of matches.
+size_t machore_lsh_query(const struct machore_lsh_index *index,
+                         const struct fingerprint_info *fingerprint,
+                         struct lsh_match *matches, size_t max_matches);
+
+// Opens the inverted index stored in the `path` directory, creating it
+// when missing. Returns NULL when a segment of the index is not valid.
+struct machore_term_index *machore_term_index_open(const char *path);
+
+void machore_term_index_close(struct machore_term_index *index);
+
+// Number of binaries queries can return: saved and not replaced.
+size_t machore_term_index_size(const struct machore_term_index *index);
+
+size_t machore_term_index_num_segments(const struct machore_term_index *index);
+
+// Adds the terms of every slice of a parsed binary under `name`, replacing
+// the binary of the same name added before. Paged outputs are read with the
+// paging APIs. Binaries are only queryable once saved.
+void machore_term_index_add(struct machore_term_index *index,
+                            const char *name,
+                            struct machore_output_t *output);
+
+// Writes the binaries added since the last save to a new segment, then
+// merges the newest segments when they get as large as the older ones.
+// Returns false on I/O errors.
+bool machore_term_index_save(struct machore_term_index *index);
+
+// Merges the newest segments so that at most `max_segments` are left,
+// dropping replaced binaries. Returns false on I/O errors.
+bool machore_term_index_merge(struct machore_term_index *index,
+                              size_t max_segments);
+
+// Visits the names of the saved binaries with a term, oldest first, and
+// returns the number of binaries visited. `visitor` may be NULL to only
+// count them. Terms match exactly: symbol and import names include their
+// leading underscore.
+size_t machore_term_index_query(const struct machore_term_index *index,
+                                term_kind_t kind, const char *term,
+                                machore_term_visitor_t visitor,
+                                void *context);
+
+// Creates a demangler running batches over `num_threads` threads (the
+// caller's included), 0 for one per CPU. C++ names go to the platform
+// demangler, Swift ones to the hook set with machore_demangler_set_swift().
+struct machore_demangler *machore_demangler_create(size_t num_threads);
+
+void machore_demangler_destroy(struct machore_demangler *demangler);
+
+// Swift names (`_$s...`, `_T0...`) are left as is without a hook.
+void machore_demangler_set_swift(struct machore_demangler *demangler,
+                                 machore_demangle_hook_t hook, void *context);
+
+// Fills `demangled[i]` with the demangled `names[i]`, NULL when the name is
+// not mangled or fails to demangle. Results are memoized by mangled name
+// and stay valid until the demangler is destroyed. One batch at a time.
+void machore_demangle_batch(struct machore_demangler *demangler,
+                            const char *const *names, size_t num_names,
+                            const char **demangled);
+
+void machore_demangler_stats(struct machore_demangler *demangler,
+                             struct demangle_stats *stats);
+
+// Maps a dyld shared cache file and the subcache files listed in its header
+// (`path` followed by their suffix). Returns NULL when a file is missing or
+// is not a cache.
+struct machore_dyld_cache *machore_dyld_cache_open(const char *path);
+
+void machore_dyld_cache_close(struct machore_dyld_cache *cache);
+
+size_t machore_dyld_cache_count_images(const struct machore_dyld_cache *cache);
+
+bool machore_dyld_cache_get_image(const struct machore_dyld_cache *cache,
+                                  size_t index,
+                                  struct cache_image_info *image_info);
+
+// Parses the images [first, first + num_images) over `num_threads` threads
+// (the caller's included), 0 for one per CPU, into `outputs[i]`, initialized
+// with init_output() beforehand. Images are parsed from views of the cache
+// in which their segments are laid out one after the other from the mach
+// header: offsets in the outputs are offsets in these views, which stay
+// valid until the cache is closed. Only 64-bit images are supported: the
+// outputs of the others stay empty. Returns the number of images parsed.
+size_t machore_dyld_cache_parse_images(struct machore_dyld_cache *cache,
+                                       size_t first, size_t num_images,
+                                       struct machore_output_t *outputs,
+                                       size_t num_threads);
+
+// Compiles a set of byte patterns (not NUL terminated) for multi-pattern
+// scanning. Patterns are referred to by their index in matches.
+struct machore_pattern_set *
+machore_pattern_set_create(const char *const *patterns,
+                           const size_t *pattern_sizes, size_t num_patterns);
+
+void machore_pattern_set_destroy(struct machore_pattern_set *set);
+
+size_t machore_pattern_set_size(const struct machore_pattern_set *set);
+
+// Reports every occurrence of every pattern in `data`, overlapping ones
+// included. Returns the number of matches.
+size_t machore_pattern_set_scan(const struct machore_pattern_set *set,
+                                const uint8_t *data, size_t size,
+                                machore_pattern_visitor_t visitor,
+                                void *context);
+
+// Scans the raw bytes of the string sections of every slice (the ones
+// parse_macho extracts strings from) without parsing the binary.
+size_t machore_scan_patterns(const struct machore_pattern_set *set,
+                             uint8_t *buffer, size_t size,
+                             machore_pattern_visitor_t visitor, void *context);
+
+// Visits every export of the trie without allocating, and returns the number
+// of exports visited. `visitor` may be NULL to only count them. Exports come
+// in trie order: a node before its children, children in the order the
+// linker wrote their edges, which need not be sorted.
+size_t machore_walk_exports(const uint8_t *trie, size_t trie_size,
+                            machore_export_visitor_t visitor, void *context);
+
+// Looks up a single export in O(strlen(name)).
+bool machore_lookup_export(const uint8_t *trie, size_t trie_size,
+                           const char *name, struct export_info *export_info);
+
 #endif
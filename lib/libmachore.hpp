@@ -0,0 +1,644 @@
+#ifndef LIBMACHORE_HPP
+#define LIBMACHORE_HPP
+
+extern "C" {
+#include "libmachore.h"
+}
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Header-only C++17 layer over libmachore.
+ *
+ * machore::Binary owns a file mapping and its parse output. Everything else
+ * is a view into them, valid until the Binary is destroyed (moving it keeps
+ * views valid): slices, and ranges of dylibs, strings, symbols, imports...
+ * whose elements are built on access from the output, as std::string_view
+ * over the C strings. Nothing allocates or copies string contents: strings
+ * and symbols of paged binaries are fetched one at a time with the paging
+ * APIs, exports and string runs are streamed through the C visitors. Lazy
+ * decoders (paging indices, metadata, byte statistics) are not thread safe,
+ * like their C counterparts.
+ */
+
+namespace machore {
+
+// A contiguous range, like the C++20 std::span
+template <typename T> class Span {
+public:
+  using value_type = std::remove_cv_t<T>;
+  using iterator = T *;
+
+  constexpr Span() noexcept = default;
+  constexpr Span(T *data, size_t size) noexcept : data_(data), size_(size) {}
+
+  constexpr T *data() const noexcept { return data_; }
+  constexpr size_t size() const noexcept { return size_; }
+  constexpr bool empty() const noexcept { return size_ == 0; }
+  constexpr T *begin() const noexcept { return data_; }
+  constexpr T *end() const noexcept { return data_ + size_; }
+  constexpr T &operator[](size_t index) const noexcept { return data_[index]; }
+
+private:
+  T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+namespace detail {
+
+// Elements of the C structs are NUL terminated, or fill their array
+template <size_t Size>
+inline std::string_view array_view(const char (&array)[Size]) noexcept {
+  return std::string_view(array, strnlen(array, Size));
+}
+
+inline std::string_view cstring_view(const char *string) noexcept {
+  return string != nullptr ? std::string_view(string) : std::string_view();
+}
+
+// A range of `Source` elements computed by `Getter::get(source, index)`
+template <typename Source, typename Getter> class IndexRange {
+public:
+  using value_type =
+      decltype(Getter::get(std::declval<const Source &>(), size_t()));
+
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename IndexRange::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    iterator(const Source &source, size_t index) noexcept
+        : source_(source), index_(index) {}
+
+    value_type operator*() const { return Getter::get(source_, index_); }
+    iterator &operator++() noexcept {
+      ++index_;
+      return *this;
+    }
+    iterator operator++(int) noexcept {
+      iterator previous = *this;
+      ++index_;
+      return previous;
+    }
+    bool operator==(const iterator &other) const noexcept {
+      return index_ == other.index_;
+    }
+    bool operator!=(const iterator &other) const noexcept {
+      return index_ != other.index_;
+    }
+
+  private:
+    Source source_;
+    size_t index_;
+  };
+
+  IndexRange(const Source &source, size_t size) noexcept
+      : source_(source), size_(size) {}
+
+  iterator begin() const noexcept { return iterator(source_, 0); }
+  iterator end() const noexcept { return iterator(source_, size_); }
+  size_t size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+  value_type operator[](size_t index) const {
+    return Getter::get(source_, index);
+  }
+
+private:
+  Source source_;
+  size_t size_;
+};
+
+// Calls `visitor(element)`, which may return void or false to stop
+template <typename Visitor, typename Element>
+inline bool visit(Visitor &visitor, const Element &element) {
+  if constexpr (std::is_void_v<std::invoke_result_t<Visitor &,
+                                                    const Element &>>) {
+    visitor(element);
+    return true;
+  } else {
+    return static_cast<bool>(visitor(element));
+  }
+}
+
+} // namespace detail
+
+class Dylib {
+public:
+  explicit Dylib(const dylib_info *info) noexcept : info_(info) {}
+
+  std::string_view path() const noexcept {
+    return detail::array_view(info_->path);
+  }
+  std::string_view version() const noexcept {
+    return detail::array_view(info_->version);
+  }
+  bool is_path_truncated() const noexcept { return info_->is_path_truncated; }
+  // 1-based library ordinal used by imports, 0 for LC_ID_DYLIB
+  uint32_t ordinal() const noexcept { return info_->ordinal; }
+  const dylib_info &raw() const noexcept { return *info_; }
+
+private:
+  const dylib_info *info_;
+};
+
+// Holds the string_info filled by the paging APIs: the section and segment
+// names are views into this object.
+class String {
+public:
+  explicit String(const string_info &info) noexcept : info_(info) {}
+
+  // Without the terminating NUL, paged views may have none
+  std::string_view content() const noexcept {
+    const bool has_nul =
+        info_.size > 0 && info_.content[info_.size - 1] == '\0';
+    return std::string_view(info_.content, info_.size - has_nul);
+  }
+  uint64_t offset() const noexcept { return info_.original_offset; }
+  std::string_view section() const noexcept {
+    return detail::array_view(info_.original_section);
+  }
+  std::string_view segment() const noexcept {
+    return detail::array_view(info_.original_segment);
+  }
+  const string_info &raw() const noexcept { return info_; }
+
+private:
+  string_info info_;
+};
+
+// Same as String for symbols: the type is a view into this object
+class Symbol {
+public:
+  explicit Symbol(const symbol_info &info) noexcept : info_(info) {}
+
+  std::string_view name() const noexcept {
+    return detail::cstring_view(info_.name);
+  }
+  std::string_view type() const noexcept {
+    return detail::array_view(info_.type);
+  }
+  bool has_no_section() const noexcept { return info_.has_no_section; }
+  const symbol_info &raw() const noexcept { return info_; }
+
+private:
+  symbol_info info_;
+};
+
+class Import {
+public:
+  explicit Import(const import_info *info) noexcept : info_(info) {}
+
+  std::string_view name() const noexcept {
+    return detail::cstring_view(info_->name);
+  }
+  // Matches Dylib::ordinal() when positive, LIBMACHORE_ORDINAL_* otherwise
+  int32_t library_ordinal() const noexcept { return info_->library_ordinal; }
+  bool is_weak() const noexcept { return info_->is_weak; }
+  uint32_t num_references() const noexcept { return info_->num_references; }
+  const import_info &raw() const noexcept { return *info_; }
+
+private:
+  const import_info *info_;
+};
+
+class CFString {
+public:
+  explicit CFString(const cfstring_info *info) noexcept : info_(info) {}
+
+  // Raw bytes: `size() / 2` code units in the slice endianness for UTF-16
+  std::string_view content() const noexcept {
+    return std::string_view(info_->content, info_->size);
+  }
+  bool is_utf16() const noexcept { return info_->is_utf16; }
+  uint64_t offset() const noexcept { return info_->original_offset; }
+  std::string_view segment() const noexcept {
+    return detail::array_view(info_->original_segment);
+  }
+  const cfstring_info &raw() const noexcept { return *info_; }
+
+private:
+  const cfstring_info *info_;
+};
+
+// Only valid during the walk: the name is a buffer reused for every export
+class Export {
+public:
+  explicit Export(const export_info *info) noexcept : info_(info) {}
+
+  std::string_view name() const noexcept {
+    return std::string_view(info_->name, info_->name_size);
+  }
+  uint64_t flags() const noexcept { return info_->flags; }
+  uint64_t address() const noexcept { return info_->address; }
+  uint64_t other() const noexcept { return info_->other; }
+  std::string_view import_name() const noexcept {
+    return detail::cstring_view(info_->import_name);
+  }
+  const export_info &raw() const noexcept { return *info_; }
+
+private:
+  const export_info *info_;
+};
+
+// Only valid during the extraction, like Export
+class StringRun {
+public:
+  explicit StringRun(const string_run *run) noexcept : run_(run) {}
+
+  std::string_view content() const noexcept {
+    return std::string_view(run_->content, run_->size);
+  }
+  size_t length() const noexcept { return run_->length; }
+  bool is_utf16() const noexcept { return run_->is_utf16; }
+  uint64_t offset() const noexcept { return run_->original_offset; }
+  std::string_view section() const noexcept {
+    return detail::array_view(run_->original_section);
+  }
+  std::string_view segment() const noexcept {
+    return detail::array_view(run_->original_segment);
+  }
+  const string_run &raw() const noexcept { return *run_; }
+
+private:
+  const string_run *run_;
+};
+
+namespace detail {
+
+struct SliceSource {
+  machore_arch_output_t *arch_output;
+  bool is_paged;
+};
+
+struct GetDylib {
+  static Dylib get(machore_arch_output_t *arch_output, size_t index) noexcept {
+    return Dylib(&arch_output->dylibs[index]);
+  }
+};
+
+struct GetString {
+  static String get(const SliceSource &source, size_t index) noexcept {
+    if (!source.is_paged) {
+      return String(source.arch_output->strings[index]);
+    }
+    string_info info;
+    machore_get_string(source.arch_output, index, &info);
+    return String(info);
+  }
+};
+
+struct GetSymbol {
+  static Symbol get(const SliceSource &source, size_t index) noexcept {
+    if (!source.is_paged) {
+      return Symbol(source.arch_output->symbols[index]);
+    }
+    symbol_info info;
+    machore_get_symbol(source.arch_output, index, &info);
+    return Symbol(info);
+  }
+};
+
+struct GetImport {
+  static Import get(machore_arch_output_t *arch_output,
+                    size_t index) noexcept {
+    return Import(&arch_output->imports[index]);
+  }
+};
+
+struct GetCFString {
+  static CFString get(machore_arch_output_t *arch_output,
+                      size_t index) noexcept {
+    return CFString(&arch_output->cfstrings[index]);
+  }
+};
+
+struct GetMetadataName {
+  static std::string_view get(const metadata_name *names,
+                              size_t index) noexcept {
+    return std::string_view(names[index].name, names[index].size);
+  }
+};
+
+} // namespace detail
+
+using DylibRange =
+    detail::IndexRange<machore_arch_output_t *, detail::GetDylib>;
+using StringRange = detail::IndexRange<detail::SliceSource, detail::GetString>;
+using SymbolRange = detail::IndexRange<detail::SliceSource, detail::GetSymbol>;
+using ImportRange =
+    detail::IndexRange<machore_arch_output_t *, detail::GetImport>;
+using CFStringRange =
+    detail::IndexRange<machore_arch_output_t *, detail::GetCFString>;
+using MetadataRange =
+    detail::IndexRange<const metadata_name *, detail::GetMetadataName>;
+
+// A parsed slice. Copies are views of the same slice.
+class Slice {
+public:
+  Slice(machore_arch_output_t *arch_output, bool is_paged) noexcept
+      : arch_output_(arch_output), is_paged_(is_paged) {}
+
+  std::string_view architecture() const noexcept {
+    return detail::array_view(arch_output_->architecture);
+  }
+  filetype_t filetype() const noexcept { return arch_output_->filetype; }
+
+  DylibRange dylibs() const noexcept {
+    return DylibRange(arch_output_, arch_output_->num_dylibs);
+  }
+
+  // Paged slices index their strings on first access
+  StringRange strings() const {
+    return StringRange({arch_output_, is_paged_},
+                       is_paged_ ? machore_count_strings(arch_output_)
+                                 : arch_output_->num_strings);
+  }
+
+  SymbolRange symbols() const {
+    return SymbolRange({arch_output_, is_paged_},
+                       is_paged_ ? machore_count_symbols(arch_output_)
+                                 : arch_output_->num_symbols);
+  }
+
+  ImportRange imports() const noexcept {
+    return ImportRange(arch_output_, arch_output_->num_imports);
+  }
+  // Empty imports() only mean "no imports" when this is
+  // LIBMACHORE_IMPORTS_OK
+  imports_status_t imports_status() const noexcept {
+    return arch_output_->imports_status;
+  }
+
+  // The dylib an import is bound to, none for special ordinals
+  std::optional<Dylib> import_dylib(const Import &import) const noexcept {
+    const dylib_info *info =
+        machore_import_dylib(arch_output_, &import.raw());
+    return info != nullptr ? std::optional<Dylib>(Dylib(info))
+                           : std::nullopt;
+  }
+
+  CFStringRange cfstrings() const noexcept {
+    return CFStringRange(arch_output_, arch_output_->num_cfstrings);
+  }
+
+  Span<const uint64_t> function_starts() const noexcept {
+    return Span<const uint64_t>(arch_output_->function_starts,
+                                arch_output_->num_function_starts);
+  }
+
+  Span<const data_in_code_info> data_in_code() const noexcept {
+    return Span<const data_in_code_info>(arch_output_->data_in_code,
+                                         arch_output_->num_data_in_code);
+  }
+
+  // Decodes the table on first access
+  MetadataRange metadata(metadata_kind_t kind) const {
+    size_t num_names;
+    const metadata_name *names =
+        machore_metadata_names(arch_output_, kind, &num_names);
+    return MetadataRange(names, num_names);
+  }
+
+  // Computes the statistics on first access
+  Span<const byte_stats_info> section_stats() const {
+    size_t num_sections;
+    const byte_stats_info *stats =
+        machore_section_stats(arch_output_, &num_sections);
+    return Span<const byte_stats_info>(stats, num_sections);
+  }
+
+  Span<const byte_stats_info> segment_stats() const {
+    size_t num_segments;
+    const byte_stats_info *stats =
+        machore_segment_stats(arch_output_, &num_segments);
+    return Span<const byte_stats_info>(stats, num_segments);
+  }
+
+  // NULL for unsigned slices
+  const struct security_flags *security_flags() const noexcept {
+    return arch_output_->security_flags;
+  }
+
+  std::string_view entitlements() const noexcept {
+    return detail::cstring_view(arch_output_->entitlements);
+  }
+
+  Span<const uint8_t> export_trie() const noexcept {
+    return Span<const uint8_t>(arch_output_->export_trie,
+                               arch_output_->export_trie_size);
+  }
+
+  // Calls `visitor(const Export &)` for every export in trie order (not
+  // necessarily sorted), until it returns false. Returns the number of
+  // exports visited.
+  template <typename Visitor> size_t for_each_export(Visitor &&visitor) const {
+    return machore_walk_exports(
+        arch_output_->export_trie, arch_output_->export_trie_size,
+        [](const export_info *info, void *context) {
+          return detail::visit(*static_cast<std::remove_reference_t<Visitor> *>(
+                                   context),
+                               Export(info));
+        },
+        &visitor);
+  }
+
+  // Looks up a single export, `name` must be NUL terminated: the name of
+  // the result points to it.
+  std::optional<export_info> find_export(const char *name) const noexcept {
+    export_info info;
+    if (!machore_lookup_export(arch_output_->export_trie,
+                               arch_output_->export_trie_size, name, &info)) {
+      return std::nullopt;
+    }
+    return info;
+  }
+
+  // Calls `visitor(const StringRun &)` for the printable runs of the string
+  // sections, until it returns false. Returns the number of runs visited.
+  template <typename Visitor>
+  size_t extract_strings(const string_scan_options &options,
+                         Visitor &&visitor) const {
+    return machore_extract_slice_strings(
+        arch_output_, &options,
+        [](const string_run *run, void *context) {
+          return detail::visit(*static_cast<std::remove_reference_t<Visitor> *>(
+                                   context),
+                               StringRun(run));
+        },
+        &visitor);
+  }
+
+  fingerprint_info fingerprint() const noexcept {
+    fingerprint_info fingerprint;
+    machore_fingerprint_arch(arch_output_, &fingerprint);
+    return fingerprint;
+  }
+
+  bool is_paged() const noexcept { return is_paged_; }
+  machore_arch_output_t *raw() const noexcept { return arch_output_; }
+
+private:
+  machore_arch_output_t *arch_output_;
+  bool is_paged_;
+};
+
+namespace detail {
+
+// The arch outputs outlive moves of their Binary, the output does not
+struct SlicesSource {
+  machore_arch_output_t *arch_outputs;
+  bool is_paged;
+};
+
+struct GetSlice {
+  static Slice get(const SlicesSource &source, size_t index) noexcept {
+    return Slice(&source.arch_outputs[index], source.is_paged);
+  }
+};
+
+} // namespace detail
+
+using SliceRange = detail::IndexRange<detail::SlicesSource, detail::GetSlice>;
+
+// A parsed binary, owning its buffer (a private mapping of the file) and its
+// output. Move only.
+class Binary {
+public:
+  // Maps and parses a file, none when it cannot be read. Files rejected by
+  // the validation have no slices: see validation(). Pages are copy on
+  // write, mapped read only by the kernel until written.
+  static std::optional<Binary> open(const char *path,
+                                    bool is_paged = false) noexcept {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      close(fd);
+      return std::nullopt;
+    }
+    void *mapping = nullptr;
+    if (st.st_size > 0) {
+      mapping = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      return std::nullopt;
+    }
+
+    Binary binary;
+    binary.buffer_ = static_cast<uint8_t *>(mapping);
+    binary.size_ = st.st_size;
+    binary.is_mapped_ = mapping != nullptr;
+    binary.parse(is_paged);
+    return binary;
+  }
+
+  // Parses a buffer owned by the caller, which must outlive the Binary
+  static Binary parse(uint8_t *buffer, size_t size,
+                      bool is_paged = false) noexcept {
+    Binary binary;
+    binary.buffer_ = buffer;
+    binary.size_ = size;
+    binary.parse(is_paged);
+    return binary;
+  }
+
+  Binary(Binary &&other) noexcept
+      : buffer_(other.buffer_), size_(other.size_),
+        is_mapped_(other.is_mapped_), output_(other.output_) {
+    other.forget();
+  }
+
+  Binary &operator=(Binary &&other) noexcept {
+    if (this != &other) {
+      release();
+      buffer_ = other.buffer_;
+      size_ = other.size_;
+      is_mapped_ = other.is_mapped_;
+      output_ = other.output_;
+      other.forget();
+    }
+    return *this;
+  }
+
+  Binary(const Binary &) = delete;
+  Binary &operator=(const Binary &) = delete;
+
+  ~Binary() { release(); }
+
+  bool is_valid() const noexcept {
+    return output_.validation.error == LIBMACHORE_VALIDATION_OK;
+  }
+  const validation_result &validation() const noexcept {
+    return output_.validation;
+  }
+  bool is_fat() const noexcept { return output_.is_fat; }
+  bool is_paged() const noexcept { return output_.is_paged; }
+
+  Span<const uint8_t> bytes() const noexcept {
+    return Span<const uint8_t>(buffer_, size_);
+  }
+
+  SliceRange slices() const noexcept {
+    return SliceRange({output_.arch_outputs, output_.is_paged},
+                      output_.num_arch_outputs);
+  }
+
+  Slice slice(size_t index) const noexcept {
+    return Slice(&output_.arch_outputs[index], output_.is_paged);
+  }
+
+  const machore_output_t &raw() const noexcept { return output_; }
+
+private:
+  Binary() noexcept { init_output(&output_); }
+
+  void parse(bool is_paged) noexcept {
+    output_.is_paged = is_paged;
+    parse_macho(&output_, buffer_, size_);
+  }
+
+  void release() noexcept {
+    clean_output(&output_);
+    if (is_mapped_) {
+      munmap(buffer_, size_);
+    }
+    forget();
+  }
+
+  // Leaves an empty binary, after the output and buffer moved out
+  void forget() noexcept {
+    buffer_ = nullptr;
+    size_ = 0;
+    is_mapped_ = false;
+    init_output(&output_);
+  }
+
+  uint8_t *buffer_ = nullptr;
+  size_t size_ = 0;
+  bool is_mapped_ = false;
+  machore_output_t output_;
+};
+
+} // namespace machore
+
+#endif
@@ -0,0 +1,473 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "libmachore.h"
+
+/*
+ * On-disk LSH index of fingerprints.
+ *
+ * MinHash signatures are cut in LSH_NUM_BANDS bands of LSH_ROWS_PER_BAND
+ * values: two slices land in the same bucket of a band when the whole band
+ * is equal, which happens with probability s^rows for a similarity s. A
+ * query only ranks the records sharing at least one bucket, with 16 bands of
+ * 4 rows that is 50% of the pairs at s = 0.5 and 99.9% at s = 0.8.
+ *
+ * File layout, in native byte order:
+ *
+ *   struct lsh_file_header
+ *   struct lsh_record records[num_records]
+ *   struct lsh_band_entry bands[LSH_NUM_BANDS][num_records] (sorted by key)
+ *   char names[names_size] (NUL terminated)
+ *
+ * The file is mapped read only and queried in place with binary searches.
+ * Inserts are kept in memory, queried linearly, and merged by
+ * machore_lsh_save() which rewrites the file.
+ */
+
+#define LSH_MAGIC "MACHLSH1"
+#define LSH_VERSION 1
+#define LSH_NUM_BANDS 16
+#define LSH_ROWS_PER_BAND (LIBMACHORE_MINHASH_SIZE / LSH_NUM_BANDS)
+
+// Records ranked per query at most, bounds queries hitting huge buckets
+#define LSH_MAX_CANDIDATES 2048
+#define LSH_CANDIDATE_SLOTS (2 * LSH_MAX_CANDIDATES)
+
+struct lsh_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t minhash_size;
+  uint32_t num_bands;
+  uint32_t reserved;
+  uint64_t num_records;
+  uint64_t names_size;
+};
+
+struct lsh_record {
+  uint32_t minhash[LIBMACHORE_MINHASH_SIZE];
+  uint64_t simhash;
+  uint64_t num_features;
+  uint64_t name_offset;
+};
+
+struct lsh_band_entry {
+  uint64_t key;
+  uint64_t record_index;
+};
+
+struct machore_lsh_index {
+  char *path;
+
+  // Mapped file, NULL until the index is first saved
+  void *mapping;
+  size_t mapping_size;
+  const struct lsh_record *records;
+  const struct lsh_band_entry *bands;
+  const char *names;
+  uint64_t num_records;
+  uint64_t names_size;
+
+  // Inserted since the last save, numbered after the mapped records
+  struct lsh_record *pending_records;
+  uint64_t (*pending_keys)[LSH_NUM_BANDS];
+  size_t num_pending;
+  size_t pending_capacity;
+  char *pending_names;
+  size_t pending_names_size;
+  size_t pending_names_capacity;
+};
+
+static uint64_t band_key(const uint32_t *minhash, int band) {
+  return hash_bytes(minhash + band * LSH_ROWS_PER_BAND,
+                    LSH_ROWS_PER_BAND * sizeof(uint32_t));
+}
+
+static bool map_index(struct machore_lsh_index *index) {
+  int fd = open(index->path, O_RDONLY);
+  if (fd < 0) {
+    // No file yet: empty index
+    return true;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(struct lsh_file_header)) {
+    close(fd);
+    return false;
+  }
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  // Sections are sized against what is left of the file, so no sum of
+  // header fields can wrap around
+  const struct lsh_file_header *header = mapping;
+  uint64_t num_records = header->num_records;
+  size_t size_left = (size_t)st.st_size - sizeof(struct lsh_file_header);
+  bool is_valid =
+      memcmp(header->magic, LSH_MAGIC, sizeof(header->magic)) == 0 &&
+      header->version == LSH_VERSION &&
+      header->minhash_size == LIBMACHORE_MINHASH_SIZE &&
+      header->num_bands == LSH_NUM_BANDS &&
+      num_records <= size_left / sizeof(struct lsh_record);
+  size_t records_size = 0;
+  size_t bands_size = 0;
+  if (is_valid) {
+    records_size = num_records * sizeof(struct lsh_record);
+    size_left -= records_size;
+    is_valid = num_records <= size_left / (LSH_NUM_BANDS *
+                                           sizeof(struct lsh_band_entry));
+  }
+  if (is_valid) {
+    bands_size = num_records * LSH_NUM_BANDS * sizeof(struct lsh_band_entry);
+    size_left -= bands_size;
+    is_valid = header->names_size == size_left;
+  }
+
+  // Queries follow band entries to records and return names: both must stay
+  // in bounds, names NUL terminated in the pool
+  const struct lsh_record *records =
+      (const void *)((const uint8_t *)mapping + sizeof(struct lsh_file_header));
+  const struct lsh_band_entry *bands =
+      (const void *)((const uint8_t *)records + records_size);
+  const char *names = (const char *)bands + bands_size;
+  is_valid = is_valid && (header->names_size == 0 ||
+                          names[header->names_size - 1] == '\0');
+  for (uint64_t i = 0; i < num_records && is_valid; i++) {
+    is_valid = records[i].name_offset < header->names_size;
+  }
+  for (uint64_t i = 0; i < num_records * LSH_NUM_BANDS && is_valid; i++) {
+    is_valid = bands[i].record_index < num_records;
+  }
+  if (!is_valid) {
+    munmap(mapping, st.st_size);
+    return false;
+  }
+
+  index->mapping = mapping;
+  index->mapping_size = st.st_size;
+  index->num_records = num_records;
+  index->names_size = header->names_size;
+  index->records = records;
+  index->bands = bands;
+  index->names = names;
+  return true;
+}
+
+static void unmap_index(struct machore_lsh_index *index) {
+  if (index->mapping != NULL) {
+    munmap(index->mapping, index->mapping_size);
+  }
+  index->mapping = NULL;
+  index->mapping_size = 0;
+  index->records = NULL;
+  index->bands = NULL;
+  index->names = NULL;
+  index->num_records = 0;
+  index->names_size = 0;
+}
+
+struct machore_lsh_index *machore_lsh_open(const char *path) {
+  struct machore_lsh_index *index = calloc(1, sizeof(*index));
+  assert(index != NULL);
+  index->path = strdup(path);
+  assert(index->path != NULL);
+  if (!map_index(index)) {
+    free(index->path);
+    free(index);
+    return NULL;
+  }
+  return index;
+}
+
+void machore_lsh_close(struct machore_lsh_index *index) {
+  if (index == NULL) {
+    return;
+  }
+  unmap_index(index);
+  free(index->pending_records);
+  free(index->pending_keys);
+  free(index->pending_names);
+  free(index->path);
+  free(index);
+}
+
+size_t machore_lsh_size(const struct machore_lsh_index *index) {
+  return index->num_records + index->num_pending;
+}
+
+void machore_lsh_insert(struct machore_lsh_index *index, const char *name,
+                        const struct fingerprint_info *fingerprint) {
+  if (index->num_pending == index->pending_capacity) {
+    index->pending_capacity =
+        index->pending_capacity ? index->pending_capacity * 2 : 64;
+    index->pending_records =
+        realloc(index->pending_records,
+                index->pending_capacity * sizeof(struct lsh_record));
+    index->pending_keys =
+        realloc(index->pending_keys,
+                index->pending_capacity * sizeof(*index->pending_keys));
+    assert(index->pending_records != NULL && index->pending_keys != NULL);
+  }
+
+  size_t name_size = strlen(name) + 1;
+  if (index->pending_names_size + name_size > index->pending_names_capacity) {
+    while (index->pending_names_size + name_size >
+           index->pending_names_capacity) {
+      index->pending_names_capacity = index->pending_names_capacity
+                                          ? index->pending_names_capacity * 2
+                                          : 4096;
+    }
+    index->pending_names =
+        realloc(index->pending_names, index->pending_names_capacity);
+    assert(index->pending_names != NULL);
+  }
+
+  struct lsh_record *record = &index->pending_records[index->num_pending];
+  memcpy(record->minhash, fingerprint->minhash, sizeof(record->minhash));
+  record->simhash = fingerprint->simhash;
+  record->num_features = fingerprint->num_features;
+  record->name_offset = index->pending_names_size;
+  memcpy(index->pending_names + index->pending_names_size, name, name_size);
+  index->pending_names_size += name_size;
+
+  for (int band = 0; band < LSH_NUM_BANDS; band++) {
+    index->pending_keys[index->num_pending][band] =
+        band_key(fingerprint->minhash, band);
+  }
+  index->num_pending++;
+}
+
+static const struct lsh_record *
+lsh_record(const struct machore_lsh_index *index, uint64_t record_index) {
+  return record_index < index->num_records
+             ? &index->records[record_index]
+             : &index->pending_records[record_index - index->num_records];
+}
+
+static const char *lsh_record_name(const struct machore_lsh_index *index,
+                                   uint64_t record_index) {
+  const struct lsh_record *record = lsh_record(index, record_index);
+  return record_index < index->num_records
+             ? index->names + record->name_offset
+             : index->pending_names + record->name_offset;
+}
+
+// Adds a record to the candidate set, false when the set is full
+static bool add_candidate(uint64_t *slots, size_t *num_candidates,
+                          uint64_t record_index) {
+  size_t slot = hash_mix(record_index) & (LSH_CANDIDATE_SLOTS - 1);
+  while (slots[slot] != UINT64_MAX) {
+    if (slots[slot] == record_index) {
+      return true;
+    }
+    slot = (slot + 1) & (LSH_CANDIDATE_SLOTS - 1);
+  }
+  if (*num_candidates == LSH_MAX_CANDIDATES) {
+    return false;
+  }
+  slots[slot] = record_index;
+  (*num_candidates)++;
+  return true;
+}
+
+// Keeps `matches` sorted by decreasing similarity
+static void add_match(struct lsh_match *matches, size_t *num_matches,
+                      size_t max_matches, const struct lsh_match *match) {
+  if (*num_matches == max_matches &&
+      (max_matches == 0 ||
+       matches[max_matches - 1].similarity >= match->similarity)) {
+    return;
+  }
+  size_t position = *num_matches < max_matches ? (*num_matches)++
+                                               : max_matches - 1;
+  while (position > 0 && matches[position - 1].similarity < match->similarity) {
+    matches[position] = matches[position - 1];
+    position--;
+  }
+  matches[position] = *match;
+}
+
+size_t machore_lsh_query(const struct machore_lsh_index *index,
+                         const struct fingerprint_info *fingerprint,
+                         struct lsh_match *matches, size_t max_matches) {
+  uint64_t slots[LSH_CANDIDATE_SLOTS];
+  memset(slots, 0xFF, sizeof(slots));
+  size_t num_candidates = 0;
+  bool is_full = false;
+
+  for (int band = 0; band < LSH_NUM_BANDS && !is_full; band++) {
+    uint64_t key = band_key(fingerprint->minhash, band);
+
+    // Lower bound in the sorted band of the mapped records
+    const struct lsh_band_entry *entries =
+        index->bands + band * index->num_records;
+    size_t low = 0;
+    size_t high = index->num_records;
+    while (low < high) {
+      size_t middle = low + (high - low) / 2;
+      if (entries[middle].key < key) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    for (; low < index->num_records && entries[low].key == key && !is_full;
+         low++) {
+      is_full = !add_candidate(slots, &num_candidates,
+                               entries[low].record_index);
+    }
+
+    for (size_t i = 0; i < index->num_pending && !is_full; i++) {
+      if (index->pending_keys[i][band] == key) {
+        is_full =
+            !add_candidate(slots, &num_candidates, index->num_records + i);
+      }
+    }
+  }
+
+  size_t num_matches = 0;
+  for (size_t slot = 0; slot < LSH_CANDIDATE_SLOTS; slot++) {
+    if (slots[slot] == UINT64_MAX) {
+      continue;
+    }
+    const struct lsh_record *record = lsh_record(index, slots[slot]);
+    struct fingerprint_info candidate;
+    memcpy(candidate.minhash, record->minhash, sizeof(candidate.minhash));
+    candidate.simhash = record->simhash;
+    candidate.num_features = record->num_features;
+
+    struct lsh_match match;
+    match.name = lsh_record_name(index, slots[slot]);
+    match.similarity = machore_fingerprint_similarity(fingerprint, &candidate);
+    match.distance = machore_fingerprint_distance(fingerprint, &candidate);
+    add_match(matches, &num_matches, max_matches, &match);
+  }
+  return num_matches;
+}
+
+static int compare_band_entries(const void *a, const void *b) {
+  const struct lsh_band_entry *entry_a = a;
+  const struct lsh_band_entry *entry_b = b;
+  if (entry_a->key != entry_b->key) {
+    return entry_a->key < entry_b->key ? -1 : 1;
+  }
+  return entry_a->record_index < entry_b->record_index ? -1 : 1;
+}
+
+static bool write_index(const struct machore_lsh_index *index, FILE *file) {
+  uint64_t num_records = index->num_records + index->num_pending;
+  struct lsh_file_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LSH_MAGIC, sizeof(header.magic));
+  header.version = LSH_VERSION;
+  header.minhash_size = LIBMACHORE_MINHASH_SIZE;
+  header.num_bands = LSH_NUM_BANDS;
+  header.num_records = num_records;
+  header.names_size = index->names_size + index->pending_names_size;
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    return false;
+  }
+
+  // Records, pending names move after the mapped ones
+  if (index->num_records > 0 &&
+      fwrite(index->records, sizeof(struct lsh_record), index->num_records,
+             file) != index->num_records) {
+    return false;
+  }
+  for (size_t i = 0; i < index->num_pending; i++) {
+    struct lsh_record record = index->pending_records[i];
+    record.name_offset += index->names_size;
+    if (fwrite(&record, sizeof(record), 1, file) != 1) {
+      return false;
+    }
+  }
+
+  // Bands: merge the sorted mapped entries with the sorted pending ones
+  struct lsh_band_entry *pending =
+      malloc((index->num_pending + 1) * sizeof(struct lsh_band_entry));
+  assert(pending != NULL);
+  bool is_written = true;
+  for (int band = 0; band < LSH_NUM_BANDS && is_written; band++) {
+    for (size_t i = 0; i < index->num_pending; i++) {
+      pending[i].key = index->pending_keys[i][band];
+      pending[i].record_index = index->num_records + i;
+    }
+    qsort(pending, index->num_pending, sizeof(struct lsh_band_entry),
+          compare_band_entries);
+
+    const struct lsh_band_entry *entries =
+        index->bands + band * index->num_records;
+    size_t i = 0;
+    size_t j = 0;
+    while (is_written && (i < index->num_records || j < index->num_pending)) {
+      const struct lsh_band_entry *entry =
+          j == index->num_pending ||
+                  (i < index->num_records && entries[i].key <= pending[j].key)
+              ? &entries[i++]
+              : &pending[j++];
+      is_written = fwrite(entry, sizeof(*entry), 1, file) == 1;
+    }
+  }
+  free(pending);
+  if (!is_written) {
+    return false;
+  }
+
+  return (index->names_size == 0 ||
+          fwrite(index->names, 1, index->names_size, file) ==
+              index->names_size) &&
+         (index->pending_names_size == 0 ||
+          fwrite(index->pending_names, 1, index->pending_names_size, file) ==
+              index->pending_names_size);
+}
+
+bool machore_lsh_save(struct machore_lsh_index *index) {
+  size_t tmp_path_size = strlen(index->path) + sizeof(".tmp");
+  char *tmp_path = malloc(tmp_path_size);
+  assert(tmp_path != NULL);
+  snprintf(tmp_path, tmp_path_size, "%s.tmp", index->path);
+
+  // Write a new file and swap it in: readers never see a partial index
+  FILE *file = fopen(tmp_path, "wb");
+  bool is_saved = file != NULL && write_index(index, file);
+  if (file != NULL && fclose(file) != 0) {
+    is_saved = false;
+  }
+  if (!is_saved || rename(tmp_path, index->path) != 0) {
+    unlink(tmp_path);
+    free(tmp_path);
+    return false;
+  }
+  free(tmp_path);
+
+  // Map the new file before dropping anything: when that fails the index
+  // keeps its previous mapping and inserts, and a later save rewrites them
+  struct machore_lsh_index saved;
+  memset(&saved, 0, sizeof(saved));
+  saved.path = index->path;
+  if (!map_index(&saved)) {
+    return false;
+  }
+  unmap_index(index);
+  index->mapping = saved.mapping;
+  index->mapping_size = saved.mapping_size;
+  index->records = saved.records;
+  index->bands = saved.bands;
+  index->names = saved.names;
+  index->num_records = saved.num_records;
+  index->names_size = saved.names_size;
+  index->num_pending = 0;
+  index->pending_names_size = 0;
+  return true;
+}
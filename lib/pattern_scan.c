@@ -0,0 +1,426 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "libmachore.h"
+
+/*
+ * Aho-Corasick automaton over a set of byte patterns.
+ *
+ * The trie is built with child/sibling lists, then compacted: every state
+ * keeps its outgoing edges sorted in one shared array, and the root gets a
+ * dense 256 entries table since it is where the scan spends most of its
+ * time. The other high fan-out states near the root get dense rows too, with
+ * their fail transitions folded in. Outputs follow dictionary suffix links,
+ * so overlapping matches of several patterns are all reported.
+ *
+ * While the automaton sits in the root state, a prefilter skips every byte
+ * that can't start a pattern, 16 bytes at a time with SIMD when available.
+ */
+
+#define ROOT_STATE 0
+#define NO_STATE UINT32_MAX
+#define NO_PATTERN UINT32_MAX
+#define NO_DENSE_ROW UINT32_MAX
+
+// States with at least that many edges get a dense row, up to the max rows
+// (1 KB each)
+#define DENSE_ROW_MIN_EDGES 8
+#define MAX_DENSE_ROWS 1024
+
+struct pattern_state {
+  uint32_t fail;
+  // Nearest state on the fail chain that ends a pattern
+  uint32_t dictionary_link;
+  uint32_t pattern_index;
+  uint32_t edges_start;
+  uint32_t num_edges;
+  uint32_t dense_row;
+};
+
+struct machore_pattern_set {
+  struct pattern_state *states;
+  uint32_t num_states;
+
+  // Sorted outgoing edges of every state
+  uint8_t *edge_bytes;
+  uint32_t *edge_targets;
+
+  uint32_t root_next[256];
+  uint32_t *dense_rows;
+  uint32_t num_dense_rows;
+
+  // Prefilter: bytes starting at least one pattern
+  bool first_bytes[256];
+  uint8_t first_bytes_low_half[16];  // [high nibble] -> low nibbles 0-7
+  uint8_t first_bytes_high_half[16]; // [high nibble] -> low nibbles 8-15
+
+  size_t *pattern_sizes;
+  size_t num_patterns;
+};
+
+// Trie under construction
+struct pattern_trie {
+  uint32_t *first_child;
+  uint32_t *next_sibling;
+  uint8_t *byte;
+  uint32_t *pattern_index;
+  uint32_t num_states;
+  uint32_t capacity;
+};
+
+static uint32_t trie_add_state(struct pattern_trie *trie, uint8_t byte) {
+  if (trie->num_states == trie->capacity) {
+    trie->capacity = trie->capacity == 0 ? 256 : trie->capacity * 2;
+    trie->first_child =
+        realloc(trie->first_child, trie->capacity * sizeof(uint32_t));
+    trie->next_sibling =
+        realloc(trie->next_sibling, trie->capacity * sizeof(uint32_t));
+    trie->byte = realloc(trie->byte, trie->capacity);
+    trie->pattern_index =
+        realloc(trie->pattern_index, trie->capacity * sizeof(uint32_t));
+    assert(trie->first_child != NULL && trie->next_sibling != NULL &&
+           trie->byte != NULL && trie->pattern_index != NULL);
+  }
+  uint32_t state = trie->num_states++;
+  trie->first_child[state] = NO_STATE;
+  trie->next_sibling[state] = NO_STATE;
+  trie->byte[state] = byte;
+  trie->pattern_index[state] = NO_PATTERN;
+  return state;
+}
+
+static uint32_t trie_child(const struct pattern_trie *trie, uint32_t state,
+                           uint8_t byte) {
+  for (uint32_t child = trie->first_child[state]; child != NO_STATE;
+       child = trie->next_sibling[child]) {
+    if (trie->byte[child] == byte) {
+      return child;
+    }
+  }
+  return NO_STATE;
+}
+
+static void trie_free(struct pattern_trie *trie) {
+  free(trie->first_child);
+  free(trie->next_sibling);
+  free(trie->byte);
+  free(trie->pattern_index);
+}
+
+static uint32_t pattern_set_goto(const struct machore_pattern_set *set,
+                                 uint32_t state, uint8_t byte) {
+  if (state == ROOT_STATE) {
+    return set->root_next[byte];
+  }
+  const struct pattern_state *s = &set->states[state];
+  const uint8_t *bytes = set->edge_bytes + s->edges_start;
+  for (uint32_t index = 0; index < s->num_edges; index++) {
+    if (bytes[index] >= byte) {
+      return bytes[index] == byte ? set->edge_targets[s->edges_start + index]
+                                  : NO_STATE;
+    }
+  }
+  return NO_STATE;
+}
+
+// Full transition, following fail links until an edge or a dense row
+static uint32_t pattern_set_next(const struct machore_pattern_set *set,
+                                 uint32_t state, uint8_t byte) {
+  uint32_t next;
+  while (set->states[state].dense_row == NO_DENSE_ROW &&
+         (next = pattern_set_goto(set, state, byte)) == NO_STATE) {
+    state = set->states[state].fail;
+  }
+  if (set->states[state].dense_row != NO_DENSE_ROW) {
+    return set->dense_rows[set->states[state].dense_row * 256 + byte];
+  }
+  return next;
+}
+
+static void build_dense_rows(struct machore_pattern_set *set,
+                             const uint32_t *queue, uint32_t num_states) {
+  set->states[ROOT_STATE].dense_row = 0;
+  set->num_dense_rows = 1;
+  for (uint32_t position = 1; position < num_states; position++) {
+    const struct pattern_state *s = &set->states[queue[position]];
+    if (s->num_edges >= DENSE_ROW_MIN_EDGES &&
+        set->num_dense_rows < MAX_DENSE_ROWS) {
+      set->num_dense_rows++;
+    }
+  }
+  set->dense_rows = malloc(set->num_dense_rows * 256 * sizeof(uint32_t));
+  assert(set->dense_rows != NULL);
+  memcpy(set->dense_rows, set->root_next, sizeof(set->root_next));
+
+  // BFS order: the fail state of a state is complete before its row is built
+  uint32_t row = 1;
+  for (uint32_t position = 1;
+       position < num_states && row < set->num_dense_rows; position++) {
+    uint32_t state = queue[position];
+    struct pattern_state *s = &set->states[state];
+    if (s->num_edges < DENSE_ROW_MIN_EDGES) {
+      continue;
+    }
+    uint32_t *next = set->dense_rows + row * 256;
+    for (int byte = 0; byte < 256; byte++) {
+      next[byte] = pattern_set_next(set, s->fail, byte);
+    }
+    for (uint32_t edge = s->edges_start; edge < s->edges_start + s->num_edges;
+         edge++) {
+      next[set->edge_bytes[edge]] = set->edge_targets[edge];
+    }
+    s->dense_row = row++;
+  }
+}
+
+static void build_prefilter(struct machore_pattern_set *set) {
+  memset(set->first_bytes_low_half, 0, sizeof(set->first_bytes_low_half));
+  memset(set->first_bytes_high_half, 0, sizeof(set->first_bytes_high_half));
+  for (int byte = 0; byte < 256; byte++) {
+    set->first_bytes[byte] = set->root_next[byte] != ROOT_STATE;
+    if (set->first_bytes[byte]) {
+      uint8_t high = byte >> 4;
+      uint8_t low = byte & 0x0F;
+      if (low < 8) {
+        set->first_bytes_low_half[high] |= 1 << low;
+      } else {
+        set->first_bytes_high_half[high] |= 1 << (low - 8);
+      }
+    }
+  }
+}
+
+struct machore_pattern_set *
+machore_pattern_set_create(const char *const *patterns,
+                           const size_t *pattern_sizes, size_t num_patterns) {
+  struct pattern_trie trie = {0};
+  trie_add_state(&trie, 0);
+
+  // 1. Insert every pattern in the trie
+  for (size_t index = 0; index < num_patterns; index++) {
+    const uint8_t *pattern = (const uint8_t *)patterns[index];
+    uint32_t state = ROOT_STATE;
+    for (size_t i = 0; i < pattern_sizes[index]; i++) {
+      uint32_t child = trie_child(&trie, state, pattern[i]);
+      if (child == NO_STATE) {
+        child = trie_add_state(&trie, pattern[i]);
+        trie.next_sibling[child] = trie.first_child[state];
+        trie.first_child[state] = child;
+      }
+      state = child;
+    }
+    // Empty patterns never match, duplicates keep the first index
+    if (state != ROOT_STATE && trie.pattern_index[state] == NO_PATTERN) {
+      trie.pattern_index[state] = index;
+    }
+  }
+
+  struct machore_pattern_set *set = calloc(1, sizeof(*set));
+  assert(set != NULL);
+  set->num_states = trie.num_states;
+  set->states = malloc(trie.num_states * sizeof(struct pattern_state));
+  set->edge_bytes = malloc(trie.num_states);
+  set->edge_targets = malloc(trie.num_states * sizeof(uint32_t));
+  set->pattern_sizes = malloc((num_patterns + 1) * sizeof(size_t));
+  assert(set->states != NULL && set->edge_bytes != NULL &&
+         set->edge_targets != NULL && set->pattern_sizes != NULL);
+  memcpy(set->pattern_sizes, pattern_sizes, num_patterns * sizeof(size_t));
+  set->num_patterns = num_patterns;
+
+  // 2. Compact the edges, sorted by byte, in BFS order so that a state
+  // always comes after the states on its fail chain
+  uint32_t *queue = malloc(trie.num_states * sizeof(uint32_t));
+  assert(queue != NULL);
+  uint32_t queue_head = 0;
+  uint32_t queue_tail = 0;
+  uint32_t num_edges = 0;
+  queue[queue_tail++] = ROOT_STATE;
+  while (queue_head < queue_tail) {
+    uint32_t state = queue[queue_head++];
+    struct pattern_state *s = &set->states[state];
+    s->pattern_index = trie.pattern_index[state];
+    s->edges_start = num_edges;
+    s->num_edges = 0;
+    s->dense_row = NO_DENSE_ROW;
+    for (uint32_t child = trie.first_child[state]; child != NO_STATE;
+         child = trie.next_sibling[child]) {
+      // Insertion sort, fan-outs are small past the first levels
+      uint32_t position = num_edges + s->num_edges;
+      while (position > s->edges_start &&
+             set->edge_bytes[position - 1] > trie.byte[child]) {
+        set->edge_bytes[position] = set->edge_bytes[position - 1];
+        set->edge_targets[position] = set->edge_targets[position - 1];
+        position--;
+      }
+      set->edge_bytes[position] = trie.byte[child];
+      set->edge_targets[position] = child;
+      s->num_edges++;
+      queue[queue_tail++] = child;
+    }
+    num_edges += s->num_edges;
+  }
+
+  for (int byte = 0; byte < 256; byte++) {
+    uint32_t child = trie_child(&trie, ROOT_STATE, byte);
+    set->root_next[byte] = child == NO_STATE ? ROOT_STATE : child;
+  }
+
+  // 3. Fail and dictionary links, in BFS order (queue[0] is the root)
+  set->states[ROOT_STATE].fail = ROOT_STATE;
+  set->states[ROOT_STATE].dictionary_link = NO_STATE;
+  for (uint32_t edge = 0; edge < set->states[ROOT_STATE].num_edges; edge++) {
+    set->states[set->edge_targets[edge]].fail = ROOT_STATE;
+  }
+  for (uint32_t position = 1; position < queue_tail; position++) {
+    uint32_t state = queue[position];
+    struct pattern_state *s = &set->states[state];
+    for (uint32_t edge = s->edges_start; edge < s->edges_start + s->num_edges;
+         edge++) {
+      uint8_t byte = set->edge_bytes[edge];
+      uint32_t child = set->edge_targets[edge];
+      uint32_t fail = s->fail;
+      uint32_t next;
+      while ((next = pattern_set_goto(set, fail, byte)) == NO_STATE) {
+        fail = set->states[fail].fail;
+      }
+      set->states[child].fail = next;
+    }
+  }
+  for (uint32_t position = 1; position < queue_tail; position++) {
+    uint32_t state = queue[position];
+    struct pattern_state *s = &set->states[state];
+    const struct pattern_state *fail = &set->states[s->fail];
+    s->dictionary_link = fail->pattern_index != NO_PATTERN
+                             ? s->fail
+                             : fail->dictionary_link;
+  }
+
+  build_dense_rows(set, queue, queue_tail);
+  free(queue);
+  trie_free(&trie);
+  build_prefilter(set);
+  return set;
+}
+
+void machore_pattern_set_destroy(struct machore_pattern_set *set) {
+  if (set == NULL) {
+    return;
+  }
+  free(set->states);
+  free(set->edge_bytes);
+  free(set->edge_targets);
+  free(set->dense_rows);
+  free(set->pattern_sizes);
+  free(set);
+}
+
+size_t machore_pattern_set_size(const struct machore_pattern_set *set) {
+  return set->num_patterns;
+}
+
+// Returns the position of the first byte at or after `position` that
+// starts a pattern, or `size`.
+static size_t next_candidate(const struct machore_pattern_set *set,
+                             const uint8_t *data, size_t position,
+                             size_t size) {
+#if defined(__SSSE3__)
+  const __m128i low_half =
+      _mm_loadu_si128((const __m128i *)set->first_bytes_low_half);
+  const __m128i high_half =
+      _mm_loadu_si128((const __m128i *)set->first_bytes_high_half);
+  const __m128i bit_of_low =
+      _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64,
+                    (char)128);
+  const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+  while (size - position >= 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(data + position));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble_mask);
+    __m128i low = _mm_and_si128(chunk, nibble_mask);
+    __m128i is_high_half = _mm_cmpgt_epi8(low, _mm_set1_epi8(7));
+    __m128i row =
+        _mm_or_si128(_mm_and_si128(is_high_half,
+                                   _mm_shuffle_epi8(high_half, high)),
+                     _mm_andnot_si128(is_high_half,
+                                      _mm_shuffle_epi8(low_half, high)));
+    __m128i miss = _mm_cmpeq_epi8(
+        _mm_and_si128(row, _mm_shuffle_epi8(bit_of_low, low)),
+        _mm_setzero_si128());
+    uint32_t hits = ~_mm_movemask_epi8(miss) & 0xFFFF;
+    if (hits != 0) {
+      return position + __builtin_ctz(hits);
+    }
+    position += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t low_half = vld1q_u8(set->first_bytes_low_half);
+  const uint8x16_t high_half = vld1q_u8(set->first_bytes_high_half);
+  static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                   1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t bit_of_low = vld1q_u8(bits);
+  while (size - position >= 16) {
+    uint8x16_t chunk = vld1q_u8(data + position);
+    uint8x16_t high = vshrq_n_u8(chunk, 4);
+    uint8x16_t low = vandq_u8(chunk, vdupq_n_u8(0x0F));
+    uint8x16_t is_high_half = vcgtq_u8(low, vdupq_n_u8(7));
+    uint8x16_t row = vbslq_u8(is_high_half, vqtbl1q_u8(high_half, high),
+                              vqtbl1q_u8(low_half, high));
+    uint8x16_t hits = vtstq_u8(row, vqtbl1q_u8(bit_of_low, low));
+    if (vmaxvq_u8(hits) != 0) {
+      break;
+    }
+    position += 16;
+  }
+#endif
+  while (position < size && !set->first_bytes[data[position]]) {
+    position++;
+  }
+  return position;
+}
+
+static bool report_match(const struct machore_pattern_set *set,
+                         uint32_t pattern_index, size_t end_position,
+                         machore_pattern_visitor_t visitor, void *context) {
+  struct pattern_match match;
+  memset(&match, 0, sizeof(match));
+  match.pattern_index = pattern_index;
+  match.original_offset = end_position + 1 - set->pattern_sizes[pattern_index];
+  return visitor == NULL || visitor(&match, context);
+}
+
+size_t machore_pattern_set_scan(const struct machore_pattern_set *set,
+                                const uint8_t *data, size_t size,
+                                machore_pattern_visitor_t visitor,
+                                void *context) {
+  size_t num_matches = 0;
+  uint32_t state = ROOT_STATE;
+  for (size_t position = 0; position < size; position++) {
+    if (state == ROOT_STATE) {
+      position = next_candidate(set, data, position, size);
+      if (position == size) {
+        break;
+      }
+      state = set->root_next[data[position]];
+    } else {
+      state = pattern_set_next(set, state, data[position]);
+    }
+
+    const struct pattern_state *s = &set->states[state];
+    uint32_t output = s->pattern_index != NO_PATTERN ? state
+                                                     : s->dictionary_link;
+    for (; output != NO_STATE; output = set->states[output].dictionary_link) {
+      num_matches++;
+      if (!report_match(set, set->states[output].pattern_index, position,
+                        visitor, context)) {
+        return num_matches;
+      }
+    }
+  }
+  return num_matches;
+}
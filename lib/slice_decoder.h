@@ -0,0 +1,684 @@
+/*
+ * Slice decoders, specialized by width and byte order.
+ *
+ * This file has no include guard: libmachore.c includes it once per layout
+ * of mach_header, after defining
+ *   SLICE_IS_64       1 for MH_MAGIC_64 / MH_CIGAM_64 slices, 0 otherwise
+ *   SLICE_IS_SWAPPED  1 when the slice byte order is not the host one
+ *   SLICE_SUFFIX      suffix of the generated functions (e.g. 64_swapped)
+ *
+ * Header, load command, section and nlist fields are read through the
+ * SLICE_READ macros, which are plain loads or byte swaps: the layout is
+ * picked once per slice from the magic and never tested while walking it.
+ */
+
+#define SLICE_CONCAT_(name, suffix) name##_##suffix
+#define SLICE_CONCAT(name, suffix) SLICE_CONCAT_(name, suffix)
+#define SLICE_FN(name) SLICE_CONCAT(name, SLICE_SUFFIX)
+
+#if SLICE_IS_SWAPPED
+#define SLICE_READ32(value) OSSwapInt32(value)
+#define SLICE_READ64(value) OSSwapInt64(value)
+#else
+#define SLICE_READ32(value) (value)
+#define SLICE_READ64(value) (value)
+#endif
+
+#if SLICE_IS_64
+#define SLICE_MACH_HEADER struct mach_header_64
+#define SLICE_SEGMENT_COMMAND struct segment_command_64
+#define SLICE_SECTION struct section_64
+#define SLICE_NLIST struct nlist_64
+#define SLICE_POINTER uint64_t
+#define SLICE_LC_SEGMENT LC_SEGMENT_64
+#define SLICE_READ_POINTER(value) SLICE_READ64(value)
+#else
+#define SLICE_MACH_HEADER struct mach_header
+#define SLICE_SEGMENT_COMMAND struct segment_command
+#define SLICE_SECTION struct section
+#define SLICE_NLIST struct nlist
+#define SLICE_POINTER uint32_t
+#define SLICE_LC_SEGMENT LC_SEGMENT
+#define SLICE_READ_POINTER(value) SLICE_READ32(value)
+#endif
+
+static void SLICE_FN(collect_segments)(struct segment_map *map,
+                                       const uint8_t *buffer, uint32_t ncmds) {
+  map->num_segments = 0;
+  map->base_address = 0;
+  map->is_64 = SLICE_IS_64;
+  map->is_swapped = SLICE_IS_SWAPPED;
+
+  const uint8_t *cmd = buffer + sizeof(SLICE_MACH_HEADER);
+  const struct load_command *chained_fixups = NULL;
+  for (uint32_t index = 0; index < ncmds; index++) {
+    const struct load_command *lc = (const struct load_command *)cmd;
+    if (SLICE_READ32(lc->cmd) == SLICE_LC_SEGMENT) {
+      const SLICE_SEGMENT_COMMAND *seg = (const SLICE_SEGMENT_COMMAND *)lc;
+      add_segment_range(map, SLICE_READ_POINTER(seg->vmaddr),
+                        SLICE_READ_POINTER(seg->vmsize),
+                        SLICE_READ_POINTER(seg->fileoff),
+                        SLICE_READ_POINTER(seg->filesize));
+    }
+#if !SLICE_IS_SWAPPED
+    if (lc->cmd == LC_DYLD_CHAINED_FIXUPS) {
+      chained_fixups = lc;
+    }
+#endif
+    cmd += SLICE_READ32(lc->cmdsize);
+  }
+
+  // Pointers are decoded with the format of their segment, known once
+  // every segment is. Chained fixups are in host order.
+  if (chained_fixups != NULL) {
+    collect_pointer_formats(
+        map, buffer, (const struct linkedit_data_command *)chained_fixups);
+  }
+}
+
+// __cfstring holds an array of CFString objects, not text:
+//   { isa, flags (+ padding on 64-bit), data pointer, length }
+// The data pointer references the literal in __cstring (UTF-8) or
+// __ustring (UTF-16, flagged with __kCFIsUnicode).
+static void SLICE_FN(parse_cfstring_section)(
+    struct machore_arch_output_t *arch_output, uint8_t *buffer,
+    const char *segname, uint64_t sect_offset, uint64_t sect_size,
+    const struct segment_map *segments) {
+  const size_t stride = 4 * sizeof(SLICE_POINTER);
+  const size_t count = sect_size / stride;
+  if (count == 0) {
+    return;
+  }
+
+  // One allocation per section, entries are views into the buffer
+  arch_output->cfstrings =
+      realloc(arch_output->cfstrings, (arch_output->num_cfstrings + count) *
+                                          sizeof(struct cfstring_info));
+  assert(arch_output->cfstrings != NULL);
+
+  uint8_t *entry = buffer + sect_offset;
+  uint8_t *entries_end = entry + count * stride;
+  for (; entry < entries_end; entry += stride) {
+    const SLICE_POINTER *fields = (const SLICE_POINTER *)entry;
+    uint32_t flags = SLICE_READ32(*(const uint32_t *)&fields[1]);
+    uint64_t length = SLICE_READ_POINTER(fields[3]);
+
+    // Unresolvable pointers are left to relocations (MH_OBJECT), bound or
+    // broken, literals are cut at the end of their segment
+    uint64_t offset;
+    if (!resolve_data_pointer(segments, buffer,
+                              (const uint8_t *)&fields[2] - buffer, &offset)) {
+      continue;
+    }
+    const bool is_utf16 = flags & CFSTRING_FLAG_IS_UNICODE;
+    const uint64_t unit_size = is_utf16 ? 2 : 1;
+    const uint64_t max_length =
+        segment_bytes_left(segments, offset) / unit_size;
+
+    struct cfstring_info *cfstring_info =
+        &arch_output->cfstrings[arch_output->num_cfstrings++];
+    cfstring_info->content = (const char *)buffer + offset;
+    cfstring_info->is_utf16 = is_utf16;
+    cfstring_info->size =
+        (length < max_length ? length : max_length) * unit_size;
+    cfstring_info->original_offset = offset;
+    strncpy(cfstring_info->original_segment, segname, 16);
+    cfstring_info->original_segment[16] = '\0';
+  }
+}
+
+// Records where the metadata sections live and extracts the strings
+static void SLICE_FN(parse_segment)(struct machore_arch_output_t *arch_output,
+                                    uint8_t *buffer,
+                                    const SLICE_SEGMENT_COMMAND *seg,
+                                    const struct segment_map *segments) {
+  const SLICE_SECTION *sect = (const SLICE_SECTION *)(seg + 1);
+  const uint32_t nsects = SLICE_READ32(seg->nsects);
+  const bool is_cfstring_data = is_cfstring_segment(seg->segname);
+  for (uint32_t index = 0; index < nsects; index++, sect++) {
+    const uint32_t offset = SLICE_READ32(sect->offset);
+    const uint64_t size = SLICE_READ_POINTER(sect->size);
+    // Nothing to read, and left out of the validation
+    if (!has_section_contents(SLICE_READ32(sect->flags), offset)) {
+      continue;
+    }
+    record_metadata_section(arch_output, sect->sectname,
+                            SLICE_READ_POINTER(sect->addr), size, offset);
+    if (is_string_section(seg->segname, sect->sectname)) {
+      record_string_section(arch_output->slice_context, seg->segname,
+                            sect->sectname, offset, size, false);
+      if (!arch_output->slice_context->is_paged) {
+        parse_string_section(arch_output, buffer, seg->segname,
+                             sect->sectname, offset, size);
+      }
+    } else if (strncmp(seg->segname, "__TEXT", 16) == 0 &&
+               strncmp(sect->sectname, "__ustring", 16) == 0) {
+      record_string_section(arch_output->slice_context, seg->segname,
+                            sect->sectname, offset, size, true);
+    } else if (is_cfstring_data &&
+               strncmp(sect->sectname, "__cfstring", 16) == 0) {
+      SLICE_FN(parse_cfstring_section)(arch_output, buffer, seg->segname,
+                                       offset, size, segments);
+    }
+  }
+}
+
+static void SLICE_FN(decode_symbol)(uint8_t *buffer,
+                                    const struct symtab_location *symtab,
+                                    uint32_t entry,
+                                    struct symbol_info *symbol_info) {
+  const SLICE_NLIST *symbol =
+      (const SLICE_NLIST *)(buffer + symtab->symoff) + entry;
+  // Names past the string table read as the NUL ending it
+  const uint32_t strx = SLICE_READ32(symbol->n_un.n_strx);
+  symbol_info->name =
+      (char *)buffer + symtab->stroff +
+      (strx < symtab->strsize ? strx : symtab->strsize - 1);
+  symbol_info->has_no_section = symbol->n_sect == NO_SECT;
+
+  // TODO: handle symbol type N_TYPE
+  // (with #include <mach-o/stab.h> for stabs)
+  uint8_t type = symbol->n_type;
+  if (type & N_STAB) {
+    strcpy(symbol_info->type, "STAB");
+  } else if (type & N_EXT) {
+    strcpy(symbol_info->type, "EXTERNAL");
+  } else {
+    strcpy(symbol_info->type, "PRIVATE EXTERNAL");
+  }
+}
+
+// Writes the indices of the entries with a name, the ones listed as
+// symbols, and returns their number
+static size_t SLICE_FN(index_symbols)(uint8_t *buffer,
+                                      const struct symtab_location *symtab,
+                                      uint32_t *entries) {
+  const SLICE_NLIST *symbol_table =
+      (const SLICE_NLIST *)(buffer + symtab->symoff);
+  size_t num_entries = 0;
+  for (uint32_t index = 0; index < symtab->nsyms; index++) {
+    // A zero n_strx reads the same in both byte orders
+    entries[num_entries] = index;
+    num_entries += symbol_table[index].n_un.n_strx != 0;
+  }
+  return num_entries;
+}
+
+static void SLICE_FN(parse_symtab)(struct machore_arch_output_t *arch_output,
+                                   uint8_t *buffer,
+                                   const struct symtab_location *symtab) {
+  if (symtab->nsyms == 0) {
+    return;
+  }
+  const SLICE_NLIST *symbol_table =
+      (const SLICE_NLIST *)(buffer + symtab->symoff);
+
+  // Sized for every entry, the unnamed ones are given back at the end
+  struct symbol_info *symbols = realloc(
+      arch_output->symbols,
+      (arch_output->num_symbols + symtab->nsyms) * sizeof(struct symbol_info));
+  assert(symbols != NULL);
+  size_t num_symbols = arch_output->num_symbols;
+
+  for (uint32_t index = 0; index < symtab->nsyms; index++) {
+    if (symbol_table[index].n_un.n_strx == 0) {
+      continue;
+    }
+    SLICE_FN(decode_symbol)(buffer, symtab, index, &symbols[num_symbols++]);
+  }
+
+  if (num_symbols == 0) {
+    free(symbols);
+    symbols = NULL;
+  } else {
+    symbols = realloc(symbols, num_symbols * sizeof(struct symbol_info));
+  }
+  arch_output->symbols = symbols;
+  arch_output->num_symbols = num_symbols;
+}
+
+// Callees of the load command walk get a host order copy of the command
+static struct linkedit_data_command
+SLICE_FN(read_linkedit_data_command)(const struct load_command *lc) {
+  const struct linkedit_data_command *cmd =
+      (const struct linkedit_data_command *)lc;
+  struct linkedit_data_command decoded = {
+      .cmd = SLICE_READ32(cmd->cmd),
+      .cmdsize = SLICE_READ32(cmd->cmdsize),
+      .dataoff = SLICE_READ32(cmd->dataoff),
+      .datasize = SLICE_READ32(cmd->datasize),
+  };
+  return decoded;
+}
+
+static void SLICE_FN(parse_load_commands)(
+    struct machore_arch_output_t *arch_output, uint8_t *buffer,
+    uint32_t ncmds, bool is_paged) {
+  // Go to the first load command
+  uint8_t *cmd = buffer + sizeof(SLICE_MACH_HEADER);
+
+  struct machore_slice_context *slice_context =
+      calloc(1, sizeof(struct machore_slice_context));
+  assert(slice_context != NULL);
+  slice_context->buffer = buffer;
+  slice_context->is_paged = is_paged;
+  SLICE_FN(collect_segments)(&slice_context->segments, buffer, ncmds);
+  arch_output->slice_context = slice_context;
+  const struct segment_map *segments = &slice_context->segments;
+
+  // Imports refer to dylibs by their load order, LC_ID_DYLIB excluded
+  uint32_t dylib_ordinal = 0;
+
+  for (uint32_t index = 0; index < ncmds; index++) {
+    struct load_command *lc = (struct load_command *)cmd;
+    const uint32_t lc_cmd = SLICE_READ32(lc->cmd);
+
+    switch (lc_cmd) {
+    case LC_LOAD_DYLIB:
+    case LC_LOAD_WEAK_DYLIB:
+    case LC_ID_DYLIB:
+    case LC_REEXPORT_DYLIB:
+    case LC_LOAD_UPWARD_DYLIB:
+    case LC_LAZY_LOAD_DYLIB: {
+      // TODO: we should add context, like the original_load_command
+      struct dylib_command *dylib_cmd = (struct dylib_command *)lc;
+      uint32_t ordinal = lc_cmd == LC_ID_DYLIB ? 0 : ++dylib_ordinal;
+      parse_dylib_command(
+          (const char *)lc + SLICE_READ32(dylib_cmd->dylib.name.offset),
+          SLICE_READ32(dylib_cmd->dylib.current_version), ordinal,
+          arch_output);
+      break;
+    }
+    // TODO: handle other __LINKEDIT segments
+    case SLICE_LC_SEGMENT:
+      SLICE_FN(parse_segment)(arch_output, buffer,
+                              (const SLICE_SEGMENT_COMMAND *)lc, segments);
+      break;
+    case LC_CODE_SIGNATURE: {
+      struct linkedit_data_command linkedit_data_cmd =
+          SLICE_FN(read_linkedit_data_command)(lc);
+      parse_security_flags(arch_output, buffer, &linkedit_data_cmd);
+      break;
+    }
+    case LC_SYMTAB: {
+      const struct symtab_command *symtab_cmd =
+          (const struct symtab_command *)lc;
+      struct symtab_location *symtab = &slice_context->symtab;
+      symtab->symoff = SLICE_READ32(symtab_cmd->symoff);
+      symtab->nsyms = SLICE_READ32(symtab_cmd->nsyms);
+      symtab->stroff = SLICE_READ32(symtab_cmd->stroff);
+      symtab->strsize = SLICE_READ32(symtab_cmd->strsize);
+      if (!is_paged) {
+        SLICE_FN(parse_symtab)(arch_output, buffer, symtab);
+      }
+      break;
+    }
+    case LC_DYLD_EXPORTS_TRIE: {
+      struct linkedit_data_command linkedit_data_cmd =
+          SLICE_FN(read_linkedit_data_command)(lc);
+      arch_output->export_trie = buffer + linkedit_data_cmd.dataoff;
+      arch_output->export_trie_size = linkedit_data_cmd.datasize;
+      break;
+    }
+    case LC_DYLD_INFO:
+    case LC_DYLD_INFO_ONLY: {
+      const struct dyld_info_command *info = (struct dyld_info_command *)lc;
+      struct dyld_info_command dyld_info_cmd = {
+          .cmd = lc_cmd,
+          .cmdsize = SLICE_READ32(info->cmdsize),
+          .rebase_off = SLICE_READ32(info->rebase_off),
+          .rebase_size = SLICE_READ32(info->rebase_size),
+          .bind_off = SLICE_READ32(info->bind_off),
+          .bind_size = SLICE_READ32(info->bind_size),
+          .weak_bind_off = SLICE_READ32(info->weak_bind_off),
+          .weak_bind_size = SLICE_READ32(info->weak_bind_size),
+          .lazy_bind_off = SLICE_READ32(info->lazy_bind_off),
+          .lazy_bind_size = SLICE_READ32(info->lazy_bind_size),
+          .export_off = SLICE_READ32(info->export_off),
+          .export_size = SLICE_READ32(info->export_size),
+      };
+      if (dyld_info_cmd.export_size > 0) {
+        arch_output->export_trie = buffer + dyld_info_cmd.export_off;
+        arch_output->export_trie_size = dyld_info_cmd.export_size;
+      }
+      parse_bind_opcodes(arch_output, buffer, &dyld_info_cmd);
+      break;
+    }
+    case LC_FUNCTION_STARTS: {
+      struct linkedit_data_command linkedit_data_cmd =
+          SLICE_FN(read_linkedit_data_command)(lc);
+      parse_function_starts(arch_output, buffer, &linkedit_data_cmd,
+                            segments);
+      break;
+    }
+#if !SLICE_IS_SWAPPED
+    // Only emitted for little-endian targets, their payloads are decoded in
+    // host order
+    case LC_DATA_IN_CODE: {
+      struct linkedit_data_command linkedit_data_cmd =
+          SLICE_FN(read_linkedit_data_command)(lc);
+      arch_output->data_in_code =
+          (const struct data_in_code_info *)(buffer +
+                                             linkedit_data_cmd.dataoff);
+      arch_output->num_data_in_code =
+          linkedit_data_cmd.datasize / sizeof(struct data_in_code_info);
+      break;
+    }
+    case LC_DYLD_CHAINED_FIXUPS: {
+      struct linkedit_data_command linkedit_data_cmd =
+          SLICE_FN(read_linkedit_data_command)(lc);
+      parse_chained_fixups(arch_output, buffer, &linkedit_data_cmd, segments);
+      break;
+    }
+#endif
+    default:
+      break;
+    }
+
+    cmd += SLICE_READ32(lc->cmdsize);
+  }
+}
+
+static void SLICE_FN(parse_slice)(struct machore_arch_output_t *arch_output,
+                                  uint8_t *buffer, bool is_paged) {
+  const SLICE_MACH_HEADER *header = (const SLICE_MACH_HEADER *)buffer;
+  copy_cpu_arch(SLICE_READ32(header->cputype), arch_output->architecture,
+                LIBMACHORE_ARCHITECTURE_SIZE);
+  arch_output->filetype = get_file_type(SLICE_READ32(header->filetype));
+  SLICE_FN(parse_load_commands)(arch_output, buffer,
+                                SLICE_READ32(header->ncmds), is_paged);
+  parse_flags(SLICE_READ32(header->flags), arch_output);
+}
+
+static void SLICE_FN(compute_byte_stats)(
+    struct machore_arch_output_t *arch_output, uint8_t *buffer) {
+  const SLICE_MACH_HEADER *header = (const SLICE_MACH_HEADER *)buffer;
+  const uint32_t ncmds = SLICE_READ32(header->ncmds);
+  uint8_t *first_cmd = buffer + sizeof(SLICE_MACH_HEADER);
+
+  // 1. Count segments and sections
+  size_t num_segments = 0;
+  size_t num_sections = 0;
+  uint8_t *cmd = first_cmd;
+  for (uint32_t index = 0; index < ncmds; index++) {
+    struct load_command *lc = (struct load_command *)cmd;
+    if (SLICE_READ32(lc->cmd) == SLICE_LC_SEGMENT) {
+      num_segments++;
+      num_sections += SLICE_READ32(((SLICE_SEGMENT_COMMAND *)lc)->nsects);
+    }
+    cmd += SLICE_READ32(lc->cmdsize);
+  }
+
+  arch_output->segment_stats =
+      malloc(num_segments * sizeof(struct byte_stats_info));
+  arch_output->section_stats =
+      malloc(num_sections * sizeof(struct byte_stats_info));
+  struct stats_range *ranges =
+      malloc(num_sections * sizeof(struct stats_range));
+  assert((arch_output->segment_stats != NULL || num_segments == 0) &&
+         (arch_output->section_stats != NULL || num_sections == 0) &&
+         (ranges != NULL || num_sections == 0));
+
+  // 2. Walk every segment once
+  cmd = first_cmd;
+  for (uint32_t index = 0; index < ncmds; index++) {
+    struct load_command *lc = (struct load_command *)cmd;
+    cmd += SLICE_READ32(lc->cmdsize);
+    if (SLICE_READ32(lc->cmd) != SLICE_LC_SEGMENT) {
+      continue;
+    }
+    SLICE_SEGMENT_COMMAND *seg = (SLICE_SEGMENT_COMMAND *)lc;
+    struct byte_stats_info *segment =
+        &arch_output->segment_stats[arch_output->num_segment_stats];
+    init_byte_stats(segment, seg->segname, NULL,
+                    SLICE_READ_POINTER(seg->fileoff),
+                    SLICE_READ_POINTER(seg->filesize));
+    size_t num_ranges = 0;
+    const SLICE_SECTION *sect = (const SLICE_SECTION *)(seg + 1);
+    const uint32_t nsects = SLICE_READ32(seg->nsects);
+    for (uint32_t i = 0; i < nsects; i++) {
+      struct byte_stats_info *stats =
+          &arch_output->section_stats[arch_output->num_section_stats++];
+      init_byte_stats(stats, seg->segname, sect[i].sectname,
+                      SLICE_READ32(sect[i].offset),
+                      SLICE_READ_POINTER(sect[i].size));
+      add_section_range(ranges, &num_ranges, stats,
+                        SLICE_READ32(sect[i].flags));
+    }
+    compute_segment_stats(buffer, segment, ranges, num_ranges);
+    arch_output->num_segment_stats++;
+  }
+  free(ranges);
+}
+
+static size_t SLICE_FN(scan_patterns)(const struct machore_pattern_set *set,
+                                      uint8_t *buffer,
+                                      struct section_scan *scan) {
+  const SLICE_MACH_HEADER *header = (const SLICE_MACH_HEADER *)buffer;
+  const uint32_t ncmds = SLICE_READ32(header->ncmds);
+  uint8_t *cmd = buffer + sizeof(SLICE_MACH_HEADER);
+
+  size_t num_matches = 0;
+  for (uint32_t index = 0; index < ncmds && !scan->is_stopped; index++) {
+    struct load_command *lc = (struct load_command *)cmd;
+    if (SLICE_READ32(lc->cmd) == SLICE_LC_SEGMENT) {
+      SLICE_SEGMENT_COMMAND *seg = (SLICE_SEGMENT_COMMAND *)lc;
+      const SLICE_SECTION *sect = (const SLICE_SECTION *)(seg + 1);
+      const uint32_t nsects = SLICE_READ32(seg->nsects);
+      for (uint32_t i = 0; i < nsects && !scan->is_stopped; i++) {
+        if (!has_section_contents(SLICE_READ32(sect[i].flags),
+                                  SLICE_READ32(sect[i].offset))) {
+          continue;
+        }
+        num_matches += scan_section(set, buffer, scan, seg->segname,
+                                    sect[i].sectname,
+                                    SLICE_READ32(sect[i].offset),
+                                    SLICE_READ_POINTER(sect[i].size));
+      }
+    }
+    cmd += SLICE_READ32(lc->cmdsize);
+  }
+  return num_matches;
+}
+
+static validation_error_t
+SLICE_FN(validate_segment)(uint64_t size, const SLICE_SEGMENT_COMMAND *seg,
+                           uint32_t cmdsize) {
+  // No segment field lies in the load command before this check
+  if (cmdsize < sizeof(SLICE_SEGMENT_COMMAND)) {
+    return LIBMACHORE_VALIDATION_BAD_CMDSIZE;
+  }
+  const uint32_t nsects = SLICE_READ32(seg->nsects);
+  if (nsects > (cmdsize - sizeof(SLICE_SEGMENT_COMMAND)) /
+                   sizeof(SLICE_SECTION)) {
+    return LIBMACHORE_VALIDATION_BAD_CMDSIZE;
+  }
+  if (!is_range_in_slice(SLICE_READ_POINTER(seg->fileoff),
+                         SLICE_READ_POINTER(seg->filesize), size)) {
+    return LIBMACHORE_VALIDATION_BAD_SEGMENT;
+  }
+  const SLICE_SECTION *sect = (const SLICE_SECTION *)(seg + 1);
+  for (uint32_t index = 0; index < nsects; index++) {
+    const uint32_t offset = SLICE_READ32(sect[index].offset);
+    if (has_section_contents(SLICE_READ32(sect[index].flags), offset) &&
+        !is_range_in_slice(offset, SLICE_READ_POINTER(sect[index].size),
+                           size)) {
+      return LIBMACHORE_VALIDATION_BAD_SECTION;
+    }
+  }
+  return LIBMACHORE_VALIDATION_OK;
+}
+
+// The string table ends with a NUL, and decode_symbol() clamps n_strx to
+// it: names can be read with strlen(). Checking every n_strx here would
+// cost as much as indexing the symbols, and the paging APIs index them
+// only when asked to.
+static validation_error_t
+SLICE_FN(validate_symtab)(const uint8_t *buffer, uint64_t size,
+                          const struct symtab_command *symtab_cmd) {
+  const uint32_t nsyms = SLICE_READ32(symtab_cmd->nsyms);
+  const uint32_t stroff = SLICE_READ32(symtab_cmd->stroff);
+  const uint32_t strsize = SLICE_READ32(symtab_cmd->strsize);
+  if (!is_range_in_slice(SLICE_READ32(symtab_cmd->symoff),
+                         (uint64_t)nsyms * sizeof(SLICE_NLIST), size) ||
+      !is_range_in_slice(stroff, strsize, size) ||
+      (nsyms > 0 && strsize == 0) ||
+      (strsize > 0 && buffer[stroff + strsize - 1] != '\0')) {
+    return LIBMACHORE_VALIDATION_BAD_SYMTAB;
+  }
+  return LIBMACHORE_VALIDATION_OK;
+}
+
+static validation_error_t
+SLICE_FN(validate_dyld_info)(uint64_t size,
+                             const struct dyld_info_command *info) {
+  const uint32_t ranges[][2] = {
+      {SLICE_READ32(info->rebase_off), SLICE_READ32(info->rebase_size)},
+      {SLICE_READ32(info->bind_off), SLICE_READ32(info->bind_size)},
+      {SLICE_READ32(info->weak_bind_off), SLICE_READ32(info->weak_bind_size)},
+      {SLICE_READ32(info->lazy_bind_off), SLICE_READ32(info->lazy_bind_size)},
+      {SLICE_READ32(info->export_off), SLICE_READ32(info->export_size)},
+  };
+  for (size_t index = 0; index < sizeof(ranges) / sizeof(ranges[0]);
+       index++) {
+    if (!is_range_in_slice(ranges[index][0], ranges[index][1], size)) {
+      return LIBMACHORE_VALIDATION_BAD_DYLD_INFO;
+    }
+  }
+  return LIBMACHORE_VALIDATION_OK;
+}
+
+static validation_error_t
+SLICE_FN(validate_load_command)(const uint8_t *buffer, uint64_t size,
+                                const struct load_command *lc,
+                                uint32_t cmdsize) {
+  switch (SLICE_READ32(lc->cmd)) {
+  case LC_LOAD_DYLIB:
+  case LC_LOAD_WEAK_DYLIB:
+  case LC_ID_DYLIB:
+  case LC_REEXPORT_DYLIB:
+  case LC_LOAD_UPWARD_DYLIB:
+  case LC_LAZY_LOAD_DYLIB: {
+    if (cmdsize < sizeof(struct dylib_command)) {
+      return LIBMACHORE_VALIDATION_BAD_CMDSIZE;
+    }
+    const uint32_t name_offset =
+        SLICE_READ32(((const struct dylib_command *)lc)->dylib.name.offset);
+    if (name_offset >= cmdsize ||
+        memchr((const uint8_t *)lc + name_offset, '\0',
+               cmdsize - name_offset) == NULL) {
+      return LIBMACHORE_VALIDATION_BAD_DYLIB;
+    }
+    return LIBMACHORE_VALIDATION_OK;
+  }
+  case SLICE_LC_SEGMENT:
+    return SLICE_FN(validate_segment)(
+        size, (const SLICE_SEGMENT_COMMAND *)lc, cmdsize);
+  case LC_SYMTAB:
+    if (cmdsize < sizeof(struct symtab_command)) {
+      return LIBMACHORE_VALIDATION_BAD_CMDSIZE;
+    }
+    return SLICE_FN(validate_symtab)(buffer, size,
+                                     (const struct symtab_command *)lc);
+  case LC_DYLD_INFO:
+  case LC_DYLD_INFO_ONLY:
+    if (cmdsize < sizeof(struct dyld_info_command)) {
+      return LIBMACHORE_VALIDATION_BAD_CMDSIZE;
+    }
+    return SLICE_FN(validate_dyld_info)(size,
+                                        (const struct dyld_info_command *)lc);
+  case LC_CODE_SIGNATURE:
+  case LC_DYLD_EXPORTS_TRIE:
+  case LC_FUNCTION_STARTS:
+#if !SLICE_IS_SWAPPED
+  case LC_DATA_IN_CODE:
+  case LC_DYLD_CHAINED_FIXUPS:
+#endif
+  {
+    if (cmdsize < sizeof(struct linkedit_data_command)) {
+      return LIBMACHORE_VALIDATION_BAD_CMDSIZE;
+    }
+    struct linkedit_data_command linkedit_data_cmd =
+        SLICE_FN(read_linkedit_data_command)(lc);
+    if (!is_range_in_slice(linkedit_data_cmd.dataoff,
+                           linkedit_data_cmd.datasize, size)) {
+      return LIBMACHORE_VALIDATION_BAD_LINKEDIT_DATA;
+    }
+    if (linkedit_data_cmd.cmd == LC_CODE_SIGNATURE) {
+      return validate_code_signature(buffer, &linkedit_data_cmd);
+    }
+    if (linkedit_data_cmd.cmd == LC_DYLD_CHAINED_FIXUPS) {
+      return validate_chained_fixups(buffer, &linkedit_data_cmd);
+    }
+    return LIBMACHORE_VALIDATION_OK;
+  }
+  default:
+    return LIBMACHORE_VALIDATION_OK;
+  }
+}
+
+// Walks the load commands once. `result` gets the index and slice offset of
+// the first invalid one.
+static bool SLICE_FN(validate_slice)(const uint8_t *buffer, uint64_t size,
+                                     struct validation_result *result) {
+  result->load_command_index = LIBMACHORE_NO_LOAD_COMMAND;
+  result->offset = 0;
+  if (size < sizeof(SLICE_MACH_HEADER)) {
+    result->error = LIBMACHORE_VALIDATION_TRUNCATED;
+    return false;
+  }
+  const SLICE_MACH_HEADER *header = (const SLICE_MACH_HEADER *)buffer;
+  const uint32_t ncmds = SLICE_READ32(header->ncmds);
+  uint32_t remaining = SLICE_READ32(header->sizeofcmds);
+  if (remaining > size - sizeof(SLICE_MACH_HEADER) ||
+      ncmds > remaining / sizeof(struct load_command)) {
+    result->error = LIBMACHORE_VALIDATION_BAD_LOAD_COMMANDS;
+    return false;
+  }
+
+  const uint8_t *cmd = buffer + sizeof(SLICE_MACH_HEADER);
+  for (uint32_t index = 0; index < ncmds; index++) {
+    const struct load_command *lc = (const struct load_command *)cmd;
+    const uint32_t cmdsize =
+        remaining < sizeof(struct load_command) ? 0 : SLICE_READ32(lc->cmdsize);
+    validation_error_t error =
+        cmdsize < sizeof(struct load_command) || cmdsize > remaining
+            ? LIBMACHORE_VALIDATION_BAD_CMDSIZE
+            : SLICE_FN(validate_load_command)(buffer, size, lc, cmdsize);
+    if (error != LIBMACHORE_VALIDATION_OK) {
+      result->error = error;
+      result->load_command_index = index;
+      result->offset = cmd - buffer;
+      return false;
+    }
+    cmd += cmdsize;
+    remaining -= cmdsize;
+  }
+  result->error = LIBMACHORE_VALIDATION_OK;
+  return true;
+}
+
+static const struct slice_decoder SLICE_FN(slice_decoder) = {
+    .parse = SLICE_FN(parse_slice),
+    .compute_byte_stats = SLICE_FN(compute_byte_stats),
+    .scan_patterns = SLICE_FN(scan_patterns),
+    .index_symbols = SLICE_FN(index_symbols),
+    .decode_symbol = SLICE_FN(decode_symbol),
+    .validate = SLICE_FN(validate_slice),
+};
+
+#undef SLICE_READ_POINTER
+#undef SLICE_LC_SEGMENT
+#undef SLICE_POINTER
+#undef SLICE_NLIST
+#undef SLICE_SECTION
+#undef SLICE_SEGMENT_COMMAND
+#undef SLICE_MACH_HEADER
+#undef SLICE_READ64
+#undef SLICE_READ32
+#undef SLICE_FN
+#undef SLICE_CONCAT
+#undef SLICE_CONCAT_
+#undef SLICE_SUFFIX
+#undef SLICE_IS_SWAPPED
+#undef SLICE_IS_64
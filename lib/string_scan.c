@@ -0,0 +1,329 @@
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "libmachore.h"
+
+/*
+ * `strings -n` style extraction: runs of printable characters at least
+ * `min_length` characters long, whatever separates them.
+ *
+ * Every 16 bytes are classified at once with SIMD into masks (bit i for
+ * byte i): printable ASCII, high bit set, UTF-8 lead byte, and zero.
+ * Printable chunks extend the current run by 16 characters, chunks without
+ * any candidate byte are skipped whole, and only the bytes at the edges of
+ * a run, or non-ASCII characters when they are allowed, are looked at one
+ * by one.
+ *
+ * UTF-16LE runs are scanned two bytes at a time from the start of the data:
+ * a code unit is printable ASCII when its low (even) byte is and its high
+ * (odd) byte is zero, so the same masks give 8 code units per chunk.
+ */
+
+#define NO_RUN SIZE_MAX
+#define EVEN_BITS 0x5555
+
+struct byte_classes {
+  uint32_t printable;
+  uint32_t high;
+  // 0xC2-0xF4, the lead bytes of well-formed multibyte sequences
+  uint32_t utf8_lead;
+  uint32_t zero;
+};
+
+static inline bool is_printable_ascii(uint8_t byte) {
+  return (byte >= 0x20 && byte < 0x7F) || byte == '\t';
+}
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+// Bit i of the result is the top bit of lane i
+static inline uint32_t movemask_u8(uint8x16_t lanes) {
+  static const int8_t shifts[16] = {0, 1, 2, 3, 4, 5, 6, 7,
+                                    0, 1, 2, 3, 4, 5, 6, 7};
+  uint8x16_t bits = vshlq_u8(vshrq_n_u8(lanes, 7), vld1q_s8(shifts));
+  return vaddv_u8(vget_low_u8(bits)) |
+         ((uint32_t)vaddv_u8(vget_high_u8(bits)) << 8);
+}
+#endif
+
+static inline void classify16(const uint8_t *p, struct byte_classes *classes) {
+#if defined(__SSE2__)
+  __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+  // 0x20-0x7E becomes -128..-34 as signed bytes, the rest is above
+  __m128i shifted = _mm_add_epi8(bytes, _mm_set1_epi8(0x60));
+  __m128i printable =
+      _mm_or_si128(_mm_cmplt_epi8(shifted, _mm_set1_epi8((char)0xDF)),
+                   _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+  classes->printable = (uint32_t)_mm_movemask_epi8(printable);
+  classes->high = (uint32_t)_mm_movemask_epi8(bytes);
+  // Same for 0xC2-0xF4, which becomes -128..-78
+  __m128i lead = _mm_cmplt_epi8(_mm_sub_epi8(bytes, _mm_set1_epi8(0x42)),
+                                _mm_set1_epi8((char)0xB3));
+  classes->utf8_lead = (uint32_t)_mm_movemask_epi8(lead);
+  classes->zero = (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(bytes, _mm_setzero_si128()));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  uint8x16_t bytes = vld1q_u8(p);
+  uint8x16_t printable =
+      vorrq_u8(vcleq_u8(vsubq_u8(bytes, vdupq_n_u8(0x20)), vdupq_n_u8(0x5E)),
+               vceqq_u8(bytes, vdupq_n_u8('\t')));
+  classes->printable = movemask_u8(printable);
+  classes->high = movemask_u8(bytes);
+  classes->utf8_lead = movemask_u8(
+      vcleq_u8(vsubq_u8(bytes, vdupq_n_u8(0xC2)), vdupq_n_u8(0x32)));
+  classes->zero = movemask_u8(vceqzq_u8(bytes));
+#else
+  classes->printable = 0;
+  classes->high = 0;
+  classes->utf8_lead = 0;
+  classes->zero = 0;
+  for (int i = 0; i < 16; i++) {
+    classes->printable |= (uint32_t)is_printable_ascii(p[i]) << i;
+    classes->high |= (uint32_t)(p[i] >> 7) << i;
+    classes->utf8_lead |= (uint32_t)(p[i] >= 0xC2 && p[i] <= 0xF4) << i;
+    classes->zero |= (uint32_t)(p[i] == 0) << i;
+  }
+#endif
+}
+
+// Size of the well-formed UTF-8 sequence of a non-ASCII character at `p`,
+// 0 when there is none (overlong forms, surrogates, C1 controls...)
+static size_t utf8_sequence_size(const uint8_t *p, size_t available) {
+  uint8_t lead = p[0];
+  size_t size;
+  uint8_t min_second = 0x80;
+  uint8_t max_second = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    // U+0080-U+009F are C1 controls
+    if (lead == 0xC2) {
+      min_second = 0xA0;
+    }
+    size = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    if (lead == 0xE0) {
+      min_second = 0xA0;
+    } else if (lead == 0xED) {
+      max_second = 0x9F;
+    }
+    size = 3;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    if (lead == 0xF0) {
+      min_second = 0x90;
+    } else if (lead == 0xF4) {
+      max_second = 0x8F;
+    }
+    size = 4;
+  } else {
+    return 0;
+  }
+  if (available < size || p[1] < min_second || p[1] > max_second) {
+    return 0;
+  }
+  for (size_t i = 2; i < size; i++) {
+    if ((p[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+  }
+  return size;
+}
+
+// Size in bytes of a non-ASCII printable UTF-16LE character at `p`: a code
+// unit above the C1 controls or a well-formed surrogate pair, 0 otherwise
+static size_t utf16_sequence_size(const uint8_t *p, size_t available) {
+  uint16_t unit = p[0] | (p[1] << 8);
+  if (unit < 0xA0 || unit == 0xFFFE || unit == 0xFFFF) {
+    return 0;
+  }
+  if (unit < 0xD800 || unit > 0xDFFF) {
+    return 2;
+  }
+  if (unit > 0xDBFF || available < 4) {
+    return 0;
+  }
+  uint16_t low = p[2] | (p[3] << 8);
+  return low >= 0xDC00 && low <= 0xDFFF ? 4 : 0;
+}
+
+struct run_state {
+  const uint8_t *data;
+  const struct string_scan_options *options;
+  machore_string_visitor_t visitor;
+  void *context;
+  size_t start;
+  size_t length;
+  size_t num_runs;
+  bool is_stopped;
+};
+
+static inline void extend_run(struct run_state *state, size_t position,
+                              size_t length) {
+  if (state->start == NO_RUN) {
+    state->start = position;
+  }
+  state->length += length;
+}
+
+// Reports the current run if it is long enough, then starts a new one
+static void end_run(struct run_state *state, size_t position) {
+  if (state->is_stopped) {
+    return;
+  }
+  if (state->start != NO_RUN && state->length >= state->options->min_length) {
+    struct string_run run = {
+        .content = (const char *)state->data + state->start,
+        .original_offset = state->start,
+        .size = position - state->start,
+        .length = state->length,
+        .is_utf16 = state->options->is_utf16,
+    };
+    state->num_runs++;
+    if (state->visitor != NULL && !state->visitor(&run, state->context)) {
+      state->is_stopped = true;
+    }
+  }
+  state->start = NO_RUN;
+  state->length = 0;
+}
+
+static void scan_8bit_runs(const uint8_t *data, size_t size,
+                           struct run_state *state) {
+  const bool allow_unicode = state->options->allow_unicode;
+  size_t position = 0;
+  while (position < size && !state->is_stopped) {
+    struct byte_classes classes;
+    if (size - position >= 16) {
+      classify16(data + position, &classes);
+      if (classes.printable == 0xFFFF) {
+        extend_run(state, position, 16);
+        position += 16;
+        continue;
+      }
+      size_t prefix = __builtin_ctz(~classes.printable);
+      if (prefix > 0) {
+        extend_run(state, position, prefix);
+        position += prefix;
+        continue;
+      }
+    } else if (is_printable_ascii(data[position])) {
+      extend_run(state, position, 1);
+      position++;
+      continue;
+    }
+
+    // data[position] is not printable ASCII
+    if (allow_unicode && data[position] >= 0x80) {
+      size_t sequence_size =
+          utf8_sequence_size(data + position, size - position);
+      if (sequence_size > 0) {
+        extend_run(state, position, 1);
+        position += sequence_size;
+        continue;
+      }
+    }
+    end_run(state, position);
+
+    // Skip to the next byte that may start a run
+    position++;
+    while (size - position >= 16) {
+      classify16(data + position, &classes);
+      uint32_t candidates =
+          classes.printable | (allow_unicode ? classes.utf8_lead : 0);
+      if (candidates != 0) {
+        position += __builtin_ctz(candidates);
+        break;
+      }
+      position += 16;
+    }
+  }
+}
+
+static void scan_utf16_runs(const uint8_t *data, size_t size,
+                            struct run_state *state) {
+  const bool allow_unicode = state->options->allow_unicode;
+  size -= size % 2;
+  size_t position = 0;
+  while (position < size && !state->is_stopped) {
+    struct byte_classes classes;
+    if (size - position >= 16) {
+      classify16(data + position, &classes);
+      uint32_t printable = classes.printable & (classes.zero >> 1) & EVEN_BITS;
+      if (printable == EVEN_BITS) {
+        extend_run(state, position, 8);
+        position += 16;
+        continue;
+      }
+      size_t prefix = __builtin_ctz(~printable & EVEN_BITS);
+      if (prefix > 0) {
+        extend_run(state, position, prefix / 2);
+        position += prefix;
+        continue;
+      }
+    } else if (data[position + 1] == 0 && is_printable_ascii(data[position])) {
+      extend_run(state, position, 1);
+      position += 2;
+      continue;
+    }
+
+    // The code unit at `position` is not printable ASCII
+    if (allow_unicode) {
+      size_t sequence_size =
+          utf16_sequence_size(data + position, size - position);
+      if (sequence_size > 0) {
+        extend_run(state, position, 1);
+        position += sequence_size;
+        continue;
+      }
+    }
+    end_run(state, position);
+
+    // Skip to the next code unit that may start a run
+    position += 2;
+    while (size - position >= 16) {
+      classify16(data + position, &classes);
+      uint32_t candidates = classes.printable & (classes.zero >> 1);
+      if (allow_unicode) {
+        candidates |= classes.high | ~classes.zero >> 1;
+      }
+      candidates &= EVEN_BITS;
+      if (candidates != 0) {
+        position += __builtin_ctz(candidates);
+        break;
+      }
+      position += 16;
+    }
+  }
+}
+
+size_t machore_extract_strings(const uint8_t *data, size_t size,
+                               const struct string_scan_options *options,
+                               machore_string_visitor_t visitor,
+                               void *context) {
+  // Empty runs are never reported
+  struct string_scan_options run_options = *options;
+  if (run_options.min_length == 0) {
+    run_options.min_length = 1;
+  }
+  struct run_state state = {
+      .data = data,
+      .options = &run_options,
+      .visitor = visitor,
+      .context = context,
+      .start = NO_RUN,
+      .length = 0,
+      .num_runs = 0,
+      .is_stopped = false,
+  };
+  if (options->is_utf16) {
+    scan_utf16_runs(data, size, &state);
+    end_run(&state, size - size % 2);
+  } else {
+    scan_8bit_runs(data, size, &state);
+    end_run(&state, size);
+  }
+  return state.num_runs;
+}
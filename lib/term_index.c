@@ -0,0 +1,1100 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "leb128.h"
+#include "libmachore.h"
+
+/*
+ * Inverted index of binaries by term: linked dylib paths and versions,
+ * symbol and import names, security flags and entitlement keys.
+ *
+ * The index is a directory of immutable segments, each one a sorted term
+ * dictionary pointing to the posting lists of its documents. A document is
+ * a binary added by machore_term_index_add(), all slices together, numbered
+ * from 0 in its segment. It replaces the documents of the same name added
+ * before it, in its segment or in older ones: replaced documents are skipped
+ * by queries and dropped by merges.
+ *
+ * Segment file layout, in native byte order:
+ *
+ *   struct term_segment_header
+ *   uint64_t name_offsets[num_documents]
+ *   char names[names_size] (NUL terminated)
+ *   uint8_t postings[postings_size]
+ *   char texts[texts_size]
+ *   padding to 8 bytes
+ *   struct term_entry terms[num_terms] (sorted by kind, then by text)
+ *
+ * A posting list holds the ascending document ids of a term as uleb128
+ * deltas, a byte each for terms common to a corpus. Segments are mapped read
+ * only and queried in place with a binary search of the dictionary: only the
+ * pages of the dictionary and the posting list of the term are read.
+ *
+ * machore_term_index_save() writes the documents added since the last save
+ * to a new segment, then merges the newest segments while the one before
+ * them is at most TERM_MERGE_RATIO times as large, so that documents are
+ * rewritten O(log(n)) times and there are O(log(n)) segments. A merged
+ * segment takes the place of the newest segment it merges: a crash before
+ * the older ones are deleted only leaves documents it replaces.
+ */
+
+#define TERM_MAGIC "MACHTIX1"
+#define TERM_VERSION 1
+#define TERM_MERGE_RATIO 2
+#define TERM_SEGMENT_SUFFIX ".tix"
+// Generation in hex, then the suffix
+#define TERM_SEGMENT_NAME_SIZE (16 + sizeof(TERM_SEGMENT_SUFFIX) - 1)
+
+struct term_segment_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_documents;
+  uint64_t num_terms;
+  uint64_t names_size;
+  uint64_t postings_size;
+  uint64_t texts_size;
+};
+
+struct term_entry {
+  uint64_t text_offset;
+  uint64_t postings_offset;
+  uint32_t text_size;
+  uint32_t num_documents;
+  uint32_t kind;
+  uint32_t reserved;
+};
+
+struct term_segment {
+  uint64_t generation;
+  void *mapping;
+  size_t mapping_size;
+  const uint64_t *name_offsets;
+  const char *names;
+  const uint8_t *postings;
+  const char *texts;
+  const struct term_entry *terms;
+  uint64_t num_documents;
+  uint64_t num_terms;
+  uint64_t names_size;
+  uint64_t postings_size;
+  uint64_t texts_size;
+
+  // One bit per document replaced by a later one
+  uint64_t *replaced;
+  uint64_t num_replaced;
+};
+
+// A term of the documents added since the last save
+struct pending_term {
+  uint64_t hash;
+  uint64_t text_offset;
+  uint32_t text_size;
+  uint32_t kind;
+  // Last document listing the term, terms are posted once per document
+  uint32_t last_document;
+  uint32_t num_documents;
+};
+
+struct pending_posting {
+  uint32_t term;
+  uint32_t document;
+};
+
+struct machore_term_index {
+  char *path;
+
+  // Oldest first
+  struct term_segment *segments;
+  size_t num_segments;
+
+  // Added since the last save. Terms are interned in a hash table of
+  // indices into `pending_terms`, UINT32_MAX for empty slots.
+  struct pending_term *pending_terms;
+  size_t num_pending_terms;
+  size_t pending_terms_capacity;
+  uint32_t *pending_slots;
+  size_t num_pending_slots;
+  char *pending_texts;
+  size_t pending_texts_size;
+  size_t pending_texts_capacity;
+  struct pending_posting *pending_postings;
+  size_t num_pending_postings;
+  size_t pending_postings_capacity;
+  uint64_t *pending_name_offsets;
+  size_t num_pending_documents;
+  size_t pending_documents_capacity;
+  char *pending_names;
+  size_t pending_names_size;
+  size_t pending_names_capacity;
+};
+
+// A sorted term and its posting list, written to a new segment
+struct term_key {
+  const char *text;
+  uint32_t text_size;
+  uint32_t kind;
+  uint32_t term;
+};
+
+struct segment_writer {
+  FILE *file;
+  struct term_segment_header header;
+
+  // The dictionary goes after the posting lists
+  struct term_entry *terms;
+  size_t terms_capacity;
+  char *texts;
+  size_t texts_capacity;
+  bool is_written;
+};
+
+struct posting_cursor {
+  const uint8_t *cursor;
+  const uint8_t *end;
+  uint64_t num_left;
+  uint64_t num_documents;
+  uint64_t document;
+};
+
+// Grows `array` to at least `count` elements
+static void *reserve_array(void *array, size_t *capacity, size_t count,
+                           size_t element_size) {
+  if (count <= *capacity) {
+    return array;
+  }
+  size_t new_capacity = *capacity ? *capacity : 64;
+  while (new_capacity < count) {
+    new_capacity *= 2;
+  }
+  array = realloc(array, new_capacity * element_size);
+  assert(array != NULL);
+  *capacity = new_capacity;
+  return array;
+}
+
+static int compare_terms(uint32_t kind_a, const char *text_a, size_t size_a,
+                         uint32_t kind_b, const char *text_b, size_t size_b) {
+  if (kind_a != kind_b) {
+    return kind_a < kind_b ? -1 : 1;
+  }
+  int result = memcmp(text_a, text_b, size_a < size_b ? size_a : size_b);
+  if (result != 0) {
+    return result;
+  }
+  return size_a < size_b ? -1 : size_a > size_b;
+}
+
+static int compare_term_keys(const void *a, const void *b) {
+  const struct term_key *key_a = a;
+  const struct term_key *key_b = b;
+  return compare_terms(key_a->kind, key_a->text, key_a->text_size,
+                       key_b->kind, key_b->text, key_b->text_size);
+}
+
+// Text of a mapped term, cut at the end of the texts of a corrupted segment
+static const char *term_text(const struct term_segment *segment,
+                             const struct term_entry *term, size_t *size) {
+  uint64_t offset = term->text_offset < segment->texts_size
+                        ? term->text_offset
+                        : segment->texts_size;
+  uint64_t size_left = segment->texts_size - offset;
+  *size = term->text_size < size_left ? term->text_size : size_left;
+  return segment->texts + offset;
+}
+
+static void init_posting_cursor(struct posting_cursor *cursor,
+                                const struct term_segment *segment,
+                                const struct term_entry *term) {
+  uint64_t offset = term->postings_offset < segment->postings_size
+                        ? term->postings_offset
+                        : segment->postings_size;
+  cursor->cursor = segment->postings + offset;
+  cursor->end = segment->postings + segment->postings_size;
+  cursor->num_left = term->num_documents;
+  cursor->num_documents = segment->num_documents;
+  cursor->document = 0;
+}
+
+// Stops at the end of the list, or at the first invalid document id
+static bool next_posting(struct posting_cursor *cursor, uint64_t *document) {
+  uint64_t delta;
+  if (cursor->num_left == 0 ||
+      !read_uleb128(&cursor->cursor, cursor->end, &delta) ||
+      delta >= cursor->num_documents - cursor->document) {
+    return false;
+  }
+  cursor->num_left--;
+  cursor->document += delta;
+  *document = cursor->document;
+  return true;
+}
+
+static bool is_replaced(const struct term_segment *segment,
+                        uint64_t document) {
+  return segment->replaced[document / 64] >> (document % 64) & 1;
+}
+
+static const char *document_name(const struct term_segment *segment,
+                                 uint64_t document) {
+  return segment->names + segment->name_offsets[document];
+}
+
+static char *segment_path(const char *path, uint64_t generation,
+                          const char *suffix) {
+  size_t size = strlen(path) + 1 + TERM_SEGMENT_NAME_SIZE + strlen(suffix) + 1;
+  char *segment_path = malloc(size);
+  assert(segment_path != NULL);
+  snprintf(segment_path, size, "%s/%016" PRIx64 TERM_SEGMENT_SUFFIX "%s",
+           path, generation, suffix);
+  return segment_path;
+}
+
+static bool parse_segment_name(const char *name, uint64_t *generation) {
+  if (strlen(name) != TERM_SEGMENT_NAME_SIZE ||
+      strcmp(name + 16, TERM_SEGMENT_SUFFIX) != 0) {
+    return false;
+  }
+  for (int i = 0; i < 16; i++) {
+    if (!isxdigit((unsigned char)name[i])) {
+      return false;
+    }
+  }
+  *generation = strtoull(name, NULL, 16);
+  return true;
+}
+
+static bool map_segment(const char *path, struct term_segment *segment) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(struct term_segment_header)) {
+    close(fd);
+    return false;
+  }
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  // Every count is below the file size, so the sums below cannot overflow
+  const struct term_segment_header *header = mapping;
+  uint64_t size = st.st_size;
+  bool is_valid =
+      memcmp(header->magic, TERM_MAGIC, sizeof(header->magic)) == 0 &&
+      header->version == TERM_VERSION &&
+      header->num_documents <= size / sizeof(uint64_t) &&
+      header->num_terms <= size / sizeof(struct term_entry) &&
+      header->names_size <= size && header->postings_size <= size &&
+      header->texts_size <= size;
+  uint64_t names_offset = 0;
+  uint64_t terms_offset = 0;
+  if (is_valid) {
+    names_offset = sizeof(struct term_segment_header) +
+                   header->num_documents * sizeof(uint64_t);
+    terms_offset = (names_offset + header->names_size +
+                    header->postings_size + header->texts_size + 7) &
+                   ~(uint64_t)7;
+    is_valid = terms_offset + header->num_terms * sizeof(struct term_entry) ==
+                   size &&
+               (header->names_size == 0
+                    ? header->num_documents == 0
+                    : ((const char *)mapping)[names_offset +
+                                              header->names_size - 1] == '\0');
+  }
+  if (!is_valid) {
+    munmap(mapping, st.st_size);
+    return false;
+  }
+
+  const uint8_t *base = mapping;
+  segment->mapping = mapping;
+  segment->mapping_size = st.st_size;
+  segment->num_documents = header->num_documents;
+  segment->num_terms = header->num_terms;
+  segment->names_size = header->names_size;
+  segment->postings_size = header->postings_size;
+  segment->texts_size = header->texts_size;
+  segment->name_offsets =
+      (const void *)(base + sizeof(struct term_segment_header));
+  segment->names = (const char *)base + names_offset;
+  segment->postings = (const uint8_t *)segment->names + header->names_size;
+  segment->texts = (const char *)segment->postings + header->postings_size;
+  segment->terms = (const void *)(base + terms_offset);
+  segment->replaced = NULL;
+  segment->num_replaced = 0;
+  return true;
+}
+
+static void unmap_segment(struct term_segment *segment) {
+  munmap(segment->mapping, segment->mapping_size);
+  free(segment->replaced);
+  memset(segment, 0, sizeof(*segment));
+}
+
+struct seen_name {
+  uint64_t hash;
+  const char *name;
+};
+
+// Marks the documents replaced by a later document of the same name, going
+// from the newest one. False when a name offset is invalid.
+static bool mark_replaced_documents(struct machore_term_index *index) {
+  uint64_t num_documents = 0;
+  for (size_t i = 0; i < index->num_segments; i++) {
+    num_documents += index->segments[i].num_documents;
+  }
+  size_t num_slots = 64;
+  while (num_slots < 2 * num_documents) {
+    num_slots *= 2;
+  }
+  struct seen_name *slots = calloc(num_slots, sizeof(struct seen_name));
+  assert(slots != NULL);
+
+  bool is_valid = true;
+  for (size_t i = index->num_segments; i-- > 0 && is_valid;) {
+    struct term_segment *segment = &index->segments[i];
+    free(segment->replaced);
+    segment->replaced =
+        calloc(segment->num_documents / 64 + 1, sizeof(uint64_t));
+    assert(segment->replaced != NULL);
+    segment->num_replaced = 0;
+
+    for (uint64_t document = segment->num_documents; document-- > 0;) {
+      if (segment->name_offsets[document] >= segment->names_size) {
+        is_valid = false;
+        break;
+      }
+      const char *name = document_name(segment, document);
+      uint64_t hash = hash_bytes(name, strlen(name));
+      size_t slot = hash & (num_slots - 1);
+      while (slots[slot].name != NULL &&
+             (slots[slot].hash != hash ||
+              strcmp(slots[slot].name, name) != 0)) {
+        slot = (slot + 1) & (num_slots - 1);
+      }
+      if (slots[slot].name != NULL) {
+        segment->replaced[document / 64] |= 1ULL << (document % 64);
+        segment->num_replaced++;
+      } else {
+        slots[slot].hash = hash;
+        slots[slot].name = name;
+      }
+    }
+  }
+  free(slots);
+  return is_valid;
+}
+
+static int compare_generations(const void *a, const void *b) {
+  uint64_t generation_a = *(const uint64_t *)a;
+  uint64_t generation_b = *(const uint64_t *)b;
+  return generation_a < generation_b ? -1 : generation_a > generation_b;
+}
+
+struct machore_term_index *machore_term_index_open(const char *path) {
+  if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+    return NULL;
+  }
+  DIR *directory = opendir(path);
+  if (directory == NULL) {
+    return NULL;
+  }
+  uint64_t *generations = NULL;
+  size_t num_generations = 0;
+  size_t generations_capacity = 0;
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != NULL) {
+    uint64_t generation;
+    if (parse_segment_name(entry->d_name, &generation)) {
+      generations = reserve_array(generations, &generations_capacity,
+                                  num_generations + 1, sizeof(uint64_t));
+      generations[num_generations++] = generation;
+    }
+  }
+  closedir(directory);
+  qsort(generations, num_generations, sizeof(uint64_t), compare_generations);
+
+  struct machore_term_index *index = calloc(1, sizeof(*index));
+  assert(index != NULL);
+  index->path = strdup(path);
+  assert(index->path != NULL);
+  index->segments = calloc(num_generations + 1, sizeof(struct term_segment));
+  assert(index->segments != NULL);
+
+  bool is_valid = true;
+  for (size_t i = 0; i < num_generations && is_valid; i++) {
+    char *file_path = segment_path(path, generations[i], "");
+    is_valid = map_segment(file_path, &index->segments[i]);
+    if (is_valid) {
+      index->segments[i].generation = generations[i];
+      index->num_segments++;
+    }
+    free(file_path);
+  }
+  free(generations);
+  if (!is_valid || !mark_replaced_documents(index)) {
+    machore_term_index_close(index);
+    return NULL;
+  }
+  return index;
+}
+
+static void clear_pending(struct machore_term_index *index) {
+  index->num_pending_terms = 0;
+  index->pending_texts_size = 0;
+  index->num_pending_postings = 0;
+  index->num_pending_documents = 0;
+  index->pending_names_size = 0;
+  if (index->pending_slots != NULL) {
+    memset(index->pending_slots, 0xFF,
+           index->num_pending_slots * sizeof(uint32_t));
+  }
+}
+
+void machore_term_index_close(struct machore_term_index *index) {
+  if (index == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < index->num_segments; i++) {
+    unmap_segment(&index->segments[i]);
+  }
+  free(index->segments);
+  free(index->pending_terms);
+  free(index->pending_slots);
+  free(index->pending_texts);
+  free(index->pending_postings);
+  free(index->pending_name_offsets);
+  free(index->pending_names);
+  free(index->path);
+  free(index);
+}
+
+size_t machore_term_index_size(const struct machore_term_index *index) {
+  size_t num_documents = 0;
+  for (size_t i = 0; i < index->num_segments; i++) {
+    num_documents += index->segments[i].num_documents -
+                     index->segments[i].num_replaced;
+  }
+  return num_documents;
+}
+
+size_t
+machore_term_index_num_segments(const struct machore_term_index *index) {
+  return index->num_segments;
+}
+
+static void grow_pending_slots(struct machore_term_index *index) {
+  free(index->pending_slots);
+  index->num_pending_slots =
+      index->num_pending_slots ? index->num_pending_slots * 2 : 1024;
+  index->pending_slots =
+      malloc(index->num_pending_slots * sizeof(uint32_t));
+  assert(index->pending_slots != NULL);
+  memset(index->pending_slots, 0xFF,
+         index->num_pending_slots * sizeof(uint32_t));
+  size_t mask = index->num_pending_slots - 1;
+  for (uint32_t i = 0; i < index->num_pending_terms; i++) {
+    size_t slot = index->pending_terms[i].hash & mask;
+    while (index->pending_slots[slot] != UINT32_MAX) {
+      slot = (slot + 1) & mask;
+    }
+    index->pending_slots[slot] = i;
+  }
+}
+
+static void add_term(struct machore_term_index *index, uint32_t document,
+                     term_kind_t kind, const char *text, size_t size) {
+  if (size == 0 || size > UINT32_MAX) {
+    return;
+  }
+  if (2 * (index->num_pending_terms + 1) > index->num_pending_slots) {
+    grow_pending_slots(index);
+  }
+
+  uint64_t hash = hash_mix(hash_bytes(text, size) + kind);
+  size_t mask = index->num_pending_slots - 1;
+  size_t slot = hash & mask;
+  uint32_t term_index;
+  while ((term_index = index->pending_slots[slot]) != UINT32_MAX) {
+    const struct pending_term *term = &index->pending_terms[term_index];
+    if (term->hash == hash && term->kind == (uint32_t)kind &&
+        term->text_size == size &&
+        memcmp(index->pending_texts + term->text_offset, text, size) == 0) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  if (term_index == UINT32_MAX) {
+    term_index = index->num_pending_terms++;
+    index->pending_terms = reserve_array(
+        index->pending_terms, &index->pending_terms_capacity,
+        index->num_pending_terms, sizeof(struct pending_term));
+    index->pending_texts =
+        reserve_array(index->pending_texts, &index->pending_texts_capacity,
+                      index->pending_texts_size + size, 1);
+    struct pending_term *term = &index->pending_terms[term_index];
+    term->hash = hash;
+    term->text_offset = index->pending_texts_size;
+    term->text_size = size;
+    term->kind = kind;
+    term->last_document = UINT32_MAX;
+    term->num_documents = 0;
+    memcpy(index->pending_texts + index->pending_texts_size, text, size);
+    index->pending_texts_size += size;
+    index->pending_slots[slot] = term_index;
+  }
+
+  struct pending_term *term = &index->pending_terms[term_index];
+  if (term->last_document == document) {
+    return;
+  }
+  term->last_document = document;
+  term->num_documents++;
+  index->pending_postings = reserve_array(
+      index->pending_postings, &index->pending_postings_capacity,
+      index->num_pending_postings + 1, sizeof(struct pending_posting));
+  index->pending_postings[index->num_pending_postings].term = term_index;
+  index->pending_postings[index->num_pending_postings].document = document;
+  index->num_pending_postings++;
+}
+
+static void add_string_term(struct machore_term_index *index,
+                            uint32_t document, term_kind_t kind,
+                            const char *text) {
+  add_term(index, document, kind, text, strlen(text));
+}
+
+// Keys of the entitlements plist, but the ones set to false
+static void add_entitlement_terms(struct machore_term_index *index,
+                                  uint32_t document,
+                                  const char *entitlements) {
+  const char *cursor = entitlements;
+  while ((cursor = strstr(cursor, "<key>")) != NULL) {
+    const char *key = cursor + strlen("<key>");
+    const char *key_end = strstr(key, "</key>");
+    if (key_end == NULL) {
+      return;
+    }
+    cursor = key_end + strlen("</key>");
+    while (isspace((unsigned char)*cursor)) {
+      cursor++;
+    }
+    if (strncmp(cursor, "<false/>", strlen("<false/>")) != 0) {
+      add_term(index, document, LIBMACHORE_TERM_ENTITLEMENT, key,
+               key_end - key);
+    }
+  }
+}
+
+#define TERM_SYMBOL_BATCH_SIZE 256
+
+static void add_arch_terms(struct machore_term_index *index,
+                           uint32_t document,
+                           struct machore_arch_output_t *arch_output,
+                           bool is_paged) {
+  char version_term[LIBMACHORE_DYLIB_PATH_SIZE +
+                    LIBMACHORE_DYLIB_VERSION_SIZE + 1];
+  for (size_t i = 0; i < arch_output->num_dylibs; i++) {
+    const struct dylib_info *dylib = &arch_output->dylibs[i];
+    // LC_ID_DYLIB names the binary itself
+    if (dylib->ordinal == 0) {
+      continue;
+    }
+    add_string_term(index, document, LIBMACHORE_TERM_DYLIB, dylib->path);
+    snprintf(version_term, sizeof(version_term), "%s@%s", dylib->path,
+             dylib->version);
+    add_string_term(index, document, LIBMACHORE_TERM_DYLIB_VERSION,
+                    version_term);
+  }
+
+  if (is_paged) {
+    struct symbol_info symbols[TERM_SYMBOL_BATCH_SIZE];
+    size_t first = 0;
+    size_t num_symbols;
+    while ((num_symbols = machore_get_symbols(arch_output, first, symbols,
+                                              TERM_SYMBOL_BATCH_SIZE)) > 0) {
+      for (size_t i = 0; i < num_symbols; i++) {
+        add_string_term(index, document, LIBMACHORE_TERM_SYMBOL,
+                        symbols[i].name);
+      }
+      first += num_symbols;
+    }
+  } else {
+    for (size_t i = 0; i < arch_output->num_symbols; i++) {
+      add_string_term(index, document, LIBMACHORE_TERM_SYMBOL,
+                      arch_output->symbols[i].name);
+    }
+  }
+
+  for (size_t i = 0; i < arch_output->num_imports; i++) {
+    add_string_term(index, document, LIBMACHORE_TERM_IMPORT,
+                    arch_output->imports[i].name);
+  }
+  // An import query can't match these binaries, they can be listed instead
+  if (arch_output->imports_status == LIBMACHORE_IMPORTS_UNSUPPORTED) {
+    add_string_term(index, document, LIBMACHORE_TERM_FLAG,
+                    "unsupported-imports");
+  }
+
+  const struct security_flags *flags = arch_output->security_flags;
+  if (flags != NULL) {
+    if (flags->is_signed) {
+      add_string_term(index, document, LIBMACHORE_TERM_FLAG, "signed");
+    }
+    if (flags->has_hardened_runtime) {
+      add_string_term(index, document, LIBMACHORE_TERM_FLAG,
+                      "hardened-runtime");
+    }
+    if (flags->is_library_validation_disabled) {
+      add_string_term(index, document, LIBMACHORE_TERM_FLAG,
+                      "disable-library-validation");
+    }
+    if (flags->is_dylib_env_var_allowed) {
+      add_string_term(index, document, LIBMACHORE_TERM_FLAG,
+                      "allow-dyld-environment-variables");
+    }
+  }
+  if (arch_output->entitlements != NULL) {
+    add_entitlement_terms(index, document, arch_output->entitlements);
+  }
+}
+
+void machore_term_index_add(struct machore_term_index *index,
+                            const char *name,
+                            struct machore_output_t *output) {
+  uint32_t document = index->num_pending_documents++;
+  index->pending_name_offsets = reserve_array(
+      index->pending_name_offsets, &index->pending_documents_capacity,
+      index->num_pending_documents, sizeof(uint64_t));
+  size_t name_size = strlen(name) + 1;
+  index->pending_names =
+      reserve_array(index->pending_names, &index->pending_names_capacity,
+                    index->pending_names_size + name_size, 1);
+  index->pending_name_offsets[document] = index->pending_names_size;
+  memcpy(index->pending_names + index->pending_names_size, name, name_size);
+  index->pending_names_size += name_size;
+
+  for (size_t i = 0; i < output->num_arch_outputs; i++) {
+    add_arch_terms(index, document, &output->arch_outputs[i],
+                   output->is_paged);
+  }
+}
+
+static size_t encode_uleb128(uint8_t *p, uint64_t value) {
+  size_t size = 0;
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    p[size++] = byte | (value != 0 ? 0x80 : 0);
+  } while (value != 0);
+  return size;
+}
+
+// Starts a segment with the names of its documents, in document order
+static bool open_segment_writer(struct segment_writer *writer,
+                                const char *path, const char *const *names,
+                                size_t num_documents) {
+  memset(writer, 0, sizeof(*writer));
+  memcpy(writer->header.magic, TERM_MAGIC, sizeof(writer->header.magic));
+  writer->header.version = TERM_VERSION;
+  writer->header.num_documents = num_documents;
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL) {
+    return false;
+  }
+
+  // The header is rewritten once the sizes are known
+  writer->is_written = fwrite(&writer->header, sizeof(writer->header), 1,
+                              writer->file) == 1;
+  uint64_t name_offset = 0;
+  for (size_t i = 0; i < num_documents && writer->is_written; i++) {
+    writer->is_written =
+        fwrite(&name_offset, sizeof(name_offset), 1, writer->file) == 1;
+    name_offset += strlen(names[i]) + 1;
+  }
+  for (size_t i = 0; i < num_documents && writer->is_written; i++) {
+    size_t size = strlen(names[i]) + 1;
+    writer->is_written = fwrite(names[i], 1, size, writer->file) == size;
+  }
+  writer->header.names_size = name_offset;
+  return writer->is_written;
+}
+
+// Terms are added in dictionary order, with their ascending documents
+static void write_term(struct segment_writer *writer, uint32_t kind,
+                       const char *text, uint32_t text_size,
+                       const uint32_t *documents, size_t num_documents) {
+  writer->terms = reserve_array(writer->terms, &writer->terms_capacity,
+                                writer->header.num_terms + 1,
+                                sizeof(struct term_entry));
+  writer->texts = reserve_array(writer->texts, &writer->texts_capacity,
+                                writer->header.texts_size + text_size, 1);
+  struct term_entry *term = &writer->terms[writer->header.num_terms++];
+  term->text_offset = writer->header.texts_size;
+  term->postings_offset = writer->header.postings_size;
+  term->text_size = text_size;
+  term->num_documents = num_documents;
+  term->kind = kind;
+  term->reserved = 0;
+  memcpy(writer->texts + writer->header.texts_size, text, text_size);
+  writer->header.texts_size += text_size;
+
+  uint8_t buffer[4096];
+  size_t size = 0;
+  uint32_t previous = 0;
+  for (size_t i = 0; i < num_documents && writer->is_written; i++) {
+    size += encode_uleb128(buffer + size, documents[i] - previous);
+    previous = documents[i];
+    if (size > sizeof(buffer) - 16 || i + 1 == num_documents) {
+      writer->is_written = fwrite(buffer, 1, size, writer->file) == size;
+      writer->header.postings_size += size;
+      size = 0;
+    }
+  }
+}
+
+static bool close_segment_writer(struct segment_writer *writer) {
+  static const uint8_t padding[8];
+  uint64_t offset = sizeof(struct term_segment_header) +
+                    writer->header.num_documents * sizeof(uint64_t) +
+                    writer->header.names_size +
+                    writer->header.postings_size + writer->header.texts_size;
+  size_t padding_size = (8 - offset % 8) % 8;
+  bool is_written =
+      writer->is_written &&
+      fwrite(writer->texts, 1, writer->header.texts_size, writer->file) ==
+          writer->header.texts_size &&
+      fwrite(padding, 1, padding_size, writer->file) == padding_size &&
+      fwrite(writer->terms, sizeof(struct term_entry),
+             writer->header.num_terms,
+             writer->file) == writer->header.num_terms &&
+      fseek(writer->file, 0, SEEK_SET) == 0 &&
+      fwrite(&writer->header, sizeof(writer->header), 1, writer->file) == 1;
+  if (fclose(writer->file) != 0) {
+    is_written = false;
+  }
+  free(writer->terms);
+  free(writer->texts);
+  return is_written;
+}
+
+static bool write_pending_segment(const struct machore_term_index *index,
+                                  const char *path) {
+  const char **names =
+      malloc((index->num_pending_documents + 1) * sizeof(char *));
+  assert(names != NULL);
+  for (size_t i = 0; i < index->num_pending_documents; i++) {
+    names[i] = index->pending_names + index->pending_name_offsets[i];
+  }
+  struct segment_writer writer;
+  bool is_open = open_segment_writer(&writer, path, names,
+                                     index->num_pending_documents);
+  free(names);
+  if (!is_open) {
+    if (writer.file != NULL) {
+      fclose(writer.file);
+    }
+    return false;
+  }
+
+  // Posting lists of every term, postings come in document order
+  size_t num_terms = index->num_pending_terms;
+  size_t *ends = malloc((num_terms + 1) * sizeof(size_t));
+  uint32_t *documents =
+      malloc((index->num_pending_postings + 1) * sizeof(uint32_t));
+  struct term_key *keys = malloc((num_terms + 1) * sizeof(struct term_key));
+  assert(ends != NULL && documents != NULL && keys != NULL);
+  size_t total = 0;
+  for (size_t i = 0; i < num_terms; i++) {
+    ends[i] = total;
+    total += index->pending_terms[i].num_documents;
+  }
+  for (size_t i = 0; i < index->num_pending_postings; i++) {
+    const struct pending_posting *posting = &index->pending_postings[i];
+    documents[ends[posting->term]++] = posting->document;
+  }
+
+  for (size_t i = 0; i < num_terms; i++) {
+    const struct pending_term *term = &index->pending_terms[i];
+    keys[i].text = index->pending_texts + term->text_offset;
+    keys[i].text_size = term->text_size;
+    keys[i].kind = term->kind;
+    keys[i].term = i;
+  }
+  qsort(keys, num_terms, sizeof(struct term_key), compare_term_keys);
+  for (size_t i = 0; i < num_terms; i++) {
+    uint32_t num_documents = index->pending_terms[keys[i].term].num_documents;
+    write_term(&writer, keys[i].kind, keys[i].text, keys[i].text_size,
+               documents + ends[keys[i].term] - num_documents, num_documents);
+  }
+
+  free(keys);
+  free(documents);
+  free(ends);
+  return close_segment_writer(&writer);
+}
+
+// Merges the segments from `first` on into one, in place of the newest
+static bool merge_segments(struct machore_term_index *index, size_t first) {
+  struct term_segment *segments = index->segments + first;
+  size_t num_merged = index->num_segments - first;
+  uint64_t generation = segments[num_merged - 1].generation;
+
+  // Renumbers the documents left in (segment, document) order
+  uint32_t **document_ids = malloc(num_merged * sizeof(uint32_t *));
+  size_t num_documents = 0;
+  for (size_t i = 0; i < num_merged; i++) {
+    num_documents += segments[i].num_documents;
+  }
+  const char **names = malloc((num_documents + 1) * sizeof(char *));
+  assert(document_ids != NULL && names != NULL);
+  size_t num_names = 0;
+  for (size_t i = 0; i < num_merged; i++) {
+    document_ids[i] =
+        malloc((segments[i].num_documents + 1) * sizeof(uint32_t));
+    assert(document_ids[i] != NULL);
+    for (uint64_t document = 0; document < segments[i].num_documents;
+         document++) {
+      if (is_replaced(&segments[i], document)) {
+        document_ids[i][document] = UINT32_MAX;
+      } else {
+        document_ids[i][document] = num_names;
+        names[num_names++] = document_name(&segments[i], document);
+      }
+    }
+  }
+
+  char *tmp_path = segment_path(index->path, generation, ".tmp");
+  struct segment_writer writer;
+  bool is_merged = open_segment_writer(&writer, tmp_path, names, num_names);
+  free(names);
+
+  // Merges the dictionaries: posting lists of a term are concatenated in
+  // segment order, which keeps the new document ids ascending
+  uint64_t *cursors = calloc(num_merged, sizeof(uint64_t));
+  uint32_t *documents = NULL;
+  size_t documents_capacity = 0;
+  assert(cursors != NULL);
+  while (is_merged) {
+    const struct term_entry *smallest = NULL;
+    const char *text = NULL;
+    size_t text_size = 0;
+    for (size_t i = 0; i < num_merged; i++) {
+      if (cursors[i] == segments[i].num_terms) {
+        continue;
+      }
+      const struct term_entry *term = &segments[i].terms[cursors[i]];
+      size_t size;
+      const char *candidate_text = term_text(&segments[i], term, &size);
+      if (smallest == NULL || compare_terms(term->kind, candidate_text, size,
+                                            smallest->kind, text,
+                                            text_size) < 0) {
+        smallest = term;
+        text = candidate_text;
+        text_size = size;
+      }
+    }
+    if (smallest == NULL) {
+      break;
+    }
+
+    size_t num_postings = 0;
+    uint32_t kind = smallest->kind;
+    for (size_t i = 0; i < num_merged; i++) {
+      if (cursors[i] == segments[i].num_terms) {
+        continue;
+      }
+      const struct term_entry *term = &segments[i].terms[cursors[i]];
+      size_t size;
+      const char *candidate_text = term_text(&segments[i], term, &size);
+      if (compare_terms(term->kind, candidate_text, size, kind, text,
+                        text_size) != 0) {
+        continue;
+      }
+      struct posting_cursor cursor;
+      init_posting_cursor(&cursor, &segments[i], term);
+      uint64_t document;
+      while (next_posting(&cursor, &document)) {
+        if (document_ids[i][document] != UINT32_MAX) {
+          documents = reserve_array(documents, &documents_capacity,
+                                    num_postings + 1, sizeof(uint32_t));
+          documents[num_postings++] = document_ids[i][document];
+        }
+      }
+      cursors[i]++;
+    }
+    // Terms only listed by replaced documents are dropped
+    if (num_postings > 0) {
+      write_term(&writer, kind, text, text_size, documents, num_postings);
+    }
+  }
+  free(documents);
+  free(cursors);
+  for (size_t i = 0; i < num_merged; i++) {
+    free(document_ids[i]);
+  }
+  free(document_ids);
+
+  if (writer.file != NULL) {
+    is_merged = close_segment_writer(&writer) && is_merged;
+  }
+  char *path = segment_path(index->path, generation, "");
+  if (!is_merged || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    free(tmp_path);
+    free(path);
+    return false;
+  }
+  free(tmp_path);
+
+  for (size_t i = 0; i < num_merged; i++) {
+    if (i + 1 < num_merged) {
+      char *old_path = segment_path(index->path, segments[i].generation, "");
+      unlink(old_path);
+      free(old_path);
+    }
+    unmap_segment(&segments[i]);
+  }
+  index->num_segments = first;
+  if (!map_segment(path, &segments[0])) {
+    free(path);
+    return false;
+  }
+  free(path);
+  segments[0].generation = generation;
+  index->num_segments++;
+  return mark_replaced_documents(index);
+}
+
+static uint64_t num_live_documents(const struct term_segment *segment) {
+  return segment->num_documents - segment->num_replaced;
+}
+
+bool machore_term_index_save(struct machore_term_index *index) {
+  if (index->num_pending_documents == 0) {
+    return true;
+  }
+  uint64_t generation =
+      index->num_segments > 0
+          ? index->segments[index->num_segments - 1].generation + 1
+          : 0;
+
+  // Write a new file and swap it in: readers never see a partial segment
+  char *tmp_path = segment_path(index->path, generation, ".tmp");
+  char *path = segment_path(index->path, generation, "");
+  if (!write_pending_segment(index, tmp_path) ||
+      rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    free(tmp_path);
+    free(path);
+    return false;
+  }
+  free(tmp_path);
+
+  index->segments =
+      realloc(index->segments,
+              (index->num_segments + 1) * sizeof(struct term_segment));
+  assert(index->segments != NULL);
+  struct term_segment *segment = &index->segments[index->num_segments];
+  bool is_mapped = map_segment(path, segment);
+  free(path);
+  if (!is_mapped) {
+    return false;
+  }
+  segment->generation = generation;
+  index->num_segments++;
+  clear_pending(index);
+  if (!mark_replaced_documents(index)) {
+    return false;
+  }
+
+  // Merges the newest segments while the previous one is not much larger
+  size_t first = index->num_segments - 1;
+  uint64_t num_documents = num_live_documents(&index->segments[first]);
+  while (first > 0 && num_live_documents(&index->segments[first - 1]) <=
+                          TERM_MERGE_RATIO * num_documents) {
+    first--;
+    num_documents += num_live_documents(&index->segments[first]);
+  }
+  return first == index->num_segments - 1 || merge_segments(index, first);
+}
+
+bool machore_term_index_merge(struct machore_term_index *index,
+                              size_t max_segments) {
+  max_segments = max_segments ? max_segments : 1;
+  if (index->num_segments <= max_segments) {
+    return true;
+  }
+  return merge_segments(index, max_segments - 1);
+}
+
+static const struct term_entry *find_term(const struct term_segment *segment,
+                                          term_kind_t kind, const char *text,
+                                          size_t size) {
+  size_t low = 0;
+  size_t high = segment->num_terms;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    const struct term_entry *term = &segment->terms[middle];
+    size_t term_size;
+    const char *term_text_middle = term_text(segment, term, &term_size);
+    int result = compare_terms(term->kind, term_text_middle, term_size, kind,
+                               text, size);
+    if (result == 0) {
+      return term;
+    }
+    if (result < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return NULL;
+}
+
+size_t machore_term_index_query(const struct machore_term_index *index,
+                                term_kind_t kind, const char *term,
+                                machore_term_visitor_t visitor,
+                                void *context) {
+  size_t size = strlen(term);
+  size_t num_documents = 0;
+  for (size_t i = 0; i < index->num_segments; i++) {
+    const struct term_segment *segment = &index->segments[i];
+    const struct term_entry *entry = find_term(segment, kind, term, size);
+    if (entry == NULL) {
+      continue;
+    }
+    struct posting_cursor cursor;
+    init_posting_cursor(&cursor, segment, entry);
+    uint64_t document;
+    while (next_posting(&cursor, &document)) {
+      if (is_replaced(segment, document)) {
+        continue;
+      }
+      num_documents++;
+      if (visitor != NULL &&
+          !visitor(document_name(segment, document), context)) {
+        return num_documents;
+      }
+    }
+  }
+  return num_documents;
+}
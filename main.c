@@ -1,4 +1,8 @@
+#include "daemon.h"
 #include "lib/libmachore.h"
+#include "watch.h"
+
+#include <mach-o/loader.h>
 
 #include <ctype.h>
 #include <stdint.h>
@@ -9,10 +13,60 @@
 enum {
   DISPLAY_STRINGS = 0x1,
   DISPLAY_SYMBOLS = 0x2,
+  DISPLAY_EXPORTS = 0x4,
+  DISPLAY_IMPORTS = 0x8,
+  DISPLAY_FUNCTIONS = 0x10,
+  DISPLAY_METADATA = 0x20,
+  DISPLAY_STATS = 0x40,
+};
+
+// Entropy above which a section is likely packed or encrypted
+#define HIGH_ENTROPY_THRESHOLD 7.2
+
+// Window of the strings and symbols to print (--offset, --limit). Only the
+// entries of the window are decoded.
+struct page {
+  size_t offset;
+  // SIZE_MAX when not set
+  size_t limit;
+  // --min-length: list the runs of printable characters of the string
+  // sections (`strings -n`) instead of their NUL separated strings, 0 when
+  // not set
+  size_t min_string_length;
 };
 
+// Symbols printed by default by the pretty printer
+#define DEFAULT_SYMBOL_LIMIT 20
+
+// Symbols are decoded and demangled a batch at a time
+#define SYMBOL_BATCH_SIZE 4096
+
 void print_usage(const char *program_name) {
-  printf("Usage: %s <path-to-binary>\n", program_name);
+  printf("Usage: %s <path-to-binary> [--first-only] [--strings] [--symbols] "
+         "[--exports] [--imports] [--functions] "
+         "[--metadata] [--stats] [--json] [--patterns <file>] "
+         "[--offset <index>] [--limit <count>] [--min-length <count>] "
+         "[--demangle]\n",
+         program_name);
+  printf("       %s diff <old-binary> <new-binary> [--old-slice <index>] "
+         "[--new-slice <index>] [--json]\n",
+         program_name);
+  printf("       %s index <index-file> <binary>...\n", program_name);
+  printf("       %s similar <index-file> <binary> [--top <count>]\n",
+         program_name);
+  printf("       %s terms <index-directory> <binary>... [--merge]\n",
+         program_name);
+  printf("       %s lookup <index-directory> <dylib|dylib-version|symbol|"
+         "import|flag|entitlement> <term> [--count]\n",
+         program_name);
+  printf("       %s cache <dyld-shared-cache> [--threads <count>] [--json]\n",
+         program_name);
+  printf("       %s --watch <directory> [--debounce <ms>]\n", program_name);
+  printf("       %s serve <socket> [--workers <count>] [--cache <count>]\n",
+         program_name);
+  printf("       %s load-test <socket> <binary> [--connections <count>] "
+         "[--requests <count>]\n",
+         program_name);
   printf("Displays linked libraries in a Mach-O binary file\n");
 }
 
@@ -39,8 +93,208 @@ const char *filetype_to_string(filetype_t filetype) {
   }
 }
 
-void print_arch(const struct machore_arch_output_t *arch_output,
-                uint8_t display_flags) {
+const char *ordinal_to_string(int32_t ordinal) {
+  switch (ordinal) {
+  case LIBMACHORE_ORDINAL_SELF:
+    return "self";
+  case LIBMACHORE_ORDINAL_MAIN_EXECUTABLE:
+    return "main executable";
+  case LIBMACHORE_ORDINAL_FLAT_LOOKUP:
+    return "flat lookup";
+  case LIBMACHORE_ORDINAL_WEAK_LOOKUP:
+    return "weak lookup";
+  default:
+    return "unknown dylib";
+  }
+}
+
+void print_escaped_char(uint32_t c) {
+  switch (c) {
+  case '\n':
+    printf("\\n");
+    break;
+  case '\0':
+    // We don't want to print the null terminator
+    break;
+  default:
+    if (c < 0x80 && isprint(c)) {
+      printf("%c", (char)c);
+    } else if (c < 0x100) {
+      printf("\\x%02x", c);
+    } else {
+      printf("\\u%04x", c);
+    }
+  }
+}
+
+void print_cfstring(const struct cfstring_info *cfstring_info) {
+  if (cfstring_info->is_utf16) {
+    const uint8_t *units = (const uint8_t *)cfstring_info->content;
+    for (size_t i = 0; i + 1 < cfstring_info->size; i += 2) {
+      print_escaped_char(units[i] | (units[i + 1] << 8));
+    }
+  } else {
+    for (size_t i = 0; i < cfstring_info->size; i++) {
+      print_escaped_char((unsigned char)cfstring_info->content[i]);
+    }
+  }
+}
+
+// Prints the runs of a page, counting all of them
+struct run_printer {
+  const struct page *page;
+  size_t num_runs;
+};
+
+bool is_run_in_page(struct run_printer *printer) {
+  size_t index = printer->num_runs++;
+  return index >= printer->page->offset &&
+         index - printer->page->offset < printer->page->limit;
+}
+
+// Runs print like CFStrings, 8-bit or UTF-16 views into the buffer
+void run_to_cfstring(const struct string_run *run,
+                     struct cfstring_info *cfstring_info) {
+  cfstring_info->content = run->content;
+  cfstring_info->size = run->size;
+  cfstring_info->is_utf16 = run->is_utf16;
+  cfstring_info->original_offset = run->original_offset;
+  strcpy(cfstring_info->original_segment, run->original_segment);
+}
+
+bool print_string_run(const struct string_run *run, void *context) {
+  if (!is_run_in_page(context)) {
+    return true;
+  }
+  struct cfstring_info cfstring_info;
+  run_to_cfstring(run, &cfstring_info);
+  printf("   │  • ");
+  print_cfstring(&cfstring_info);
+  printf(" \033[90m(%s,%s%s)\033[0m\n", run->original_segment,
+         run->original_section, run->is_utf16 ? ", UTF-16" : "");
+  return true;
+}
+
+struct symbol_batch {
+  struct symbol_info symbols[SYMBOL_BATCH_SIZE];
+  const char *names[SYMBOL_BATCH_SIZE];
+  // NULL for the names left as is
+  const char *demangled[SYMBOL_BATCH_SIZE];
+};
+
+// Decodes the next batch of symbols of a page, at most `limit - *num_read`
+// from index `first + *num_read`, demangled when `demangler` is set
+size_t read_symbol_batch(struct machore_arch_output_t *arch_output,
+                         size_t first, size_t limit, size_t *num_read,
+                         struct machore_demangler *demangler,
+                         struct symbol_batch *batch) {
+  size_t max_symbols = limit - *num_read < SYMBOL_BATCH_SIZE
+                           ? limit - *num_read
+                           : SYMBOL_BATCH_SIZE;
+  size_t count = machore_get_symbols(arch_output, first + *num_read,
+                                     batch->symbols, max_symbols);
+  for (size_t index = 0; index < count; index++) {
+    batch->names[index] = batch->symbols[index].name;
+    batch->demangled[index] = NULL;
+  }
+  if (demangler != NULL && count > 0) {
+    machore_demangle_batch(demangler, batch->names, count, batch->demangled);
+  }
+  *num_read += count;
+  return count;
+}
+
+bool print_export(const struct export_info *export_info, void *context) {
+  size_t *num_printed = context;
+  if (*num_printed == 20) {
+    return false;
+  }
+  (*num_printed)++;
+
+  if (export_info->flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+    printf("   │  • %s \033[90m(re-export)\033[0m\n", export_info->name);
+  } else {
+    printf("   │  • %s \033[90m(0x%llx)\033[0m\n", export_info->name,
+           (unsigned long long)export_info->address);
+  }
+  return true;
+}
+
+const char *metadata_kind_to_string(metadata_kind_t kind) {
+  switch (kind) {
+  case LIBMACHORE_METADATA_OBJC_CLASSES:
+    return "Objective-C Classes";
+  case LIBMACHORE_METADATA_OBJC_METHNAMES:
+    return "Objective-C Methods";
+  case LIBMACHORE_METADATA_OBJC_SELECTORS:
+    return "Objective-C Selectors";
+  case LIBMACHORE_METADATA_SWIFT_TYPES:
+    return "Swift Types";
+  case LIBMACHORE_METADATA_SWIFT_TYPEREFS:
+    return "Swift Type References";
+  case LIBMACHORE_METADATA_SWIFT_REFLSTRS:
+    return "Swift Field Names";
+  default:
+    return "Unknown";
+  }
+}
+
+void print_metadata(struct machore_arch_output_t *arch_output) {
+  printf("   ├─ Metadata:\n");
+  for (int kind = 0; kind < LIBMACHORE_METADATA_COUNT; kind++) {
+    size_t num_names;
+    const struct metadata_name *names =
+        machore_metadata_names(arch_output, kind, &num_names);
+    printf("   │  • %s: %zu\n", metadata_kind_to_string(kind), num_names);
+
+    // NOTE: We only print the first 10 names of each table
+    size_t max_printed_names = num_names < 10 ? num_names : 10;
+    for (size_t name_index = 0; name_index < max_printed_names;
+         name_index++) {
+      printf("   │   └─ ");
+      for (size_t i = 0; i < names[name_index].size; i++) {
+        print_escaped_char((unsigned char)names[name_index].name[i]);
+      }
+      printf("\n");
+    }
+    if (num_names > max_printed_names) {
+      printf("   │   └─ ... (truncated)\n");
+    }
+  }
+  printf("   └────────────────\n");
+}
+
+void print_byte_stats(const struct byte_stats_info *stats) {
+  printf("   │  • %s%s%s \033[90m(%llu bytes)\033[0m entropy %.2f, printable "
+         "%.0f%%, zero %.0f%%%s\n",
+         stats->original_segment, stats->original_section[0] ? "," : "",
+         stats->original_section, (unsigned long long)stats->size,
+         stats->entropy, stats->printable_ratio * 100, stats->zero_ratio * 100,
+         stats->entropy >= HIGH_ENTROPY_THRESHOLD ? " ⚠️  high entropy" : "");
+}
+
+void print_stats(struct machore_arch_output_t *arch_output) {
+  size_t num_segments;
+  const struct byte_stats_info *segment_stats =
+      machore_segment_stats(arch_output, &num_segments);
+  printf("   ├─ Segments:\n");
+  for (size_t index = 0; index < num_segments; index++) {
+    print_byte_stats(&segment_stats[index]);
+  }
+
+  size_t num_sections;
+  const struct byte_stats_info *section_stats =
+      machore_section_stats(arch_output, &num_sections);
+  printf("   ├─ Sections:\n");
+  for (size_t index = 0; index < num_sections; index++) {
+    print_byte_stats(&section_stats[index]);
+  }
+  printf("   └────────────────\n");
+}
+
+void print_arch(struct machore_arch_output_t *arch_output,
+                uint8_t display_flags, const struct page *page,
+                struct machore_demangler *demangler) {
   printf("🔧 Architecture: %s\n", arch_output->architecture);
   printf("📁 File Type: %s\n", filetype_to_string(arch_output->filetype));
 
@@ -77,67 +331,158 @@ void print_arch(const struct machore_arch_output_t *arch_output,
     printf("   │   └─ Version: %s\n", dylib_info[dylib_index].version);
   }
 
-  if (display_flags & DISPLAY_STRINGS) {
+  if ((display_flags & DISPLAY_STRINGS) && page->min_string_length > 0) {
     printf("   ├─ String:\n");
-    struct string_info *string_info = arch_output->strings;
-    // NOTE: We only print the first 20 strings
-    for (size_t string_index = 0; string_index < arch_output->num_strings;
+    struct string_scan_options options = {
+        .min_length = page->min_string_length, .allow_unicode = true};
+    struct run_printer printer = {.page = page, .num_runs = 0};
+    machore_extract_slice_strings(arch_output, &options, print_string_run,
+                                  &printer);
+    printf("   │  (%zu strings of %zu characters or more)\n",
+           printer.num_runs, page->min_string_length);
+    printf("   └────────────────\n");
+  } else if (display_flags & DISPLAY_STRINGS) {
+    printf("   ├─ String:\n");
+    struct string_info string_info;
+    for (size_t string_index = page->offset;
+         string_index - page->offset < page->limit &&
+         machore_get_string(arch_output, string_index, &string_info);
          string_index++) {
-      const char *content = string_info[string_index].content;
-      size_t length = string_info[string_index].size;
-
       printf("   │  • ");
 
-      for (size_t i = 0; i < length; i++) {
-        char c = content[i];
-        switch (c) {
-        case '\n':
-          printf("\\n");
-          break;
-        case '\0':
-          // We don't want to print the null terminator
-          break;
-        default:
-          if (isprint(c)) {
-            printf("%c", c);
-          } else {
-            printf("\\x%02x", (unsigned char)c);
-          }
-        }
+      for (size_t i = 0; i < string_info.size; i++) {
+        print_escaped_char((unsigned char)string_info.content[i]);
       }
 
-      printf(" \033[90m(%s,%s)\033[0m",
-             string_info[string_index].original_segment,
-             string_info[string_index].original_section);
+      printf(" \033[90m(%s,%s)\033[0m", string_info.original_segment,
+             string_info.original_section);
 
       printf("\n");
     }
-    printf("   │  (%zu strings)\n", arch_output->num_strings);
+    // CFStrings are listed once, with the first page
+    size_t num_printed_cfstrings =
+        page->offset == 0 ? arch_output->num_cfstrings : 0;
+    for (size_t cfstring_index = 0; cfstring_index < num_printed_cfstrings;
+         cfstring_index++) {
+      const struct cfstring_info *cfstring_info =
+          &arch_output->cfstrings[cfstring_index];
+
+      printf("   │  • ");
+      print_cfstring(cfstring_info);
+      printf(" \033[90m(%s,__cfstring%s)\033[0m\n",
+             cfstring_info->original_segment,
+             cfstring_info->is_utf16 ? ", UTF-16" : "");
+    }
+    printf("   │  (%zu strings, %zu CFStrings)\n",
+           machore_count_strings(arch_output), arch_output->num_cfstrings);
     printf("   └────────────────\n");
   }
 
   if (display_flags & DISPLAY_SYMBOLS) {
     printf("   ├─ Symbols:\n");
-    struct symbol_info *symbol_info = arch_output->symbols;
-    // NOTE: We only print the first 20 strings
-    size_t max_printed_symbols =
-        arch_output->num_symbols < 20 ? arch_output->num_symbols : 20;
-    for (size_t symbol_index = 0; symbol_index < max_printed_symbols;
-         symbol_index++) {
-      struct symbol_info *sym = &symbol_info[symbol_index];
+    size_t limit = page->limit == SIZE_MAX ? DEFAULT_SYMBOL_LIMIT : page->limit;
+    struct symbol_batch *batch = malloc(sizeof(struct symbol_batch));
+    size_t num_read = 0;
+    size_t count;
+    while (batch != NULL && (count = read_symbol_batch(
+                                 arch_output, page->offset, limit, &num_read,
+                                 demangler, batch)) > 0) {
+      for (size_t index = 0; index < count; index++) {
+        const char *demangled = batch->demangled[index];
+        printf("   │  • %s \033[90m(%s)\033[0m \n",
+               demangled ? demangled : batch->symbols[index].name,
+               batch->symbols[index].type);
+      }
+    }
+    free(batch);
+    size_t symbol_index = page->offset + num_read;
 
-      printf("   │  • %s \033[90m(%s)\033[0m \n", sym->name, sym->type);
+    if (symbol_index < machore_count_symbols(arch_output)) {
+      printf("   │  ... (truncated)\n");
     }
+    printf("   └────────────────\n");
+  }
 
-    if (arch_output->num_symbols >= 20) {
+  if (display_flags & DISPLAY_EXPORTS) {
+    printf("   ├─ Exports:\n");
+    // NOTE: We only print the first 20 exports
+    size_t num_printed = 0;
+    size_t num_exports =
+        machore_walk_exports(arch_output->export_trie,
+                             arch_output->export_trie_size, NULL, NULL);
+    machore_walk_exports(arch_output->export_trie,
+                         arch_output->export_trie_size, print_export,
+                         &num_printed);
+    if (num_exports > num_printed) {
       printf("   │  ... (truncated)\n");
     }
+    printf("   │  (%zu exports)\n", num_exports);
     printf("   └────────────────\n");
   }
+
+  if (display_flags & DISPLAY_IMPORTS) {
+    printf("   ├─ Imports:\n");
+    // NOTE: We only print the first 20 imports
+    size_t max_printed_imports =
+        arch_output->num_imports < 20 ? arch_output->num_imports : 20;
+    for (size_t import_index = 0; import_index < max_printed_imports;
+         import_index++) {
+      const struct import_info *import_info =
+          &arch_output->imports[import_index];
+      const struct dylib_info *dylib_info =
+          machore_import_dylib(arch_output, import_info);
+
+      printf("   │  • %s \033[90m(%s%s)\033[0m\n", import_info->name,
+             dylib_info != NULL
+                 ? dylib_info->path
+                 : ordinal_to_string(import_info->library_ordinal),
+             import_info->is_weak ? ", weak" : "");
+    }
+
+    if (arch_output->num_imports > 20) {
+      printf("   │  ... (truncated)\n");
+    }
+    if (arch_output->imports_status == LIBMACHORE_IMPORTS_UNSUPPORTED) {
+      printf("   │  (unsupported chained fixups format, imports unknown)\n");
+    } else {
+      printf("   │  (%zu imports)\n", arch_output->num_imports);
+    }
+    printf("   └────────────────\n");
+  }
+
+  if (display_flags & DISPLAY_FUNCTIONS) {
+    printf("   ├─ Function Starts:\n");
+    // NOTE: We only print the first 20 functions
+    size_t max_printed_functions = arch_output->num_function_starts < 20
+                                       ? arch_output->num_function_starts
+                                       : 20;
+    for (size_t function_index = 0; function_index < max_printed_functions;
+         function_index++) {
+      printf("   │  • 0x%llx\n",
+             (unsigned long long)arch_output->function_starts[function_index]);
+    }
+
+    if (arch_output->num_function_starts > 20) {
+      printf("   │  ... (truncated)\n");
+    }
+    printf("   │  (%zu functions, %zu data in code entries)\n",
+           arch_output->num_function_starts, arch_output->num_data_in_code);
+    printf("   └────────────────\n");
+  }
+
+  if (display_flags & DISPLAY_METADATA) {
+    print_metadata(arch_output);
+  }
+
+  if (display_flags & DISPLAY_STATS) {
+    print_stats(arch_output);
+  }
 }
 
-void pretty_print_macho(const struct machore_output_t *output, const char *path,
-                        bool is_first_only, uint8_t display_flags) {
+void pretty_print_macho(struct machore_output_t *output, const char *path,
+                        bool is_first_only, uint8_t display_flags,
+                        const struct page *page,
+                        struct machore_demangler *demangler) {
   if (output->is_fat && !is_first_only) {
     printf("📦 Fat Binary\n");
     printf("📂 Path: %s\n", path);
@@ -145,89 +490,1058 @@ void pretty_print_macho(const struct machore_output_t *output, const char *path,
 
     for (size_t arch_index = 0; arch_index < output->num_arch_outputs;
          arch_index++) {
-      print_arch(&output->arch_outputs[arch_index], display_flags);
+      print_arch(&output->arch_outputs[arch_index], display_flags, page,
+                 demangler);
       printf("\n");
     }
   } else {
     printf("📦 Mach-O Binary\n");
     printf("📂 Path: %s\n", path);
     printf("══════════════\n");
-    print_arch(&output->arch_outputs[0], display_flags);
+    print_arch(&output->arch_outputs[0], display_flags, page, demangler);
   }
 }
 
-int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    print_usage(argv[0]);
-    return 1;
+/*
+ * JSON output (--json): one object per binary on a single line. Unlike the
+ * pretty printer, lists are never truncated.
+ */
+
+void print_json_char(uint32_t c) {
+  switch (c) {
+  case '"':
+    printf("\\\"");
+    break;
+  case '\\':
+    printf("\\\\");
+    break;
+  case '\n':
+    printf("\\n");
+    break;
+  case '\t':
+    printf("\\t");
+    break;
+  default:
+    // Bytes of UTF-8 sequences are written as is
+    if (c < 0x20 || c == 0x7F) {
+      printf("\\u%04x", c);
+    } else {
+      printf("%c", (char)c);
+    }
   }
+}
 
-  const char *filename = argv[1];
+void print_json_string(const char *content, size_t size) {
+  printf("\"");
+  for (size_t i = 0; i < size && content[i] != '\0'; i++) {
+    print_json_char((unsigned char)content[i]);
+  }
+  printf("\"");
+}
 
-  bool is_first_only = false;
-  uint8_t display_flags = 0;
-  if (argc == 3) {
-    const char *option = argv[2];
-    if (strcmp(option, "--first-only") == 0) {
-      is_first_only = true;
-    } else if (strcmp(option, "--strings") == 0) {
-      display_flags |= DISPLAY_STRINGS;
-    } else if (strcmp(option, "--symbols") == 0) {
-      display_flags |= DISPLAY_SYMBOLS;
+void print_json_cstring(const char *content) {
+  print_json_string(content, strlen(content));
+}
+
+void print_json_cfstring(const struct cfstring_info *cfstring_info) {
+  if (!cfstring_info->is_utf16) {
+    print_json_string(cfstring_info->content, cfstring_info->size);
+    return;
+  }
+  const uint8_t *units = (const uint8_t *)cfstring_info->content;
+  printf("\"");
+  for (size_t i = 0; i + 1 < cfstring_info->size; i += 2) {
+    uint32_t unit = units[i] | (units[i + 1] << 8);
+    if (unit < 0x80) {
+      print_json_char(unit);
     } else {
-      print_usage(argv[0]);
-      return 1;
+      printf("\\u%04x", unit);
     }
   }
+  printf("\"");
+}
 
-  if (argc == 4) {
-    const char *option = argv[3];
-    if (strcmp(option, "--first-only") == 0) {
-      is_first_only = true;
-    } else if (strcmp(option, "--strings") == 0) {
-      display_flags |= DISPLAY_STRINGS;
-    } else if (strcmp(option, "--symbols") == 0) {
-      display_flags |= DISPLAY_SYMBOLS;
-    } else {
-      print_usage(argv[0]);
-      return 1;
+bool print_json_string_run(const struct string_run *run, void *context) {
+  struct run_printer *printer = context;
+  if (!is_run_in_page(printer)) {
+    return true;
+  }
+  struct cfstring_info cfstring_info;
+  run_to_cfstring(run, &cfstring_info);
+  printf("%s{\"content\":",
+         printer->num_runs - 1 > printer->page->offset ? "," : "");
+  print_json_cfstring(&cfstring_info);
+  printf(",\"segment\":");
+  print_json_cstring(run->original_segment);
+  printf(",\"section\":");
+  print_json_cstring(run->original_section);
+  printf(",\"is_utf16\":%s,\"offset\":%llu}",
+         run->is_utf16 ? "true" : "false",
+         (unsigned long long)run->original_offset);
+  return true;
+}
+
+void print_json_byte_stats(const struct byte_stats_info *stats,
+                           size_t num_stats) {
+  printf("[");
+  for (size_t index = 0; index < num_stats; index++) {
+    const struct byte_stats_info *info = &stats[index];
+    printf("%s{\"segment\":", index ? "," : "");
+    print_json_cstring(info->original_segment);
+    if (info->original_section[0] != '\0') {
+      printf(",\"section\":");
+      print_json_cstring(info->original_section);
+    }
+    printf(",\"offset\":%llu,\"size\":%llu,\"entropy\":%.4f,"
+           "\"printable_ratio\":%.4f,\"zero_ratio\":%.4f,\"histogram\":[",
+           (unsigned long long)info->original_offset,
+           (unsigned long long)info->size, info->entropy,
+           info->printable_ratio, info->zero_ratio);
+    for (int byte = 0; byte < 256; byte++) {
+      printf("%s%llu", byte ? "," : "",
+             (unsigned long long)info->histogram[byte]);
+    }
+    printf("]}");
+  }
+  printf("]");
+}
+
+bool print_json_export(const struct export_info *export_info, void *context) {
+  bool *is_first = context;
+  printf("%s{\"name\":", *is_first ? "" : ",");
+  *is_first = false;
+  print_json_cstring(export_info->name);
+  printf(",\"flags\":%llu,\"address\":%llu}",
+         (unsigned long long)export_info->flags,
+         (unsigned long long)export_info->address);
+  return true;
+}
+
+void print_json_arch(struct machore_arch_output_t *arch_output,
+                     uint8_t display_flags, const struct page *page,
+                     struct machore_demangler *demangler) {
+  printf("{\"architecture\":");
+  print_json_cstring(arch_output->architecture);
+  printf(",\"filetype\":");
+  print_json_cstring(filetype_to_string(arch_output->filetype));
+
+  printf(",\"flags\":{\"no_undefined_refs\":%s,\"dyld_compatible\":%s,"
+         "\"defines_weak_symbols\":%s,\"uses_weak_symbols\":%s,"
+         "\"allows_stack_execution\":%s,\"enforce_no_heap_exec\":%s}",
+         arch_output->no_undefined_refs ? "true" : "false",
+         arch_output->dyld_compatible ? "true" : "false",
+         arch_output->defines_weak_symbols ? "true" : "false",
+         arch_output->uses_weak_symbols ? "true" : "false",
+         arch_output->allows_stack_execution ? "true" : "false",
+         arch_output->enforce_no_heap_exec ? "true" : "false");
+
+  if (arch_output->security_flags != NULL) {
+    const struct security_flags *flags = arch_output->security_flags;
+    printf(",\"security\":{\"is_signed\":%s,"
+           "\"is_library_validation_disabled\":%s,"
+           "\"is_dylib_env_var_allowed\":%s,\"has_hardened_runtime\":%s}",
+           flags->is_signed ? "true" : "false",
+           flags->is_library_validation_disabled ? "true" : "false",
+           flags->is_dylib_env_var_allowed ? "true" : "false",
+           flags->has_hardened_runtime ? "true" : "false");
+  }
+
+  printf(",\"dylibs\":[");
+  for (size_t index = 0; index < arch_output->num_dylibs; index++) {
+    printf("%s{\"path\":", index ? "," : "");
+    print_json_cstring(arch_output->dylibs[index].path);
+    printf(",\"version\":");
+    print_json_cstring(arch_output->dylibs[index].version);
+    printf("}");
+  }
+  printf("]");
+
+  if ((display_flags & DISPLAY_STRINGS) && page->min_string_length > 0) {
+    printf(",\"strings\":[");
+    struct string_scan_options options = {
+        .min_length = page->min_string_length, .allow_unicode = true};
+    struct run_printer printer = {.page = page, .num_runs = 0};
+    machore_extract_slice_strings(arch_output, &options,
+                                  print_json_string_run, &printer);
+    printf("],\"num_strings\":%zu", printer.num_runs);
+  } else if (display_flags & DISPLAY_STRINGS) {
+    printf(",\"num_strings\":%zu,\"strings\":[",
+           machore_count_strings(arch_output));
+    struct string_info string_info;
+    for (size_t index = page->offset;
+         index - page->offset < page->limit &&
+         machore_get_string(arch_output, index, &string_info);
+         index++) {
+      printf("%s{\"content\":", index > page->offset ? "," : "");
+      print_json_string(string_info.content, string_info.size);
+      printf(",\"segment\":");
+      print_json_cstring(string_info.original_segment);
+      printf(",\"section\":");
+      print_json_cstring(string_info.original_section);
+      printf(",\"offset\":%llu}",
+             (unsigned long long)string_info.original_offset);
+    }
+    printf("],\"cfstrings\":[");
+    size_t num_printed_cfstrings =
+        page->offset == 0 ? arch_output->num_cfstrings : 0;
+    for (size_t index = 0; index < num_printed_cfstrings; index++) {
+      const struct cfstring_info *cfstring_info =
+          &arch_output->cfstrings[index];
+      printf("%s{\"content\":", index ? "," : "");
+      print_json_cfstring(cfstring_info);
+      printf(",\"segment\":");
+      print_json_cstring(cfstring_info->original_segment);
+      printf(",\"is_utf16\":%s,\"offset\":%llu}",
+             cfstring_info->is_utf16 ? "true" : "false",
+             (unsigned long long)cfstring_info->original_offset);
+    }
+    printf("]");
+  }
+
+  if (display_flags & DISPLAY_SYMBOLS) {
+    printf(",\"num_symbols\":%zu,\"symbols\":[",
+           machore_count_symbols(arch_output));
+    struct symbol_batch *batch = malloc(sizeof(struct symbol_batch));
+    size_t num_read = 0;
+    size_t count;
+    while (batch != NULL && (count = read_symbol_batch(
+                                 arch_output, page->offset, page->limit,
+                                 &num_read, demangler, batch)) > 0) {
+      for (size_t index = 0; index < count; index++) {
+        const struct symbol_info *symbol_info = &batch->symbols[index];
+        printf("%s{\"name\":", num_read - count + index > 0 ? "," : "");
+        print_json_cstring(symbol_info->name);
+        if (batch->demangled[index] != NULL) {
+          printf(",\"demangled\":");
+          print_json_cstring(batch->demangled[index]);
+        }
+        printf(",\"type\":");
+        print_json_cstring(symbol_info->type);
+        printf("}");
+      }
+    }
+    free(batch);
+    printf("]");
+  }
+
+  if (display_flags & DISPLAY_EXPORTS) {
+    printf(",\"exports\":[");
+    bool is_first = true;
+    machore_walk_exports(arch_output->export_trie,
+                         arch_output->export_trie_size, print_json_export,
+                         &is_first);
+    printf("]");
+  }
+
+  if (display_flags & DISPLAY_IMPORTS) {
+    printf(",\"imports\":[");
+    for (size_t index = 0; index < arch_output->num_imports; index++) {
+      const struct import_info *import_info = &arch_output->imports[index];
+      const struct dylib_info *dylib_info =
+          machore_import_dylib(arch_output, import_info);
+      printf("%s{\"name\":", index ? "," : "");
+      print_json_cstring(import_info->name);
+      printf(",\"library\":");
+      print_json_cstring(dylib_info != NULL
+                             ? dylib_info->path
+                             : ordinal_to_string(import_info->library_ordinal));
+      printf(",\"is_weak\":%s}", import_info->is_weak ? "true" : "false");
+    }
+    printf("],\"has_unsupported_imports\":%s",
+           arch_output->imports_status == LIBMACHORE_IMPORTS_UNSUPPORTED
+               ? "true"
+               : "false");
+  }
+
+  if (display_flags & DISPLAY_FUNCTIONS) {
+    printf(",\"function_starts\":[");
+    for (size_t index = 0; index < arch_output->num_function_starts;
+         index++) {
+      printf("%s%llu", index ? "," : "",
+             (unsigned long long)arch_output->function_starts[index]);
     }
+    printf("]");
+  }
+
+  if (display_flags & DISPLAY_METADATA) {
+    printf(",\"metadata\":{");
+    for (int kind = 0; kind < LIBMACHORE_METADATA_COUNT; kind++) {
+      size_t num_names;
+      const struct metadata_name *names =
+          machore_metadata_names(arch_output, kind, &num_names);
+      printf("%s", kind ? "," : "");
+      print_json_cstring(metadata_kind_to_string(kind));
+      printf(":[");
+      for (size_t index = 0; index < num_names; index++) {
+        printf("%s", index ? "," : "");
+        print_json_string(names[index].name, names[index].size);
+      }
+      printf("]");
+    }
+    printf("}");
+  }
+
+  if (display_flags & DISPLAY_STATS) {
+    size_t num_stats;
+    const struct byte_stats_info *stats =
+        machore_segment_stats(arch_output, &num_stats);
+    printf(",\"segments\":");
+    print_json_byte_stats(stats, num_stats);
+    stats = machore_section_stats(arch_output, &num_stats);
+    printf(",\"sections\":");
+    print_json_byte_stats(stats, num_stats);
   }
+  printf("}");
+}
+
+void json_print_macho(struct machore_output_t *output, const char *path,
+                      bool is_first_only, uint8_t display_flags,
+                      const struct page *page,
+                      struct machore_demangler *demangler) {
+  printf("{\"path\":");
+  print_json_cstring(path);
+  printf(",\"is_fat\":%s,\"slices\":[", output->is_fat ? "true" : "false");
+  size_t num_printed = is_first_only && output->num_arch_outputs > 0
+                           ? 1
+                           : output->num_arch_outputs;
+  for (size_t arch_index = 0; arch_index < num_printed; arch_index++) {
+    printf("%s", arch_index ? "," : "");
+    print_json_arch(&output->arch_outputs[arch_index], display_flags, page,
+                    demangler);
+  }
+  printf("]}\n");
+}
 
-  // Read the binary file
+struct pattern_list {
+  char **patterns;
+  size_t *pattern_sizes;
+  size_t num_patterns;
+};
+
+// Reads one pattern per line, skipping empty lines
+bool load_patterns(struct pattern_list *list, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+
+  size_t capacity = 0;
+  char *line = NULL;
+  size_t line_capacity = 0;
+  ssize_t length;
+  while ((length = getline(&line, &line_capacity, file)) != -1) {
+    while (length > 0 &&
+           (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      length--;
+    }
+    if (length == 0) {
+      continue;
+    }
+    if (list->num_patterns == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      list->patterns = realloc(list->patterns, capacity * sizeof(char *));
+      list->pattern_sizes =
+          realloc(list->pattern_sizes, capacity * sizeof(size_t));
+    }
+    list->patterns[list->num_patterns] = strndup(line, length);
+    list->pattern_sizes[list->num_patterns] = length;
+    list->num_patterns++;
+  }
+  free(line);
+  fclose(file);
+  return true;
+}
+
+void free_patterns(struct pattern_list *list) {
+  for (size_t i = 0; i < list->num_patterns; i++) {
+    free(list->patterns[i]);
+  }
+  free(list->patterns);
+  free(list->pattern_sizes);
+}
+
+bool print_pattern_match(const struct pattern_match *match, void *context) {
+  const struct pattern_list *list = context;
+  printf("   │  • [%zu] %s \033[90m(%s,%s) @0x%llx\033[0m\n",
+         match->arch_index, list->patterns[match->pattern_index],
+         match->original_segment, match->original_section,
+         (unsigned long long)match->original_offset);
+  return true;
+}
+
+int scan_patterns(const char *path, uint8_t *buffer, size_t size,
+                  const char *patterns_path) {
+  struct pattern_list list = {0};
+  if (!load_patterns(&list, patterns_path)) {
+    printf("Error: Cannot open patterns file '%s'\n", patterns_path);
+    return 1;
+  }
+
+  struct machore_pattern_set *set = machore_pattern_set_create(
+      (const char *const *)list.patterns, list.pattern_sizes,
+      list.num_patterns);
+
+  printf("📂 Path: %s\n", path);
+  printf("   ├─ Pattern matches:\n");
+  size_t num_matches =
+      machore_scan_patterns(set, buffer, size, print_pattern_match, &list);
+  printf("   │  (%zu matches for %zu patterns)\n", num_matches,
+         list.num_patterns);
+  printf("   └────────────────\n");
+
+  machore_pattern_set_destroy(set);
+  free_patterns(&list);
+  return 0;
+}
+
+uint8_t *read_file(const char *filename, size_t *size) {
   FILE *file = fopen(filename, "rb");
   if (!file) {
     printf("Error: Cannot open file '%s'\n", filename);
-    return 1;
+    return NULL;
   }
 
   // Get file size
   fseek(file, 0, SEEK_END);
-  size_t size = ftell(file);
+  *size = ftell(file);
   fseek(file, 0, SEEK_SET);
 
   // Read file into buffer
-  uint8_t *buffer = malloc(size);
+  uint8_t *buffer = malloc(*size);
   if (!buffer) {
     printf("Error: Memory allocation failed\n");
     fclose(file);
-    return 1;
+    return NULL;
   }
 
-  if (fread(buffer, 1, size, file) != size) {
+  if (fread(buffer, 1, *size, file) != *size) {
     printf("Error: Failed to read file\n");
     free(buffer);
     fclose(file);
-    return 1;
+    return NULL;
   }
   fclose(file);
+  return buffer;
+}
+
+const char *diff_kind_to_string(diff_kind_t kind) {
+  switch (kind) {
+  case LIBMACHORE_DIFF_FLAG:
+    return "Flags";
+  case LIBMACHORE_DIFF_DYLIB:
+    return "Dylibs";
+  case LIBMACHORE_DIFF_EXPORT:
+    return "Exports";
+  case LIBMACHORE_DIFF_SYMBOL:
+    return "Symbols";
+  case LIBMACHORE_DIFF_STRING:
+    return "Strings";
+  default:
+    return "Unknown";
+  }
+}
+
+const char *diff_change_to_string(diff_change_t change) {
+  switch (change) {
+  case LIBMACHORE_DIFF_ADDED:
+    return "added";
+  case LIBMACHORE_DIFF_REMOVED:
+    return "removed";
+  case LIBMACHORE_DIFF_CHANGED:
+    return "changed";
+  default:
+    return "unknown";
+  }
+}
+
+void pretty_print_diff(const struct machore_diff_t *diff,
+                       const char *old_path, const char *new_path) {
+  printf("🔀 Diff\n");
+  printf("📂 Old: %s\n", old_path);
+  printf("📂 New: %s\n", new_path);
+  printf("══════════════\n");
+
+  size_t index = 0;
+  while (index < diff->num_entries) {
+    diff_kind_t kind = diff->entries[index].kind;
+    size_t end = index;
+    while (end < diff->num_entries && diff->entries[end].kind == kind) {
+      end++;
+    }
+
+    printf("   ├─ %s:\n", diff_kind_to_string(kind));
+    // NOTE: We only print the first 20 differences of each kind
+    size_t max_printed = end - index < 20 ? end - index : 20;
+    for (size_t i = index; i < index + max_printed; i++) {
+      const struct diff_entry *entry = &diff->entries[i];
+      printf("   │  %s ", entry->change == LIBMACHORE_DIFF_ADDED     ? "+"
+                            : entry->change == LIBMACHORE_DIFF_REMOVED ? "-"
+                                                                      : "~");
+      for (size_t c = 0; c < entry->name_size; c++) {
+        print_escaped_char((unsigned char)entry->name[c]);
+      }
+      if (entry->change == LIBMACHORE_DIFF_CHANGED) {
+        printf(" \033[90m(%s → %s)\033[0m", entry->old_value,
+               entry->new_value);
+      }
+      printf("\n");
+    }
+    if (end - index > max_printed) {
+      printf("   │  ... (truncated)\n");
+    }
+    printf("   │  (%zu differences)\n", end - index);
+    index = end;
+  }
+  if (diff->num_entries == 0) {
+    printf("   ├─ No differences\n");
+  }
+  printf("   └────────────────\n");
+}
+
+void json_print_diff(const struct machore_diff_t *diff, const char *old_path,
+                     size_t old_slice, const char *new_path,
+                     size_t new_slice) {
+  printf("{\"old\":");
+  print_json_cstring(old_path);
+  printf(",\"old_slice\":%zu,\"new\":", old_slice);
+  print_json_cstring(new_path);
+  printf(",\"new_slice\":%zu,\"differences\":[", new_slice);
+  for (size_t index = 0; index < diff->num_entries; index++) {
+    const struct diff_entry *entry = &diff->entries[index];
+    printf("%s{\"kind\":", index ? "," : "");
+    print_json_cstring(diff_kind_to_string(entry->kind));
+    printf(",\"change\":");
+    print_json_cstring(diff_change_to_string(entry->change));
+    printf(",\"name\":");
+    print_json_string(entry->name, entry->name_size);
+    if (entry->change == LIBMACHORE_DIFF_CHANGED) {
+      printf(",\"old_value\":");
+      print_json_cstring(entry->old_value);
+      printf(",\"new_value\":");
+      print_json_cstring(entry->new_value);
+    }
+    printf("}");
+  }
+  printf("]}\n");
+}
+
+// Prints why a parsed file was rejected, returns false when it is valid
+bool print_validation_error(const char *filename,
+                            const struct machore_output_t *output) {
+  const struct validation_result *validation = &output->validation;
+  if (validation->error == LIBMACHORE_VALIDATION_OK) {
+    return false;
+  }
+  printf("Error: '%s' is not a valid Mach-O file: %s", filename,
+         machore_validation_error_string(validation->error));
+  if (validation->load_command_index != LIBMACHORE_NO_LOAD_COMMAND) {
+    printf(" (slice %u, load command %u at 0x%llx)", validation->arch_index,
+           validation->load_command_index,
+           (unsigned long long)validation->offset);
+  }
+  printf("\n");
+  return true;
+}
+
+int diff_main(int argc, char *argv[]) {
+  if (argc < 4) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  const char *paths[2] = {argv[2], argv[3]};
+  size_t slices[2] = {0, 0};
+  bool is_json = false;
+  for (int arg_index = 4; arg_index < argc; arg_index++) {
+    const char *option = argv[arg_index];
+    if (strcmp(option, "--old-slice") == 0 && arg_index + 1 < argc) {
+      slices[0] = strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(option, "--new-slice") == 0 && arg_index + 1 < argc) {
+      slices[1] = strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(option, "--json") == 0) {
+      is_json = true;
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  uint8_t *buffers[2] = {NULL, NULL};
+  struct machore_output_t outputs[2];
+  init_output(&outputs[0]);
+  init_output(&outputs[1]);
+  int status = 0;
+  for (int side = 0; side < 2 && status == 0; side++) {
+    size_t size;
+    buffers[side] = read_file(paths[side], &size);
+    if (!buffers[side]) {
+      status = 1;
+      break;
+    }
+    parse_macho(&outputs[side], buffers[side], size);
+    if (print_validation_error(paths[side], &outputs[side])) {
+      status = 1;
+    } else if (slices[side] >= outputs[side].num_arch_outputs) {
+      printf("Error: '%s' has no slice %zu\n", paths[side], slices[side]);
+      status = 1;
+    }
+  }
+
+  if (status == 0) {
+    struct machore_diff_t diff;
+    machore_diff_arch(&diff, &outputs[0].arch_outputs[slices[0]],
+                      &outputs[1].arch_outputs[slices[1]]);
+    if (is_json) {
+      json_print_diff(&diff, paths[0], slices[0], paths[1], slices[1]);
+    } else {
+      pretty_print_diff(&diff, paths[0], paths[1]);
+    }
+    machore_clean_diff(&diff);
+  }
+
+  for (int side = 0; side < 2; side++) {
+    free(buffers[side]);
+    clean_output(&outputs[side]);
+  }
+  return status;
+}
+
+// Indexes every slice as `path`, or `path#index` in fat binaries
+int index_main(int argc, char *argv[]) {
+  if (argc < 4) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  struct machore_lsh_index *index = machore_lsh_open(argv[2]);
+  if (!index) {
+    printf("Error: '%s' is not a valid index\n", argv[2]);
+    return 1;
+  }
+
+  int status = 0;
+  for (int arg_index = 3; arg_index < argc; arg_index++) {
+    const char *path = argv[arg_index];
+    size_t size;
+    uint8_t *buffer = read_file(path, &size);
+    if (!buffer) {
+      status = 1;
+      continue;
+    }
+
+    struct machore_output_t output;
+    init_output(&output);
+    parse_macho(&output, buffer, size);
+    // Rejected files are skipped, not indexed as empty binaries
+    if (print_validation_error(path, &output)) {
+      clean_output(&output);
+      free(buffer);
+      status = 1;
+      continue;
+    }
+    for (size_t i = 0; i < output.num_arch_outputs; i++) {
+      struct fingerprint_info fingerprint;
+      machore_fingerprint_arch(&output.arch_outputs[i], &fingerprint);
+      if (output.num_arch_outputs == 1) {
+        machore_lsh_insert(index, path, &fingerprint);
+      } else {
+        size_t name_size = strlen(path) + 32;
+        char *name = malloc(name_size);
+        snprintf(name, name_size, "%s#%zu", path, i);
+        machore_lsh_insert(index, name, &fingerprint);
+        free(name);
+      }
+    }
+    clean_output(&output);
+    free(buffer);
+  }
+
+  if (!machore_lsh_save(index)) {
+    printf("Error: could not write '%s'\n", argv[2]);
+    status = 1;
+  } else {
+    printf("%zu slices indexed\n", machore_lsh_size(index));
+  }
+  machore_lsh_close(index);
+  return status;
+}
+
+int similar_main(int argc, char *argv[]) {
+  if (argc < 4) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  size_t max_matches = 10;
+  for (int arg_index = 4; arg_index < argc; arg_index++) {
+    if (strcmp(argv[arg_index], "--top") == 0 && arg_index + 1 < argc) {
+      max_matches = strtoul(argv[++arg_index], NULL, 10);
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  struct machore_lsh_index *index = machore_lsh_open(argv[2]);
+  if (!index) {
+    printf("Error: '%s' is not a valid index\n", argv[2]);
+    return 1;
+  }
+  size_t size;
+  uint8_t *buffer = read_file(argv[3], &size);
+  if (!buffer) {
+    machore_lsh_close(index);
+    return 1;
+  }
 
   struct machore_output_t output;
   init_output(&output);
+  parse_macho(&output, buffer, size);
+  if (print_validation_error(argv[3], &output)) {
+    clean_output(&output);
+    free(buffer);
+    machore_lsh_close(index);
+    return 1;
+  }
+  struct lsh_match *matches = malloc(max_matches * sizeof(struct lsh_match));
+  for (size_t i = 0; i < output.num_arch_outputs; i++) {
+    struct fingerprint_info fingerprint;
+    machore_fingerprint_arch(&output.arch_outputs[i], &fingerprint);
+    size_t num_matches =
+        machore_lsh_query(index, &fingerprint, matches, max_matches);
+
+    printf("%s (%s):\n", argv[3], output.arch_outputs[i].architecture);
+    for (size_t j = 0; j < num_matches; j++) {
+      printf("   %5.1f%%  \033[90m(distance %2u)\033[0m  %s\n",
+             matches[j].similarity * 100, matches[j].distance,
+             matches[j].name);
+    }
+    if (num_matches == 0) {
+      printf("   No similar binaries\n");
+    }
+  }
+
+  free(matches);
+  clean_output(&output);
+  free(buffer);
+  machore_lsh_close(index);
+  return 0;
+}
+
+// Binaries per segment of the inverted index
+#define TERM_BATCH_SIZE 4096
+
+// Adds every binary to the inverted index, replacing the ones already there
+int terms_main(int argc, char *argv[]) {
+  if (argc < 4) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  struct machore_term_index *index = machore_term_index_open(argv[2]);
+  if (!index) {
+    printf("Error: '%s' is not a valid index\n", argv[2]);
+    return 1;
+  }
+
+  int status = 0;
+  bool is_merged = false;
+  bool is_saved = true;
+  size_t num_added = 0;
+  for (int arg_index = 3; arg_index < argc && is_saved; arg_index++) {
+    const char *path = argv[arg_index];
+    if (strcmp(path, "--merge") == 0) {
+      is_merged = true;
+      continue;
+    }
+    size_t size;
+    uint8_t *buffer = read_file(path, &size);
+    if (!buffer) {
+      status = 1;
+      continue;
+    }
+
+    struct machore_output_t output;
+    init_output(&output);
+    output.is_paged = true;
+    parse_macho(&output, buffer, size);
+    if (print_validation_error(path, &output)) {
+      clean_output(&output);
+      free(buffer);
+      status = 1;
+      continue;
+    }
+    machore_term_index_add(index, path, &output);
+    clean_output(&output);
+    free(buffer);
+    if (++num_added % TERM_BATCH_SIZE == 0) {
+      is_saved = machore_term_index_save(index);
+    }
+  }
+
+  is_saved = is_saved && machore_term_index_save(index) &&
+             (!is_merged || machore_term_index_merge(index, 1));
+  if (!is_saved) {
+    printf("Error: could not write '%s'\n", argv[2]);
+    status = 1;
+  } else {
+    printf("%zu binaries indexed in %zu segments\n",
+           machore_term_index_size(index),
+           machore_term_index_num_segments(index));
+  }
+  machore_term_index_close(index);
+  return status;
+}
+
+bool print_term_match(const char *name, void *context) {
+  (void)context;
+  printf("%s\n", name);
+  return true;
+}
+
+int lookup_main(int argc, char *argv[]) {
+  static const char *const kind_names[LIBMACHORE_TERM_COUNT] = {
+      "dylib", "dylib-version", "symbol", "import", "flag", "entitlement",
+  };
+  if (argc < 5 || (argc == 6 && strcmp(argv[5], "--count") != 0) ||
+      argc > 6) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  int kind = 0;
+  while (kind < LIBMACHORE_TERM_COUNT &&
+         strcmp(argv[3], kind_names[kind]) != 0) {
+    kind++;
+  }
+  if (kind == LIBMACHORE_TERM_COUNT) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  bool is_count = argc == 6;
+
+  struct machore_term_index *index = machore_term_index_open(argv[2]);
+  if (!index) {
+    printf("Error: '%s' is not a valid index\n", argv[2]);
+    return 1;
+  }
+  size_t num_binaries =
+      machore_term_index_query(index, (term_kind_t)kind, argv[4],
+                               is_count ? NULL : print_term_match, NULL);
+  if (is_count) {
+    printf("%zu\n", num_binaries);
+  }
+  machore_term_index_close(index);
+  return 0;
+}
+
+#define CACHE_BATCH_SIZE 256
+
+// Lists the images of a dyld shared cache, parsed in batches
+int cache_main(int argc, char *argv[]) {
+  if (argc < 3) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  size_t num_threads = 0;
+  bool is_json = false;
+  for (int arg_index = 3; arg_index < argc; arg_index++) {
+    const char *option = argv[arg_index];
+    if (strcmp(option, "--threads") == 0 && arg_index + 1 < argc) {
+      num_threads = strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(option, "--json") == 0) {
+      is_json = true;
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  struct machore_dyld_cache *cache = machore_dyld_cache_open(argv[2]);
+  if (!cache) {
+    printf("Error: '%s' is not a dyld shared cache\n", argv[2]);
+    return 1;
+  }
+  size_t num_images = machore_dyld_cache_count_images(cache);
+  if (is_json) {
+    printf("{\"path\":");
+    print_json_cstring(argv[2]);
+    printf(",\"images\":[");
+  } else {
+    printf("%s: %zu images\n", argv[2], num_images);
+  }
+
+  struct machore_output_t outputs[CACHE_BATCH_SIZE];
+  for (size_t first = 0; first < num_images; first += CACHE_BATCH_SIZE) {
+    size_t batch_size = num_images - first < CACHE_BATCH_SIZE
+                            ? num_images - first
+                            : CACHE_BATCH_SIZE;
+    for (size_t i = 0; i < batch_size; i++) {
+      init_output(&outputs[i]);
+      outputs[i].is_paged = true;
+    }
+    machore_dyld_cache_parse_images(cache, first, batch_size, outputs,
+                                    num_threads);
+
+    for (size_t i = 0; i < batch_size; i++) {
+      struct cache_image_info image_info;
+      machore_dyld_cache_get_image(cache, first + i, &image_info);
+      struct machore_arch_output_t *arch_output =
+          outputs[i].num_arch_outputs > 0 ? &outputs[i].arch_outputs[0]
+                                          : NULL;
+      size_t num_dylibs = arch_output ? arch_output->num_dylibs : 0;
+      size_t num_symbols = arch_output ? machore_count_symbols(arch_output) : 0;
+      size_t num_strings = arch_output ? machore_count_strings(arch_output) : 0;
+      if (is_json) {
+        printf("%s{\"path\":", first + i ? "," : "");
+        print_json_cstring(image_info.path);
+        printf(",\"address\":%llu,\"architecture\":",
+               (unsigned long long)image_info.address);
+        print_json_cstring(arch_output ? arch_output->architecture : "Unknown");
+        printf(",\"num_dylibs\":%zu,\"num_symbols\":%zu,"
+               "\"num_strings\":%zu}",
+               num_dylibs, num_symbols, num_strings);
+      } else if (arch_output) {
+        printf("   0x%llx  %s  %s  \033[90m(%zu dylibs, %zu symbols, %zu "
+               "strings)\033[0m\n",
+               (unsigned long long)image_info.address,
+               arch_output->architecture, image_info.path, num_dylibs,
+               num_symbols, num_strings);
+      } else {
+        printf("   0x%llx  %s  \033[90m(not parsed)\033[0m\n",
+               (unsigned long long)image_info.address, image_info.path);
+      }
+      clean_output(&outputs[i]);
+    }
+  }
+  if (is_json) {
+    printf("]}\n");
+  }
+  machore_dyld_cache_close(cache);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (strcmp(argv[1], "diff") == 0) {
+    return diff_main(argc, argv);
+  }
+  if (strcmp(argv[1], "index") == 0) {
+    return index_main(argc, argv);
+  }
+  if (strcmp(argv[1], "similar") == 0) {
+    return similar_main(argc, argv);
+  }
+  if (strcmp(argv[1], "terms") == 0) {
+    return terms_main(argc, argv);
+  }
+  if (strcmp(argv[1], "lookup") == 0) {
+    return lookup_main(argc, argv);
+  }
+  if (strcmp(argv[1], "cache") == 0) {
+    return cache_main(argc, argv);
+  }
+  if (strcmp(argv[1], "--watch") == 0) {
+    return watch_main(argc, argv);
+  }
+  if (strcmp(argv[1], "serve") == 0) {
+    return serve_main(argc, argv);
+  }
+  if (strcmp(argv[1], "load-test") == 0) {
+    return load_test_main(argc, argv);
+  }
+
+  const char *filename = argv[1];
+
+  bool is_first_only = false;
+  uint8_t display_flags = 0;
+  const char *patterns_path = NULL;
+  bool is_json = false;
+  bool is_demangled = false;
+  struct page page = {.offset = 0, .limit = SIZE_MAX, .min_string_length = 0};
+  for (int arg_index = 2; arg_index < argc; arg_index++) {
+    const char *option = argv[arg_index];
+    if (strcmp(option, "--first-only") == 0) {
+      is_first_only = true;
+    } else if (strcmp(option, "--strings") == 0) {
+      display_flags |= DISPLAY_STRINGS;
+    } else if (strcmp(option, "--symbols") == 0) {
+      display_flags |= DISPLAY_SYMBOLS;
+    } else if (strcmp(option, "--exports") == 0) {
+      display_flags |= DISPLAY_EXPORTS;
+    } else if (strcmp(option, "--imports") == 0) {
+      display_flags |= DISPLAY_IMPORTS;
+    } else if (strcmp(option, "--functions") == 0) {
+      display_flags |= DISPLAY_FUNCTIONS;
+    } else if (strcmp(option, "--metadata") == 0) {
+      display_flags |= DISPLAY_METADATA;
+    } else if (strcmp(option, "--stats") == 0) {
+      display_flags |= DISPLAY_STATS;
+    } else if (strcmp(option, "--json") == 0) {
+      is_json = true;
+    } else if (strcmp(option, "--demangle") == 0) {
+      is_demangled = true;
+    } else if (strcmp(option, "--patterns") == 0 && arg_index + 1 < argc) {
+      patterns_path = argv[++arg_index];
+    } else if (strcmp(option, "--offset") == 0 && arg_index + 1 < argc) {
+      page.offset = strtoull(argv[++arg_index], NULL, 10);
+    } else if (strcmp(option, "--limit") == 0 && arg_index + 1 < argc) {
+      page.limit = strtoull(argv[++arg_index], NULL, 10);
+    } else if (strcmp(option, "--min-length") == 0 && arg_index + 1 < argc) {
+      page.min_string_length = strtoull(argv[++arg_index], NULL, 10);
+      display_flags |= DISPLAY_STRINGS;
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  size_t size;
+  uint8_t *buffer = read_file(filename, &size);
+  if (!buffer) {
+    return 1;
+  }
+
+  // Pattern scans only walk the string sections, no full parse needed
+  if (patterns_path) {
+    int status = scan_patterns(filename, buffer, size, patterns_path);
+    free(buffer);
+    return status;
+  }
+
+  struct machore_output_t output;
+  init_output(&output);
+  // Only the printed window of strings and symbols is decoded
+  output.is_paged = true;
+
+  // One thread per CPU, names repeated across slices are demangled once
+  struct machore_demangler *demangler =
+      is_demangled ? machore_demangler_create(0) : NULL;
 
   parse_macho(&output, buffer, size);
-  pretty_print_macho(&output, filename, is_first_only, display_flags);
+  if (print_validation_error(filename, &output)) {
+    if (demangler != NULL) {
+      machore_demangler_destroy(demangler);
+    }
+    free(buffer);
+    clean_output(&output);
+    return 1;
+  }
+  if (is_json) {
+    json_print_macho(&output, filename, is_first_only, display_flags, &page,
+                     demangler);
+  } else {
+    pretty_print_macho(&output, filename, is_first_only, display_flags,
+                       &page, demangler);
+  }
 
+  if (demangler != NULL) {
+    machore_demangler_destroy(demangler);
+  }
   free(buffer);
   clean_output(&output);
   return 0;
@@ -1,12 +1,24 @@
 extern "C" {
+#include "../lib/byte_stats.h"
+#include "../lib/leb128.h"
 #include "../lib/libmachore.h"
+#include "../tools/synthetic_cache.h"
 }
+#include "../lib/libmachore.hpp"
 
 #include <gtest/gtest.h>
+#include <mach-o/fat.h>
+#include <mach-o/fixup-chains.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
 
+#include <stddef.h>
 #include <filesystem>
+#include <string>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 static void read_file_to_buffer(const char *filename, uint8_t **buffer,
                                 size_t *size) {
@@ -236,3 +248,1727 @@ TEST(libmachore, parse_macho_symbols) {
 
   CLEAN_OUTPUT();
 }
+
+// A 32-bit slice with a __cstring, a dylib and a symbol table, every field
+// written in the requested byte order
+static std::vector<uint8_t> build_slice32(bool is_swapped) {
+  std::vector<uint8_t> slice(0x1000);
+  auto put32 = [&](size_t offset, uint32_t value) {
+    value = is_swapped ? __builtin_bswap32(value) : value;
+    memcpy(&slice[offset], &value, sizeof(value));
+  };
+  auto put_name = [&](size_t offset, const char *name) {
+    memcpy(&slice[offset], name, strlen(name));
+  };
+
+  const size_t seg = sizeof(struct mach_header);
+  const size_t sect = seg + sizeof(struct segment_command);
+  const size_t dylib = sect + sizeof(struct section);
+  const size_t symtab = dylib + sizeof(struct dylib_command) + 28;
+
+  put32(offsetof(struct mach_header, magic), MH_MAGIC);
+  put32(offsetof(struct mach_header, cputype), CPU_TYPE_ARM);
+  put32(offsetof(struct mach_header, filetype), MH_EXECUTE);
+  put32(offsetof(struct mach_header, ncmds), 3);
+  put32(offsetof(struct mach_header, sizeofcmds),
+        symtab + sizeof(struct symtab_command) - seg);
+  put32(offsetof(struct mach_header, flags), MH_NOUNDEFS | MH_DYLDLINK);
+
+  put32(seg + offsetof(struct segment_command, cmd), LC_SEGMENT);
+  put32(seg + offsetof(struct segment_command, cmdsize), dylib - seg);
+  put_name(seg + offsetof(struct segment_command, segname), "__TEXT");
+  put32(seg + offsetof(struct segment_command, vmaddr), 0x4000);
+  put32(seg + offsetof(struct segment_command, vmsize), 0x1000);
+  put32(seg + offsetof(struct segment_command, filesize), 0x1000);
+  put32(seg + offsetof(struct segment_command, nsects), 1);
+  put_name(sect + offsetof(struct section, sectname), "__cstring");
+  put_name(sect + offsetof(struct section, segname), "__TEXT");
+  put32(sect + offsetof(struct section, addr), 0x4800);
+  put32(sect + offsetof(struct section, size), 12);
+  put32(sect + offsetof(struct section, offset), 0x800);
+  memcpy(&slice[0x800], "hello\0world\0", 12);
+
+  put32(dylib + offsetof(struct dylib_command, cmd), LC_LOAD_DYLIB);
+  put32(dylib + offsetof(struct dylib_command, cmdsize), symtab - dylib);
+  put32(dylib + offsetof(struct dylib_command, dylib.name),
+        sizeof(struct dylib_command));
+  put32(dylib + offsetof(struct dylib_command, dylib.current_version),
+        0x05010002);
+  put_name(dylib + sizeof(struct dylib_command), "/usr/lib/libSystem.B.dylib");
+
+  put32(symtab + offsetof(struct symtab_command, cmd), LC_SYMTAB);
+  put32(symtab + offsetof(struct symtab_command, cmdsize),
+        sizeof(struct symtab_command));
+  put32(symtab + offsetof(struct symtab_command, symoff), 0x900);
+  put32(symtab + offsetof(struct symtab_command, nsyms), 3);
+  put32(symtab + offsetof(struct symtab_command, stroff), 0xA00);
+  put32(symtab + offsetof(struct symtab_command, strsize), 13);
+  const size_t main_symbol = 0x900;
+  const size_t puts_symbol = 0x900 + 2 * sizeof(struct nlist);
+  put32(main_symbol + offsetof(struct nlist, n_un), 1);
+  slice[main_symbol + offsetof(struct nlist, n_type)] = N_SECT | N_EXT;
+  slice[main_symbol + offsetof(struct nlist, n_sect)] = 1;
+  put32(puts_symbol + offsetof(struct nlist, n_un), 7);
+  slice[puts_symbol + offsetof(struct nlist, n_type)] = N_UNDF | N_EXT;
+  memcpy(&slice[0xA00], "\0_main\0_puts\0", 13);
+  return slice;
+}
+
+// A 64-bit slice linked with chained fixups (DYLD_CHAINED_PTR_64 or
+// DYLD_CHAINED_PTR_64_OFFSET):
+//   __TEXT     0x100000000  header, __cstring "hello"
+//   __DATA     0x100004000  __cfstring, two CFStrings
+//   __LINKEDIT 0x100008000  LC_DYLD_CHAINED_FIXUPS payload
+// The chain of __DATA binds the isa of both CFStrings, rebases the literal
+// of the first one to "hello" and binds the literal of the second one.
+static std::vector<uint8_t> build_chained_slice64(uint16_t pointer_format,
+                                                  uint32_t symbols_format) {
+  const uint64_t base = 0x100000000;
+  std::vector<uint8_t> slice(0x9000);
+  auto put32 = [&](size_t offset, uint32_t value) {
+    memcpy(&slice[offset], &value, sizeof(value));
+  };
+  auto put64 = [&](size_t offset, uint64_t value) {
+    memcpy(&slice[offset], &value, sizeof(value));
+  };
+  auto put_name = [&](size_t offset, const char *name) {
+    memcpy(&slice[offset], name, strlen(name));
+  };
+  auto put_segment = [&](size_t offset, const char *name, uint64_t fileoff,
+                         uint32_t nsects) {
+    put32(offset + offsetof(struct segment_command_64, cmd), LC_SEGMENT_64);
+    put32(offset + offsetof(struct segment_command_64, cmdsize),
+          sizeof(struct segment_command_64) +
+              nsects * sizeof(struct section_64));
+    put_name(offset + offsetof(struct segment_command_64, segname), name);
+    put64(offset + offsetof(struct segment_command_64, vmaddr),
+          base + fileoff);
+    put64(offset + offsetof(struct segment_command_64, vmsize), 0x4000);
+    put64(offset + offsetof(struct segment_command_64, fileoff), fileoff);
+    put64(offset + offsetof(struct segment_command_64, filesize),
+          fileoff == 0x8000 ? 0x1000 : 0x4000);
+    put32(offset + offsetof(struct segment_command_64, nsects), nsects);
+  };
+  auto put_section = [&](size_t offset, const char *segname,
+                         const char *sectname, uint64_t fileoff,
+                         uint64_t size) {
+    put_name(offset + offsetof(struct section_64, sectname), sectname);
+    put_name(offset + offsetof(struct section_64, segname), segname);
+    put64(offset + offsetof(struct section_64, addr), base + fileoff);
+    put64(offset + offsetof(struct section_64, size), size);
+    put32(offset + offsetof(struct section_64, offset), fileoff);
+  };
+
+  const size_t text = sizeof(struct mach_header_64);
+  const size_t data = text + sizeof(struct segment_command_64) +
+                      sizeof(struct section_64);
+  const size_t linkedit = data + sizeof(struct segment_command_64) +
+                          sizeof(struct section_64);
+  const size_t dylib = linkedit + sizeof(struct segment_command_64);
+  const size_t fixups_cmd = dylib + sizeof(struct dylib_command) + 32;
+  const size_t end = fixups_cmd + sizeof(struct linkedit_data_command);
+
+  put32(offsetof(struct mach_header_64, magic), MH_MAGIC_64);
+  put32(offsetof(struct mach_header_64, cputype), CPU_TYPE_ARM64);
+  put32(offsetof(struct mach_header_64, filetype), MH_EXECUTE);
+  put32(offsetof(struct mach_header_64, ncmds), 5);
+  put32(offsetof(struct mach_header_64, sizeofcmds), end - text);
+
+  put_segment(text, "__TEXT", 0, 1);
+  put_section(text + sizeof(struct segment_command_64), "__TEXT",
+              "__cstring", 0x1000, 6);
+  memcpy(&slice[0x1000], "hello", 6);
+  put_segment(data, "__DATA", 0x4000, 1);
+  put_section(data + sizeof(struct segment_command_64), "__DATA",
+              "__cfstring", 0x4000, 64);
+  put_segment(linkedit, "__LINKEDIT", 0x8000, 0);
+
+  put32(dylib + offsetof(struct dylib_command, cmd), LC_LOAD_DYLIB);
+  put32(dylib + offsetof(struct dylib_command, cmdsize), fixups_cmd - dylib);
+  put32(dylib + offsetof(struct dylib_command, dylib.name),
+        sizeof(struct dylib_command));
+  put_name(dylib + sizeof(struct dylib_command), "/usr/lib/libSystem.B.dylib");
+
+  put32(fixups_cmd + offsetof(struct linkedit_data_command, cmd),
+        LC_DYLD_CHAINED_FIXUPS);
+  put32(fixups_cmd + offsetof(struct linkedit_data_command, cmdsize),
+        sizeof(struct linkedit_data_command));
+  put32(fixups_cmd + offsetof(struct linkedit_data_command, dataoff), 0x8000);
+  put32(fixups_cmd + offsetof(struct linkedit_data_command, datasize), 0x100);
+
+  // Fixups header, starts of the 3 segments, imports and their names
+  const size_t fixups = 0x8000;
+  const size_t starts = fixups + 0x20;
+  const size_t data_starts = starts + 0x10;
+  const size_t imports = fixups + 0x50;
+  const size_t symbols = fixups + 0x60;
+  put32(fixups + offsetof(struct dyld_chained_fixups_header, starts_offset),
+        starts - fixups);
+  put32(fixups + offsetof(struct dyld_chained_fixups_header, imports_offset),
+        imports - fixups);
+  put32(fixups + offsetof(struct dyld_chained_fixups_header, symbols_offset),
+        symbols - fixups);
+  put32(fixups + offsetof(struct dyld_chained_fixups_header, imports_count),
+        2);
+  put32(fixups + offsetof(struct dyld_chained_fixups_header, imports_format),
+        DYLD_CHAINED_IMPORT);
+  put32(fixups + offsetof(struct dyld_chained_fixups_header, symbols_format),
+        symbols_format);
+  put32(starts + offsetof(struct dyld_chained_starts_in_image, seg_count), 3);
+  // seg_info_offset[1], __DATA
+  put32(starts + sizeof(uint32_t) * 2, data_starts - starts);
+  put32(data_starts + offsetof(struct dyld_chained_starts_in_segment, size),
+        sizeof(struct dyld_chained_starts_in_segment));
+  const uint16_t page_size = 0x4000;
+  memcpy(&slice[data_starts +
+                offsetof(struct dyld_chained_starts_in_segment, page_size)],
+         &page_size, sizeof(page_size));
+  memcpy(&slice[data_starts + offsetof(struct dyld_chained_starts_in_segment,
+                                       pointer_format)],
+         &pointer_format, sizeof(pointer_format));
+  put64(data_starts +
+            offsetof(struct dyld_chained_starts_in_segment, segment_offset),
+        0x4000);
+  slice[data_starts +
+        offsetof(struct dyld_chained_starts_in_segment, page_count)] = 1;
+  // Ordinal 1, name offsets 1 and 35
+  put32(imports, 1 | (1 << 9));
+  put32(imports + 4, 1 | (35 << 9));
+  memcpy(&slice[symbols], "\0___CFConstantStringClassReference\0_puts", 41);
+
+  // __DATA holds a single chain, in 4-byte strides
+  auto bind = [](uint32_t import_index, uint64_t next) {
+    return 1ULL << 63 | next << 51 | import_index;
+  };
+  const uint64_t hello =
+      pointer_format == DYLD_CHAINED_PTR_64 ? base + 0x1000 : 0x1000;
+  put64(0x4000, bind(0, 4));
+  put64(0x4008, 0x7c8);
+  put64(0x4010, 4ULL << 51 | hello);
+  put64(0x4018, 5);
+  put64(0x4020, bind(0, 4));
+  put64(0x4028, 0x7c8);
+  // The literal of the second CFString is bound to _puts: not a literal
+  put64(0x4030, bind(1, 0));
+  put64(0x4038, 5);
+  return slice;
+}
+
+// A 64-bit slice without chained fixups whose __swift5_types holds one entry
+// of each TypeReferenceKind and one that doesn't resolve:
+//   __TEXT 0x100000000  header, __swift5_types, descriptors and names
+//   __DATA 0x100004000  pointers to a descriptor and to an Objective-C class
+static std::vector<uint8_t> build_swift_types_slice64() {
+  const uint64_t base = 0x100000000;
+  std::vector<uint8_t> slice(0x8000);
+  auto put32 = [&](size_t offset, uint32_t value) {
+    memcpy(&slice[offset], &value, sizeof(value));
+  };
+  auto put64 = [&](size_t offset, uint64_t value) {
+    memcpy(&slice[offset], &value, sizeof(value));
+  };
+  auto put_name = [&](size_t offset, const char *name) {
+    memcpy(&slice[offset], name, strlen(name));
+  };
+  auto put_segment = [&](size_t offset, const char *name, uint64_t fileoff,
+                         uint32_t nsects) {
+    put32(offset + offsetof(struct segment_command_64, cmd), LC_SEGMENT_64);
+    put32(offset + offsetof(struct segment_command_64, cmdsize),
+          sizeof(struct segment_command_64) +
+              nsects * sizeof(struct section_64));
+    put_name(offset + offsetof(struct segment_command_64, segname), name);
+    put64(offset + offsetof(struct segment_command_64, vmaddr),
+          base + fileoff);
+    put64(offset + offsetof(struct segment_command_64, vmsize), 0x4000);
+    put64(offset + offsetof(struct segment_command_64, fileoff), fileoff);
+    put64(offset + offsetof(struct segment_command_64, filesize), 0x4000);
+    put32(offset + offsetof(struct segment_command_64, nsects), nsects);
+  };
+
+  const size_t text = sizeof(struct mach_header_64);
+  const size_t section = text + sizeof(struct segment_command_64);
+  const size_t data = section + sizeof(struct section_64);
+  const size_t end = data + sizeof(struct segment_command_64);
+
+  put32(offsetof(struct mach_header_64, magic), MH_MAGIC_64);
+  put32(offsetof(struct mach_header_64, cputype), CPU_TYPE_ARM64);
+  put32(offsetof(struct mach_header_64, filetype), MH_EXECUTE);
+  put32(offsetof(struct mach_header_64, ncmds), 2);
+  put32(offsetof(struct mach_header_64, sizeofcmds), end - text);
+
+  const size_t types = 0x1000;
+  put_segment(text, "__TEXT", 0, 1);
+  put_name(section + offsetof(struct section_64, sectname), "__swift5_types");
+  put_name(section + offsetof(struct section_64, segname), "__TEXT");
+  put64(section + offsetof(struct section_64, addr), base + types);
+  put64(section + offsetof(struct section_64, size), 5 * sizeof(int32_t));
+  put32(section + offsetof(struct section_64, offset), types);
+  put_segment(data, "__DATA", 0x4000, 0);
+
+  // Entries are relative to themselves, the kind in their low 2 bits
+  auto put_entry = [&](size_t index, uint64_t target, uint32_t kind) {
+    const size_t entry = types + index * sizeof(int32_t);
+    put32(entry, (uint32_t)(target - entry) | kind);
+  };
+  // descriptor: { flags, parent, name (relative to the field) }
+  auto put_descriptor = [&](size_t offset, size_t name_offset,
+                            const char *name) {
+    put32(offset + 8, (uint32_t)(name_offset - (offset + 8)));
+    put_name(name_offset, name);
+  };
+
+  put_entry(0, 0x1100, 0);
+  put_descriptor(0x1100, 0x1180, "Direct");
+  put_entry(1, 0x4000, 1);
+  put64(0x4000, base + 0x1200);
+  put_descriptor(0x1200, 0x1280, "Indirect");
+  put_entry(2, 0x1300, 2);
+  put_name(0x1300, "ObjCName");
+  // class_t.data at 0x4100 + 32, class_ro_t.name at 0x4200 + 24
+  put_entry(3, 0x4008, 3);
+  put64(0x4008, base + 0x4100);
+  put64(0x4100 + 32, base + 0x4200);
+  put64(0x4200 + 24, base + 0x1400);
+  put_name(0x1400, "ObjCClass");
+  // Points past the end of the slice
+  put_entry(4, 0x10000, 0);
+  return slice;
+}
+
+TEST(libmachore, parse_macho_32bit_slices) {
+  // Native and swapped byte order decode to the same output
+  for (bool is_swapped : {false, true}) {
+    std::vector<uint8_t> slice = build_slice32(is_swapped);
+    struct machore_output_t output;
+    init_output(&output);
+    parse_macho(&output, slice.data(), slice.size());
+
+    ASSERT_EQ(output.num_arch_outputs, 1);
+    struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+    EXPECT_STREQ(arch_output->architecture, "ARM");
+    EXPECT_EQ(arch_output->filetype, LIBMACHORE_FILETYPE_EXECUTE);
+    EXPECT_TRUE(arch_output->no_undefined_refs);
+    EXPECT_TRUE(arch_output->dyld_compatible);
+
+    ASSERT_EQ(arch_output->num_dylibs, 1);
+    EXPECT_STREQ(arch_output->dylibs[0].path, "/usr/lib/libSystem.B.dylib");
+    EXPECT_STREQ(arch_output->dylibs[0].version, "5.1.2");
+
+    ASSERT_EQ(arch_output->num_strings, 2);
+    EXPECT_STREQ(arch_output->strings[1].content, "world");
+    EXPECT_EQ(arch_output->strings[1].original_offset, 0x806);
+    EXPECT_STREQ(arch_output->strings[1].original_segment, "__TEXT");
+    EXPECT_STREQ(arch_output->strings[1].original_section, "__cstring");
+
+    // nlist entries without a name are skipped
+    ASSERT_EQ(arch_output->num_symbols, 2);
+    EXPECT_STREQ(arch_output->symbols[0].name, "_main");
+    EXPECT_STREQ(arch_output->symbols[0].type, "EXTERNAL");
+    EXPECT_FALSE(arch_output->symbols[0].has_no_section);
+    EXPECT_STREQ(arch_output->symbols[1].name, "_puts");
+    EXPECT_TRUE(arch_output->symbols[1].has_no_section);
+
+    size_t num_segments = 0;
+    const struct byte_stats_info *segments =
+        machore_segment_stats(arch_output, &num_segments);
+    ASSERT_EQ(num_segments, 1);
+    EXPECT_EQ(segments[0].size, 0x1000);
+
+    clean_output(&output);
+  }
+}
+
+TEST(libmachore, paged_strings_and_symbols) {
+  std::vector<uint8_t> slice = build_slice32(true);
+  struct machore_output_t output;
+  init_output(&output);
+  output.is_paged = true;
+  parse_macho(&output, slice.data(), slice.size());
+
+  // Nothing is materialized until the paging APIs are used
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+  EXPECT_EQ(arch_output->num_strings, 0);
+  EXPECT_EQ(arch_output->num_symbols, 0);
+
+  ASSERT_EQ(machore_count_strings(arch_output), 2);
+  struct string_info strings[4];
+  ASSERT_EQ(machore_get_strings(arch_output, 1, strings, 4), 1);
+  EXPECT_STREQ(strings[0].content, "world");
+  EXPECT_EQ(strings[0].size, 6);
+  EXPECT_EQ(strings[0].original_offset, 0x806);
+  EXPECT_STREQ(strings[0].original_section, "__cstring");
+  // Views into the parsed buffer
+  EXPECT_EQ((uint8_t *)strings[0].content, slice.data() + 0x806);
+  EXPECT_FALSE(machore_get_string(arch_output, 2, strings));
+
+  ASSERT_EQ(machore_count_symbols(arch_output), 2);
+  struct symbol_info symbol_info;
+  ASSERT_TRUE(machore_get_symbol(arch_output, 1, &symbol_info));
+  EXPECT_STREQ(symbol_info.name, "_puts");
+  EXPECT_TRUE(symbol_info.has_no_section);
+  EXPECT_FALSE(machore_get_symbol(arch_output, 2, &symbol_info));
+
+  clean_output(&output);
+
+  // A section that does not end with a NUL: the copy and the view both
+  // read "world", the view stops at the section end
+  slice = build_slice32(false);
+  const size_t sect = sizeof(struct mach_header) +
+                      sizeof(struct segment_command);
+  const uint32_t unterminated_size = 11;
+  memcpy(&slice[sect + offsetof(struct section, size)], &unterminated_size,
+         sizeof(unterminated_size));
+  for (bool is_paged : {false, true}) {
+    init_output(&output);
+    output.is_paged = is_paged;
+    parse_macho(&output, slice.data(), slice.size());
+    arch_output = &output.arch_outputs[0];
+    ASSERT_TRUE(machore_get_string(arch_output, 1, strings));
+    EXPECT_EQ(strings[0].size, 5);
+    EXPECT_EQ(std::string(strings[0].content, strings[0].size), "world");
+    EXPECT_EQ(machore::String(strings[0]).content(), "world");
+    if (!is_paged) {
+      ASSERT_EQ(arch_output->num_strings, 2);
+      EXPECT_EQ(arch_output->strings[1].size, 6);
+      EXPECT_STREQ(arch_output->strings[1].content, "world");
+      EXPECT_EQ(machore::String(arch_output->strings[1]).content(), "world");
+    }
+    clean_output(&output);
+  }
+}
+
+TEST(libmachore, cpp_binary) {
+  char path[] = "/tmp/libmachore_binary_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  std::vector<uint8_t> slice = build_slice32(true);
+  ASSERT_EQ(write(fd, slice.data(), slice.size()), (ssize_t)slice.size());
+  close(fd);
+
+  // Paged or not, the ranges read the same views
+  for (bool is_paged : {false, true}) {
+    std::optional<machore::Binary> binary =
+        machore::Binary::open(path, is_paged);
+    ASSERT_TRUE(binary.has_value());
+    ASSERT_TRUE(binary->is_valid());
+    EXPECT_FALSE(binary->is_fat());
+    ASSERT_EQ(binary->slices().size(), 1);
+
+    // Slices stay valid when the binary moves
+    machore::Slice slice_view = binary->slice(0);
+    machore::Binary moved = std::move(*binary);
+    EXPECT_EQ(binary->slices().size(), 0);
+    EXPECT_EQ(moved.slices().size(), 1);
+    EXPECT_EQ(slice_view.architecture(), "ARM");
+    EXPECT_EQ(slice_view.filetype(), LIBMACHORE_FILETYPE_EXECUTE);
+
+    std::vector<std::string_view> paths;
+    for (machore::Dylib dylib : slice_view.dylibs()) {
+      paths.push_back(dylib.path());
+      EXPECT_EQ(dylib.version(), "5.1.2");
+    }
+    EXPECT_EQ(paths, std::vector<std::string_view>{
+                         "/usr/lib/libSystem.B.dylib"});
+
+    std::vector<std::string_view> strings;
+    for (const machore::String &string : slice_view.strings()) {
+      strings.push_back(string.content());
+    }
+    EXPECT_EQ(strings, (std::vector<std::string_view>{"hello", "world"}));
+    machore::String world = slice_view.strings()[1];
+    EXPECT_EQ(world.offset(), 0x806);
+    EXPECT_EQ(world.section(), "__cstring");
+    EXPECT_EQ(world.segment(), "__TEXT");
+    if (is_paged) {
+      // A view into the mapped file
+      EXPECT_EQ((const uint8_t *)world.content().data(),
+                moved.bytes().data() + 0x806);
+    }
+
+    std::vector<std::string_view> symbols;
+    for (const machore::Symbol &symbol : slice_view.symbols()) {
+      symbols.push_back(symbol.name());
+    }
+    EXPECT_EQ(symbols, (std::vector<std::string_view>{"_main", "_puts"}));
+    EXPECT_EQ(slice_view.symbols()[0].type(), "EXTERNAL");
+    EXPECT_TRUE(slice_view.symbols()[1].has_no_section());
+
+    EXPECT_TRUE(slice_view.imports().empty());
+    EXPECT_EQ(slice_view.for_each_export([](const machore::Export &) {}), 0);
+    size_t num_runs = 0;
+    struct string_scan_options options = {};
+    options.min_length = 4;
+    slice_view.extract_strings(options, [&](const machore::StringRun &run) {
+      num_runs++;
+      return run.content() != "hello";
+    });
+    EXPECT_EQ(num_runs, 1);
+    ASSERT_EQ(slice_view.segment_stats().size(), 1);
+    EXPECT_EQ(slice_view.segment_stats()[0].size, 0x1000);
+  }
+
+  EXPECT_FALSE(machore::Binary::open("/nonexistent/binary").has_value());
+
+  // Rejected files open without slices
+  ASSERT_EQ(truncate(path, 0x100), 0);
+  std::optional<machore::Binary> truncated = machore::Binary::open(path);
+  ASSERT_TRUE(truncated.has_value());
+  EXPECT_FALSE(truncated->is_valid());
+  EXPECT_NE(truncated->validation().error, LIBMACHORE_VALIDATION_OK);
+  EXPECT_TRUE(truncated->slices().empty());
+  unlink(path);
+
+  // Borrowed buffers are parsed in place
+  machore::Binary borrowed = machore::Binary::parse(slice.data(), slice.size());
+  ASSERT_EQ(borrowed.slices().size(), 1);
+  for (machore::Slice slice_view : borrowed.slices()) {
+    EXPECT_EQ(slice_view.dylibs().size(), 1);
+  }
+  EXPECT_EQ(borrowed.bytes().data(), slice.data());
+}
+
+TEST(libmachore, list_slices) {
+  // FAT_MAGIC_64 header with the native and swapped 32-bit slices
+  std::vector<uint8_t> native_slice = build_slice32(false);
+  std::vector<uint8_t> swapped_slice = build_slice32(true);
+  std::vector<uint8_t> fat(0x3000);
+  auto put32 = [&](size_t offset, uint32_t value) {
+    value = __builtin_bswap32(value);
+    memcpy(&fat[offset], &value, sizeof(value));
+  };
+  auto put64 = [&](size_t offset, uint64_t value) {
+    value = __builtin_bswap64(value);
+    memcpy(&fat[offset], &value, sizeof(value));
+  };
+  put32(offsetof(struct fat_header, magic), FAT_MAGIC_64);
+  put32(offsetof(struct fat_header, nfat_arch), 2);
+  for (size_t index = 0; index < 2; index++) {
+    size_t arch =
+        sizeof(struct fat_header) + index * sizeof(struct fat_arch_64);
+    put32(arch + offsetof(struct fat_arch_64, cputype), CPU_TYPE_ARM);
+    put32(arch + offsetof(struct fat_arch_64, cpusubtype), index);
+    put64(arch + offsetof(struct fat_arch_64, offset), 0x1000 * (index + 1));
+    put64(arch + offsetof(struct fat_arch_64, size), 0x1000);
+    put32(arch + offsetof(struct fat_arch_64, align), 12);
+  }
+  memcpy(&fat[0x1000], native_slice.data(), 0x1000);
+  memcpy(&fat[0x2000], swapped_slice.data(), 0x1000);
+
+  struct slice_info slices[2];
+  ASSERT_EQ(machore_list_slices(fat.data(), fat.size(), slices, 2), 2);
+  EXPECT_EQ(slices[0].cputype, CPU_TYPE_ARM);
+  EXPECT_EQ(slices[1].cpusubtype, 1);
+  EXPECT_EQ(slices[1].offset, 0x2000);
+  EXPECT_EQ(slices[1].size, 0x1000);
+  EXPECT_EQ(slices[1].align, 12);
+
+  // The count does not depend on the room left for entries, and the table
+  // must fit in the buffer
+  EXPECT_EQ(machore_list_slices(fat.data(), fat.size(), slices, 1), 2);
+  EXPECT_EQ(machore_list_slices(fat.data(), 40, slices, 2), 0);
+
+  struct machore_output_t output;
+  init_output(&output);
+  parse_macho(&output, fat.data(), fat.size());
+  EXPECT_TRUE(output.is_fat);
+  ASSERT_EQ(output.num_arch_outputs, 2);
+  EXPECT_EQ(output.arch_outputs[1].num_symbols, 2);
+  EXPECT_STREQ(output.arch_outputs[1].dylibs[0].version, "5.1.2");
+  clean_output(&output);
+
+  // Thin files are a single slice covering the whole file
+  ASSERT_EQ(machore_list_slices(swapped_slice.data(), swapped_slice.size(),
+                                slices, 2),
+            1);
+  EXPECT_EQ(slices[0].cputype, CPU_TYPE_ARM);
+  EXPECT_EQ(slices[0].offset, 0);
+  EXPECT_EQ(slices[0].size, 0x1000);
+
+  const uint8_t elf[64] = {0x7f, 'E', 'L', 'F'};
+  EXPECT_EQ(machore_list_slices(elf, sizeof(elf), slices, 2), 0);
+}
+
+TEST(libmachore, validate_macho) {
+  const size_t seg = sizeof(struct mach_header);
+  const size_t sect = seg + sizeof(struct segment_command);
+  const size_t dylib = sect + sizeof(struct section);
+  const size_t symtab = dylib + sizeof(struct dylib_command) + 28;
+  auto corrupt = [](size_t offset, uint32_t value) {
+    std::vector<uint8_t> slice = build_slice32(false);
+    memcpy(&slice[offset], &value, sizeof(value));
+    return slice;
+  };
+  struct validation_result result;
+
+  std::vector<uint8_t> slice = build_slice32(true);
+  EXPECT_TRUE(machore_validate(slice.data(), slice.size(), &result));
+  EXPECT_EQ(result.error, LIBMACHORE_VALIDATION_OK);
+  EXPECT_FALSE(machore_validate(slice.data(), 20, &result));
+  EXPECT_EQ(result.error, LIBMACHORE_VALIDATION_TRUNCATED);
+  const uint8_t elf[64] = {0x7f, 'E', 'L', 'F'};
+  EXPECT_FALSE(machore_validate(elf, sizeof(elf), &result));
+  EXPECT_EQ(result.error, LIBMACHORE_VALIDATION_BAD_MAGIC);
+
+  // Errors point at the load command at fault
+  struct {
+    size_t offset;
+    uint32_t value;
+    validation_error_t error;
+    uint32_t load_command_index;
+  } cases[] = {
+      {offsetof(struct mach_header, sizeofcmds), 0x1000,
+       LIBMACHORE_VALIDATION_BAD_LOAD_COMMANDS, LIBMACHORE_NO_LOAD_COMMAND},
+      {symtab + offsetof(struct symtab_command, cmdsize), 0x100,
+       LIBMACHORE_VALIDATION_BAD_CMDSIZE, 2},
+      {seg + offsetof(struct segment_command, nsects), 2,
+       LIBMACHORE_VALIDATION_BAD_CMDSIZE, 0},
+      {seg + offsetof(struct segment_command, fileoff), 1,
+       LIBMACHORE_VALIDATION_BAD_SEGMENT, 0},
+      {sect + offsetof(struct section, offset), 0xFF8,
+       LIBMACHORE_VALIDATION_BAD_SECTION, 0},
+      {dylib + offsetof(struct dylib_command, dylib.name), symtab - dylib,
+       LIBMACHORE_VALIDATION_BAD_DYLIB, 1},
+      {symtab + offsetof(struct symtab_command, nsyms), 0x100,
+       LIBMACHORE_VALIDATION_BAD_SYMTAB, 2},
+      // The string table no longer ends with a NUL
+      {symtab + offsetof(struct symtab_command, strsize), 12,
+       LIBMACHORE_VALIDATION_BAD_SYMTAB, 2},
+  };
+  for (const auto &test_case : cases) {
+    std::vector<uint8_t> bad = corrupt(test_case.offset, test_case.value);
+    EXPECT_FALSE(machore_validate(bad.data(), bad.size(), &result));
+    EXPECT_EQ(result.error, test_case.error);
+    EXPECT_EQ(result.load_command_index, test_case.load_command_index);
+  }
+
+  // A segment command cut after its cmdsize ends the buffer: nothing past
+  // the load_command is read (fuzz/corpus/truncated_segment_64)
+  std::vector<uint8_t> truncated(sizeof(struct mach_header_64) +
+                                 sizeof(struct load_command));
+  struct mach_header_64 header64 = {};
+  header64.magic = MH_MAGIC_64;
+  header64.cputype = CPU_TYPE_ARM64;
+  header64.filetype = MH_EXECUTE;
+  header64.ncmds = 1;
+  header64.sizeofcmds = sizeof(struct load_command);
+  struct load_command segment64 = {LC_SEGMENT_64, sizeof(struct load_command)};
+  memcpy(truncated.data(), &header64, sizeof(header64));
+  memcpy(&truncated[sizeof(header64)], &segment64, sizeof(segment64));
+  EXPECT_FALSE(machore_validate(truncated.data(), truncated.size(), &result));
+  EXPECT_EQ(result.error, LIBMACHORE_VALIDATION_BAD_CMDSIZE);
+  EXPECT_EQ(result.load_command_index, 0);
+  EXPECT_EQ(result.offset, sizeof(header64));
+
+  // parse_macho() reports the error and parses nothing
+  std::vector<uint8_t> bad =
+      corrupt(symtab + offsetof(struct symtab_command, stroff), 0xFFF);
+  struct machore_output_t output;
+  init_output(&output);
+  parse_macho(&output, bad.data(), bad.size());
+  EXPECT_EQ(output.num_arch_outputs, 0);
+  EXPECT_EQ(output.validation.error, LIBMACHORE_VALIDATION_BAD_SYMTAB);
+  EXPECT_EQ(output.validation.offset, symtab);
+  EXPECT_STREQ(machore_validation_error_string(output.validation.error),
+               "invalid symbol table");
+  clean_output(&output);
+
+  // Sections without contents (dSYMs) are neither checked nor read
+  std::vector<uint8_t> dsym =
+      corrupt(sect + offsetof(struct section, offset), 0);
+  memcpy(&dsym[sect + offsetof(struct section, size)], "\0\0\1\0", 4);
+  init_output(&output);
+  parse_macho(&output, dsym.data(), dsym.size());
+  ASSERT_EQ(output.num_arch_outputs, 1);
+  EXPECT_EQ(output.arch_outputs[0].num_strings, 0);
+  EXPECT_EQ(output.arch_outputs[0].num_symbols, 2);
+  clean_output(&output);
+
+  // Fat slices are checked against the file, offsets are file offsets
+  std::vector<uint8_t> fat(0x2000);
+  auto put_fat32 = [&](size_t offset, uint32_t value) {
+    value = __builtin_bswap32(value);
+    memcpy(&fat[offset], &value, sizeof(value));
+  };
+  const size_t arch = sizeof(struct fat_header);
+  put_fat32(offsetof(struct fat_header, magic), FAT_MAGIC);
+  put_fat32(offsetof(struct fat_header, nfat_arch), 1);
+  put_fat32(arch + offsetof(struct fat_arch, offset), 0x1000);
+  put_fat32(arch + offsetof(struct fat_arch, size), 0x1001);
+  EXPECT_FALSE(machore_validate(fat.data(), fat.size(), &result));
+  EXPECT_EQ(result.error, LIBMACHORE_VALIDATION_BAD_SLICE);
+  EXPECT_EQ(result.offset, arch);
+  put_fat32(arch + offsetof(struct fat_arch, size), 0x1000);
+  memcpy(&fat[0x1000], bad.data(), 0x1000);
+  EXPECT_FALSE(machore_validate(fat.data(), fat.size(), &result));
+  EXPECT_EQ(result.error, LIBMACHORE_VALIDATION_BAD_SYMTAB);
+  EXPECT_EQ(result.arch_index, 0);
+  EXPECT_EQ(result.offset, 0x1000 + symtab);
+  memcpy(&fat[0x1000], slice.data(), 0x1000);
+  EXPECT_TRUE(machore_validate(fat.data(), fat.size(), &result));
+}
+
+TEST(libmachore, parse_macho_cfstrings) {
+  INIT_OUTPUT(
+      "/System/Library/CoreServices/SecurityAgentPlugins/DiskUnlock.bundle/"
+      "Contents/MacOS/DiskUnlock");
+  parse_macho(&output, buffer, buffer_size);
+
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+  EXPECT_GT(arch_output->num_cfstrings, 0);
+  for (size_t i = 0; i < arch_output->num_cfstrings; i++) {
+    struct cfstring_info *cfstring = &arch_output->cfstrings[i];
+    // CFStrings are views into the parsed buffer
+    EXPECT_GE((uint8_t *)cfstring->content, buffer);
+    EXPECT_LE((uint8_t *)cfstring->content + cfstring->size,
+              buffer + buffer_size);
+    if (!cfstring->is_utf16) {
+      EXPECT_EQ(strlen(cfstring->content), cfstring->size);
+    }
+  }
+
+  // __cfstring is no longer scanned as NUL terminated text
+  for (size_t i = 0; i < arch_output->num_strings; i++) {
+    EXPECT_STRNE(arch_output->strings[i].original_section, "__cfstring");
+  }
+
+  CLEAN_OUTPUT();
+}
+
+TEST(libmachore, parse_macho_exports) {
+  INIT_OUTPUT("/bin/ls");
+  parse_macho(&output, buffer, buffer_size);
+
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+  ASSERT_TRUE(arch_output->export_trie != NULL);
+
+  struct export_info export_info;
+  EXPECT_TRUE(machore_lookup_export(arch_output->export_trie,
+                                    arch_output->export_trie_size,
+                                    "__mh_execute_header", &export_info));
+  EXPECT_EQ(export_info.address, 0);
+  EXPECT_FALSE(machore_lookup_export(arch_output->export_trie,
+                                     arch_output->export_trie_size,
+                                     "__mh_execute", &export_info));
+  EXPECT_GT(machore_walk_exports(arch_output->export_trie,
+                                 arch_output->export_trie_size, NULL, NULL),
+            0);
+
+  CLEAN_OUTPUT();
+}
+
+static bool collect_export_names(const struct export_info *export_info,
+                                 void *context) {
+  auto *names = static_cast<std::vector<std::string> *>(context);
+  names->emplace_back(export_info->name, export_info->name_size);
+  return true;
+}
+
+TEST(libmachore, walk_exports) {
+  // "_foo" (0x10) and "_foobar" (0x20)
+  const uint8_t trie[] = {0x00, 0x01, '_', 'f', 'o',  'o',  0,
+                          0x08, 0x02, 0x00, 0x10, 0x01, 'b',  'a',
+                          'r',  0,    0x11, 0x02, 0x00, 0x20, 0x00};
+
+  std::vector<std::string> names;
+  EXPECT_EQ(machore_walk_exports(trie, sizeof(trie), collect_export_names,
+                                 &names),
+            2);
+  ASSERT_EQ(names.size(), 2);
+  EXPECT_EQ(names[0], "_foo");
+  EXPECT_EQ(names[1], "_foobar");
+
+  struct export_info export_info;
+  EXPECT_TRUE(
+      machore_lookup_export(trie, sizeof(trie), "_foobar", &export_info));
+  EXPECT_EQ(export_info.address, 0x20);
+  EXPECT_FALSE(machore_lookup_export(trie, sizeof(trie), "_fo", &export_info));
+
+  // Truncated tries are rejected instead of read out of bounds
+  EXPECT_EQ(machore_walk_exports(trie, 10, NULL, NULL), 0);
+  EXPECT_FALSE(machore_lookup_export(trie, 10, "_foobar", &export_info));
+}
+
+TEST(libmachore, parse_macho_imports) {
+  INIT_OUTPUT("/bin/ls");
+  parse_macho(&output, buffer, buffer_size);
+
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+  EXPECT_EQ(arch_output->dylibs[0].ordinal, 1);
+  EXPECT_EQ(arch_output->dylibs[2].ordinal, 3);
+
+  ASSERT_GT(arch_output->num_imports, 0);
+  bool has_libsystem_import = false;
+  for (size_t i = 0; i < arch_output->num_imports; i++) {
+    struct import_info *import_info = &arch_output->imports[i];
+    EXPECT_TRUE(import_info->name != NULL);
+    const struct dylib_info *dylib_info =
+        machore_import_dylib(arch_output, import_info);
+    if (import_info->library_ordinal > 0) {
+      ASSERT_TRUE(dylib_info != NULL);
+      if (strcmp(dylib_info->path, "/usr/lib/libSystem.B.dylib") == 0) {
+        has_libsystem_import = true;
+      }
+    } else {
+      EXPECT_TRUE(dylib_info == NULL);
+    }
+  }
+  EXPECT_TRUE(has_libsystem_import);
+
+  CLEAN_OUTPUT();
+}
+
+TEST(libmachore, parse_macho_chained_imports) {
+  std::vector<uint8_t> slice =
+      build_chained_slice64(DYLD_CHAINED_PTR_64_OFFSET, 0);
+  struct machore_output_t output;
+  init_output(&output);
+  parse_macho(&output, slice.data(), slice.size());
+  ASSERT_EQ(output.num_arch_outputs, 1);
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+  EXPECT_EQ(arch_output->imports_status, LIBMACHORE_IMPORTS_OK);
+  ASSERT_EQ(arch_output->num_imports, 2);
+  EXPECT_STREQ(arch_output->imports[0].name,
+               "___CFConstantStringClassReference");
+  EXPECT_EQ(arch_output->imports[0].num_references, 2);
+  EXPECT_STREQ(arch_output->imports[1].name, "_puts");
+  EXPECT_EQ(arch_output->imports[1].num_references, 1);
+  clean_output(&output);
+
+  // A zlib compressed symbol pool is reported, not mistaken for no imports
+  slice = build_chained_slice64(DYLD_CHAINED_PTR_64_OFFSET, 1);
+  init_output(&output);
+  parse_macho(&output, slice.data(), slice.size());
+  ASSERT_EQ(output.num_arch_outputs, 1);
+  EXPECT_EQ(output.arch_outputs[0].num_imports, 0);
+  EXPECT_EQ(output.arch_outputs[0].imports_status,
+            LIBMACHORE_IMPORTS_UNSUPPORTED);
+  clean_output(&output);
+}
+
+TEST(libmachore, parse_macho_chained_pointers) {
+  // Rebase targets are vmaddrs in DYLD_CHAINED_PTR_64 and offsets from the
+  // image base in DYLD_CHAINED_PTR_64_OFFSET
+  for (uint16_t pointer_format :
+       {DYLD_CHAINED_PTR_64, DYLD_CHAINED_PTR_64_OFFSET}) {
+    std::vector<uint8_t> slice = build_chained_slice64(pointer_format, 0);
+    struct machore_output_t output;
+    init_output(&output);
+    parse_macho(&output, slice.data(), slice.size());
+    ASSERT_EQ(output.num_arch_outputs, 1);
+    // The bound literal of the second CFString is not a literal
+    struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+    ASSERT_EQ(arch_output->num_cfstrings, 1);
+    EXPECT_EQ(arch_output->cfstrings[0].original_offset, 0x1000);
+    EXPECT_EQ(std::string(arch_output->cfstrings[0].content,
+                          arch_output->cfstrings[0].size),
+              "hello");
+    clean_output(&output);
+
+    // The target encoded the other way resolves to nothing
+    const uint64_t other_target =
+        pointer_format == DYLD_CHAINED_PTR_64 ? 0x1000 : 0x100001000;
+    const uint64_t rebase = 4ULL << 51 | other_target;
+    memcpy(&slice[0x4010], &rebase, sizeof(rebase));
+    init_output(&output);
+    parse_macho(&output, slice.data(), slice.size());
+    ASSERT_EQ(output.num_arch_outputs, 1);
+    EXPECT_EQ(output.arch_outputs[0].num_cfstrings, 0);
+    clean_output(&output);
+  }
+}
+
+TEST(libmachore, parse_macho_cfstring_segments) {
+  const size_t data = sizeof(struct mach_header_64) +
+                      sizeof(struct segment_command_64) +
+                      sizeof(struct section_64);
+  const size_t data_section = data + sizeof(struct segment_command_64);
+  for (const char *segname :
+       {"__DATA", "__DATA_CONST", "__DATA_DIRTY", "__AUTH_CONST", "__OTHER"}) {
+    std::vector<uint8_t> slice = build_chained_slice64(DYLD_CHAINED_PTR_64, 0);
+    for (size_t offset :
+         {data + offsetof(struct segment_command_64, segname),
+          data_section + offsetof(struct section_64, segname)}) {
+      memset(&slice[offset], 0, 16);
+      memcpy(&slice[offset], segname, strlen(segname));
+    }
+    struct machore_output_t output;
+    init_output(&output);
+    parse_macho(&output, slice.data(), slice.size());
+    ASSERT_EQ(output.num_arch_outputs, 1);
+    struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+    if (strcmp(segname, "__OTHER") == 0) {
+      EXPECT_EQ(arch_output->num_cfstrings, 0);
+    } else {
+      ASSERT_EQ(arch_output->num_cfstrings, 1);
+      EXPECT_STREQ(arch_output->cfstrings[0].original_segment, segname);
+    }
+    clean_output(&output);
+  }
+}
+
+TEST(libmachore, parse_macho_function_starts) {
+  INIT_OUTPUT("/bin/ls");
+  parse_macho(&output, buffer, buffer_size);
+
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+  ASSERT_GT(arch_output->num_function_starts, 0);
+  // x86_64 executables are based at 0x100000000
+  EXPECT_GT(arch_output->function_starts[0], 0x100000000);
+  for (size_t i = 1; i < arch_output->num_function_starts; i++) {
+    EXPECT_GT(arch_output->function_starts[i],
+              arch_output->function_starts[i - 1]);
+  }
+
+  CLEAN_OUTPUT();
+}
+
+TEST(libmachore, decode_uleb128_batch) {
+  // Mix of 1, 2 and 3+ bytes values, long enough to hit the 16 bytes path
+  std::vector<uint64_t> values;
+  std::vector<uint8_t> stream;
+  for (uint64_t i = 0; i < 1000; i++) {
+    uint64_t value = i % 3 == 0 ? i % 128 : i % 3 == 1 ? i * 37 : i << 20;
+    values.push_back(value);
+    do {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      stream.push_back(byte | (value != 0 ? 0x80 : 0));
+    } while (value != 0);
+  }
+
+  std::vector<uint64_t> decoded(values.size());
+  const uint8_t *cursor = stream.data();
+  EXPECT_EQ(decode_uleb128_batch(&cursor, stream.data() + stream.size(),
+                                 decoded.data(), decoded.size()),
+            values.size());
+  EXPECT_EQ(cursor, stream.data() + stream.size());
+  EXPECT_EQ(decoded, values);
+
+  // A truncated value is left undecoded
+  const uint8_t truncated[] = {0x05, 0x81, 0x81};
+  cursor = truncated;
+  EXPECT_EQ(decode_uleb128_batch(&cursor, truncated + sizeof(truncated),
+                                 decoded.data(), decoded.size()),
+            1);
+  EXPECT_EQ(cursor, truncated + 1);
+}
+
+TEST(libmachore, parse_macho_objc_metadata) {
+  INIT_OUTPUT(
+      "/System/Library/CoreServices/SecurityAgentPlugins/DiskUnlock.bundle/"
+      "Contents/MacOS/DiskUnlock");
+  parse_macho(&output, buffer, buffer_size);
+
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+
+  // Counting classes doesn't decode the table
+  size_t num_classes =
+      machore_metadata_count(arch_output, LIBMACHORE_METADATA_OBJC_CLASSES);
+  EXPECT_GT(num_classes, 0);
+  EXPECT_FALSE(
+      arch_output->metadata[LIBMACHORE_METADATA_OBJC_CLASSES].is_decoded);
+
+  size_t num_names;
+  const struct metadata_name *classes = machore_metadata_names(
+      arch_output, LIBMACHORE_METADATA_OBJC_CLASSES, &num_names);
+  EXPECT_EQ(num_names, num_classes);
+  for (size_t i = 0; i < num_names; i++) {
+    EXPECT_EQ(strlen(classes[i].name), classes[i].size);
+    EXPECT_GT(classes[i].size, 0);
+  }
+
+  const struct metadata_name *selectors = machore_metadata_names(
+      arch_output, LIBMACHORE_METADATA_OBJC_SELECTORS, &num_names);
+  EXPECT_GT(num_names, 0);
+  EXPECT_TRUE(selectors[0].name != NULL);
+
+  CLEAN_OUTPUT();
+}
+
+TEST(libmachore, parse_macho_swift_types) {
+  std::vector<uint8_t> slice = build_swift_types_slice64();
+  struct machore_output_t output;
+  init_output(&output);
+  parse_macho(&output, slice.data(), slice.size());
+  ASSERT_EQ(output.num_arch_outputs, 1);
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+
+  // Slots are counted before decoding, resolved names after
+  EXPECT_EQ(
+      machore_metadata_count(arch_output, LIBMACHORE_METADATA_SWIFT_TYPES), 5);
+  size_t num_names;
+  const struct metadata_name *types = machore_metadata_names(
+      arch_output, LIBMACHORE_METADATA_SWIFT_TYPES, &num_names);
+  ASSERT_EQ(num_names, 4);
+  EXPECT_STREQ(types[0].name, "Direct");
+  EXPECT_STREQ(types[1].name, "Indirect");
+  EXPECT_STREQ(types[2].name, "ObjCName");
+  EXPECT_STREQ(types[3].name, "ObjCClass");
+  EXPECT_EQ(
+      machore_metadata_count(arch_output, LIBMACHORE_METADATA_SWIFT_TYPES), 4);
+
+  clean_output(&output);
+}
+
+static bool collect_pattern_matches(const struct pattern_match *match,
+                                    void *context) {
+  static_cast<std::vector<struct pattern_match> *>(context)->push_back(*match);
+  return true;
+}
+
+TEST(libmachore, pattern_set_scan) {
+  const char *patterns[] = {"he", "she", "his", "hers"};
+  const size_t pattern_sizes[] = {2, 3, 3, 4};
+  struct machore_pattern_set *set =
+      machore_pattern_set_create(patterns, pattern_sizes, 4);
+  EXPECT_EQ(machore_pattern_set_size(set), 4);
+
+  // Overlapping matches are all reported
+  const char *data = "ushers";
+  std::vector<struct pattern_match> matches;
+  EXPECT_EQ(machore_pattern_set_scan(set, (const uint8_t *)data, strlen(data),
+                                     collect_pattern_matches, &matches),
+            3);
+  ASSERT_EQ(matches.size(), 3);
+  EXPECT_EQ(matches[0].pattern_index, 1);
+  EXPECT_EQ(matches[0].original_offset, 1);
+  EXPECT_EQ(matches[1].pattern_index, 0);
+  EXPECT_EQ(matches[1].original_offset, 2);
+  EXPECT_EQ(matches[2].pattern_index, 3);
+  EXPECT_EQ(matches[2].original_offset, 2);
+
+  machore_pattern_set_destroy(set);
+}
+
+TEST(libmachore, scan_patterns) {
+  INIT_OUTPUT("/bin/ls");
+  const char *patterns[] = {"CLICOLOR"};
+  const size_t pattern_sizes[] = {8};
+  struct machore_pattern_set *set =
+      machore_pattern_set_create(patterns, pattern_sizes, 1);
+
+  std::vector<struct pattern_match> matches;
+  EXPECT_GT(machore_scan_patterns(set, buffer, buffer_size,
+                                  collect_pattern_matches, &matches),
+            0);
+  ASSERT_FALSE(matches.empty());
+  EXPECT_STREQ(matches[0].original_segment, "__TEXT");
+  EXPECT_STREQ(matches[0].original_section, "__cstring");
+  EXPECT_TRUE(matches[0].original_offset > 0);
+
+  machore_pattern_set_destroy(set);
+  CLEAN_OUTPUT();
+}
+
+static bool collect_string_runs(const struct string_run *run, void *context) {
+  static_cast<std::vector<std::string> *>(context)->emplace_back(run->content,
+                                                                 run->size);
+  return true;
+}
+
+TEST(libmachore, extract_strings) {
+  // Short fragments are dropped, long runs span several 16 bytes chunks
+  const std::string data("\x01" "ab\0" "a printable run of text\x02"
+                         "caf\xc3\xa9\xff" "\xc0\xafnope",
+                         40);
+  struct string_scan_options options = {};
+  options.min_length = 3;
+  std::vector<std::string> runs;
+  EXPECT_EQ(machore_extract_strings((const uint8_t *)data.data(), data.size(),
+                                    &options, collect_string_runs, &runs),
+            3);
+  EXPECT_EQ(runs, (std::vector<std::string>{"a printable run of text", "caf",
+                                            "nope"}));
+  ASSERT_EQ(runs[1].size(), 3);
+
+  // Well-formed UTF-8 only: the overlong "\xc0\xaf" still ends a run
+  options.allow_unicode = true;
+  runs.clear();
+  machore_extract_strings((const uint8_t *)data.data(), data.size(), &options,
+                          collect_string_runs, &runs);
+  EXPECT_EQ(runs, (std::vector<std::string>{"a printable run of text",
+                                            "caf\xc3\xa9", "nope"}));
+
+  // UTF-16LE, with a surrogate pair and a lone surrogate
+  const uint16_t units[] = {'H',    'i',    0,   'S',    'w',
+                            'i',    't',    'c', 'h',    0xD83D,
+                            0xDE00, 0,      'x', 0xDC00, 'y'};
+  options.is_utf16 = true;
+  runs.clear();
+  EXPECT_EQ(machore_extract_strings((const uint8_t *)units, sizeof(units),
+                                    &options, collect_string_runs, &runs),
+            1);
+  ASSERT_EQ(runs.size(), 1);
+  EXPECT_EQ(runs[0].size(), 16);
+  options.min_length = 2;
+  options.allow_unicode = false;
+  runs.clear();
+  EXPECT_EQ(machore_extract_strings((const uint8_t *)units, sizeof(units),
+                                    &options, NULL, NULL),
+            2);
+
+  // Slices scan their string sections, offsets are rebased on the slice
+  std::vector<uint8_t> slice = build_slice32(false);
+  struct machore_output_t output;
+  init_output(&output);
+  parse_macho(&output, slice.data(), slice.size());
+  options.min_length = 5;
+  runs.clear();
+  EXPECT_EQ(machore_extract_slice_strings(&output.arch_outputs[0], &options,
+                                          collect_string_runs, &runs),
+            2);
+  EXPECT_EQ(runs, (std::vector<std::string>{"hello", "world"}));
+  clean_output(&output);
+}
+
+TEST(libmachore, byte_histogram) {
+  // Long enough for the table kernel, with uniform blocks and a tail
+  std::vector<uint8_t> data(4099);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = i < 1024 ? 0 : (uint8_t)(i * 7);
+  }
+
+  struct byte_stats_info stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.size = data.size();
+  byte_histogram_add(data.data(), data.size(), stats.histogram);
+  finalize_byte_stats(&stats);
+
+  uint64_t expected[256] = {0};
+  for (uint8_t byte : data) {
+    expected[byte]++;
+  }
+  EXPECT_EQ(memcmp(stats.histogram, expected, sizeof(expected)), 0);
+  EXPECT_GT(stats.entropy, 0);
+  EXPECT_LE(stats.entropy, 8);
+  EXPECT_GE(stats.zero_ratio, 1024.0 / data.size());
+}
+
+TEST(libmachore, parse_macho_byte_stats) {
+  INIT_OUTPUT("/bin/ls");
+  parse_macho(&output, buffer, buffer_size);
+
+  struct machore_arch_output_t *arch_output = &output.arch_outputs[0];
+  size_t num_sections;
+  const struct byte_stats_info *section_stats =
+      machore_section_stats(arch_output, &num_sections);
+  ASSERT_GT(num_sections, 0);
+  bool has_text = false;
+  for (size_t i = 0; i < num_sections; i++) {
+    if (strcmp(section_stats[i].original_section, "__text") == 0) {
+      has_text = true;
+      EXPECT_GT(section_stats[i].entropy, 4);
+      EXPECT_LT(section_stats[i].entropy, 8);
+    }
+  }
+  EXPECT_TRUE(has_text);
+
+  // Segment histograms cover every byte of the segment
+  size_t num_segments;
+  const struct byte_stats_info *segment_stats =
+      machore_segment_stats(arch_output, &num_segments);
+  ASSERT_GT(num_segments, 0);
+  for (size_t i = 0; i < num_segments; i++) {
+    uint64_t total = 0;
+    for (int byte = 0; byte < 256; byte++) {
+      total += segment_stats[i].histogram[byte];
+    }
+    EXPECT_EQ(total, segment_stats[i].size);
+  }
+
+  CLEAN_OUTPUT();
+}
+
+TEST(libmachore, diff_arch) {
+  struct dylib_info old_dylibs[2] = {};
+  strcpy(old_dylibs[0].path, "/usr/lib/libSystem.B.dylib");
+  strcpy(old_dylibs[0].version, "1.0.0");
+  strcpy(old_dylibs[1].path, "/usr/lib/libold.dylib");
+  struct dylib_info new_dylibs[2] = {};
+  strcpy(new_dylibs[0].path, "/usr/lib/libSystem.B.dylib");
+  strcpy(new_dylibs[0].version, "1.2.0");
+  strcpy(new_dylibs[1].path, "/usr/lib/libnew.dylib");
+
+  char old_content[] = "kept";
+  char new_content[] = "added";
+  struct string_info old_strings[1] = {};
+  old_strings[0].content = old_content;
+  old_strings[0].size = sizeof(old_content);
+  struct string_info new_strings[2] = {};
+  new_strings[0].content = new_content;
+  new_strings[0].size = sizeof(new_content);
+  new_strings[1].content = old_content;
+  new_strings[1].size = sizeof(old_content);
+
+  struct machore_arch_output_t old_arch = {};
+  old_arch.dylibs = old_dylibs;
+  old_arch.num_dylibs = 2;
+  old_arch.strings = old_strings;
+  old_arch.num_strings = 1;
+  struct machore_arch_output_t new_arch = {};
+  new_arch.dylibs = new_dylibs;
+  new_arch.num_dylibs = 2;
+  new_arch.strings = new_strings;
+  new_arch.num_strings = 2;
+  new_arch.uses_weak_symbols = true;
+
+  struct machore_diff_t diff;
+  machore_diff_arch(&diff, &old_arch, &new_arch);
+  ASSERT_EQ(diff.num_entries, 5);
+
+  // Sorted by kind, then by name
+  EXPECT_EQ(diff.entries[0].kind, LIBMACHORE_DIFF_FLAG);
+  EXPECT_EQ(std::string(diff.entries[0].name, diff.entries[0].name_size),
+            "uses_weak_symbols");
+  EXPECT_EQ(diff.entries[1].change, LIBMACHORE_DIFF_CHANGED);
+  EXPECT_STREQ(diff.entries[1].old_value, "1.0.0");
+  EXPECT_STREQ(diff.entries[1].new_value, "1.2.0");
+  EXPECT_EQ(diff.entries[2].change, LIBMACHORE_DIFF_ADDED);
+  EXPECT_EQ(std::string(diff.entries[2].name, diff.entries[2].name_size),
+            "/usr/lib/libnew.dylib");
+  EXPECT_EQ(diff.entries[3].change, LIBMACHORE_DIFF_REMOVED);
+  EXPECT_EQ(diff.entries[4].kind, LIBMACHORE_DIFF_STRING);
+  EXPECT_EQ(std::string(diff.entries[4].name, diff.entries[4].name_size),
+            "added");
+
+  machore_clean_diff(&diff);
+}
+
+// Two 16-byte names with the same hash_bytes() of lib/hash.h: the second
+// word cancels the difference of the states after the first one
+static void build_hash_collision(char first[17], char second[17]) {
+  auto step = [](uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * 0x9FB21C651E98DF25ULL;
+    return hash ^ (hash >> 29);
+  };
+  const uint64_t seed = 0x9E3779B97F4A7C15ULL ^ (16 * 0xFF51AFD7ED558CCDULL);
+  uint64_t words[2] = {0x6F6F6F6F6F6F6F6FULL, 0x7373737373737373ULL};
+  memcpy(first, words, 16);
+  uint64_t state = step(seed, words[0]);
+  words[0] ^= 1;
+  words[1] ^= state ^ step(seed, words[0]);
+  memcpy(second, words, 16);
+  first[16] = second[16] = '\0';
+}
+
+TEST(libmachore, diff_hash_collisions) {
+  char first[17];
+  char second[17];
+  build_hash_collision(first, second);
+  ASSERT_NE(memcmp(first, second, 16), 0);
+
+  // Colliding names are neither equal nor duplicates
+  struct string_info old_strings[1] = {};
+  old_strings[0].content = first;
+  old_strings[0].size = sizeof(first);
+  struct string_info new_strings[2] = {};
+  new_strings[0].content = first;
+  new_strings[0].size = sizeof(first);
+  new_strings[1].content = second;
+  new_strings[1].size = sizeof(second);
+
+  struct machore_arch_output_t old_arch = {};
+  old_arch.strings = old_strings;
+  old_arch.num_strings = 1;
+  struct machore_arch_output_t new_arch = {};
+  new_arch.strings = new_strings;
+  new_arch.num_strings = 2;
+
+  struct machore_diff_t diff;
+  machore_diff_arch(&diff, &old_arch, &new_arch);
+  ASSERT_EQ(diff.num_entries, 1);
+  EXPECT_EQ(diff.entries[0].change, LIBMACHORE_DIFF_ADDED);
+  EXPECT_EQ(diff.entries[0].name_size, 16);
+  EXPECT_EQ(memcmp(diff.entries[0].name, second, 16), 0);
+  machore_clean_diff(&diff);
+
+  new_arch.strings = new_strings + 1;
+  new_arch.num_strings = 1;
+  machore_diff_arch(&diff, &old_arch, &new_arch);
+  ASSERT_EQ(diff.num_entries, 2);
+  EXPECT_EQ(diff.entries[0].change + diff.entries[1].change,
+            LIBMACHORE_DIFF_ADDED + LIBMACHORE_DIFF_REMOVED);
+  machore_clean_diff(&diff);
+}
+
+TEST(libmachore, paged_diff_and_fingerprint) {
+  std::vector<uint8_t> old_slice = build_slice32(false);
+  std::vector<uint8_t> new_slice = build_slice32(false);
+  const size_t main_symbol = 0x900;
+  new_slice[main_symbol + offsetof(struct nlist, n_type)] = N_SECT;
+  memcpy(&new_slice[0x806], "earth", 5);
+
+  struct machore_output_t outputs[3];
+  for (int i = 0; i < 3; i++) {
+    init_output(&outputs[i]);
+    outputs[i].is_paged = i > 0;
+  }
+  parse_macho(&outputs[0], old_slice.data(), old_slice.size());
+  parse_macho(&outputs[1], old_slice.data(), old_slice.size());
+  parse_macho(&outputs[2], new_slice.data(), new_slice.size());
+  struct machore_arch_output_t *eager_arch = &outputs[0].arch_outputs[0];
+  struct machore_arch_output_t *old_arch = &outputs[1].arch_outputs[0];
+  struct machore_arch_output_t *new_arch = &outputs[2].arch_outputs[0];
+  EXPECT_FALSE(machore_is_paged(eager_arch));
+  EXPECT_TRUE(machore_is_paged(old_arch));
+
+  // Paged outputs read the same features as the eager ones
+  struct fingerprint_info eager_fingerprint, paged_fingerprint;
+  machore_fingerprint_arch(eager_arch, &eager_fingerprint);
+  machore_fingerprint_arch(old_arch, &paged_fingerprint);
+  EXPECT_EQ(paged_fingerprint.num_features, 5);
+  EXPECT_EQ(memcmp(&eager_fingerprint, &paged_fingerprint,
+                   sizeof(struct fingerprint_info)),
+            0);
+
+  struct machore_diff_t diff;
+  machore_diff_arch(&diff, eager_arch, old_arch);
+  EXPECT_EQ(diff.num_entries, 0);
+  machore_clean_diff(&diff);
+
+  machore_diff_arch(&diff, old_arch, new_arch);
+  ASSERT_EQ(diff.num_entries, 3);
+  EXPECT_EQ(diff.entries[0].kind, LIBMACHORE_DIFF_SYMBOL);
+  EXPECT_EQ(diff.entries[0].change, LIBMACHORE_DIFF_CHANGED);
+  EXPECT_STREQ(diff.entries[0].old_value, "EXTERNAL");
+  EXPECT_STREQ(diff.entries[0].new_value, "PRIVATE EXTERNAL");
+  EXPECT_EQ(diff.entries[1].kind, LIBMACHORE_DIFF_STRING);
+  EXPECT_EQ(std::string(diff.entries[1].name, diff.entries[1].name_size),
+            "earth");
+  EXPECT_EQ(diff.entries[2].change, LIBMACHORE_DIFF_REMOVED);
+  machore_clean_diff(&diff);
+
+  for (int i = 0; i < 3; i++) {
+    clean_output(&outputs[i]);
+  }
+}
+
+TEST(libmachore, parse_macho_diff) {
+  INIT_OUTPUT("/bin/ls");
+  parse_macho(&output, buffer, buffer_size);
+
+  // A slice has no difference with itself
+  struct machore_diff_t diff;
+  machore_diff_arch(&diff, &output.arch_outputs[0], &output.arch_outputs[0]);
+  EXPECT_EQ(diff.num_entries, 0);
+  machore_clean_diff(&diff);
+
+  CLEAN_OUTPUT();
+}
+
+TEST(libmachore, fingerprint_similarity) {
+  // 150 shared strings out of 250: a Jaccard similarity of 0.6
+  std::vector<std::string> contents;
+  for (int i = 0; i < 250; i++) {
+    contents.push_back("string_" + std::to_string(i));
+  }
+  std::vector<struct string_info> strings(250);
+  for (int i = 0; i < 250; i++) {
+    strings[i].content = (char *)contents[i].c_str();
+    strings[i].size = contents[i].size() + 1;
+  }
+  struct machore_arch_output_t first_arch = {};
+  first_arch.strings = strings.data();
+  first_arch.num_strings = 200;
+  struct machore_arch_output_t second_arch = {};
+  second_arch.strings = strings.data() + 50;
+  second_arch.num_strings = 200;
+
+  struct fingerprint_info first, second;
+  machore_fingerprint_arch(&first_arch, &first);
+  machore_fingerprint_arch(&second_arch, &second);
+  EXPECT_EQ(first.num_features, 200);
+  EXPECT_NEAR(machore_fingerprint_similarity(&first, &second), 0.6, 0.2);
+  EXPECT_EQ(machore_fingerprint_similarity(&first, &first), 1.0);
+  EXPECT_EQ(machore_fingerprint_distance(&first, &first), 0);
+  EXPECT_GT(machore_fingerprint_distance(&first, &second), 0);
+}
+
+TEST(libmachore, lsh_index) {
+  char path[] = "/tmp/libmachore_lsh_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  unlink(path);
+
+  // Fingerprints with unrelated features, plus one close to the first
+  std::vector<std::string> contents;
+  for (int i = 0; i < 400; i++) {
+    contents.push_back("feature_" + std::to_string(i));
+  }
+  std::vector<struct string_info> strings(400);
+  for (int i = 0; i < 400; i++) {
+    strings[i].content = (char *)contents[i].c_str();
+    strings[i].size = contents[i].size() + 1;
+  }
+  struct fingerprint_info fingerprints[5];
+  for (int i = 0; i < 4; i++) {
+    struct machore_arch_output_t arch = {};
+    arch.strings = strings.data() + i * 100;
+    arch.num_strings = 100;
+    machore_fingerprint_arch(&arch, &fingerprints[i]);
+  }
+  struct machore_arch_output_t close_arch = {};
+  close_arch.strings = strings.data() + 5;
+  close_arch.num_strings = 100;
+  machore_fingerprint_arch(&close_arch, &fingerprints[4]);
+
+  struct machore_lsh_index *index = machore_lsh_open(path);
+  ASSERT_NE(index, nullptr);
+  machore_lsh_insert(index, "first", &fingerprints[0]);
+  machore_lsh_insert(index, "second", &fingerprints[1]);
+  ASSERT_TRUE(machore_lsh_save(index));
+  machore_lsh_close(index);
+
+  // Queries mix saved records and pending inserts
+  index = machore_lsh_open(path);
+  ASSERT_NE(index, nullptr);
+  machore_lsh_insert(index, "third", &fingerprints[2]);
+  EXPECT_EQ(machore_lsh_size(index), 3);
+
+  struct lsh_match matches[4];
+  size_t num_matches = machore_lsh_query(index, &fingerprints[4], matches, 4);
+  ASSERT_GE(num_matches, 1);
+  EXPECT_STREQ(matches[0].name, "first");
+  EXPECT_GT(matches[0].similarity, 0.7);
+  num_matches = machore_lsh_query(index, &fingerprints[2], matches, 4);
+  ASSERT_GE(num_matches, 1);
+  EXPECT_STREQ(matches[0].name, "third");
+  EXPECT_EQ(matches[0].similarity, 1.0);
+  EXPECT_EQ(machore_lsh_query(index, &fingerprints[3], matches, 4), 0);
+
+  ASSERT_TRUE(machore_lsh_save(index));
+  EXPECT_EQ(machore_lsh_size(index), 3);
+  num_matches = machore_lsh_query(index, &fingerprints[2], matches, 4);
+  ASSERT_GE(num_matches, 1);
+  EXPECT_STREQ(matches[0].name, "third");
+  machore_lsh_close(index);
+
+  // Corrupt indexes are rejected at open. Layout: a 40-byte header ending
+  // with num_records and names_size, records of minhash, simhash,
+  // num_features and name_offset, then 16-byte band entries
+  // { key, record_index }.
+  std::vector<uint8_t> saved;
+  FILE *file = fopen(path, "rb");
+  ASSERT_NE(file, nullptr);
+  for (int byte; (byte = fgetc(file)) != EOF;) {
+    saved.push_back(byte);
+  }
+  fclose(file);
+  auto patched = [](std::vector<uint8_t> contents, size_t position,
+                    uint64_t value) {
+    memcpy(&contents[position], &value, sizeof(value));
+    return contents;
+  };
+  auto opens = [&](const std::vector<uint8_t> &contents) {
+    FILE *corrupt_file = fopen(path, "wb");
+    fwrite(contents.data(), 1, contents.size(), corrupt_file);
+    fclose(corrupt_file);
+    struct machore_lsh_index *corrupt_index = machore_lsh_open(path);
+    machore_lsh_close(corrupt_index);
+    return corrupt_index != nullptr;
+  };
+  const size_t header_size = 40;
+  const size_t record_size =
+      LIBMACHORE_MINHASH_SIZE * sizeof(uint32_t) + 3 * sizeof(uint64_t);
+  const size_t bands_size_per_record = 16 * 2 * sizeof(uint64_t);
+  const size_t num_records = 3;
+  const size_t bands = header_size + num_records * record_size;
+  ASSERT_TRUE(opens(patched(saved, bands + 8, num_records - 1)));
+  // Name offset past the name pool
+  EXPECT_FALSE(opens(patched(saved, header_size + record_size - 8, 1 << 20)));
+  // Band entry pointing past the records
+  EXPECT_FALSE(opens(patched(saved, bands + 8, num_records)));
+  // Records filling the file, and a names size wrapping the sum of the
+  // sections around to the file size
+  const uint64_t max_records = saved.size() / record_size;
+  const uint64_t wrapped_names_size =
+      saved.size() - header_size - max_records * record_size -
+      max_records * bands_size_per_record;
+  EXPECT_FALSE(opens(patched(patched(saved, 24, max_records), 32,
+                             wrapped_names_size)));
+  unlink(path);
+
+  // Inserts survive a failed save
+  std::string missing_path = std::string(path) + "_missing/index";
+  index = machore_lsh_open(missing_path.c_str());
+  ASSERT_NE(index, nullptr);
+  machore_lsh_insert(index, "first", &fingerprints[0]);
+  EXPECT_FALSE(machore_lsh_save(index));
+  EXPECT_EQ(machore_lsh_size(index), 1);
+  num_matches = machore_lsh_query(index, &fingerprints[0], matches, 4);
+  ASSERT_EQ(num_matches, 1);
+  EXPECT_STREQ(matches[0].name, "first");
+  machore_lsh_close(index);
+}
+
+static bool collect_term_match(const char *name, void *context) {
+  static_cast<std::vector<std::string> *>(context)->push_back(name);
+  return true;
+}
+
+static std::vector<std::string>
+query_term_index(const struct machore_term_index *index, term_kind_t kind,
+                 const char *term) {
+  std::vector<std::string> names;
+  machore_term_index_query(index, kind, term, collect_term_match, &names);
+  return names;
+}
+
+TEST(libmachore, term_index) {
+  char path[] = "/tmp/libmachore_terms_XXXXXX";
+  ASSERT_NE(mkdtemp(path), nullptr);
+
+  struct dylib_info dylibs[3] = {};
+  strcpy(dylibs[0].path, "/usr/lib/libcrypto.1.0.dylib");
+  strcpy(dylibs[0].version, "1.0.0");
+  dylibs[0].ordinal = 1;
+  strcpy(dylibs[1].path, "/usr/lib/libSystem.B.dylib");
+  strcpy(dylibs[1].version, "1319.0.0");
+  dylibs[1].ordinal = 2;
+  // LC_ID_DYLIB is not a linked dylib
+  strcpy(dylibs[2].path, "/usr/lib/libfirst.dylib");
+  dylibs[2].ordinal = 0;
+  struct symbol_info symbols[2] = {};
+  symbols[0].name = (char *)"_main";
+  symbols[1].name = (char *)"_SecTrustEvaluate";
+  struct import_info imports[2] = {};
+  imports[0].name = "_SecTrustEvaluate";
+  imports[1].name = "_SecTrustEvaluate";
+  struct security_flags flags = {};
+  flags.is_signed = true;
+  flags.is_library_validation_disabled = true;
+  char entitlements[] =
+      "<dict><key>com.apple.security.cs.disable-library-validation</key>"
+      "<true/>\n<key>com.apple.security.get-task-allow</key> <false/></dict>";
+
+  // Two slices listing the same terms make one document
+  struct machore_arch_output_t first_archs[2] = {};
+  for (auto &arch : first_archs) {
+    arch.dylibs = dylibs;
+    arch.num_dylibs = 3;
+    arch.symbols = symbols;
+    arch.num_symbols = 2;
+    arch.imports = imports;
+    arch.num_imports = 2;
+    arch.security_flags = &flags;
+    arch.entitlements = entitlements;
+  }
+  struct machore_output_t first = {};
+  first.arch_outputs = first_archs;
+  first.num_arch_outputs = 2;
+
+  struct machore_arch_output_t second_arch = {};
+  second_arch.dylibs = dylibs + 1;
+  second_arch.num_dylibs = 1;
+  second_arch.symbols = symbols;
+  second_arch.num_symbols = 1;
+  struct machore_output_t second = {};
+  second.arch_outputs = &second_arch;
+  second.num_arch_outputs = 1;
+
+  struct machore_term_index *index = machore_term_index_open(path);
+  ASSERT_NE(index, nullptr);
+  machore_term_index_add(index, "first", &first);
+  machore_term_index_add(index, "second", &second);
+  EXPECT_EQ(machore_term_index_size(index), 0);
+  ASSERT_TRUE(machore_term_index_save(index));
+  EXPECT_EQ(machore_term_index_size(index), 2);
+  machore_term_index_close(index);
+
+  index = machore_term_index_open(path);
+  ASSERT_NE(index, nullptr);
+  using names = std::vector<std::string>;
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_DYLIB,
+                             "/usr/lib/libSystem.B.dylib"),
+            (names{"first", "second"}));
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_DYLIB,
+                             "/usr/lib/libcrypto.1.0.dylib"),
+            names{"first"});
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_DYLIB_VERSION,
+                             "/usr/lib/libcrypto.1.0.dylib@1.0.0"),
+            names{"first"});
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_DYLIB,
+                             "/usr/lib/libfirst.dylib"),
+            names{});
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_IMPORT,
+                             "_SecTrustEvaluate"),
+            names{"first"});
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_SYMBOL, "_main"),
+            (names{"first", "second"}));
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_FLAG,
+                             "disable-library-validation"),
+            names{"first"});
+  EXPECT_EQ(
+      query_term_index(index, LIBMACHORE_TERM_ENTITLEMENT,
+                       "com.apple.security.cs.disable-library-validation"),
+      names{"first"});
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_ENTITLEMENT,
+                             "com.apple.security.get-task-allow"),
+            names{});
+  // Kinds do not mix
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_SYMBOL,
+                             "/usr/lib/libSystem.B.dylib"),
+            names{});
+  EXPECT_EQ(machore_term_index_query(index, LIBMACHORE_TERM_SYMBOL, "_main",
+                                     NULL, NULL),
+            2);
+
+  // A rebuilt binary replaces the old one, in a segment of its own until
+  // the segments get merged
+  for (int i = 0; i < 3; i++) {
+    std::string name = "other" + std::to_string(i);
+    machore_term_index_add(index, name.c_str(), &second);
+  }
+  ASSERT_TRUE(machore_term_index_save(index));
+  EXPECT_EQ(machore_term_index_num_segments(index), 1);
+  machore_term_index_add(index, "first", &second);
+  ASSERT_TRUE(machore_term_index_save(index));
+  EXPECT_EQ(machore_term_index_num_segments(index), 2);
+  EXPECT_EQ(machore_term_index_size(index), 5);
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_DYLIB,
+                             "/usr/lib/libcrypto.1.0.dylib"),
+            names{});
+  EXPECT_EQ(machore_term_index_query(index, LIBMACHORE_TERM_DYLIB,
+                                     "/usr/lib/libSystem.B.dylib", NULL,
+                                     NULL),
+            5);
+
+  ASSERT_TRUE(machore_term_index_merge(index, 1));
+  EXPECT_EQ(machore_term_index_num_segments(index), 1);
+  EXPECT_EQ(machore_term_index_size(index), 5);
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_IMPORT,
+                             "_SecTrustEvaluate"),
+            names{});
+  EXPECT_EQ(query_term_index(index, LIBMACHORE_TERM_SYMBOL, "_main"),
+            (names{"second", "other0", "other1", "other2", "first"}));
+  machore_term_index_close(index);
+
+  index = machore_term_index_open(path);
+  ASSERT_NE(index, nullptr);
+  EXPECT_EQ(machore_term_index_size(index), 5);
+  machore_term_index_close(index);
+  std::filesystem::remove_all(path);
+}
+
+// Swift hook writing "swift:<name>" like a real demangler would
+static char *demangle_swift_name(const char *name, char *buffer,
+                                 size_t *length, void *context) {
+  ++*static_cast<int *>(context);
+  size_t size = strlen("swift:") + strlen(name) + 1;
+  if (buffer == NULL || *length < size) {
+    buffer = static_cast<char *>(realloc(buffer, size));
+  }
+  snprintf(buffer, size, "swift:%s", name);
+  *length = size;
+  return buffer;
+}
+
+TEST(libmachore, demangle_batch) {
+  struct machore_demangler *demangler = machore_demangler_create(3);
+  int num_swift_calls = 0;
+  machore_demangler_set_swift(demangler, demangle_swift_name,
+                              &num_swift_calls);
+
+  const char *const cycle[] = {"__ZN3foo3barEv", "_main", "_$s4main3FooV",
+                               "__Zinvalid"};
+  const char *first_demangled[4];
+  machore_demangle_batch(demangler, cycle, 4, first_demangled);
+  EXPECT_STREQ(first_demangled[0], "foo::bar()");
+  EXPECT_EQ(first_demangled[1], nullptr);
+  EXPECT_STREQ(first_demangled[2], "swift:$s4main3FooV");
+  EXPECT_EQ(first_demangled[3], nullptr);
+
+  // Large enough for the worker threads to take part, all cache hits
+  std::vector<const char *> names(2000);
+  for (size_t index = 0; index < names.size(); index++) {
+    names[index] = cycle[index % 4];
+  }
+  std::vector<const char *> demangled(names.size());
+  machore_demangle_batch(demangler, names.data(), names.size(),
+                         demangled.data());
+
+  for (size_t index = 0; index < names.size(); index++) {
+    EXPECT_EQ(demangled[index], first_demangled[index % 4]);
+  }
+  EXPECT_EQ(num_swift_calls, 1);
+
+  struct demangle_stats stats;
+  machore_demangler_stats(demangler, &stats);
+  EXPECT_EQ(stats.num_lookups, 1503);
+  EXPECT_EQ(stats.num_hits, 1500);
+  EXPECT_EQ(stats.num_entries, 3);
+  EXPECT_EQ(stats.num_failures, 1);
+
+  // Blocks in C++ functions keep one more underscore after the strip
+  const char *const blocks[] = {"___ZN3foo3barEv_block_invoke",
+                                "___ZN3foo3barEv_block_invoke_2",
+                                "___ZN3foo3barEv_block_invoke_x"};
+  const char *blocks_demangled[3];
+  machore_demangle_batch(demangler, blocks, 3, blocks_demangled);
+  EXPECT_STREQ(blocks_demangled[0],
+               "invocation function for block in foo::bar()");
+  EXPECT_STREQ(blocks_demangled[1],
+               "invocation function for block in foo::bar()");
+  EXPECT_EQ(blocks_demangled[2], nullptr);
+  machore_demangler_destroy(demangler);
+}
+
+TEST(libmachore, dyld_cache_images) {
+  // A single file, then __TEXT in the main file and a subcache and
+  // __LINKEDIT in a third one
+  for (size_t num_subcaches : {0, 2}) {
+    char path[] = "/tmp/libmachore_cache_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    struct synthetic_cache_options options = {
+        .num_images = 6,
+        .num_subcaches = num_subcaches,
+        .num_strings = 10,
+        .num_symbols = 20,
+    };
+    ASSERT_TRUE(write_synthetic_cache(path, &options));
+
+    struct machore_dyld_cache *cache = machore_dyld_cache_open(path);
+    ASSERT_NE(cache, nullptr);
+    ASSERT_EQ(machore_dyld_cache_count_images(cache), 6);
+    struct cache_image_info image_info;
+    ASSERT_TRUE(machore_dyld_cache_get_image(cache, 5, &image_info));
+    EXPECT_STREQ(image_info.path, "/usr/lib/libsynthetic5.dylib");
+    EXPECT_FALSE(machore_dyld_cache_get_image(cache, 6, &image_info));
+
+    struct machore_output_t outputs[6];
+    for (struct machore_output_t &output : outputs) {
+      init_output(&output);
+    }
+    EXPECT_EQ(machore_dyld_cache_parse_images(cache, 0, 6, outputs, 3), 6);
+    for (size_t index = 0; index < 6; index++) {
+      ASSERT_EQ(outputs[index].num_arch_outputs, 1);
+      struct machore_arch_output_t *arch_output =
+          &outputs[index].arch_outputs[0];
+      EXPECT_STREQ(arch_output->architecture, "ARM64");
+      EXPECT_EQ(arch_output->filetype, LIBMACHORE_FILETYPE_DYLIB);
+      ASSERT_EQ(arch_output->num_dylibs, 2);
+      EXPECT_STREQ(arch_output->dylibs[1].path, "/usr/lib/libSystem.B.dylib");
+
+      std::string prefix = "image" + std::to_string(index);
+      ASSERT_EQ(arch_output->num_strings, 10);
+      EXPECT_EQ(arch_output->strings[9].content, prefix + "_string9");
+      // Symbols are in the shared __LINKEDIT
+      ASSERT_EQ(arch_output->num_symbols, 20);
+      EXPECT_EQ(arch_output->symbols[19].name, "_" + prefix + "_symbol19");
+      clean_output(&outputs[index]);
+    }
+    machore_dyld_cache_close(cache);
+
+    unlink(path);
+    for (size_t index = 1; index <= num_subcaches; index++) {
+      char subcache_path[sizeof(path) + 8];
+      snprintf(subcache_path, sizeof(subcache_path), "%s.%02zu", path, index);
+      unlink(subcache_path);
+    }
+  }
+  EXPECT_EQ(machore_dyld_cache_open("/nonexistent/dyld_shared_cache"),
+            nullptr);
+}
@@ -0,0 +1,47 @@
+#include "synthetic_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Writes a synthetic dyld shared cache, for testing on any platform
+int main(int argc, char *argv[]) {
+  struct synthetic_cache_options options = {
+      .num_images = 16,
+      .num_subcaches = 0,
+      .num_strings = 100,
+      .num_symbols = 100,
+  };
+  if (argc < 2) {
+    printf("Usage: %s <cache-path> [--images <count>] [--subcaches <count>] "
+           "[--strings <count>] [--symbols <count>]\n",
+           argv[0]);
+    return 1;
+  }
+  for (int arg_index = 2; arg_index < argc; arg_index++) {
+    const char *option = argv[arg_index];
+    if (arg_index + 1 == argc) {
+      printf("Error: missing value for '%s'\n", option);
+      return 1;
+    }
+    size_t value = strtoul(argv[++arg_index], NULL, 10);
+    if (strcmp(option, "--images") == 0) {
+      options.num_images = value;
+    } else if (strcmp(option, "--subcaches") == 0) {
+      options.num_subcaches = value;
+    } else if (strcmp(option, "--strings") == 0) {
+      options.num_strings = value;
+    } else if (strcmp(option, "--symbols") == 0) {
+      options.num_symbols = value;
+    } else {
+      printf("Error: unknown option '%s'\n", option);
+      return 1;
+    }
+  }
+
+  if (!write_synthetic_cache(argv[1], &options)) {
+    printf("Error: could not write '%s'\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,309 @@
+#include "synthetic_cache.h"
+#include "../lib/dyld_cache_shim.h"
+
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#include <mach/machine.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every file starts with a dyld_cache_header and is mapped whole, except
+ * single file caches which have a __TEXT and a __LINKEDIT mapping:
+ *
+ *   main file   header | mappings | subcaches | images | paths | __TEXT...
+ *   .01, .02... header | mappings | __TEXT...
+ *   last file   header | mappings | __LINKEDIT
+ *
+ * where __TEXT is the mach header, load commands and __cstring section of
+ * an image, and __LINKEDIT the nlist_64 entries of every image followed by
+ * a string table they share.
+ */
+#define BASE_ADDRESS 0x180000000ULL
+#define SEGMENT_ALIGN 0x4000
+#define CSTRING_OFFSET 0x1000
+#define NAME_SIZE 48
+#define LIBSYSTEM_PATH "/usr/lib/libSystem.B.dylib"
+
+struct cache_file {
+  uint8_t *data;
+  size_t size;
+  uint64_t address;
+};
+
+static size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static void image_path(size_t index, char *path) {
+  snprintf(path, NAME_SIZE, "/usr/lib/libsynthetic%zu.dylib", index);
+}
+
+static size_t dylib_command_size(const char *path) {
+  return sizeof(struct dylib_command) + align_up(strlen(path) + 1, 8);
+}
+
+static size_t cstring_size(const struct synthetic_cache_options *options,
+                           size_t image) {
+  size_t size = 0;
+  char name[NAME_SIZE];
+  for (size_t index = 0; index < options->num_strings; index++) {
+    size += snprintf(name, NAME_SIZE, "image%zu_string%zu", image, index) + 1;
+  }
+  return size;
+}
+
+static size_t text_size(const struct synthetic_cache_options *options,
+                        size_t image) {
+  return align_up(CSTRING_OFFSET + cstring_size(options, image),
+                  SEGMENT_ALIGN);
+}
+
+static void write_header(struct cache_file *file, uint32_t num_mappings) {
+  dyld_cache_header_shim *header = (dyld_cache_header_shim *)file->data;
+  memcpy(header->magic, "dyld_v1   arm64", 16);
+  header->mappingOffset = sizeof(dyld_cache_header_shim);
+  header->mappingCount = num_mappings;
+  header->sharedRegionStart = BASE_ADDRESS;
+}
+
+static void write_mapping(struct cache_file *file, uint32_t index,
+                          uint64_t file_offset, uint64_t size) {
+  dyld_cache_mapping_info_shim *mapping =
+      (dyld_cache_mapping_info_shim *)(file->data +
+                                       sizeof(dyld_cache_header_shim)) +
+      index;
+  mapping->address = file->address + file_offset;
+  mapping->size = size;
+  mapping->fileOffset = file_offset;
+  mapping->maxProt = 1;
+  mapping->initProt = 1;
+}
+
+struct linkedit_layout {
+  struct cache_file *file;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t string_table;
+  uint64_t string_table_size;
+};
+
+static uint8_t *write_dylib_command(uint8_t *cmd, uint32_t type,
+                                    const char *path) {
+  struct dylib_command *dylib = (struct dylib_command *)cmd;
+  dylib->cmd = type;
+  dylib->cmdsize = dylib_command_size(path);
+  dylib->dylib.name.offset = sizeof(struct dylib_command);
+  dylib->dylib.current_version = 0x10000;
+  dylib->dylib.compatibility_version = 0x10000;
+  strcpy((char *)cmd + sizeof(struct dylib_command), path);
+  return cmd + dylib->cmdsize;
+}
+
+static void write_image(const struct synthetic_cache_options *options,
+                        size_t image, struct cache_file *file,
+                        uint64_t offset, const struct linkedit_layout *linkedit,
+                        uint32_t *string_index) {
+  char path[NAME_SIZE];
+  image_path(image, path);
+  const size_t size = text_size(options, image);
+
+  uint8_t *text = file->data + offset;
+  struct mach_header_64 *header = (struct mach_header_64 *)text;
+  header->magic = MH_MAGIC_64;
+  header->cputype = CPU_TYPE_ARM64;
+  header->filetype = MH_DYLIB;
+  header->ncmds = 5;
+  header->flags = MH_NOUNDEFS | MH_DYLDLINK | MH_TWOLEVEL;
+
+  uint8_t *cmd = text + sizeof(struct mach_header_64);
+  struct segment_command_64 *seg = (struct segment_command_64 *)cmd;
+  seg->cmd = LC_SEGMENT_64;
+  seg->cmdsize = sizeof(*seg) + sizeof(struct section_64);
+  strcpy(seg->segname, "__TEXT");
+  seg->vmaddr = file->address + offset;
+  seg->vmsize = size;
+  seg->fileoff = offset;
+  seg->filesize = size;
+  seg->nsects = 1;
+  struct section_64 *sect = (struct section_64 *)(seg + 1);
+  strcpy(sect->sectname, "__cstring");
+  strcpy(sect->segname, "__TEXT");
+  sect->addr = seg->vmaddr + CSTRING_OFFSET;
+  sect->size = cstring_size(options, image);
+  sect->offset = offset + CSTRING_OFFSET;
+  sect->flags = S_CSTRING_LITERALS;
+  cmd += seg->cmdsize;
+
+  // Every image maps the whole shared __LINKEDIT
+  seg = (struct segment_command_64 *)cmd;
+  seg->cmd = LC_SEGMENT_64;
+  seg->cmdsize = sizeof(*seg);
+  strcpy(seg->segname, "__LINKEDIT");
+  seg->vmaddr = linkedit->file->address + linkedit->offset;
+  seg->vmsize = linkedit->size;
+  seg->fileoff = linkedit->offset;
+  seg->filesize = linkedit->size;
+  cmd += seg->cmdsize;
+
+  cmd = write_dylib_command(cmd, LC_ID_DYLIB, path);
+  cmd = write_dylib_command(cmd, LC_LOAD_DYLIB, LIBSYSTEM_PATH);
+
+  const size_t symoff =
+      linkedit->offset + image * options->num_symbols * sizeof(struct nlist_64);
+  struct symtab_command *symtab = (struct symtab_command *)cmd;
+  symtab->cmd = LC_SYMTAB;
+  symtab->cmdsize = sizeof(*symtab);
+  symtab->symoff = symoff;
+  symtab->nsyms = options->num_symbols;
+  symtab->stroff = linkedit->string_table;
+  symtab->strsize = linkedit->string_table_size;
+  cmd += symtab->cmdsize;
+  header->sizeofcmds = cmd - (text + sizeof(struct mach_header_64));
+  assert(cmd - text <= CSTRING_OFFSET);
+
+  char *string = (char *)text + CSTRING_OFFSET;
+  for (size_t index = 0; index < options->num_strings; index++) {
+    string += sprintf(string, "image%zu_string%zu", image, index) + 1;
+  }
+
+  struct nlist_64 *symbols =
+      (struct nlist_64 *)(linkedit->file->data + symoff);
+  char *names = (char *)linkedit->file->data + linkedit->string_table;
+  for (size_t index = 0; index < options->num_symbols; index++) {
+    symbols[index].n_un.n_strx = *string_index;
+    symbols[index].n_type = N_SECT | N_EXT;
+    symbols[index].n_sect = 1;
+    symbols[index].n_value = sect->addr;
+    *string_index += sprintf(names + *string_index, "_image%zu_symbol%zu",
+                             image, index) +
+                     1;
+  }
+}
+
+static bool save_file(const char *path, const struct cache_file *file) {
+  FILE *stream = fopen(path, "wb");
+  if (stream == NULL) {
+    return false;
+  }
+  bool is_written = fwrite(file->data, 1, file->size, stream) == file->size;
+  return fclose(stream) == 0 && is_written;
+}
+
+bool write_synthetic_cache(const char *path,
+                           const struct synthetic_cache_options *options) {
+  const size_t num_text_files =
+      options->num_subcaches > 0 ? options->num_subcaches : 1;
+  const size_t num_files = options->num_subcaches + 1;
+  struct cache_file *files = calloc(num_files, sizeof(struct cache_file));
+  assert(files != NULL);
+
+  // 1. Sizes: tables, then __TEXT of the images in each text file
+  const size_t header_size =
+      sizeof(dyld_cache_header_shim) + 2 * sizeof(dyld_cache_mapping_info_shim);
+  const size_t images_offset =
+      header_size + options->num_subcaches * sizeof(dyld_subcache_entry_shim);
+  const size_t paths_offset =
+      images_offset + options->num_images * sizeof(dyld_cache_image_info_shim);
+  for (size_t index = 0; index < num_text_files; index++) {
+    files[index].size = align_up(
+        index == 0 ? paths_offset + options->num_images * NAME_SIZE
+                   : header_size,
+        SEGMENT_ALIGN);
+  }
+  uint64_t *text_offsets = malloc(options->num_images * sizeof(uint64_t));
+  assert(text_offsets != NULL || options->num_images == 0);
+  for (size_t image = 0; image < options->num_images; image++) {
+    struct cache_file *file = &files[image % num_text_files];
+    text_offsets[image] = file->size;
+    file->size += text_size(options, image);
+  }
+
+  size_t string_table_size = 1;
+  char name[NAME_SIZE];
+  for (size_t image = 0; image < options->num_images; image++) {
+    for (size_t index = 0; index < options->num_symbols; index++) {
+      string_table_size +=
+          snprintf(name, NAME_SIZE, "_image%zu_symbol%zu", image, index) + 1;
+    }
+  }
+  struct linkedit_layout linkedit;
+  linkedit.file = &files[num_files - 1];
+  linkedit.offset = num_files == 1 ? linkedit.file->size
+                                    : align_up(header_size, SEGMENT_ALIGN);
+  linkedit.string_table =
+      linkedit.offset +
+      options->num_images * options->num_symbols * sizeof(struct nlist_64);
+  linkedit.string_table_size = string_table_size;
+  linkedit.size = linkedit.string_table + string_table_size - linkedit.offset;
+  linkedit.file->size =
+      align_up(linkedit.offset + linkedit.size, SEGMENT_ALIGN);
+
+  // 2. Files follow each other in the shared region
+  uint64_t address = BASE_ADDRESS;
+  for (size_t index = 0; index < num_files; index++) {
+    files[index].address = address;
+    address += files[index].size;
+    files[index].data = calloc(1, files[index].size);
+    assert(files[index].data != NULL);
+  }
+
+  // 3. Headers
+  if (num_files == 1) {
+    write_header(&files[0], 2);
+    write_mapping(&files[0], 0, 0, linkedit.offset);
+    write_mapping(&files[0], 1, linkedit.offset,
+                  files[0].size - linkedit.offset);
+  } else {
+    for (size_t index = 0; index < num_files; index++) {
+      write_header(&files[index], 1);
+      write_mapping(&files[index], 0, 0, files[index].size);
+    }
+  }
+  dyld_cache_header_shim *header = (dyld_cache_header_shim *)files[0].data;
+  header->subCacheArrayOffset = header_size;
+  header->subCacheArrayCount = options->num_subcaches;
+  header->imagesOffset = images_offset;
+  header->imagesCount = options->num_images;
+  dyld_subcache_entry_shim *subcaches =
+      (dyld_subcache_entry_shim *)(files[0].data + header_size);
+  for (size_t index = 0; index < options->num_subcaches; index++) {
+    subcaches[index].cacheVMOffset = files[index + 1].address - BASE_ADDRESS;
+    snprintf(subcaches[index].fileSuffix, sizeof(subcaches[index].fileSuffix),
+             ".%02zu", index + 1);
+  }
+
+  // 4. Images
+  dyld_cache_image_info_shim *images =
+      (dyld_cache_image_info_shim *)(files[0].data + images_offset);
+  uint32_t string_index = 1;
+  for (size_t image = 0; image < options->num_images; image++) {
+    struct cache_file *file = &files[image % num_text_files];
+    images[image].address = file->address + text_offsets[image];
+    images[image].pathFileOffset = paths_offset + image * NAME_SIZE;
+    image_path(image, (char *)files[0].data + images[image].pathFileOffset);
+    write_image(options, image, file, text_offsets[image], &linkedit,
+                &string_index);
+  }
+
+  // 5. Files
+  bool is_written = save_file(path, &files[0]);
+  size_t path_size = strlen(path) + 8;
+  char *subcache_path = malloc(path_size);
+  assert(subcache_path != NULL);
+  for (size_t index = 1; index < num_files && is_written; index++) {
+    snprintf(subcache_path, path_size, "%s.%02zu", path, index);
+    is_written = save_file(subcache_path, &files[index]);
+  }
+  free(subcache_path);
+  for (size_t index = 0; index < num_files; index++) {
+    free(files[index].data);
+  }
+  free(files);
+  free(text_offsets);
+  return is_written;
+}
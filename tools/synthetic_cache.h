@@ -0,0 +1,26 @@
+#ifndef MACHO_RE_SYNTHETIC_CACHE_H
+#define MACHO_RE_SYNTHETIC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct synthetic_cache_options {
+  size_t num_images;
+  // 0 writes a single file. Otherwise the images are spread over the main
+  // file and `num_subcaches - 1` subcaches, and __LINKEDIT is in the last
+  // subcache, like in split caches.
+  size_t num_subcaches;
+  // Per image
+  size_t num_strings;
+  size_t num_symbols;
+};
+
+// Writes an arm64 dyld shared cache of dylibs named
+// /usr/lib/libsynthetic<i>.dylib to `path`, and its subcaches to `path.01`,
+// `path.02`... Image i has `num_strings` __cstring strings
+// "image<i>_string<j>", `num_symbols` symbols "_image<i>_symbol<j>", and
+// links /usr/lib/libSystem.B.dylib. Returns false on I/O errors.
+bool write_synthetic_cache(const char *path,
+                           const struct synthetic_cache_options *options);
+
+#endif
@@ -0,0 +1,705 @@
+#include "watch.h"
+#include "json.h"
+#include "lib/hash.h"
+#include "lib/libmachore.h"
+
+#include <mach-o/fat.h>
+#include <mach-o/loader.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#else
+#include <sys/event.h>
+#include <sys/resource.h>
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Watch mode: keeps the dylibs and entitlements report of every Mach-O file
+ * under a directory, and prints NDJSON deltas as files change.
+ *
+ *   {"event":"added","path":...,"slices":[...]}    new Mach-O file
+ *   {"event":"changed","path":...,"slices":[...]}  report changed
+ *   {"event":"removed","path":...}                 deleted or not Mach-O
+ *   {"event":"ready","files":N,"elapsed_us":...}   initial scan done
+ *   {"event":"batch","files":N,"elapsed_us":...}   debounced batch done
+ *
+ * Change events (inotify on Linux, kqueue elsewhere) only queue paths. Once
+ * no event arrived for the debounce delay, the queued paths are deduplicated
+ * and refreshed: a file whose size and mtime did not change is skipped, and a
+ * rewritten file is only reported when its report differs. A refresh costs
+ * the changed files only, whatever the size of the directory.
+ */
+
+#define DEFAULT_DEBOUNCE_MS 200
+#define INITIAL_NUM_BUCKETS 1024
+
+#ifndef __linux__
+// Share of the descriptor limit kept open for file events, the rest is left
+// to directories and parsing
+#define FILE_FDS_SHARE 2
+#endif
+
+// A regular file under the watched directory
+struct watched_file {
+  char *path;
+  struct timespec mtime;
+  off_t size;
+  // JSON array of the slices, NULL when the file is not a Mach-O file
+  char *report;
+#ifndef __linux__
+  // Kept open for its kqueue events
+  int fd;
+#endif
+  struct watched_file *next;
+};
+
+#ifndef __linux__
+struct watched_directory {
+  char *path;
+  int fd;
+  struct watched_directory *next;
+};
+#endif
+
+struct watch_state {
+  // Every regular file, by path
+  struct watched_file **buckets;
+  size_t num_buckets;
+  size_t num_files;
+
+  // Paths to refresh at the end of the debounce delay
+  char **pending_paths;
+  size_t num_pending;
+  size_t pending_capacity;
+
+  int event_fd;
+#ifdef __linux__
+  // Watched directory of every inotify watch descriptor
+  char **directories;
+  size_t num_directories;
+#else
+  // kqueue identifiers of the watched directories, freed on exit
+  struct watched_directory *directories;
+  // Files beyond the budget are only refreshed on directory events
+  size_t num_file_fds;
+  size_t max_file_fds;
+  bool is_file_budget_reported;
+#endif
+};
+
+static volatile sig_atomic_t is_stopping = 0;
+
+static void handle_stop_signal(int signal_number) {
+  (void)signal_number;
+  is_stopping = 1;
+}
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static char *join_path(const char *directory, const char *name) {
+  size_t size = strlen(directory) + strlen(name) + 2;
+  char *path = malloc(size);
+  snprintf(path, size, "%s/%s", directory, name);
+  return path;
+}
+
+static struct watched_file **find_file(struct watch_state *state,
+                                       const char *path) {
+  size_t bucket = hash_bytes(path, strlen(path)) & (state->num_buckets - 1);
+  struct watched_file **link = &state->buckets[bucket];
+  while (*link && strcmp((*link)->path, path) != 0) {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+static void grow_buckets(struct watch_state *state) {
+  size_t num_buckets = state->num_buckets * 2;
+  struct watched_file **buckets =
+      calloc(num_buckets, sizeof(struct watched_file *));
+  for (size_t i = 0; i < state->num_buckets; i++) {
+    struct watched_file *file = state->buckets[i];
+    while (file) {
+      struct watched_file *next = file->next;
+      size_t bucket =
+          hash_bytes(file->path, strlen(file->path)) & (num_buckets - 1);
+      file->next = buckets[bucket];
+      buckets[bucket] = file;
+      file = next;
+    }
+  }
+  free(state->buckets);
+  state->buckets = buckets;
+  state->num_buckets = num_buckets;
+}
+
+static void add_pending(struct watch_state *state, const char *path) {
+  if (state->num_pending == state->pending_capacity) {
+    state->pending_capacity =
+        state->pending_capacity ? state->pending_capacity * 2 : 64;
+    state->pending_paths = realloc(state->pending_paths,
+                                   state->pending_capacity * sizeof(char *));
+  }
+  state->pending_paths[state->num_pending++] = strdup(path);
+}
+
+// Queues every known file under `directory`, for moved or deleted trees
+static void add_pending_tree(struct watch_state *state,
+                             const char *directory) {
+  size_t directory_size = strlen(directory);
+  for (size_t i = 0; i < state->num_buckets; i++) {
+    for (struct watched_file *file = state->buckets[i]; file;
+         file = file->next) {
+      if (strncmp(file->path, directory, directory_size) == 0 &&
+          file->path[directory_size] == '/') {
+        add_pending(state, file->path);
+      }
+    }
+  }
+}
+
+static bool is_macho_magic(uint32_t magic) {
+  return magic == MH_MAGIC || magic == MH_CIGAM || magic == MH_MAGIC_64 ||
+         magic == MH_CIGAM_64 || magic == FAT_MAGIC || magic == FAT_CIGAM ||
+         magic == FAT_MAGIC_64 || magic == FAT_CIGAM_64;
+}
+
+// Parses a Mach-O file into its report, NULL when it is not a Mach-O file or
+// fails the validation, reported on stderr to keep stdout NDJSON
+static char *build_report(const char *path, off_t size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  uint32_t magic = 0;
+  uint8_t *buffer = NULL;
+  size_t read_size = 0;
+  if (size >= (off_t)sizeof(magic) &&
+      read(fd, &magic, sizeof(magic)) == sizeof(magic) &&
+      is_macho_magic(magic)) {
+    buffer = malloc(size);
+    memcpy(buffer, &magic, sizeof(magic));
+    read_size = sizeof(magic);
+    while (read_size < (size_t)size) {
+      ssize_t result = read(fd, buffer + read_size, size - read_size);
+      if (result <= 0) {
+        break;
+      }
+      read_size += result;
+    }
+  }
+  close(fd);
+  if (!buffer || read_size != (size_t)size) {
+    free(buffer);
+    return NULL;
+  }
+
+  struct machore_output_t output;
+  init_output(&output);
+  parse_macho(&output, buffer, size);
+  if (output.validation.error != LIBMACHORE_VALIDATION_OK) {
+    fprintf(stderr, "Error: '%s' is not a valid Mach-O file: %s\n", path,
+            machore_validation_error_string(output.validation.error));
+    clean_output(&output);
+    free(buffer);
+    return NULL;
+  }
+
+  char *report = NULL;
+  size_t report_size = 0;
+  FILE *stream = open_memstream(&report, &report_size);
+  fprintf(stream, "[");
+  for (size_t i = 0; i < output.num_arch_outputs; i++) {
+    const struct machore_arch_output_t *arch_output = &output.arch_outputs[i];
+    fprintf(stream, "%s{\"architecture\":", i ? "," : "");
+    write_json_string(stream, arch_output->architecture);
+    fprintf(stream, ",\"dylibs\":");
+    write_json_dylibs(stream, arch_output);
+    fprintf(stream, ",\"entitlements\":");
+    if (arch_output->entitlements) {
+      write_json_string(stream, arch_output->entitlements);
+    } else {
+      fprintf(stream, "null");
+    }
+    fprintf(stream, "}");
+  }
+  fprintf(stream, "]");
+  fclose(stream);
+
+  clean_output(&output);
+  free(buffer);
+  return report;
+}
+
+static void print_event(const char *event, const char *path,
+                        const char *report) {
+  printf("{\"event\":\"%s\",\"path\":", event);
+  write_json_string(stdout, path);
+  if (report) {
+    printf(",\"slices\":%s", report);
+  }
+  printf("}\n");
+}
+
+static void watch_file(struct watch_state *state, struct watched_file *file) {
+#ifdef __linux__
+  // inotify reports files through the watch of their directory
+  (void)state;
+  (void)file;
+#else
+  file->fd = -1;
+  if (state->num_file_fds == state->max_file_fds) {
+    if (!state->is_file_budget_reported) {
+      fprintf(stderr,
+              "Warning: more than %zu files, the others are only refreshed "
+              "when their directory changes\n",
+              state->max_file_fds);
+      state->is_file_budget_reported = true;
+    }
+    return;
+  }
+#ifdef O_EVTONLY
+  file->fd = open(file->path, O_EVTONLY);
+#else
+  file->fd = open(file->path, O_RDONLY);
+#endif
+  if (file->fd >= 0) {
+    struct kevent change;
+    EV_SET(&change, file->fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME,
+           0, file);
+    kevent(state->event_fd, &change, 1, NULL, 0, NULL);
+    state->num_file_fds++;
+  }
+#endif
+}
+
+static void free_file(struct watch_state *state, struct watched_file *file) {
+#ifdef __linux__
+  (void)state;
+#else
+  // Closing the descriptor also removes its kqueue events
+  if (file->fd >= 0) {
+    close(file->fd);
+    state->num_file_fds--;
+  }
+#endif
+  free(file->report);
+  free(file->path);
+  free(file);
+}
+
+// Brings the report of a file up to date, returns whether it was refreshed
+static bool refresh_file(struct watch_state *state, const char *path) {
+  struct stat st;
+  bool is_regular = lstat(path, &st) == 0 && S_ISREG(st.st_mode);
+  struct watched_file **link = find_file(state, path);
+  struct watched_file *file = *link;
+
+  if (!is_regular) {
+    if (!file) {
+      return false;
+    }
+    if (file->report) {
+      print_event("removed", path, NULL);
+    }
+    *link = file->next;
+    free_file(state, file);
+    state->num_files--;
+    return true;
+  }
+
+#ifdef __APPLE__
+  struct timespec mtime = st.st_mtimespec;
+#else
+  struct timespec mtime = st.st_mtim;
+#endif
+  if (file && file->size == st.st_size &&
+      file->mtime.tv_sec == mtime.tv_sec &&
+      file->mtime.tv_nsec == mtime.tv_nsec) {
+    return false;
+  }
+
+  if (!file) {
+    file = calloc(1, sizeof(struct watched_file));
+    file->path = strdup(path);
+    file->next = *link;
+    *link = file;
+    watch_file(state, file);
+    if (++state->num_files > state->num_buckets) {
+      grow_buckets(state);
+    }
+  }
+  file->mtime = mtime;
+  file->size = st.st_size;
+
+  char *report = build_report(path, st.st_size);
+  if (report && !file->report) {
+    print_event("added", path, report);
+  } else if (report && strcmp(report, file->report) != 0) {
+    print_event("changed", path, report);
+  } else if (!report && file->report) {
+    print_event("removed", path, NULL);
+  }
+  free(file->report);
+  file->report = report;
+  return true;
+}
+
+#ifndef __linux__
+static bool is_watched_directory(const struct watch_state *state,
+                                 const char *path) {
+  for (const struct watched_directory *directory = state->directories;
+       directory; directory = directory->next) {
+    if (directory->fd >= 0 && strcmp(directory->path, path) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+static void watch_directory(struct watch_state *state, const char *path) {
+#ifdef __linux__
+  int wd = inotify_add_watch(state->event_fd, path,
+                             IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE |
+                                 IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                 IN_DELETE_SELF | IN_ONLYDIR);
+  if (wd < 0) {
+    return;
+  }
+  if ((size_t)wd >= state->num_directories) {
+    size_t num_directories = (size_t)wd * 2 + 16;
+    state->directories =
+        realloc(state->directories, num_directories * sizeof(char *));
+    memset(state->directories + state->num_directories, 0,
+           (num_directories - state->num_directories) * sizeof(char *));
+    state->num_directories = num_directories;
+  }
+  free(state->directories[wd]);
+  state->directories[wd] = strdup(path);
+#else
+#ifdef O_EVTONLY
+  int fd = open(path, O_EVTONLY);
+#else
+  int fd = open(path, O_RDONLY);
+#endif
+  if (fd < 0) {
+    return;
+  }
+  struct watched_directory *directory =
+      calloc(1, sizeof(struct watched_directory));
+  directory->path = strdup(path);
+  directory->fd = fd;
+  directory->next = state->directories;
+  state->directories = directory;
+  // Tagged pointer: bit 0 tells directories from files in kevent data
+  struct kevent change;
+  EV_SET(&change, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+         NOTE_WRITE | NOTE_DELETE | NOTE_RENAME, 0,
+         (void *)((uintptr_t)directory | 1));
+  kevent(state->event_fd, &change, 1, NULL, 0, NULL);
+#endif
+}
+
+static void scan_directory(struct watch_state *state, const char *path,
+                           bool is_initial);
+
+// Walks the entries of a watched directory: unknown files are refreshed at
+// once during the initial scan and queued afterwards, unwatched
+// subdirectories are scanned.
+static void scan_entries(struct watch_state *state, const char *path,
+                         bool is_initial) {
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    char *entry_path = join_path(path, entry->d_name);
+    struct stat st;
+    if (lstat(entry_path, &st) == 0) {
+      if (S_ISDIR(st.st_mode)) {
+        scan_directory(state, entry_path, is_initial);
+      } else if (S_ISREG(st.st_mode)) {
+        if (is_initial) {
+          refresh_file(state, entry_path);
+        } else if (!*find_file(state, entry_path)) {
+          add_pending(state, entry_path);
+        }
+      }
+    }
+    free(entry_path);
+  }
+  closedir(dir);
+}
+
+// Watches a directory tree. Known directories already have their kqueue
+// watch, and their entries are walked on their own events.
+static void scan_directory(struct watch_state *state, const char *path,
+                           bool is_initial) {
+#ifndef __linux__
+  if (is_watched_directory(state, path)) {
+    return;
+  }
+#endif
+  watch_directory(state, path);
+  scan_entries(state, path, is_initial);
+}
+
+#ifdef __linux__
+static void read_events(struct watch_state *state, const char *root) {
+  char buffer[64 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t size;
+  while ((size = read(state->event_fd, buffer, sizeof(buffer))) > 0) {
+    for (char *cursor = buffer; cursor < buffer + size;) {
+      const struct inotify_event *event = (const struct inotify_event *)cursor;
+      cursor += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were lost: check every known file and look for new ones
+        add_pending_tree(state, root);
+        scan_directory(state, root, false);
+        continue;
+      }
+      if (event->wd < 0 || (size_t)event->wd >= state->num_directories ||
+          !state->directories[event->wd]) {
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        free(state->directories[event->wd]);
+        state->directories[event->wd] = NULL;
+        continue;
+      }
+      if (event->len == 0) {
+        continue;
+      }
+
+      char *path = join_path(state->directories[event->wd], event->name);
+      if (!(event->mask & IN_ISDIR)) {
+        // Files are refreshed once closed after writing, not on creation
+        if (!(event->mask & IN_CREATE)) {
+          add_pending(state, path);
+        }
+      } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        scan_directory(state, path, false);
+      } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        add_pending_tree(state, path);
+      }
+      free(path);
+    }
+  }
+}
+#else
+static void read_events(struct watch_state *state, const char *root) {
+  (void)root;
+  struct kevent events[64];
+  struct timespec timeout = {0, 0};
+  int num_events;
+  while ((num_events = kevent(state->event_fd, NULL, 0, events, 64,
+                              &timeout)) > 0) {
+    for (int i = 0; i < num_events; i++) {
+      uintptr_t data = (uintptr_t)events[i].udata;
+      if (!(data & 1)) {
+        add_pending(state, ((struct watched_file *)data)->path);
+        continue;
+      }
+      struct watched_directory *directory =
+          (struct watched_directory *)(data & ~(uintptr_t)1);
+      if (events[i].fflags & (NOTE_DELETE | NOTE_RENAME)) {
+        add_pending_tree(state, directory->path);
+        // Stop watching it, a directory created at its path is scanned anew.
+        // Kept in the list since later events of this batch may point to it.
+        if (directory->fd >= 0) {
+          close(directory->fd);
+          directory->fd = -1;
+        }
+      } else {
+        // Entries were added, removed or renamed: look for new ones
+        scan_entries(state, directory->path, false);
+      }
+    }
+  }
+}
+#endif
+
+static int compare_paths(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void refresh_pending(struct watch_state *state) {
+  uint64_t start = now_us();
+  qsort(state->pending_paths, state->num_pending, sizeof(char *),
+        compare_paths);
+  size_t num_refreshed = 0;
+  for (size_t i = 0; i < state->num_pending; i++) {
+    if (i == 0 ||
+        strcmp(state->pending_paths[i], state->pending_paths[i - 1]) != 0) {
+      num_refreshed += refresh_file(state, state->pending_paths[i]);
+    }
+  }
+  for (size_t i = 0; i < state->num_pending; i++) {
+    free(state->pending_paths[i]);
+  }
+  state->num_pending = 0;
+
+  if (num_refreshed > 0) {
+    printf("{\"event\":\"batch\",\"files\":%zu,\"elapsed_us\":%llu}\n",
+           num_refreshed, (unsigned long long)(now_us() - start));
+    fflush(stdout);
+  }
+}
+
+static void clean_watch_state(struct watch_state *state) {
+  for (size_t i = 0; i < state->num_buckets; i++) {
+    struct watched_file *file = state->buckets[i];
+    while (file) {
+      struct watched_file *next = file->next;
+      free_file(state, file);
+      file = next;
+    }
+  }
+  free(state->buckets);
+  for (size_t i = 0; i < state->num_pending; i++) {
+    free(state->pending_paths[i]);
+  }
+  free(state->pending_paths);
+#ifdef __linux__
+  for (size_t i = 0; i < state->num_directories; i++) {
+    free(state->directories[i]);
+  }
+  free(state->directories);
+#else
+  while (state->directories) {
+    struct watched_directory *next = state->directories->next;
+    if (state->directories->fd >= 0) {
+      close(state->directories->fd);
+    }
+    free(state->directories->path);
+    free(state->directories);
+    state->directories = next;
+  }
+#endif
+  close(state->event_fd);
+}
+
+int watch_main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printf("Usage: %s --watch <directory> [--debounce <ms>]\n", argv[0]);
+    return 1;
+  }
+  uint64_t debounce_ms = DEFAULT_DEBOUNCE_MS;
+  for (int arg_index = 3; arg_index < argc; arg_index++) {
+    if (strcmp(argv[arg_index], "--debounce") == 0 && arg_index + 1 < argc) {
+      debounce_ms = strtoull(argv[++arg_index], NULL, 10);
+    } else {
+      printf("Error: unknown option '%s'\n", argv[arg_index]);
+      return 1;
+    }
+  }
+
+  // Event paths are joined to the root: keep them stable if it is relative
+  char *root = realpath(argv[2], NULL);
+  struct stat st;
+  if (!root || stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    printf("Error: '%s' is not a directory\n", argv[2]);
+    free(root);
+    return 1;
+  }
+
+  struct watch_state state;
+  memset(&state, 0, sizeof(state));
+#ifdef __linux__
+  state.event_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+  state.event_fd = kqueue();
+#endif
+  if (state.event_fd < 0) {
+    perror("watch");
+    free(root);
+    return 1;
+  }
+  state.num_buckets = INITIAL_NUM_BUCKETS;
+  state.buckets = calloc(state.num_buckets, sizeof(struct watched_file *));
+#ifndef __linux__
+  struct rlimit limit;
+  state.max_file_fds =
+      getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+          ? limit.rlim_cur / FILE_FDS_SHARE
+          : 1024 / FILE_FDS_SHARE;
+#endif
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  // Watches are set before the scan: changes during the scan are queued
+  uint64_t start = now_us();
+  scan_directory(&state, root, true);
+  size_t num_macho = 0;
+  for (size_t i = 0; i < state.num_buckets; i++) {
+    for (struct watched_file *file = state.buckets[i]; file;
+         file = file->next) {
+      num_macho += file->report != NULL;
+    }
+  }
+  printf("{\"event\":\"ready\",\"files\":%zu,\"elapsed_us\":%llu}\n",
+         num_macho, (unsigned long long)(now_us() - start));
+  fflush(stdout);
+
+  uint64_t last_event_us = 0;
+  while (!is_stopping) {
+    int timeout_ms = -1;
+    if (state.num_pending > 0) {
+      uint64_t quiet_ms = (now_us() - last_event_us) / 1000;
+      timeout_ms = quiet_ms >= debounce_ms ? 0 : debounce_ms - quiet_ms;
+    }
+
+    struct pollfd pollfd = {.fd = state.event_fd, .events = POLLIN};
+    int result = poll(&pollfd, 1, timeout_ms);
+    if (result < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+        break;
+      }
+    } else if (result > 0) {
+      size_t num_pending = state.num_pending;
+      read_events(&state, root);
+      if (state.num_pending > num_pending) {
+        last_event_us = now_us();
+      }
+    } else if (state.num_pending > 0) {
+      refresh_pending(&state);
+    }
+  }
+
+  clean_watch_state(&state);
+  free(root);
+  return 0;
+}
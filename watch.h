@@ -0,0 +1,7 @@
+#ifndef MACHO_RE_WATCH_H
+#define MACHO_RE_WATCH_H
+
+// `macho_re --watch <directory> [--debounce <ms>]`
+int watch_main(int argc, char *argv[]);
+
+#endif